@@ -1,6 +1,8 @@
 #ifndef ANSI_H
 #define ANSI_H
+#include <cstddef>
 #include <string>
+#include <string_view>
 
 namespace console {
 
@@ -30,18 +32,76 @@ constexpr auto FG_BRIGHT_MAGENTA = "[95m";
 constexpr auto FG_BRIGHT_CYAN = "[96m";
 constexpr auto FG_BRIGHT_WHITE = "[97m";
 
+/// @brief Every style the compiler renders with. Each sequence begins with an
+/// SGR reset (`0;`) so that switching between any two styles is exactly one
+/// escape sequence, regardless of which attributes the previous style set.
+#define CONSOLE_STYLES                                                         \
+  X(Plain, "\033[0m")                                                          \
+  X(BoldRed, "\033[0;31;1m")                                                   \
+  X(BoldYellow, "\033[0;33;1m")                                                \
+  X(BoldMagenta, "\033[0;35;1m")                                               \
+  X(BoldBrightBlue, "\033[0;94;1m")                                            \
+  X(Red, "\033[0;31m")                                                         \
+  X(Green, "\033[0;32m")                                                       \
+  X(Yellow, "\033[0;33m")                                                      \
+  X(Blue, "\033[0;34m")                                                        \
+  X(Magenta, "\033[0;35m")                                                     \
+  X(Cyan, "\033[0;36m")                                                        \
+  X(BrightBlack, "\033[0;90m")
+
+enum class Style : unsigned char {
+#define X(name, seq) name,
+  CONSOLE_STYLES
+#undef X
+};
+
+/// @brief Returns the complete escape sequence that switches the terminal to
+/// the given style.
+/// @param style the style to retrieve a sequence for
+/// @return a `std::string_view` over a string literal, never allocated
+constexpr std::string_view get_style_sequence(const Style &style) {
+  switch (style) {
+#define X(name, seq)                                                           \
+  case Style::name:                                                            \
+    return seq;
+    CONSOLE_STYLES
+#undef X
+  }
+  return "";
+}
+
 /// @brief Whether or not the terminal is color capable, as in whether or not
 /// it is possible to render colors on this terminal using ANSI escape
 /// sequences.
 extern bool IS_COLOR_CAPABLE;
 
-/// @brief Colorize a string so that when it is printed to the console it will
-/// have the color and attributes provided.
-/// @param input the source string to colorize
-/// @param color the color code to use
-/// @param bold whether or not to bold the input
-/// @return One `std::string` with all the attributes added
-std::string colorize(const std::string &input, const char *color);
+/// @brief Writes styled text straight into a caller-owned buffer. The writer
+/// remembers the style currently in effect and only emits an escape sequence
+/// when the style actually changes, so runs of text sharing a style cost
+/// nothing extra. Color capability is sampled once, at construction.
+class StyledWriter {
+  std::string &out;
+  const bool colored;
+  Style current;
+
+public:
+  /// @brief Creates a writer that colors its output only if the console is
+  /// `IS_COLOR_CAPABLE`.
+  explicit StyledWriter(std::string &out);
+  StyledWriter(std::string &out, bool colored);
+
+  /// @brief Emits whatever is needed to go from the current style to `style`.
+  void set_style(Style style);
+  void write(std::string_view text);
+  void write(Style style, std::string_view text);
+  void write(char c);
+  void write_repeated(char c, size_t count);
+  void write_number(size_t n);
+
+  /// @brief Returns the terminal to `Style::Plain` if it isn't already.
+  void reset();
+  bool is_colored() const;
+};
 
 /// @brief Checks the attributes of the current console to update the
 /// `IS_COLOR_CAPABLE` boolean.
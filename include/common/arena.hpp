@@ -0,0 +1,101 @@
+#ifndef ARENA_H
+#define ARENA_H
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/// @brief A bump allocator. Memory is carved out of large blocks by moving a
+/// pointer forward and is only ever released in bulk: everything at once when
+/// the arena is destroyed or `reset()`, or everything allocated since a
+/// `mark()` when it is `rewind()`-ed. Nothing allocated here has its
+/// destructor run, so only trivially destructible types may be placed in an
+/// arena.
+class Arena {
+  struct Block {
+    std::unique_ptr<std::byte[]> memory;
+    size_t size;
+  };
+
+  /// Blocks after `current` are spares left behind by `rewind()`
+  std::vector<Block> blocks;
+  size_t current;
+  std::byte *cursor;
+  std::byte *limit;
+  size_t used;
+
+  void grow(size_t minimum);
+
+public:
+  static constexpr size_t DEFAULT_BLOCK_SIZE = 64 * 1024;
+
+  /// @brief A position in the arena, see `rewind()`.
+  struct Mark {
+    size_t block;
+    std::byte *cursor;
+    size_t used;
+  };
+
+  Arena();
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+  Arena(Arena &&other) noexcept;
+  Arena &operator=(Arena &&other) noexcept;
+
+  /// @brief Returns `size` bytes aligned to `align`, never `nullptr`.
+  void *allocate(size_t size, size_t align) {
+    auto address = reinterpret_cast<uintptr_t>(cursor);
+    auto aligned = (address + align - 1) & ~(uintptr_t)(align - 1);
+    if (cursor == nullptr ||
+        aligned + size > reinterpret_cast<uintptr_t>(limit)) {
+      grow(size + align);
+      address = reinterpret_cast<uintptr_t>(cursor);
+      aligned = (address + align - 1) & ~(uintptr_t)(align - 1);
+    }
+
+    used += aligned + size - address;
+    cursor = reinterpret_cast<std::byte *>(aligned + size);
+    return reinterpret_cast<void *>(aligned);
+  }
+
+  /// @brief Constructs a `T` inside the arena.
+  template <typename T, typename... Args> T *make(Args &&...args) {
+    static_assert(std::is_trivially_destructible_v<T>,
+                  "Arena objects are never destroyed");
+    void *memory = allocate(sizeof(T), alignof(T));
+    return new (memory) T(std::forward<Args>(args)...);
+  }
+
+  /// @brief Copies a range of trivially copyable values into the arena.
+  template <typename T> std::span<T> copy(std::span<const T> items) {
+    static_assert(std::is_trivially_copyable_v<T>,
+                  "Arena arrays are copied bytewise");
+    if (items.empty())
+      return {};
+
+    auto *memory = static_cast<T *>(allocate(items.size_bytes(), alignof(T)));
+    std::memcpy(memory, items.data(), items.size_bytes());
+    return {memory, items.size()};
+  }
+
+  /// @brief Releases every allocation at once but keeps the largest block
+  /// around for reuse.
+  void reset();
+
+  Mark mark() const { return {current, cursor, used}; }
+
+  /// @brief Releases everything allocated since `mark` was taken, in constant
+  /// time. Blocks added since then are kept as spares for later allocations.
+  void rewind(const Mark &mark);
+
+  /// @brief Returns the number of bytes handed out since the last reset,
+  /// including alignment padding.
+  size_t bytes_used() const;
+};
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef ARITH_H
+#define ARITH_H
+#include <cmath>
+#include <cstdint>
+#include <optional>
+
+/// The language's arithmetic where it differs from C++'s, shared by the
+/// folder, which works it out ahead of time, and the machine, which works it
+/// out as the program runs, so that the two can never disagree.
+namespace arith {
+
+/// @brief `a // b`, rounded towards negative infinity. `b` isn't zero and
+/// the quotient fits.
+inline int64_t floor_divide(int64_t a, int64_t b) {
+  int64_t quotient = a / b;
+  if (a % b != 0 && (a < 0) != (b < 0))
+    quotient--;
+  return quotient;
+}
+
+/// @brief `a % b` with the sign of `b`. `b` isn't zero.
+inline int64_t floor_modulo(int64_t a, int64_t b) {
+  // `LOWEST % -1` overflows in C++, though the answer is plainly zero
+  if (b == -1)
+    return 0;
+  int64_t remainder = a % b;
+  if (remainder != 0 && (remainder < 0) != (b < 0))
+    remainder += b;
+  return remainder;
+}
+
+inline double floor_modulo(double a, double b) {
+  double remainder = std::fmod(a, b);
+  if (remainder != 0 && (remainder < 0) != (b < 0))
+    remainder += b;
+  return remainder;
+}
+
+/// @brief `base ** exponent` by repeated squaring, or nothing if it
+/// overflows. `exponent` isn't negative.
+inline std::optional<int64_t> power(int64_t base, int64_t exponent) {
+  int64_t result = 1;
+  while (exponent > 0) {
+    if ((exponent & 1) && __builtin_mul_overflow(result, base, &result))
+      return std::nullopt;
+    exponent >>= 1;
+    // Squaring past the last bit would overflow for no reason
+    if (exponent > 0 && __builtin_mul_overflow(base, base, &base))
+      return std::nullopt;
+  }
+  return result;
+}
+
+} // namespace arith
+
+#endif
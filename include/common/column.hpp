@@ -0,0 +1,87 @@
+#ifndef COLUMN_H
+#define COLUMN_H
+#include <algorithm>
+#include <cstddef>
+#include <span>
+#include <vector>
+
+/// @brief A growable array that can also borrow its elements from memory it
+/// doesn't own, such as a memory-mapped cache file. A borrowed column is read
+/// in place, and copied into storage of its own the first time it is modified,
+/// so code building a column never has to know where it came from.
+template <typename T> class Column {
+  std::vector<T> owned;
+  const T *borrowed;
+  size_t borrowed_size;
+
+  void own() {
+    if (borrowed == nullptr)
+      return;
+    owned.assign(borrowed, borrowed + borrowed_size);
+    borrowed = nullptr;
+    borrowed_size = 0;
+  }
+
+public:
+  Column() : owned({}), borrowed(nullptr), borrowed_size(0) {}
+
+  /// @brief A column viewing `elements`, which must outlive it.
+  static Column borrow(std::span<const T> elements) {
+    Column column;
+    column.borrowed = elements.data();
+    column.borrowed_size = elements.size();
+    return column;
+  }
+
+  bool is_borrowed() const { return borrowed != nullptr; }
+
+  size_t size() const {
+    return borrowed != nullptr ? borrowed_size : owned.size();
+  }
+  bool empty() const { return size() == 0; }
+
+  const T *data() const {
+    return borrowed != nullptr ? borrowed : owned.data();
+  }
+  T *data() {
+    own();
+    return owned.data();
+  }
+
+  const T *begin() const { return data(); }
+  const T *end() const { return data() + size(); }
+
+  const T &operator[](size_t index) const { return data()[index]; }
+  T &operator[](size_t index) {
+    own();
+    return owned[index];
+  }
+
+  operator std::span<const T>() const { return {data(), size()}; }
+
+  void push_back(const T &value) {
+    own();
+    owned.push_back(value);
+  }
+
+  template <typename It> void append(It first, It last) {
+    own();
+    owned.insert(owned.end(), first, last);
+  }
+
+  void reserve(size_t capacity) {
+    own();
+    owned.reserve(capacity);
+  }
+
+  void resize(size_t count) {
+    own();
+    owned.resize(count);
+  }
+
+  friend bool operator==(const Column &a, const Column &b) {
+    return std::equal(a.begin(), a.end(), b.begin(), b.end());
+  }
+};
+
+#endif
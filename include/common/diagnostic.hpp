@@ -1,41 +1,64 @@
 #ifndef DIAGNOSTIC_H
 #define DIAGNOSTIC_H
 #include "ansi.hpp"
+#include "sink.hpp"
 #include "span.hpp"
 #include <iostream>
+#include <iterator>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 
 namespace diagnostic {
 
 #define DIAGNOSTIC_SEVERITIES                                                  \
-  X(Error, "Error:", console::BOLD_RED)                                        \
-  X(Warning, "Warning:", console::BOLD_MAGENTA)                                \
-  X(Info, "Info:", console::BOLD_BRIGHT_BLUE)
+  X(Error, "Error:", console::Style::BoldRed)                                  \
+  X(Warning, "Warning:", console::Style::BoldMagenta)                          \
+  X(Info, "Info:", console::Style::BoldBrightBlue)
 
 /// @brief Represents the severity of some diagnostic. Not all diagnostic kinds
 /// are errors, and only errors can abort compilation.
 enum class Severity {
-#define X(name, str, color) name,
+#define X(name, str, style) name,
   DIAGNOSTIC_SEVERITIES
 #undef X
 };
 
-/// @brief Returns the string representation of some diagnostic severity.
-/// @param severity the severity variant to retrieve a `std::string` for
-/// @return the string representation that is given by this `Severity` along
-/// with the ANSI escape codes for the severity's colors
-constexpr std::string get_diagnostic_severity_string(const Severity &severity) {
-  using enum Severity;
-
-  switch (severity) {
-#define X(name, str, color)                                                    \
-  case name:                                                                   \
-    return console::colorize(str, color);
+/// @brief Every `Severity`'s uncolored label, indexed by the severity.
+constexpr std::string_view DIAGNOSTIC_SEVERITY_LABELS[] = {
+#define X(name, str, style) str,
     DIAGNOSTIC_SEVERITIES
 #undef X
-  };
-  return std::string("<unknown>");
+};
+
+/// @brief Every `Severity`'s console style, indexed by the severity.
+constexpr console::Style DIAGNOSTIC_SEVERITY_STYLES[] = {
+#define X(name, str, style) style,
+    DIAGNOSTIC_SEVERITIES
+#undef X
+};
+
+constexpr size_t SEVERITY_COUNT = std::size(DIAGNOSTIC_SEVERITY_LABELS);
+
+/// @brief Builds the colored severity labels for the current console. Must
+/// run after `console::initialize_console_attributes()`; until it does, every
+/// lookup yields the plain labels.
+void initialize_label_tables();
+
+/// @brief Returns the string representation of some diagnostic severity.
+/// @param severity the severity variant to retrieve a string for
+/// @return a view into a static table holding the label along with the ANSI
+/// escape codes for the severity's colors, if the console supports them
+std::string_view get_diagnostic_severity_string(const Severity &severity);
+
+/// @brief Returns the uncolored label and the console style of a severity.
+/// @param severity the severity variant to retrieve a label for
+/// @return a pair of the label (e.g. "Error:") and the style to render it in
+constexpr std::pair<std::string_view, console::Style>
+get_diagnostic_severity_label(const Severity &severity) {
+  auto index = static_cast<size_t>(severity);
+  return {DIAGNOSTIC_SEVERITY_LABELS[index], DIAGNOSTIC_SEVERITY_STYLES[index]};
 }
 
 /* ---------------------------------------------------------------------------*/
@@ -48,6 +71,15 @@ constexpr std::string get_diagnostic_severity_string(const Severity &severity) {
   X(InvalidString, "Invalid String", Severity::Error)                          \
   X(UnexpectToken, "Unexpected Token", Severity::Error)                        \
   X(ExpectedExpression, "Expected Expression", Severity::Error)                \
+  X(TooDeep, "Nesting Too Deep", Severity::Error)                              \
+  X(InvalidAssignment, "Invalid Assignment", Severity::Error)                  \
+  X(UndefinedName, "Undefined Name", Severity::Error)                          \
+  X(TypeMismatch, "Type Mismatch", Severity::Error)                            \
+  X(UnknownMember, "Unknown Member", Severity::Error)                          \
+  X(DivisionByZero, "Division By Zero", Severity::Error)                       \
+  X(IntegerOverflow, "Integer Overflow", Severity::Error)                      \
+  X(Unsupported, "Unsupported", Severity::Error)                               \
+  X(RuntimeError, "Runtime Error", Severity::Error)                            \
   X(InternalError, "Internal Error", Severity::Error)
 
 /// @brief Represents a specific kind of error encountered by the compiler. This
@@ -75,21 +107,19 @@ constexpr Severity get_diagnostic_kind_severity(const Kind &kind) {
   return Severity::Error;
 }
 
+/// @brief Every `Kind`'s string representation, indexed by the kind.
+constexpr std::string_view DIAGNOSTIC_KIND_STRINGS[] = {
+#define X(name, str, severity) str,
+    DIAGNOSTIC_KINDS
+#undef X
+};
+
 /// @brief Returns the string representation of some diagnostic kind.
-/// @param kind the kind to retrieve a `std::string` for
+/// @param kind the kind to retrieve a string for
 /// @return the string representation that is given by this `Kind`, which can
 /// be found in the definition for `DIAGNOSTIC_KINDS`
-constexpr std::string get_diagnostic_kind_string(const Kind &kind) {
-  using enum Kind;
-
-  switch (kind) {
-#define X(name, str, severity)                                                 \
-  case name:                                                                   \
-    return str;
-    DIAGNOSTIC_KINDS
-#undef X
-  };
-  return std::string("<unknown>");
+constexpr std::string_view get_diagnostic_kind_string(const Kind &kind) {
+  return DIAGNOSTIC_KIND_STRINGS[static_cast<size_t>(kind)];
 }
 
 /* ---------------------------------------------------------------------------*/
@@ -104,6 +134,11 @@ struct Diagnostic {
 
   Diagnostic(const Kind kind, const Span span, const std::string message);
   std::string print() const;
+
+  /// @brief Renders this diagnostic into the writer's buffer. Unlike `print()`
+  /// this does not allocate anything per styled fragment, so it is the one to
+  /// use when rendering many diagnostics in a row.
+  void render(console::StyledWriter &writer) const;
 };
 
 std::ostream &operator<<(std::ostream &os, const Kind &kind);
@@ -119,7 +154,22 @@ class DiagnosticEngine {
 public:
   DiagnosticEngine();
   void emit(const Diagnostic diag);
+  size_t size() const;
+
+  std::vector<Diagnostic>::const_iterator begin() const;
+  std::vector<Diagnostic>::const_iterator end() const;
+
+  /// @brief Appends every diagnostic of `other`, keeping their order.
+  void merge(const DiagnosticEngine &other);
+
+  /// @brief Renders every diagnostic into `sink` and flushes it, which marks
+  /// the end of the diagnostic phase.
+  void print_all(output::Sink &sink) const;
   void print_all() const;
+
+  /// @brief Renders every diagnostic into `out` without printing anything,
+  /// for output that goes somewhere other than this process's console.
+  void render_all(std::string &out, bool colored) const;
 };
 
 #endif
\ No newline at end of file
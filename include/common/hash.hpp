@@ -0,0 +1,16 @@
+#ifndef HASH_H
+#define HASH_H
+#include <cstdint>
+#include <string_view>
+
+namespace hash {
+
+/// @brief XXH3, 64-bit variant. Produces the same values as the reference
+/// `XXH3_64bits_withSeed()`, so hashes can be checked against other tools.
+/// Fast enough to hash every input on every build; not meant to resist
+/// deliberate collisions.
+uint64_t xxh3_64(std::string_view bytes, uint64_t seed = 0);
+
+} // namespace hash
+
+#endif
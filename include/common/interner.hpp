@@ -0,0 +1,49 @@
+#ifndef INTERNER_H
+#define INTERNER_H
+#include "common/arena.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+/// @brief A name that has been interned. Two symbols from the same interner
+/// are equal exactly when their names are, so they can be compared and hashed
+/// as plain integers.
+using Symbol = uint32_t;
+
+/// @brief Maps names to dense `Symbol`s, counting up from zero in the order
+/// the names were first seen. The names themselves are copied into an arena
+/// and stay put for the interner's whole lifetime.
+class StringInterner {
+  struct Slot {
+    uint32_t hash;
+    Symbol symbol;
+  };
+
+  Arena storage;
+  std::vector<std::string_view> names;
+
+  /// Open addressing with linear probing; the table is a power of two in
+  /// size and never more than half full
+  std::vector<Slot> slots;
+
+  void grow();
+
+public:
+  static constexpr Symbol NO_SYMBOL = UINT32_MAX;
+
+  StringInterner();
+
+  StringInterner(const StringInterner &) = delete;
+  StringInterner &operator=(const StringInterner &) = delete;
+
+  Symbol intern(std::string_view name);
+
+  /// @brief The symbol of `name` if it has been interned, else `NO_SYMBOL`.
+  Symbol find(std::string_view name) const;
+
+  std::string_view name(Symbol symbol) const { return names[symbol]; }
+  size_t size() const { return names.size(); }
+};
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <string>
+
+/// @brief A read-only view of a whole file. Mapped into memory where the OS
+/// supports it, so that only the pages that are actually touched get read.
+class MappedFile {
+  const std::byte *address;
+  size_t length;
+#ifdef _WIN32
+  std::unique_ptr<std::byte[]> buffer;
+#endif
+
+  void close();
+
+public:
+  MappedFile();
+  ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  MappedFile(MappedFile &&other) noexcept;
+  MappedFile &operator=(MappedFile &&other) noexcept;
+
+  /// @brief Maps `path`, replacing whatever was mapped before. Returns false
+  /// if the file can't be opened or is empty, leaving nothing mapped.
+  bool open(const std::string &path);
+
+  bool is_open() const { return address != nullptr; }
+  size_t size() const { return length; }
+  std::span<const std::byte> bytes() const { return {address, length}; }
+};
+
+#endif
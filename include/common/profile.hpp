@@ -0,0 +1,103 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+#include "common/sink.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string>
+#include <string_view>
+
+/// Building with `SYMPH_NO_PROFILE` defined compiles every scope and counter
+/// down to nothing. Otherwise a disabled profiler costs one predicted-false
+/// branch per scope.
+namespace profile {
+
+#define PROFILE_PHASES                                                         \
+  X(Load, "load")                                                              \
+  X(Lex, "lex")                                                                \
+  X(Parse, "parse")                                                            \
+  X(Sema, "sema")                                                              \
+  X(Codegen, "codegen")                                                        \
+  X(Cache, "cache")                                                            \
+  X(Render, "render")                                                          \
+  X(Run, "run")                                                                \
+  X(Collect, "gc")                                                             \
+  X(Jit, "jit")
+
+/// @brief A part of the compiler that time and memory are attributed to.
+enum class Phase : unsigned char {
+#define X(name, str) name,
+  PROFILE_PHASES
+#undef X
+};
+
+/// @brief Every `Phase`'s name as shown in reports, indexed by the phase.
+constexpr std::string_view PHASE_NAMES[] = {
+#define X(name, str) str,
+    PROFILE_PHASES
+#undef X
+};
+
+constexpr size_t PHASE_COUNT = std::size(PHASE_NAMES);
+
+/// Set once by `enable()`, before any other thread is started
+extern bool ENABLED;
+extern bool TRACING;
+
+/// @brief Starts collecting per-phase totals from now on and, if `trace` is
+/// set, every individual scope as well.
+void enable(bool trace);
+
+/// @brief Attributes the time between its construction and destruction to a
+/// phase on the calling thread. Scopes of the same phase nested on one thread
+/// count once, for the outermost scope.
+class Scope {
+#ifndef SYMPH_NO_PROFILE
+  bool active;
+
+  void begin(Phase phase, std::string_view detail);
+  void end();
+
+public:
+  /// @param detail shown with the scope in traces, e.g. the file being lexed
+  explicit Scope(Phase phase, std::string_view detail = {}) : active(false) {
+    if (ENABLED) [[unlikely]]
+      begin(phase, detail);
+  }
+  ~Scope() {
+    if (active) [[unlikely]]
+      end();
+  }
+#else
+public:
+  explicit Scope(Phase, std::string_view = {}) {}
+#endif
+
+  Scope(const Scope &) = delete;
+  Scope &operator=(const Scope &) = delete;
+};
+
+void record_allocation_slow(size_t bytes);
+
+/// @brief Counts `bytes` as allocated by the innermost phase on the calling
+/// thread. Allocations outside of any scope aren't counted.
+inline void record_allocation([[maybe_unused]] size_t bytes) {
+#ifndef SYMPH_NO_PROFILE
+  if (ENABLED) [[unlikely]]
+    record_allocation_slow(bytes);
+#endif
+}
+
+/// @brief Writes a table of the time, calls and memory of every phase that
+/// ran, summed over all threads, along with the wall time since `enable()`.
+/// Must only be called while no scope is open on another thread.
+void write_report(output::Sink &sink);
+
+/// @brief Writes every recorded scope as Chrome trace-event JSON, one track
+/// per thread, which can be loaded into `chrome://tracing` or Perfetto.
+/// Returns false if the file couldn't be written.
+bool write_trace(const std::string &path);
+
+} // namespace profile
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef ROPE_H
+#define ROPE_H
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/// @brief Editable text for long-lived documents. The text is cut into chunks
+/// of at most `MAX_CHUNK` bytes kept in a randomized balanced tree (a treap
+/// ordered by position), where every node also knows how many bytes and
+/// newlines its subtree holds. Edits, offset/line conversions and slicing are
+/// all logarithmic in the size of the text, plus the size of one chunk, so a
+/// keystroke never copies the whole buffer.
+class Rope {
+  struct Node;
+  using NodePtr = std::unique_ptr<Node>;
+
+  NodePtr root;
+  uint64_t seed;
+
+  uint32_t next_priority();
+  NodePtr make_node(std::string text);
+  NodePtr build(std::string_view text);
+
+  static NodePtr merge(NodePtr left, NodePtr right);
+  std::pair<NodePtr, NodePtr> split(NodePtr node, size_t offset);
+  static bool edit_in_place(Node *node, size_t offset, size_t removed,
+                            std::string_view inserted);
+
+public:
+  static constexpr size_t MAX_CHUNK = 1024;
+
+  Rope();
+  explicit Rope(std::string_view text);
+  ~Rope();
+
+  Rope(Rope &&other) noexcept;
+  Rope &operator=(Rope &&other) noexcept;
+  Rope(const Rope &) = delete;
+  Rope &operator=(const Rope &) = delete;
+
+  size_t size() const;
+
+  /// @brief The number of lines, which is one more than the number of
+  /// newlines, as with `File::line_starts`.
+  size_t line_count() const;
+
+  /// @brief Replaces `removed` bytes at `offset` with `inserted`.
+  void replace(size_t offset, size_t removed, std::string_view inserted);
+
+  /// @brief The offset the 0-based `line` starts at, or `size()` past the
+  /// last line.
+  size_t line_start(size_t line) const;
+
+  /// @brief The 1-based line that `offset` is on, as with `File::line_of()`.
+  size_t line_of(size_t offset) const;
+
+  /// @brief Views of the chunks covering `[offset, offset + length)`, in
+  /// order and trimmed to the range. They are invalidated by the next edit.
+  std::vector<std::string_view> chunks(size_t offset, size_t length) const;
+
+  std::string substr(size_t offset, size_t length) const;
+
+  /// @brief Copies the whole text into one contiguous string.
+  std::string materialize() const;
+};
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef SINK_H
+#define SINK_H
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace output {
+
+/// @brief Accumulates compiler output in a handful of large chunks and hands
+/// them all to the OS in a single `writev` per flush. Nothing is written until
+/// the pending size crosses `threshold`, the owner ends a phase with `flush()`,
+/// or the sink is destroyed.
+class Sink {
+  int fd;
+  size_t threshold;
+  size_t pending;
+  std::vector<std::string> chunks;
+
+  void release();
+
+public:
+  /// Size each chunk is reserved to; a chunk is only ever grown past this when
+  /// a single write is larger than the chunk itself.
+  static constexpr size_t CHUNK_SIZE = 64 * 1024;
+  static constexpr size_t DEFAULT_THRESHOLD = 1024 * 1024;
+
+  explicit Sink(int fd, size_t threshold = DEFAULT_THRESHOLD);
+  ~Sink();
+
+  Sink(const Sink &) = delete;
+  Sink &operator=(const Sink &) = delete;
+
+  /// @brief Returns a chunk with room for at least `hint` more bytes. Callers
+  /// may append to it directly (e.g. through a `console::StyledWriter`) and
+  /// must call `commit()` once they are done.
+  std::string &buffer(size_t hint = 0);
+
+  /// @brief Accounts for bytes appended through `buffer()` and flushes if the
+  /// threshold has been crossed.
+  void commit();
+
+  void write(std::string_view text);
+
+  /// @brief Writes every pending chunk with as few `writev` calls as the OS
+  /// allows. Called at the end of every phase and before aborting.
+  void flush();
+
+  size_t pending_bytes() const;
+  int descriptor() const;
+};
+
+/// @brief The process-wide sink for standard output.
+Sink &out();
+
+/// @brief The process-wide sink for standard error.
+Sink &err();
+
+/// @brief Flushes both standard sinks. Must be called on any path that ends
+/// the process without returning from `main()` (e.g. a fatal error).
+void flush_all();
+
+} // namespace output
+
+#endif
@@ -1,14 +1,23 @@
 #ifndef SPAN_H
 #define SPAN_H
+#include <cstdint>
 #include <iostream>
 #include <string>
+#include <vector>
 
 struct File {
   std::string content;
   std::string path;
   size_t length;
 
+  /// The offset every line starts at, so that spans find their line with a
+  /// binary search instead of counting newlines from the top of the file
+  std::vector<uint32_t> line_starts;
+
   File(std::string content, std::string path);
+
+  /// @brief The 1-based line that `offset` is on.
+  size_t line_of(size_t offset) const;
 };
 
 struct Span {
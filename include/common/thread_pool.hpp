@@ -0,0 +1,107 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// @brief A fixed set of worker threads with a deque of tasks each. A worker
+/// pushes and pops the tasks it spawns at the back of its own deque, so nested
+/// work stays hot in its cache, and once that runs dry it steals the oldest
+/// task from the front of another worker's deque. Tasks submitted from outside
+/// the pool are dealt round-robin over the workers.
+class ThreadPool {
+  struct Queue {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  std::vector<std::unique_ptr<Queue>> queues;
+  std::vector<std::thread> workers;
+
+  /// Guards sleeping and waking only; the queues have their own locks
+  std::mutex mutex;
+  std::condition_variable available;
+  std::condition_variable idle;
+
+  /// Tasks sitting in some queue, and tasks submitted but not yet finished
+  std::atomic<size_t> queued;
+  std::atomic<size_t> pending;
+  std::atomic<size_t> next_queue;
+  bool stopping;
+
+  void run(size_t index);
+  bool pop(size_t index, std::function<void()> &task);
+  bool steal(size_t thief, std::function<void()> &task);
+  void finish();
+
+  /// @brief Index of the calling thread's worker in this pool, or the number
+  /// of workers if it isn't one.
+  size_t current_worker() const;
+
+public:
+  /// @brief Starts `threads` workers, or one per hardware thread if zero.
+  explicit ThreadPool(size_t threads = 0);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  void submit(std::function<void()> task);
+
+  /// @brief Runs one queued task on the calling thread, preferring its own
+  /// deque if it is a worker. Returns false if every deque was empty.
+  bool run_one();
+
+  /// @brief Blocks until every submitted task has finished. Must not be
+  /// called from inside a task, which would wait for itself.
+  void wait();
+
+  size_t size() const;
+
+  /// @brief How many tasks the calling thread is running, each one picked up
+  /// by `run_one` while the one before it waited. State a thread keeps for
+  /// the task it is running should only be touched at the same depth.
+  static size_t nesting();
+
+  /// @brief Runs `body(i)` for every `i` in `[0, count)` and waits for all of
+  /// them to finish. The calling thread runs tasks while it waits, so this is
+  /// safe to nest inside a task of the same pool.
+  template <typename F> void parallel_for(size_t count, F body) {
+    // Counted under the lock, so that the last task is done with the lock and
+    // the condition variable before this frame can see zero and unwind them
+    size_t remaining = count;
+    std::mutex done_mutex;
+    std::condition_variable done;
+
+    for (size_t i = 0; i < count; i++) {
+      submit([&, i]() {
+        body(i);
+        std::lock_guard lock(done_mutex);
+        if (--remaining == 0)
+          done.notify_all();
+      });
+    }
+
+    while (true) {
+      {
+        std::lock_guard lock(done_mutex);
+        if (remaining == 0)
+          return;
+      }
+      if (!run_one())
+        break;
+    }
+
+    // Whatever is left is already running on other threads
+    std::unique_lock lock(done_mutex);
+    done.wait(lock, [&]() { return remaining == 0; });
+  }
+};
+
+#endif
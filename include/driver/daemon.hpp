@@ -0,0 +1,31 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+#include "driver/driver.hpp"
+#include <string>
+#include <vector>
+
+/// A daemon and its clients talk over a Unix domain socket in frames of a
+/// 32-bit payload length, a one-byte frame kind and the payload itself. A
+/// client sends a single request frame, and the daemon answers with output
+/// frames as the build produces them, then a final frame with the exit status.
+namespace driver {
+
+/// @brief `$SYMPH_SOCKET` if set, else a socket in `$XDG_RUNTIME_DIR`, else
+/// one in the temporary directory named after the current user.
+std::string default_socket_path();
+
+/// @brief Serves builds on `options.socket` with one warm session, one client
+/// at a time, until a client sends a stop request. Only clients of the same
+/// user are served, and never with `--run`: programs run in the client.
+/// Returns the exit status of the daemon itself.
+int serve(const Options &options);
+
+/// @brief Hands a build with the given arguments to the daemon listening on
+/// `options.socket` and relays its output. Returns the build's exit status, or
+/// nothing if no daemon is listening.
+std::optional<int> request(const std::vector<std::string> &args,
+                           const Options &options);
+
+} // namespace driver
+
+#endif
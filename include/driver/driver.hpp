@@ -0,0 +1,106 @@
+#ifndef DRIVER_H
+#define DRIVER_H
+#include "common/thread_pool.hpp"
+#include "parser/cache.hpp"
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace driver {
+
+struct Options {
+  std::vector<std::string> inputs;
+  size_t jobs = 0;
+  std::string cache_directory;
+  uint64_t cache_capacity = cache::Store::DEFAULT_CAPACITY;
+  bool use_cache = true;
+  bool emit_ast = false;
+  /// Compile every input that checks out to bytecode and run it
+  bool run = false;
+  /// After each run, report what the garbage collector did
+  bool gc_stats = false;
+  /// Translate hot functions to native code where the platform allows
+  bool jit = false;
+  bool version = false;
+  bool time_report = false;
+  std::string trace;
+
+  /// Stay resident and serve builds, or hand this one to such a daemon
+  bool daemon = false;
+  bool client = false;
+  bool stop = false;
+  std::string socket;
+
+  /// Speak the Language Server Protocol on standard input and output
+  bool lsp = false;
+
+  /// Not a flag: whether the console the diagnostics end up on takes colors
+  bool colored = false;
+
+  /// Every option that changes what the front end produces, in a stable
+  /// order. Part of the cache key; none of the current options qualify.
+  std::string fingerprint;
+};
+
+extern const std::string_view USAGE;
+
+/// @brief Parses the command line, without the program name. Returns nothing
+/// if the arguments don't make sense, in which case `USAGE` should be shown.
+std::optional<Options> parse_arguments(std::span<const std::string> args);
+
+/// @brief Where a build sends its output.
+enum class Channel : unsigned char { Out, Err };
+using Emit = std::function<void(Channel, std::string_view)>;
+
+/// @brief Runs builds. Every phase of a file is a query over its contents,
+/// so a warm session only works out again what depends on a file that
+/// changed: it reads a file again once its modification time or size
+/// changes, and lexes, parses and checks it again once its contents do. A
+/// cold one forgets everything after each build. Programs are compiled to
+/// bytecode only when asked to run them, and then run one after the other.
+class Session {
+  struct Source;
+  struct Syntax;
+  struct Semantics;
+  struct Bytecode;
+  struct Database;
+
+  ThreadPool pool;
+  cache::Store store;
+  bool warm;
+  /// The build under way, whose options the queries go by
+  const Options *building;
+  std::unique_ptr<Database> database;
+
+  std::shared_ptr<const Syntax> parse(const Source &source);
+  std::shared_ptr<const Semantics>
+  analyze(const std::shared_ptr<const Syntax> &syntax);
+  std::shared_ptr<const Bytecode>
+  generate(const std::shared_ptr<const Semantics> &semantics);
+
+public:
+  Session(const Options &options, bool warm);
+  ~Session();
+
+  Session(const Session &) = delete;
+  Session &operator=(const Session &) = delete;
+
+  /// @brief Compiles `options.inputs`, relative paths being resolved against
+  /// `directory`, and emits the output of every input in input order.
+  /// Returns the exit status: 0 if every input compiled cleanly, else 1.
+  int build(const Options &options, const std::string &directory,
+            const Emit &emit);
+
+  /// @brief How many files a warm session currently remembers.
+  size_t remembered() const;
+};
+
+} // namespace driver
+
+#endif
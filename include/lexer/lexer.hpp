@@ -0,0 +1,34 @@
+#ifndef LEXER_H
+#define LEXER_H
+#include "common/diagnostic.hpp"
+#include "common/span.hpp"
+#include "lexer/token.hpp"
+#include <vector>
+
+/// @brief Turns the content of a `File` into a stream of tokens. The stream
+/// always ends with exactly one `Token::Kind::Eof`. Invalid input is reported
+/// to the `DiagnosticEngine` and skipped so that lexing always completes.
+class Lexer {
+  const File &file;
+  DiagnosticEngine &diagnostics;
+  std::vector<Token> tokens;
+  size_t start;
+  size_t cursor;
+
+  char peek(size_t ahead = 0) const;
+  bool match(char expected);
+  void push(Token::Kind kind);
+  void report(diagnostic::Kind kind, size_t offset, size_t length,
+              const std::string &message);
+
+  void lex_identifier();
+  void lex_number();
+  void lex_string();
+  void lex_symbol(char c);
+
+public:
+  Lexer(const File &file, DiagnosticEngine &diagnostics);
+  std::vector<Token> lex();
+};
+
+#endif
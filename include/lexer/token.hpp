@@ -3,6 +3,7 @@
 #include "common/span.hpp"
 #include <array>
 #include <iostream>
+#include <string_view>
 
 #define TOKEN_LIST                                                             \
   X(LParen, "(")                                                               \
@@ -148,6 +149,27 @@ constexpr const char *get_token_repr(const Token::Kind &kind) {
 //     }};
 // #undef REPR
 
+/// @brief The operator a compound assignment applies, e.g. `+` for `+=`, or
+/// `kind` itself if it isn't one.
+constexpr Token::Kind compound_operator(const Token::Kind &kind) {
+  switch (kind) {
+  case Token::Kind::PlusEquals:
+    return Token::Kind::Plus;
+  case Token::Kind::MinusEquals:
+    return Token::Kind::Minus;
+  case Token::Kind::StarEquals:
+    return Token::Kind::Star;
+  case Token::Kind::SlashEquals:
+    return Token::Kind::Slash;
+  case Token::Kind::SlashSlashEquals:
+    return Token::Kind::SlashSlash;
+  case Token::Kind::StarStarEquals:
+    return Token::Kind::StarStar;
+  default:
+    return kind;
+  }
+}
+
 // For use in `maybe_keyword()` only...
 #define MATCH(str, tk)                                                         \
   if (str == get_token_repr(Token::Kind::tk))                                  \
@@ -158,7 +180,7 @@ constexpr const char *get_token_repr(const Token::Kind &kind) {
 /// @param str the string to match on
 /// @return corresponding `Token::Kind` or just `Token::Kind::Identifier` if
 /// nothing matches.
-constexpr Token::Kind maybe_keyword(const std::string &str) {
+constexpr Token::Kind maybe_keyword(std::string_view str) {
   MATCH(str, If)
   MATCH(str, Else)
   MATCH(str, Return)
@@ -0,0 +1,58 @@
+#ifndef JSON_H
+#define JSON_H
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+#include <vector>
+
+/// Just enough JSON for JSON-RPC: a value tree that parses and prints itself.
+/// Objects keep their members in order and are searched linearly, which is
+/// the fastest option for the handful of members an LSP message has.
+namespace json {
+
+struct Value;
+using Array = std::vector<Value>;
+using Object = std::vector<std::pair<std::string, Value>>;
+
+struct Value {
+  std::variant<std::nullptr_t, bool, double, std::string, Array, Object> data;
+
+  Value() : data(nullptr) {}
+  Value(std::nullptr_t) : data(nullptr) {}
+  Value(bool value) : data(value) {}
+  Value(double value) : data(value) {}
+  Value(int value) : data(static_cast<double>(value)) {}
+  Value(int64_t value) : data(static_cast<double>(value)) {}
+  Value(size_t value) : data(static_cast<double>(value)) {}
+  Value(const char *value) : data(std::string(value)) {}
+  Value(std::string_view value) : data(std::string(value)) {}
+  Value(std::string value) : data(std::move(value)) {}
+  Value(Array value) : data(std::move(value)) {}
+  Value(Object value) : data(std::move(value)) {}
+
+  bool is_null() const { return data.index() == 0; }
+  const std::string *as_string() const;
+  const Array *as_array() const;
+  const Object *as_object() const;
+  std::optional<double> as_number() const;
+  /// @brief The number if it is whole and fits in an `int64_t`.
+  std::optional<int64_t> as_integer() const;
+
+  /// @brief The member `key` of an object, or null for anything else.
+  const Value &operator[](std::string_view key) const;
+};
+
+/// @brief Parses a complete JSON text. Returns nothing if it is malformed or
+/// nests deeper than any message we expect to receive.
+std::optional<Value> parse(std::string_view text);
+
+/// @brief Appends the compact JSON text of `value` to `out`.
+void write(std::string &out, const Value &value);
+std::string dump(const Value &value);
+
+} // namespace json
+
+#endif
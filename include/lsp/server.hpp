@@ -0,0 +1,128 @@
+#ifndef LSP_SERVER_H
+#define LSP_SERVER_H
+#include "common/rope.hpp"
+#include "common/sink.hpp"
+#include "common/span.hpp"
+#include "common/thread_pool.hpp"
+#include "lsp/json.hpp"
+#include "syntax/syntax_tree.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace lsp {
+
+/// @brief A position as LSP counts it: a 0-based line and a 0-based offset
+/// into that line in UTF-16 code units.
+struct Position {
+  uint32_t line;
+  uint32_t character;
+};
+
+/// @brief The byte offset of `position` in `text`, clamped to the end of its
+/// line and to the end of the text.
+size_t offset_of(const Rope &text, Position position);
+
+/// @brief The LSP position of the byte at `offset` in `file`.
+Position position_of(const File &file, size_t offset);
+
+/// @brief A language server for one client. Requests are answered on the
+/// calling thread, which never lexes or parses anything itself: document
+/// changes are queued for a worker thread that owns every open document.
+/// Edits go straight into the document's rope as they are dequeued; the
+/// worker waits until a document has been quiet for `debounce` before
+/// relexing it incrementally, parsing it and checking it, and drops the
+/// result unseen if a newer version arrived in the meantime.
+class Server {
+public:
+  /// Receives the JSON text of every message the server sends
+  using Send = std::function<void(std::string_view)>;
+
+  static constexpr std::chrono::milliseconds DEFAULT_DEBOUNCE{5};
+
+  explicit Server(Send send,
+                  std::chrono::milliseconds debounce = DEFAULT_DEBOUNCE);
+  ~Server();
+
+  Server(const Server &) = delete;
+  Server &operator=(const Server &) = delete;
+
+  /// @brief Handles one message from the client.
+  /// @return false once the client has asked the server to exit
+  bool handle(std::string_view message);
+
+  /// @brief Blocks until every queued change has been analyzed.
+  void wait_idle();
+
+  /// @brief The process exit status LSP asks for: 0 if the client shut the
+  /// server down before telling it to exit, 1 otherwise.
+  int exit_status() const;
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Edit {
+    std::optional<std::pair<Position, Position>> range;
+    std::string text;
+  };
+
+  /// @brief Everything that happened to a document since the worker last
+  /// looked at it.
+  struct Pending {
+    int64_t version = 0;
+    bool opened = false;
+    bool closed = false;
+    std::vector<Edit> edits;
+    Clock::time_point due;
+  };
+
+  Send send;
+  std::mutex send_mutex;
+  std::chrono::milliseconds debounce;
+  bool shut_down;
+
+  /// Guards the queue; the worker owns the documents outright
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::condition_variable idle;
+  std::unordered_map<std::string, Pending> queue;
+  bool busy;
+  bool stopping;
+
+  /// Type checks function bodies for the worker
+  ThreadPool pool;
+  std::unordered_map<std::string, std::unique_ptr<syntax::SyntaxTree>>
+      documents;
+  std::thread worker;
+
+  void reply(const json::Value &id, json::Value result);
+  void reply_error(const json::Value &id, int code, std::string message);
+  void notify(std::string method, json::Value params);
+
+  void enqueue(const std::string &uri, Pending change);
+  void run();
+  void analyze(const std::string &uri, Pending change);
+  bool superseded(const std::string &uri);
+};
+
+/// @brief Reads the next message framed by LSP's `Content-Length` header.
+/// Returns nothing at the end of the stream.
+std::optional<std::string> read_message(std::istream &in);
+
+/// @brief Serves one client speaking LSP over `in` and `out` until it asks
+/// the server to exit. Returns the exit status.
+int serve(std::istream &in, output::Sink &out);
+
+} // namespace lsp
+
+#endif
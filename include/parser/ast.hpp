@@ -0,0 +1,244 @@
+#ifndef AST_H
+#define AST_H
+#include "common/column.hpp"
+#include "common/span.hpp"
+#include "lexer/token.hpp"
+#include <cstdint>
+#include <iostream>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace ast {
+
+/// @brief Index of a token in the tree's token arrays.
+using TokenIndex = uint32_t;
+
+/// @brief Index of a node in the tree's node arrays.
+using NodeIndex = uint32_t;
+
+/// @brief Node 0 is always the `Root`, which nothing can have as a child, so
+/// index 0 doubles as "no node" for optional children.
+constexpr NodeIndex NULL_NODE = 0;
+
+/// @brief Every node tag together with the meaning of its main token and its
+/// two data words. "range" means `lhs..rhs` is a range of node indices in
+/// `extra`; "extra[n]" means the word points at a fixed record in `extra`.
+#define NODE_TAGS                                                              \
+  /* main: first token, data: range of items */                                \
+  X(Root)                                                                      \
+  /* main: the literal, data: unused */                                        \
+  X(Literal)                                                                   \
+  /* main: the name, data: unused */                                           \
+  X(Identifier)                                                                \
+  /* main: operator, lhs: operand */                                           \
+  X(Unary)                                                                     \
+  /* main: operator, lhs: operand */                                           \
+  X(Postfix)                                                                   \
+  /* main: operator, lhs/rhs: operands */                                      \
+  X(Binary)                                                                    \
+  /* main: operator, lhs: target, rhs: value */                                \
+  X(Assign)                                                                    \
+  /* main: `?`, lhs: condition, rhs: extra[then, otherwise] */                 \
+  X(Ternary)                                                                   \
+  /* main: `as`, lhs: value, rhs: type */                                      \
+  X(Cast)                                                                      \
+  /* main: `(`, lhs: callee, rhs: extra[start, end] of arguments */            \
+  X(Call)                                                                      \
+  /* main: `[`, lhs: object, rhs: index */                                     \
+  X(Index)                                                                     \
+  /* main: member name, lhs: object */                                         \
+  X(Member)                                                                    \
+  /* main: `(`, lhs: inner expression */                                       \
+  X(Grouping)                                                                  \
+  /* main: `(`, data: range of elements */                                     \
+  X(Tuple)                                                                     \
+  /* main: `[`, data: range of elements */                                     \
+  X(Array)                                                                     \
+  /* main: `=>`, lhs: parameters, rhs: body expression or block */             \
+  X(Lambda)                                                                    \
+  /* main: `{`, data: range of statements */                                   \
+  X(Block)                                                                     \
+  /* main: the name, lhs: type or null, rhs: value or null */                  \
+  X(VarDecl)                                                                   \
+  /* main: `if`, lhs: condition, rhs: extra[then, else or null] */             \
+  X(If)                                                                        \
+  /* main: `while`, lhs: condition, rhs: body */                               \
+  X(While)                                                                     \
+  /* main: `for` (variable follows it), lhs: iterable, rhs: body */            \
+  X(For)                                                                       \
+  /* main: `return`, lhs: value or null */                                     \
+  X(Return)                                                                    \
+  /* main: the name, lhs: extra[params start, end, return type], rhs: body */  \
+  X(FnDecl)                                                                    \
+  /* main: the name, lhs: type */                                              \
+  X(Param)                                                                     \
+  /* main: `class` (name follows it), data: range of members */                \
+  X(ClassDecl)                                                                 \
+  /* main: `enum` (name follows it), data: range of variants */                \
+  X(EnumDecl)                                                                  \
+  /* main: the name, data: unused */                                           \
+  X(EnumVariant)                                                               \
+  /* main: where the error was reported, data: skipped tokens [lhs, rhs) */    \
+  X(Error)
+
+enum class Tag : uint8_t {
+#define X(name) name,
+  NODE_TAGS
+#undef X
+};
+
+/// @brief Returns the name of a tag, for debugging output.
+constexpr const char *get_tag_name(const Tag &tag) {
+  switch (tag) {
+#define X(name)                                                                \
+  case Tag::name:                                                              \
+    return #name;
+    NODE_TAGS
+#undef X
+  }
+  return "<unknown>";
+}
+
+struct Data {
+  uint32_t lhs;
+  uint32_t rhs;
+};
+
+/* ---------------------------------------------------------------------------*/
+/* TYPED VIEWS */
+/* ---------------------------------------------------------------------------*/
+
+using NodeList = std::span<const NodeIndex>;
+
+struct TernaryExpr {
+  NodeIndex condition;
+  NodeIndex then;
+  NodeIndex otherwise;
+};
+
+struct CallExpr {
+  NodeIndex callee;
+  NodeList arguments;
+};
+
+struct VarDecl {
+  TokenIndex name;
+  NodeIndex type;
+  NodeIndex value;
+};
+
+struct IfStmt {
+  NodeIndex condition;
+  NodeIndex then;
+  /// Either `NULL_NODE`, a `Block` or another `If`
+  NodeIndex otherwise;
+};
+
+struct WhileStmt {
+  NodeIndex condition;
+  NodeIndex body;
+};
+
+struct ForStmt {
+  TokenIndex variable;
+  NodeIndex iterable;
+  NodeIndex body;
+};
+
+struct ReturnStmt {
+  NodeIndex value;
+};
+
+struct FnDecl {
+  TokenIndex name;
+  NodeList params;
+  NodeIndex return_type;
+  NodeIndex body;
+};
+
+struct ClassDecl {
+  TokenIndex name;
+  NodeList members;
+};
+
+struct EnumDecl {
+  TokenIndex name;
+  NodeList variants;
+};
+
+/* ---------------------------------------------------------------------------*/
+/* TREE */
+/* ---------------------------------------------------------------------------*/
+
+/// @brief The syntax tree of one file stored as parallel arrays. A node is an
+/// index into `tags`, `main_tokens` and `data`; anything that doesn't fit in
+/// two 32-bit words spills into `extra`. Children are always appended before
+/// their parents, so bottom-up passes walk every array front to back.
+class Tree {
+public:
+  const File *file;
+
+  // Columns rather than vectors so that a tree can be read straight out of a
+  // memory-mapped cache, see `cache::load()`
+  Column<Token::Kind> token_kinds;
+  Column<uint32_t> token_offsets;
+  Column<uint32_t> token_lengths;
+
+  Column<Tag> tags;
+  Column<TokenIndex> main_tokens;
+  Column<Data> data;
+  Column<uint32_t> extra;
+
+  explicit Tree(const File &file);
+
+  /// @brief Copies the kind and position of every token out of the stream.
+  void set_tokens(const std::vector<Token> &tokens);
+
+  NodeIndex add_node(Tag tag, TokenIndex main_token, Data node_data);
+  uint32_t add_extra(std::span<const uint32_t> words);
+
+  /// @brief Appends every node of `fragment`, a tree parsed from a range of
+  /// this tree's tokens, rewriting its node and extra indices as it goes. The
+  /// fragment's top-level items are appended to `items`. Splicing fragments in
+  /// source order yields exactly the arrays a single parse would have built.
+  void splice(const Tree &fragment, std::vector<NodeIndex> &items);
+
+  size_t node_count() const { return tags.size(); }
+
+  /// @brief Bytes taken up by the token, node and extra arrays.
+  size_t byte_size() const;
+  Tag tag(NodeIndex node) const { return tags[node]; }
+  TokenIndex main_token(NodeIndex node) const { return main_tokens[node]; }
+  Data node_data(NodeIndex node) const { return data[node]; }
+
+  Token::Kind token_kind(TokenIndex token) const { return token_kinds[token]; }
+  std::string_view token_lexeme(TokenIndex token) const;
+  Span token_span(TokenIndex token) const;
+
+  /// @brief The top-level items of the file, in source order.
+  NodeList items() const;
+
+  /// @brief The children of any node whose data is a range (`Root`, `Tuple`,
+  /// `Array`, `Block`, `ClassDecl` and `EnumDecl`).
+  NodeList list(NodeIndex node) const;
+
+  TernaryExpr ternary(NodeIndex node) const;
+  CallExpr call(NodeIndex node) const;
+  VarDecl var_decl(NodeIndex node) const;
+  IfStmt if_stmt(NodeIndex node) const;
+  WhileStmt while_stmt(NodeIndex node) const;
+  ForStmt for_stmt(NodeIndex node) const;
+  ReturnStmt return_stmt(NodeIndex node) const;
+  FnDecl fn_decl(NodeIndex node) const;
+  ClassDecl class_decl(NodeIndex node) const;
+  EnumDecl enum_decl(NodeIndex node) const;
+};
+
+/// @brief Writes a node as an S-expression, e.g. `(+ 1 (* 2 3))`, which makes
+/// the shape of the tree easy to check at a glance.
+void print_node(std::ostream &os, const Tree &tree, NodeIndex node);
+
+} // namespace ast
+
+#endif
@@ -0,0 +1,134 @@
+#ifndef CACHE_H
+#define CACHE_H
+#include "common/diagnostic.hpp"
+#include "common/mapped_file.hpp"
+#include "common/span.hpp"
+#include "parser/ast.hpp"
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+
+namespace cache {
+
+/// @brief Bumped whenever the layout below, the token kinds, the node tags or
+/// the diagnostic kinds change. A cache written by any other version is
+/// ignored.
+constexpr uint32_t FORMAT_VERSION = 9;
+
+constexpr char MAGIC[8] = {'S', 'Y', 'M', 'P', 'H', 'A', 'S', 'T'};
+
+/// Written in the host's byte order; a cache from a host of the other
+/// endianness reads back as a different number and is ignored.
+constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+/// @brief The fixed-size start of a cache file. Everything after it is a run
+/// of sections whose sizes follow from the counts here, each aligned to 8
+/// bytes, in this order:
+///
+///   token kinds, token offsets, token lengths,
+///   node tags, node main tokens, node data, extra data,
+///   diagnostics, message offsets (count + 1), message bytes
+///
+/// No section holds a pointer or an absolute address, so a cache can be mapped
+/// anywhere and read in place. `body_hash` covers everything after the header,
+/// so a damaged file is ignored rather than trusted.
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint64_t source_hash;
+  uint64_t source_length;
+  uint64_t body_hash;
+  uint32_t token_count;
+  uint32_t node_count;
+  uint32_t extra_count;
+  uint32_t diagnostic_count;
+  uint32_t message_bytes;
+  uint32_t reserved;
+};
+
+/// @brief A diagnostic as stored in the cache. Diagnostics are kept unrendered,
+/// so a cached module reports them with the current path and colors.
+struct CachedDiagnostic {
+  uint32_t kind;
+  uint32_t offset;
+  uint32_t length;
+};
+
+/// @brief Hash of a source file as recorded in the cache.
+uint64_t source_hash(const File &file);
+
+/// @brief The key a compilation is cached under: the file's contents hashed
+/// together with the compiler version and every option that affects what the
+/// front end produces. The path is deliberately left out, so identical files
+/// share an entry.
+uint64_t key_for(const File &file, std::string_view options);
+
+/// @brief Writes `tree` and the diagnostics produced while building it to
+/// `path`. The file is written under a unique temporary name and renamed into
+/// place, so a concurrent reader sees either the old cache or the new one,
+/// never half of one. Returns false if the cache couldn't be written.
+bool store(const ast::Tree &tree, const DiagnosticEngine &diagnostics,
+           const std::string &path);
+
+/// @brief A parsed module whose arrays are read straight out of a mapped
+/// cache file.
+class Module {
+  MappedFile mapping;
+  ast::Tree ast;
+  std::span<const CachedDiagnostic> diagnostics;
+  std::span<const uint32_t> message_offsets;
+  std::string_view message_bytes;
+
+  Module(MappedFile mapping, const File &file);
+  friend std::optional<Module> load(const std::string &path, const File &file);
+
+public:
+  const ast::Tree &tree() const { return ast; }
+
+  /// @brief Emits the diagnostics that were produced when the module was
+  /// first parsed, in their original order.
+  void replay(DiagnosticEngine &engine) const;
+  size_t diagnostic_count() const { return diagnostics.size(); }
+};
+
+/// @brief Maps the cache at `path` if it was written by this version of the
+/// compiler for exactly the contents of `file`. Returns nothing if the cache
+/// is missing, stale or malformed, in which case the caller parses as usual.
+std::optional<Module> load(const std::string &path, const File &file);
+
+/* ---------------------------------------------------------------------------*/
+/* STORE */
+/* ---------------------------------------------------------------------------*/
+
+/// @brief A directory of cached modules named by their key. Every hit marks
+/// its entry as recently used, so that `evict()` can drop the least recently
+/// used entries once the directory outgrows `capacity` bytes.
+class Store {
+  std::string directory;
+  uint64_t capacity;
+
+public:
+  static constexpr uint64_t DEFAULT_CAPACITY = 256ull * 1024 * 1024;
+
+  /// @brief Uses `directory`, creating it on the first store if needed.
+  explicit Store(std::string directory, uint64_t capacity = DEFAULT_CAPACITY);
+
+  std::string path_for(uint64_t key) const;
+
+  std::optional<Module> load(uint64_t key, const File &file) const;
+  bool store(uint64_t key, const ast::Tree &tree,
+             const DiagnosticEngine &diagnostics) const;
+
+  /// @brief Removes entries, oldest use first, until the total size of the
+  /// directory is at most `capacity`. Returns the number of bytes freed.
+  /// Scans the whole directory, so it is meant to run once per build rather
+  /// than after every store.
+  uint64_t evict() const;
+};
+
+} // namespace cache
+
+#endif
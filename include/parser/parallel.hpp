@@ -0,0 +1,52 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+#include "common/diagnostic.hpp"
+#include "common/thread_pool.hpp"
+#include "lexer/token.hpp"
+#include "parser/ast.hpp"
+#include <cstddef>
+#include <span>
+#include <vector>
+
+namespace parser {
+
+/// @brief A half open range of token indices.
+struct TokenRange {
+  size_t begin;
+  size_t end;
+};
+
+/// @brief Whether a `class`, `enum` or function declaration begins at
+/// `index`, which is where `split_top_level()` starts a new range.
+/// @param closing the result of `match_parens()` over the same `kinds`
+bool starts_declaration(std::span<const Token::Kind> kinds,
+                        std::span<const uint32_t> closing, size_t index);
+
+/// @brief Splits a token stream into independently parseable ranges by
+/// matching brackets. A new range starts wherever a `class`, `enum` or function
+/// declaration begins at the top level; everything between two declarations
+/// stays together with the declaration before it.
+/// @param kinds the token stream, ending in its end of file token
+/// @return the ranges in source order, covering every token but the last
+std::vector<TokenRange> split_top_level(std::span<const Token::Kind> kinds);
+
+/// @brief Splits a token stream like the overload above, with the brackets
+/// already matched, so that a caller who needs the same table for parsing
+/// only matches them once.
+/// @param kinds the token stream, ending in its end of file token
+/// @param closing the result of `match_parens()` over the same `kinds`
+/// @return the ranges in source order, covering every token but the last
+std::vector<TokenRange> split_top_level(std::span<const Token::Kind> kinds,
+                                        std::span<const uint32_t> closing);
+
+/// @brief Parses a token stream with the top-level ranges spread over `pool`,
+/// each into its own tree and diagnostic buffer, then splices the results back
+/// together in source order. Produces the same tree and the same diagnostics
+/// as a sequential `Parser::parse()`, as long as no broken statement straddles
+/// two top-level declarations.
+ast::Tree parse_parallel(const std::vector<Token> &tokens,
+                         DiagnosticEngine &diagnostics, ThreadPool &pool);
+
+} // namespace parser
+
+#endif
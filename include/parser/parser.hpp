@@ -0,0 +1,171 @@
+#ifndef PARSER_H
+#define PARSER_H
+#include "common/diagnostic.hpp"
+#include "lexer/token.hpp"
+#include "parser/ast.hpp"
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace parser {
+
+/// @brief Binding power of every operator, from loosest to tightest. An
+/// operator only continues an expression whose minimum precedence it meets.
+enum class Precedence : uint8_t {
+  None,
+  Lambda,     // =>
+  Assignment, // = += -= *= /= //= **=
+  Ternary,    // ? :
+  Arrow,      // ->
+  Or,         // ||
+  And,        // &&
+  BitOr,      // |
+  BitAnd,     // &
+  Equality,   // == !=
+  Comparison, // < <= > >=
+  Term,       // + -
+  Factor,     // * / // %
+  Cast,       // as
+  Prefix,     // - ~ ++ --
+  Power,      // **
+  Postfix,    // () [] . ++ --
+};
+
+/// @brief The infix behaviour of one token kind.
+struct InfixRule {
+  Precedence precedence;
+  bool right_associative;
+};
+
+/// @brief Returns how a token kind behaves when it follows an operand. Tokens
+/// that cannot continue an expression have `Precedence::None`.
+InfixRule get_infix_rule(Token::Kind kind);
+
+/// @brief How deeply expressions and blocks may nest. The parser and every
+/// pass after it recurse once per level, so anything deeper is reported
+/// rather than allowed to run out of stack.
+constexpr unsigned MAX_DEPTH = 256;
+
+/// @brief Marks a `(` that is never closed in `match_parens()`.
+constexpr uint32_t NO_MATCH = UINT32_MAX;
+
+/// @brief Returns, for every `(` in `kinds`, the index of its matching `)`,
+/// and `NO_MATCH` for every other token. Computed once in linear time so that
+/// looking ahead for function declarations never rescans the stream.
+std::vector<uint32_t> match_parens(std::span<const Token::Kind> kinds);
+
+/// @brief Whether the tokens at `index` start a function declaration, i.e. a
+/// name and a parenthesized list followed by `->` or `{`.
+/// @param closing the result of `match_parens()` over the same `kinds`
+bool looks_like_fn_decl(std::span<const Token::Kind> kinds,
+                        std::span<const uint32_t> closing, size_t index);
+
+} // namespace parser
+
+/// @brief Parses a token stream produced by the `Lexer` into a flat
+/// `ast::Tree`. Statements and declarations are parsed by recursive descent
+/// and expressions with a Pratt loop driven by `parser::get_infix_rule()`.
+class Parser {
+  ast::Tree tree;
+  const ast::Tree *source;
+  DiagnosticEngine &diagnostics;
+  size_t cursor;
+  size_t end;
+  unsigned nesting;
+  /// Expressions and blocks being parsed, up to `parser::MAX_DEPTH`
+  unsigned depth;
+  bool failed;
+
+  /// Set from the first error until the parser has resynchronized. Errors
+  /// reported in the meantime are most likely caused by the first one and
+  /// are suppressed.
+  bool panicking;
+  ast::TokenIndex error_token;
+
+  /// The matching `)` of every `(` in range, see `parser::match_parens()`.
+  /// Owned by the parser unless it parses part of a tree, whose table it
+  /// shares with the parsers of the other parts
+  std::vector<uint32_t> matches;
+  std::span<const uint32_t> closing;
+
+  /// Children of lists being parsed. Nested lists push on top of their parent's
+  /// children and pop their own off once copied into `tree.extra`.
+  std::vector<ast::NodeIndex> scratch;
+
+  Token::Kind kind_at(size_t index) const;
+  Token::Kind peek();
+  Token::Kind peek_raw(size_t ahead = 0) const;
+  ast::TokenIndex advance();
+  bool check(Token::Kind kind);
+  bool match(Token::Kind kind);
+  bool expect(Token::Kind kind, const char *message);
+  void skip_newlines();
+  bool at_terminator();
+  void error(diagnostic::Kind kind, ast::TokenIndex token,
+             const std::string &message);
+  /// @brief Reports and returns true if one more level would be too deep.
+  bool too_deep();
+  ast::Data take_range(size_t count);
+  void drop_scratch(size_t count);
+
+  /// @brief Everything needed to undo a statement that failed to parse.
+  struct Checkpoint {
+    size_t cursor;
+    unsigned nesting;
+    size_t nodes;
+    size_t extra;
+  };
+  Checkpoint checkpoint() const;
+
+  /// @brief Parses a statement, or on failure discards whatever the statement
+  /// had added to the tree, skips to the next synchronization point and
+  /// returns an `Error` node in its place. Always consumes at least one token
+  /// unless already at the end of the range.
+  ast::NodeIndex parse_statement_or_recover(bool member);
+  ast::NodeIndex recover(const Checkpoint &start);
+
+  ast::NodeIndex parse_statement();
+  ast::NodeIndex parse_member();
+  ast::NodeIndex parse_simple_statement();
+  ast::NodeIndex parse_block();
+  ast::NodeIndex parse_var_decl();
+  ast::NodeIndex parse_if();
+  ast::NodeIndex parse_while();
+  ast::NodeIndex parse_for();
+  ast::NodeIndex parse_return();
+  ast::NodeIndex parse_fn_decl();
+  ast::NodeIndex parse_class_decl();
+  ast::NodeIndex parse_enum_decl();
+  ast::NodeIndex parse_type();
+  bool is_fn_decl() const;
+
+  ast::NodeIndex parse_prefix();
+  ast::NodeIndex parse_infix(ast::NodeIndex lhs, parser::InfixRule rule);
+  ast::NodeIndex parse_parenthesized(ast::TokenIndex paren);
+  bool parse_list(Token::Kind close, size_t &count);
+
+public:
+  Parser(const std::vector<Token> &tokens, DiagnosticEngine &diagnostics);
+
+  /// @brief Creates a parser for the tokens in `[begin, end)` of a tree that
+  /// already holds the token arrays. The tree it produces has no tokens of its
+  /// own; it is meant to be spliced into `source` with `ast::Tree::splice()`.
+  /// @param closing the result of `match_parens()` over all of `source`'s
+  /// tokens, which has to outlive the parser
+  Parser(const ast::Tree &source, std::span<const uint32_t> closing,
+         size_t begin, size_t end, DiagnosticEngine &diagnostics);
+
+  /// @brief Parses the whole token stream as a module of newline or semicolon
+  /// separated statements and declarations. Statements that fail to parse are
+  /// reported once and kept in the tree as `Error` nodes.
+  ast::Tree parse();
+
+  /// @brief Parses a single expression whose operators all bind at least as
+  /// tightly as `min`. Returns `ast::NULL_NODE` after reporting an error.
+  ast::NodeIndex
+  parse_expression(parser::Precedence min = parser::Precedence::Lambda);
+
+  bool had_error() const;
+};
+
+#endif
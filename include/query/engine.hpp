@@ -0,0 +1,229 @@
+#ifndef QUERY_ENGINE_H
+#define QUERY_ENGINE_H
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/// Demand-driven computation: a result is worked out when first asked for,
+/// remembered together with the results it read while being worked out, and
+/// only worked out again once one of those may have changed.
+namespace query {
+
+/// @brief Counts changes to inputs. Every result records the revision it was
+/// last found up to date in and the revision its value last changed in.
+using Revision = uint64_t;
+
+class Engine;
+
+/// @brief A remembered input or result, whatever its key and value types.
+class Slot {
+  friend class Engine;
+
+  enum class State : uint8_t { Empty, Running, Done };
+
+  State state = State::Empty;
+  bool input;
+  std::thread::id runner;
+  Revision changed_at = 0;
+  Revision verified_at = 0;
+  /// Everything the last execution read, in the order it was read
+  std::vector<Slot *> dependencies;
+
+protected:
+  explicit Slot(bool input) : input(input) {}
+
+  /// @brief Works the value out again. Returns whether it differs from the
+  /// previous value, which is kept if it doesn't.
+  virtual bool execute() = 0;
+
+public:
+  virtual ~Slot() = default;
+
+  Slot(const Slot &) = delete;
+  Slot &operator=(const Slot &) = delete;
+};
+
+/// @brief Tracks revisions and dependencies for any number of `Input`s and
+/// `Query`s. Queries may be asked for from any number of threads at once; a
+/// result that is being worked out on one thread is waited for by the others.
+/// Inputs must only be set while no query is running.
+///
+/// Asking for a result that was up to date in an older revision first brings
+/// the results it read up to date, oldest first. If none of them changed
+/// since, it is up to date as it is ("green"); otherwise it is worked out
+/// again ("red"). A result worked out again to an equal value keeps the
+/// revision it last changed in, so whatever read it stays green.
+class Engine {
+public:
+  struct Stats {
+    /// Results worked out, whether for the first time or again
+    uint64_t executed = 0;
+    /// Results from an older revision found to be up to date
+    uint64_t reused = 0;
+  };
+
+private:
+  std::mutex mutex;
+  std::condition_variable finished;
+  Revision revision = 1;
+  Stats stats;
+
+  void ensure(Slot &slot, std::unique_lock<std::mutex> &lock);
+  bool outdated(Slot &slot, std::unique_lock<std::mutex> &lock);
+  void execute(Slot &slot, std::unique_lock<std::mutex> &lock);
+
+public:
+  Engine() = default;
+  Engine(const Engine &) = delete;
+  Engine &operator=(const Engine &) = delete;
+
+  /// @brief Brings `slot` up to date and records that whatever query is
+  /// running on the calling thread depends on it.
+  void read(Slot &slot);
+
+  /// @brief Starts a new revision in which the input `slot` has changed.
+  void changed(Slot &slot);
+
+  Revision current() {
+    std::lock_guard lock(mutex);
+    return revision;
+  }
+
+  Stats statistics() {
+    std::lock_guard lock(mutex);
+    return stats;
+  }
+};
+
+/// @brief Values that are set from outside rather than worked out, such as
+/// the contents of a file. Setting a value equal to the current one changes
+/// nothing.
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class Input {
+  struct Cell final : Slot {
+    Value value;
+
+    explicit Cell(Value value) : Slot(true), value(std::move(value)) {}
+    bool execute() override { return false; }
+  };
+
+  Engine &engine;
+  std::mutex mutex;
+  std::unordered_map<Key, std::unique_ptr<Cell>, Hash> cells;
+
+public:
+  explicit Input(Engine &engine) : engine(engine), mutex(), cells() {}
+
+  void set(const Key &key, Value value) {
+    std::unique_lock lock(mutex);
+    auto &cell = cells[key];
+    if (cell && cell->value == value)
+      return;
+    if (cell)
+      cell->value = std::move(value);
+    else
+      cell = std::make_unique<Cell>(std::move(value));
+    Cell &changed = *cell;
+    lock.unlock();
+    engine.changed(changed);
+  }
+
+  /// @brief The value of `key`, which must have been set.
+  const Value &get(const Key &key) {
+    Cell *cell = nullptr;
+    {
+      std::lock_guard lock(mutex);
+      auto it = cells.find(key);
+      if (it == cells.end())
+        std::abort();
+      cell = it->second.get();
+    }
+    engine.read(*cell);
+    return cell->value;
+  }
+
+  /// @brief The value of `key` if it has been set, without depending on it.
+  const Value *peek(const Key &key) {
+    std::lock_guard lock(mutex);
+    auto it = cells.find(key);
+    return it == cells.end() ? nullptr : &it->second->value;
+  }
+
+  size_t size() {
+    std::lock_guard lock(mutex);
+    return cells.size();
+  }
+};
+
+/// @brief Results worked out by `compute` from inputs and other queries.
+/// Each key's result is remembered until something it read changes.
+/// `compute` must not ask, directly or not, for the key it is computing.
+/// If it throws, the result is left to be worked out on the next ask.
+///
+/// A result worked out again is compared to the last with `==`, so a
+/// pointer result only counts as unchanged when `compute` returns the same
+/// pointer; one that builds a new object every time is always red.
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class Query {
+public:
+  using Compute = std::function<Value(const Key &)>;
+
+private:
+  struct Memo final : Slot {
+    const Compute &compute;
+    Key key;
+    std::optional<Value> value;
+
+    Memo(const Compute &compute, Key key)
+        : Slot(false), compute(compute), key(std::move(key)), value() {}
+
+    bool execute() override {
+      Value fresh = compute(key);
+      if (value && *value == fresh)
+        return false;
+      value = std::move(fresh);
+      return true;
+    }
+  };
+
+  Engine &engine;
+  Compute compute;
+  std::mutex mutex;
+  std::unordered_map<Key, std::unique_ptr<Memo>, Hash> memos;
+
+public:
+  Query(Engine &engine, Compute compute)
+      : engine(engine), compute(std::move(compute)), mutex(), memos() {}
+
+  /// @brief The result for `key`. It stays valid until an input is set.
+  const Value &get(const Key &key) {
+    Memo *memo = nullptr;
+    {
+      std::lock_guard lock(mutex);
+      auto &slot = memos[key];
+      if (!slot)
+        slot = std::make_unique<Memo>(compute, key);
+      memo = slot.get();
+    }
+    engine.read(*memo);
+    return *memo->value;
+  }
+
+  size_t size() {
+    std::lock_guard lock(mutex);
+    return memos.size();
+  }
+};
+
+} // namespace query
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef CHECKER_H
+#define CHECKER_H
+#include "common/diagnostic.hpp"
+#include "common/interner.hpp"
+#include "common/thread_pool.hpp"
+#include "parser/ast.hpp"
+#include "sema/resolver.hpp"
+#include "sema/types.hpp"
+#include <vector>
+
+namespace sema {
+
+/// @brief The type of every node: of an expression, of the variable a
+/// `VarDecl`, `Param` or `For` declares, of the function an `FnDecl`
+/// declares, or of the class or enum a declaration introduces. Nodes that
+/// have no type, or whose type could not be worked out, are `Error`.
+struct Typing {
+  std::vector<TypeId> types;
+
+  TypeId operator[](ast::NodeIndex node) const { return types[node]; }
+};
+
+/// @brief Type checks `tree` in two phases. The first runs on the calling
+/// thread: it creates the types of every class and enum, works out every
+/// function signature and field, and checks the statements at the top level
+/// of the file, which may declare globals the functions use. The second
+/// checks the bodies of the top-level functions and methods, which depend on
+/// nothing but the first phase's results, as tasks on `pool`. Each task
+/// collects its diagnostics on its own, and they follow the first phase's in
+/// the order the functions appear, so the output doesn't depend on how the
+/// tasks were scheduled.
+///
+/// `names` must not be used by anyone else during the call; `types` may be.
+Typing check(const ast::Tree &tree, const Resolution &resolution,
+             StringInterner &names, TypeInterner &types,
+             DiagnosticEngine &diagnostics, ThreadPool &pool);
+
+} // namespace sema
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef FOLDER_H
+#define FOLDER_H
+#include "common/diagnostic.hpp"
+#include "parser/ast.hpp"
+#include "sema/checker.hpp"
+#include "sema/resolver.hpp"
+#include <cstdint>
+#include <vector>
+
+namespace sema {
+
+/// @brief A value known at compile time.
+struct Constant {
+  enum class Kind : uint8_t { Unknown, Int, Float, Bool };
+
+  Kind kind;
+  union {
+    int64_t integer;
+    double real;
+    bool boolean;
+  };
+
+  constexpr Constant() : kind(Kind::Unknown), integer(0) {}
+
+  static constexpr Constant of_int(int64_t value) {
+    Constant constant;
+    constant.kind = Kind::Int;
+    constant.integer = value;
+    return constant;
+  }
+  static constexpr Constant of_float(double value) {
+    Constant constant;
+    constant.kind = Kind::Float;
+    constant.real = value;
+    return constant;
+  }
+  static constexpr Constant of_bool(bool value) {
+    Constant constant;
+    constant.kind = Kind::Bool;
+    constant.boolean = value;
+    return constant;
+  }
+
+  bool known() const { return kind != Kind::Unknown; }
+};
+
+/// @brief The value of every expression that has one at compile time,
+/// indexed by node, and the value a `VarDecl` binds if it does. Everything
+/// else is `Unknown`.
+struct Folding {
+  std::vector<Constant> constants;
+
+  const Constant &operator[](ast::NodeIndex node) const {
+    return constants[node];
+  }
+};
+
+/// @brief Evaluates the arithmetic, comparisons and logic on literals that
+/// a well-typed `tree` does, with the language's semantics rather than
+/// C++'s: ints are 64 bits and overflowing one is reported, `//` rounds
+/// towards negative infinity, `%` takes the sign of the divisor and `/`
+/// always makes a float. A variable that nothing assigns to after its
+/// declaration stands for the value it was declared with. Dividing by a
+/// constant zero is reported, unless the division sits in a branch that a
+/// constant condition rules out.
+Folding fold(const ast::Tree &tree, const Resolution &resolution,
+             const Typing &typing, DiagnosticEngine &diagnostics);
+
+} // namespace sema
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef RESOLVER_H
+#define RESOLVER_H
+#include "common/diagnostic.hpp"
+#include "common/interner.hpp"
+#include "parser/ast.hpp"
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace sema {
+
+/// @brief Every name that is in scope before anything has been declared.
+#define BUILTINS                                                               \
+  X(Int, "int")                                                                \
+  X(Float, "float")                                                            \
+  X(Str, "str")                                                                \
+  X(Bool, "bool")                                                              \
+  X(List, "List")                                                              \
+  X(Print, "print")                                                            \
+  X(Len, "len")                                                                \
+  X(Range, "range")
+
+enum class Builtin : uint8_t {
+#define X(name, str) name,
+  BUILTINS
+#undef X
+};
+
+constexpr std::string_view BUILTIN_NAMES[] = {
+#define X(name, str) str,
+    BUILTINS
+#undef X
+};
+
+/// @brief What a name refers to.
+struct Binding {
+  enum class Kind : uint8_t {
+    Unresolved,
+    /// `target` is a `Builtin`
+    Builtin,
+    /// `target` is the `VarDecl` of a variable or field, or the `For` whose
+    /// loop variable it is
+    Variable,
+    /// `target` is a `Param`, or a lambda parameter's own `Identifier`
+    Parameter,
+    /// `target` is the `FnDecl` of a function or method
+    Function,
+    /// `target` is the `ClassDecl`
+    Class,
+    /// `target` is the `EnumDecl`
+    Enum,
+  };
+
+  Kind kind = Kind::Unresolved;
+  uint32_t target = 0;
+};
+
+/// @brief The binding of every `Identifier` node, indexed by node. Any other
+/// node is left unresolved.
+struct Resolution {
+  std::vector<Binding> bindings;
+
+  const Binding &operator[](ast::NodeIndex node) const {
+    return bindings[node];
+  }
+};
+
+/// @brief Binds every name used in `tree` to its declaration and reports the
+/// ones that have none. Functions, classes and enums are visible throughout
+/// the block that declares them, so they can be used before they appear and
+/// call each other; variables are visible from their declaration onwards.
+/// Function and method bodies are resolved once the rest of their block has
+/// been, which lets them use any variable the block declares. Names are
+/// interned into `names`.
+Resolution resolve(const ast::Tree &tree, StringInterner &names,
+                   DiagnosticEngine &diagnostics);
+
+} // namespace sema
+
+#endif
@@ -0,0 +1,170 @@
+#ifndef SCOPE_H
+#define SCOPE_H
+#include "common/arena.hpp"
+#include "common/interner.hpp"
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+namespace sema {
+
+/// @brief Nested scopes mapping symbols to `T`s. Every scope lives in one
+/// arena together with its table, so popping a scope frees all of it at once
+/// by rewinding the arena. A scope keeps its first few entries inline and
+/// scans them linearly, which beats hashing for the handful of names most
+/// blocks declare; past that it switches to an open-addressing table.
+template <typename T> class ScopeStack {
+  static_assert(std::is_trivially_copyable_v<T> &&
+                    std::is_trivially_destructible_v<T>,
+                "Scope entries live in an arena and are copied bytewise");
+
+public:
+  static constexpr uint32_t INLINE_CAPACITY = 8;
+
+private:
+  struct Entry {
+    Symbol symbol;
+    T value;
+  };
+
+  struct Scope {
+    Scope *parent;
+    Arena::Mark mark;
+    /// `inline_entries` until the scope outgrows it, then a table of
+    /// `capacity` entries, a power of two
+    Entry *entries;
+    uint32_t count;
+    uint32_t capacity;
+    /// 32 less log2 of `capacity`, so a hash shifted by it is a slot
+    uint32_t shift;
+    Entry inline_entries[INLINE_CAPACITY];
+  };
+
+  Arena arena;
+  Scope *top;
+  size_t scopes;
+
+  static size_t slot_for(Symbol symbol, uint32_t shift) {
+    // Fibonacci hashing spreads the dense symbol IDs over the table. The top
+    // bits of the product are the ones every bit of the symbol reaches
+    return static_cast<uint32_t>(symbol * 0x9E3779B1u) >> shift;
+  }
+
+  static T *find(Scope *scope, Symbol symbol) {
+    if (scope->capacity == 0) {
+      for (uint32_t i = 0; i < scope->count; i++) {
+        if (scope->entries[i].symbol == symbol)
+          return &scope->entries[i].value;
+      }
+      return nullptr;
+    }
+
+    uint32_t mask = scope->capacity - 1;
+    for (size_t i = slot_for(symbol, scope->shift);; i = (i + 1) & mask) {
+      Entry &entry = scope->entries[i];
+      if (entry.symbol == symbol)
+        return &entry.value;
+      if (entry.symbol == StringInterner::NO_SYMBOL)
+        return nullptr;
+    }
+  }
+
+  static void insert(Entry *table, uint32_t capacity, uint32_t shift,
+                     const Entry &entry) {
+    uint32_t mask = capacity - 1;
+    size_t i = slot_for(entry.symbol, shift);
+    while (table[i].symbol != StringInterner::NO_SYMBOL)
+      i = (i + 1) & mask;
+    table[i] = entry;
+  }
+
+  /// @brief Moves the top scope into a table twice as large as it needs.
+  /// The old table stays behind in the arena until the scope is popped.
+  void grow() {
+    uint32_t capacity = top->capacity == 0 ? INLINE_CAPACITY * 4
+                                           : top->capacity * 2;
+    uint32_t shift = 32 - std::countr_zero(capacity);
+    auto *table = static_cast<Entry *>(
+        arena.allocate(sizeof(Entry) * capacity, alignof(Entry)));
+    for (uint32_t i = 0; i < capacity; i++)
+      table[i].symbol = StringInterner::NO_SYMBOL;
+
+    if (top->capacity == 0) {
+      for (uint32_t i = 0; i < top->count; i++)
+        insert(table, capacity, shift, top->entries[i]);
+    } else {
+      for (uint32_t i = 0; i < top->capacity; i++) {
+        if (top->entries[i].symbol != StringInterner::NO_SYMBOL)
+          insert(table, capacity, shift, top->entries[i]);
+      }
+    }
+    top->entries = table;
+    top->capacity = capacity;
+    top->shift = shift;
+  }
+
+public:
+  ScopeStack() : arena(), top(nullptr), scopes(0) {}
+
+  ScopeStack(const ScopeStack &) = delete;
+  ScopeStack &operator=(const ScopeStack &) = delete;
+
+  void push() {
+    Arena::Mark mark = arena.mark();
+    auto *scope = arena.make<Scope>();
+    scope->parent = top;
+    scope->mark = mark;
+    scope->entries = scope->inline_entries;
+    scope->count = 0;
+    scope->capacity = 0;
+    scope->shift = 32;
+    top = scope;
+    scopes++;
+  }
+
+  /// @brief Drops the innermost scope and everything declared in it.
+  void pop() {
+    Scope *scope = top;
+    top = scope->parent;
+    scopes--;
+    arena.rewind(scope->mark);
+  }
+
+  /// @brief Binds `symbol` in the innermost scope, replacing any binding it
+  /// already has there.
+  void declare(Symbol symbol, T value) {
+    if (T *existing = find(top, symbol)) {
+      *existing = value;
+      return;
+    }
+
+    if (top->capacity == 0 ? top->count == INLINE_CAPACITY
+                           : (top->count + 1) * 2 > top->capacity)
+      grow();
+
+    if (top->capacity == 0)
+      top->entries[top->count] = {symbol, value};
+    else
+      insert(top->entries, top->capacity, top->shift, {symbol, value});
+    top->count++;
+  }
+
+  /// @brief The innermost binding of `symbol`, or `nullptr`.
+  const T *lookup(Symbol symbol) const {
+    for (Scope *scope = top; scope != nullptr; scope = scope->parent) {
+      if (T *value = find(scope, symbol))
+        return value;
+    }
+    return nullptr;
+  }
+
+  /// @brief The binding of `symbol` in the innermost scope only.
+  const T *lookup_local(Symbol symbol) const { return find(top, symbol); }
+
+  size_t depth() const { return scopes; }
+};
+
+} // namespace sema
+
+#endif
@@ -0,0 +1,166 @@
+#ifndef TYPES_H
+#define TYPES_H
+#include "common/arena.hpp"
+#include "common/interner.hpp"
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <shared_mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace sema {
+
+/// @brief An interned type. Two types from the same interner are
+/// structurally equal exactly when their IDs are, so comparing and hashing
+/// types never looks past the integer.
+using TypeId = uint32_t;
+
+/// @brief Types without any structure, which have fixed IDs of their own.
+/// `Error` stands in for anything that failed to check, so that one mistake
+/// isn't reported again by every expression built on it.
+#define PRIMITIVE_TYPES                                                        \
+  X(Error, "<error>")                                                          \
+  X(Void, "void")                                                              \
+  X(Int, "int")                                                                \
+  X(Float, "float")                                                            \
+  X(Str, "str")                                                                \
+  X(Bool, "bool")
+
+enum class Primitive : uint8_t {
+#define X(name, str) name,
+  PRIMITIVE_TYPES
+#undef X
+};
+
+constexpr std::string_view PRIMITIVE_NAMES[] = {
+#define X(name, str) str,
+    PRIMITIVE_TYPES
+#undef X
+};
+
+constexpr TypeId PRIMITIVE_COUNT = std::size(PRIMITIVE_NAMES);
+
+constexpr TypeId type_of(Primitive primitive) {
+  return static_cast<TypeId>(primitive);
+}
+
+struct Type {
+  enum class Kind : uint8_t {
+    Primitive,
+    /// Nominal: `name` and `declaration` tell classes apart
+    Class,
+    Enum,
+    /// `operands` are the parameter types followed by the return type
+    Function,
+    /// `[T]`: the only operand is the element type
+    Array,
+    /// `List[int]`: `name` is the generic, `operands` its arguments
+    Generic,
+  };
+
+  Kind kind;
+  Symbol name;
+
+  /// The node that declares a class or enum, or the `Primitive`
+  uint32_t declaration;
+  std::span<const TypeId> operands;
+};
+
+/// @brief Hash-conses types, so that building a type that already exists
+/// returns the existing ID without allocating anything. Safe to use from any
+/// number of threads at once: the table is split into shards by hash, each
+/// behind a reader-writer lock, and since almost every type a checker builds
+/// already exists, lookups mostly share their shard. A type never moves once
+/// interned, so `get()` takes no lock at all.
+class TypeInterner {
+public:
+  static constexpr size_t SHARD_BITS = 4;
+  static constexpr size_t SHARD_COUNT = size_t(1) << SHARD_BITS;
+
+private:
+  /// Chunk `k` holds `FIRST_CHUNK << k` types, so a handful of pointers
+  /// covers any realistic number of types without reserving much up front
+  static constexpr size_t FIRST_CHUNK_BITS = 6;
+  static constexpr size_t FIRST_CHUNK = size_t(1) << FIRST_CHUNK_BITS;
+  static constexpr size_t MAX_CHUNKS = 20;
+
+  struct Slot {
+    uint32_t hash;
+    /// Index into the shard's types, or `EMPTY`
+    uint32_t index;
+  };
+  static constexpr uint32_t EMPTY = UINT32_MAX;
+
+  struct Shard {
+    mutable std::shared_mutex mutex;
+    /// Power of two in size and never more than half full
+    std::vector<Slot> slots;
+    /// Types live in fixed-size chunks that are never reallocated, so that
+    /// readers need no lock to follow an ID
+    std::array<std::unique_ptr<Type[]>, MAX_CHUNKS> chunks;
+    uint32_t count = 0;
+    Arena operands;
+
+    Shard();
+    /// @brief The chunk holding `index` and the position within it.
+    static std::pair<size_t, size_t> locate(uint32_t index) {
+      size_t biased = index + FIRST_CHUNK;
+      size_t top = std::bit_width(biased) - 1;
+      return {top - FIRST_CHUNK_BITS, biased - (size_t(1) << top)};
+    }
+    const Type &at(uint32_t index) const {
+      auto [chunk, offset] = locate(index);
+      return chunks[chunk][offset];
+    }
+    void grow();
+  };
+
+  std::array<Shard, SHARD_COUNT> shards;
+
+  static std::optional<uint32_t> probe(const Shard &shard, uint32_t hash,
+                                       const Type &key);
+  TypeId intern(const Type &key);
+  void append(std::string &out, TypeId type,
+              const StringInterner &names) const;
+
+public:
+  TypeInterner() = default;
+  TypeInterner(const TypeInterner &) = delete;
+  TypeInterner &operator=(const TypeInterner &) = delete;
+
+  const Type &get(TypeId type) const;
+
+  TypeId class_type(Symbol name, uint32_t declaration);
+  TypeId enum_type(Symbol name, uint32_t declaration);
+  TypeId function(std::span<const TypeId> params, TypeId result);
+  TypeId array(TypeId element);
+  TypeId generic(Symbol name, std::span<const TypeId> arguments);
+
+  /// @brief The parameters of a function type.
+  std::span<const TypeId> params(TypeId function) const {
+    auto operands = get(function).operands;
+    return operands.first(operands.size() - 1);
+  }
+  TypeId result(TypeId function) const {
+    return get(function).operands.back();
+  }
+
+  /// @brief How many types have been interned, primitives excluded.
+  size_t size() const;
+
+  /// @brief Spells a type the way it would be written in source, e.g.
+  /// `(int, str) -> [bool]`.
+  std::string to_string(TypeId type, const StringInterner &names) const;
+};
+
+} // namespace sema
+
+#endif
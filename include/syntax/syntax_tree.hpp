@@ -0,0 +1,160 @@
+#ifndef SYNTAX_TREE_H
+#define SYNTAX_TREE_H
+#include "common/diagnostic.hpp"
+#include "common/rope.hpp"
+#include "common/span.hpp"
+#include "lexer/token.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+namespace syntax {
+
+/// @brief The shapes a green node can take. Tokens are leaves; every other kind
+/// is an interior node. `Group` is a bracketed run of tokens (including the
+/// brackets), `Item` is one top-level statement or declaration.
+enum class GreenKind : uint8_t {
+  Token,
+  Group,
+  Item,
+  Root,
+};
+
+/// @brief An immutable, position independent node of the lossless syntax tree.
+/// Tokens keep their full text including the whitespace and comments before
+/// them, so concatenating every token reproduces the source exactly. Green
+/// nodes are hash-consed: structurally identical nodes are the same object, so
+/// they can be shared between trees and compared by pointer.
+struct GreenNode {
+  const GreenKind kind;
+  const Token::Kind token;
+  const uint32_t width;
+  const uint32_t trivia;
+  const std::string text;
+  const std::vector<const GreenNode *> children;
+  const size_t hash;
+
+  GreenNode(GreenKind kind, Token::Kind token, uint32_t width, uint32_t trivia,
+            std::string text, std::vector<const GreenNode *> children);
+
+  bool is_token() const { return kind == GreenKind::Token; }
+};
+
+/// @brief Owns and deduplicates green nodes.
+class GreenInterner {
+  struct Hash {
+    size_t operator()(const GreenNode *node) const { return node->hash; }
+  };
+  struct Equal {
+    bool operator()(const GreenNode *a, const GreenNode *b) const;
+  };
+
+  std::unordered_set<GreenNode *, Hash, Equal> nodes;
+  const GreenNode *intern(GreenNode *candidate);
+
+public:
+  GreenInterner();
+  ~GreenInterner();
+  GreenInterner(const GreenInterner &) = delete;
+  GreenInterner &operator=(const GreenInterner &) = delete;
+
+  /// @brief Returns the token whose full text is `text`, of which the first
+  /// `trivia` bytes are whitespace or comments.
+  const GreenNode *token(Token::Kind kind, std::string_view text,
+                         uint32_t trivia);
+  const GreenNode *node(GreenKind kind,
+                        std::vector<const GreenNode *> children);
+
+  /// @brief Frees every node that is not reachable from `root`.
+  void sweep(const GreenNode *root);
+
+  /// @brief Frees `node`, which nothing may point to anymore.
+  void release(const GreenNode *node);
+  size_t size() const;
+};
+
+/// @brief A cursor over a green node that knows its absolute position. Red
+/// nodes are created on demand while walking and are cheap to copy.
+class SyntaxNode {
+  const GreenNode *green;
+  uint32_t offset;
+
+public:
+  SyntaxNode(const GreenNode *green, uint32_t offset);
+
+  const GreenNode *get_green() const;
+  GreenKind kind() const;
+  Token::Kind token_kind() const;
+
+  /// @brief The absolute offset of the node including its leading trivia.
+  uint32_t get_offset() const;
+
+  /// @brief The node's text range without its leading trivia.
+  Span get_span(const File &file) const;
+
+  std::vector<SyntaxNode> children() const;
+
+  /// @brief Returns the token whose text or leading trivia covers `position`.
+  std::optional<SyntaxNode> token_at(uint32_t position) const;
+};
+
+/// @brief A lossless syntax tree over a rope that is edited in place. Edits
+/// that fall inside a bracketed group relex only that group and rebuild the
+/// spine above it, and edits between groups relex only the top-level item
+/// they fall in; everything else is reused by pointer.
+class SyntaxTree {
+  GreenInterner interner;
+  Rope text;
+
+  /// A contiguous copy of `text` for the lexer and the parser, which is only
+  /// made again once someone asks for it after an edit
+  mutable File file;
+  mutable bool stale;
+
+  const GreenNode *root;
+  DiagnosticEngine lexical;
+  size_t live_after_sweep;
+
+  void rebuild();
+  bool try_incremental(size_t offset, size_t removed,
+                       std::string_view inserted);
+  bool relex_item(size_t index, size_t item_offset, size_t offset,
+                  size_t removed, std::string_view inserted);
+
+  /// @brief Drops what the lexer reported in `[start, end)`, which has just
+  /// been relexed cleanly, and moves everything after it by `delta` (modulo
+  /// the width of `size_t`, so that it can shrink).
+  void shift_diagnostics(size_t start, size_t end, size_t delta);
+
+public:
+  SyntaxTree(std::string content, std::string path);
+  SyntaxTree(const SyntaxTree &) = delete;
+  SyntaxTree &operator=(const SyntaxTree &) = delete;
+
+  /// @brief The current contents as one `File`. Copies the text the first
+  /// time it is called after an edit, so a burst of edits is copied once.
+  const File &get_file() const;
+  const Rope &get_text() const;
+  SyntaxNode get_root() const;
+  const GreenNode *get_green_root() const;
+
+  /// @brief What the lexer reported for the current contents of the file.
+  const DiagnosticEngine &get_diagnostics() const;
+
+  /// @brief Replaces `removed` bytes at `offset` with `inserted`.
+  /// @return whether the edit could be applied incrementally; otherwise the
+  /// whole file was relexed (still sharing every unchanged subtree)
+  bool edit(size_t offset, size_t removed, std::string_view inserted);
+
+  /// @brief Rebuilds the token stream for the `Parser`. The tokens refer to
+  /// this tree's file and are invalidated by the next edit.
+  std::vector<Token> tokens() const;
+};
+
+} // namespace syntax
+
+#endif
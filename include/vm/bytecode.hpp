@@ -0,0 +1,251 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+#include "common/span.hpp"
+#include "vm/heap.hpp"
+#include "vm/value.hpp"
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace vm {
+
+/// @brief Every instruction is 32 bits: an 8-bit opcode in the low byte and
+/// operands in one of these layouts above it. `R[n]` is a register of the
+/// running function, `K[n]` a constant of its pool and `G[n]` a global.
+/// Jump offsets count instructions from the one after the jump.
+enum class Format : uint8_t {
+  /// Three 8-bit operands
+  ABC,
+  /// An 8-bit `A` and an unsigned 16-bit `Bx`
+  ABx,
+  /// An 8-bit `A` and a signed 16-bit `sBx`
+  AsBx,
+  /// A signed 24-bit `sAx`
+  sAx,
+  /// An unsigned 24-bit `Ax`
+  Ax,
+};
+
+/// Typed instructions such as `AddInt` check their operands' tags and fall
+/// back to the generic instruction's behaviour on anything else, so they
+/// are only ever faster, never wrong. Instructions that find a member by
+/// name are followed by a `Site`, which says which inline cache is theirs.
+/// Those that find a field by slot are followed by the `Shape` the slot is
+/// for: a value that went through an untyped variable can be an instance
+/// of any class, whatever the checker says.
+#define OPCODES                                                                \
+  /* R[A] = R[B] */                                                            \
+  X(Move, ABC)                                                                 \
+  /* R[A] = K[Bx] */                                                           \
+  X(LoadK, ABx)                                                                \
+  /* R[A] = sBx */                                                             \
+  X(LoadInt, AsBx)                                                             \
+  X(LoadNil, ABC)                                                              \
+  X(LoadTrue, ABC)                                                             \
+  X(LoadFalse, ABC)                                                            \
+  /* R[A] = G[Bx] */                                                           \
+  X(GetGlobal, ABx)                                                            \
+  /* G[Bx] = R[A] */                                                           \
+  X(SetGlobal, ABx)                                                            \
+  /* R[A] = R[B] op R[C] */                                                    \
+  X(AddInt, ABC)                                                               \
+  X(SubInt, ABC)                                                               \
+  X(MulInt, ABC)                                                               \
+  X(FloorDivInt, ABC)                                                          \
+  X(ModInt, ABC)                                                               \
+  X(AddFloat, ABC)                                                             \
+  X(SubFloat, ABC)                                                             \
+  X(MulFloat, ABC)                                                             \
+  X(DivFloat, ABC)                                                             \
+  X(Add, ABC)                                                                  \
+  X(Sub, ABC)                                                                  \
+  X(Mul, ABC)                                                                  \
+  X(Div, ABC)                                                                  \
+  X(FloorDiv, ABC)                                                             \
+  X(Mod, ABC)                                                                  \
+  X(Pow, ABC)                                                                  \
+  X(BitAnd, ABC)                                                               \
+  X(BitOr, ABC)                                                                \
+  X(LtInt, ABC)                                                                \
+  X(LeInt, ABC)                                                                \
+  X(EqInt, ABC)                                                                \
+  X(NeInt, ABC)                                                                \
+  X(LtFloat, ABC)                                                              \
+  X(LeFloat, ABC)                                                              \
+  X(Lt, ABC)                                                                   \
+  X(Le, ABC)                                                                   \
+  X(Eq, ABC)                                                                   \
+  X(Ne, ABC)                                                                   \
+  /* R[A] = R[B] + C, with C read as a signed byte */                          \
+  X(AddIntImm, ABC)                                                            \
+  /* R[A] = op R[B] */                                                         \
+  X(Neg, ABC)                                                                  \
+  X(Not, ABC)                                                                  \
+  X(ToInt, ABC)                                                                \
+  X(ToFloat, ABC)                                                              \
+  X(ToStr, ABC)                                                                \
+  X(ToBool, ABC)                                                               \
+  X(Len, ABC)                                                                  \
+  X(Jump, sAx)                                                                 \
+  X(JumpIfFalse, AsBx)                                                         \
+  X(JumpIfTrue, AsBx)                                                          \
+  /* R[A], R[A + 1] and R[A + 2] are a range's start, end and step. Jumps if  \
+     the range is empty, else starts the loop variable R[A + 3] */             \
+  X(ForPrep, AsBx)                                                             \
+  /* Steps R[A]; jumps back and updates R[A + 3] unless the range is done */   \
+  X(ForLoop, AsBx)                                                             \
+  /* R[A] is an array or string and R[A + 1] a position in it. Jumps if the   \
+     position is past the end, else loads R[A + 2] and moves on */             \
+  X(IterNext, AsBx)                                                            \
+  /* Calls R[A] with the B arguments after it; the result replaces R[A] */     \
+  X(Call, ABC)                                                                 \
+  X(Return, ABC)                                                               \
+  X(ReturnNil, ABC)                                                            \
+  /* R[A] = [R[B], ..., R[B + C - 1]] */                                       \
+  X(NewArray, ABC)                                                             \
+  /* Appends R[B], ..., R[B + C - 1] to R[A] */                                \
+  X(Push, ABC)                                                                 \
+  /* R[A] = range(R[B], ..., R[B + C - 1]) */                                  \
+  X(Range, ABC)                                                                \
+  /* R[A] = R[B][R[C]] */                                                      \
+  X(GetIndex, ABC)                                                             \
+  /* R[A][R[B]] = R[C] */                                                      \
+  X(SetIndex, ABC)                                                             \
+  /* R[A] = a new instance of class Bx */                                      \
+  X(New, ABx)                                                                  \
+  /* R[A] = R[B].fields[C], followed by a `Shape` */                          \
+  X(GetField, ABC)                                                             \
+  /* R[A].fields[B] = R[C], followed by a `Shape` */                          \
+  X(SetField, ABC)                                                             \
+  /* R[A] = the field of R[B] named K[C] */                                    \
+  X(GetFieldNamed, ABC)                                                        \
+  /* The field of R[A] named K[B] = R[C] */                                    \
+  X(SetFieldNamed, ABC)                                                        \
+  /* R[A] = the method of R[B] named K[C], R[A + 1] = R[B] */                  \
+  X(SelfMethod, ABC)                                                           \
+  /* Not run: cache Ax belongs to the instruction before, which skips this */  \
+  X(Site, Ax)                                                                  \
+  /* Not run: the instruction before picked its slot for instances of shape   \
+     Ax, and finds the field by name in any other */                          \
+  X(Shape, Ax)                                                                 \
+  /* Prints R[A], ..., R[A + B - 1] on one line */                             \
+  X(Print, ABC)
+
+enum class Op : uint8_t {
+#define X(name, format) name,
+  OPCODES
+#undef X
+};
+
+constexpr std::string_view OP_NAMES[] = {
+#define X(name, format) #name,
+    OPCODES
+#undef X
+};
+
+constexpr Format OP_FORMATS[] = {
+#define X(name, format) Format::format,
+    OPCODES
+#undef X
+};
+
+constexpr size_t OP_COUNT = std::size(OP_NAMES);
+
+using Instruction = uint32_t;
+
+constexpr int32_t SBX_BIAS = 0x7FFF;
+constexpr int32_t SAX_BIAS = 0x7FFFFF;
+
+constexpr Instruction encode(Op op, uint8_t a, uint8_t b, uint8_t c) {
+  return static_cast<uint32_t>(op) | uint32_t(a) << 8 | uint32_t(b) << 16 |
+         uint32_t(c) << 24;
+}
+constexpr Instruction encode_bx(Op op, uint8_t a, uint16_t bx) {
+  return static_cast<uint32_t>(op) | uint32_t(a) << 8 | uint32_t(bx) << 16;
+}
+constexpr Instruction encode_sbx(Op op, uint8_t a, int32_t sbx) {
+  return encode_bx(op, a, static_cast<uint16_t>(sbx + SBX_BIAS));
+}
+constexpr Instruction encode_sax(Op op, int32_t sax) {
+  return static_cast<uint32_t>(op) | uint32_t(sax + SAX_BIAS) << 8;
+}
+constexpr Instruction encode_ax(Op op, uint32_t ax) {
+  return static_cast<uint32_t>(op) | ax << 8;
+}
+
+constexpr Op op_of(Instruction i) { return static_cast<Op>(i & 0xFF); }
+constexpr uint8_t a_of(Instruction i) { return (i >> 8) & 0xFF; }
+constexpr uint8_t b_of(Instruction i) { return (i >> 16) & 0xFF; }
+constexpr uint8_t c_of(Instruction i) { return i >> 24; }
+constexpr uint16_t bx_of(Instruction i) { return i >> 16; }
+constexpr int32_t sbx_of(Instruction i) { return int32_t(i >> 16) - SBX_BIAS; }
+constexpr int32_t sax_of(Instruction i) { return int32_t(i >> 8) - SAX_BIAS; }
+constexpr uint32_t ax_of(Instruction i) { return i >> 8; }
+
+/// Sites past this many can't be told apart in an `Ax`
+constexpr uint32_t MAX_SITES = uint32_t(1) << 24;
+
+struct Function {
+  std::string name;
+  /// Arguments arrive in the first `arity` registers; a method's receiver
+  /// is the first of them
+  uint8_t arity = 0;
+  uint8_t registers = 0;
+  std::vector<Instruction> code;
+  std::vector<Value> constants;
+  /// The source each instruction was compiled from, for runtime errors
+  std::vector<uint32_t> offsets;
+  std::vector<uint32_t> lengths;
+};
+
+/// @brief The layout of instances: a field's slot is its position in
+/// `fields`. Classes with the same fields share a shape, so a cache that
+/// has learned where a field is for one class knows it for all of them.
+struct Shape {
+  std::vector<std::string> fields;
+
+  /// @brief The slot of the field called `name`, if there is one.
+  std::optional<uint32_t> slot(std::string_view name) const {
+    for (size_t i = 0; i < fields.size(); i++) {
+      if (fields[i] == name)
+        return static_cast<uint32_t>(i);
+    }
+    return std::nullopt;
+  }
+};
+
+struct Class {
+  std::string name;
+  /// Index into the program's shapes
+  uint32_t shape = 0;
+  /// Method names and the functions they are
+  std::vector<std::pair<std::string, uint32_t>> methods;
+  /// Sets the fields that have initializers, if any do
+  std::optional<uint32_t> initializer;
+};
+
+/// @brief A compiled file. Running it runs `functions[0]`, the top level.
+struct Program {
+  const File *file = nullptr;
+  std::vector<Function> functions;
+  std::vector<Class> classes;
+  std::vector<Shape> shapes;
+  uint32_t globals = 0;
+  /// How many `Site`s there are, each with an inline cache of its own
+  uint32_t sites = 0;
+  /// Owns the strings and boxed ints in the constant pools
+  Heap heap{Heap::Lifetime::Permanent};
+};
+
+/// @brief Lists every function's instructions, one per line, for debugging
+/// and for tests.
+std::string disassemble(const Program &program);
+
+} // namespace vm
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef COMPILER_H
+#define COMPILER_H
+#include "common/diagnostic.hpp"
+#include "parser/ast.hpp"
+#include "sema/checker.hpp"
+#include "sema/folder.hpp"
+#include "sema/resolver.hpp"
+#include "sema/types.hpp"
+#include "vm/bytecode.hpp"
+#include <memory>
+
+namespace vm {
+
+/// @brief Compiles a file that passed every check into bytecode. Operators
+/// whose operand types are known compile to typed instructions, folded
+/// expressions to their constants, and variables to registers unless they
+/// are declared at the top level, which makes them globals. Reports what
+/// the machine can't run yet, such as a function using the variables of the
+/// function around it, and returns nothing if there was any.
+std::unique_ptr<Program> compile(const ast::Tree &tree,
+                                 const sema::Resolution &resolution,
+                                 const sema::Typing &typing,
+                                 const sema::Folding &folding,
+                                 const sema::TypeInterner &types,
+                                 DiagnosticEngine &diagnostics);
+
+} // namespace vm
+
+#endif
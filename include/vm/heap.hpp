@@ -0,0 +1,192 @@
+#ifndef HEAP_H
+#define HEAP_H
+#include "vm/value.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <span>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace vm {
+
+/// @brief A collection a heap wants to run, or is asked to.
+enum class Collection : uint8_t {
+  None,
+  /// Empties the nursery
+  Minor,
+  /// A minor collection, then a sweep of the old generation
+  Major,
+};
+
+/// @brief Owns every object created through it, and frees the ones nothing
+/// refers to any more a generation at a time.
+///
+/// New objects are bump-allocated in a nursery. A minor collection copies
+/// the ones still reachable into the old generation, after which the whole
+/// nursery is free again, so an object that dies young costs nothing to
+/// free. The old generation is made of blocks that a major collection marks
+/// and sweeps, and whose holes later promotions are bump-allocated into.
+///
+/// A minor collection finds the old objects that refer to young ones
+/// through a card table rather than by looking at every old object: a store
+/// into an object goes through `write()`, which marks the card the object
+/// starts on when it has just been given a young value.
+///
+/// Objects only ever move in `collect()`, which the heap never calls
+/// itself: its owner does, when `pending()` says a collection is due and
+/// every value it holds is among the roots it can hand over. Until then a
+/// full nursery sends new objects straight to the old generation.
+class Heap {
+public:
+  static constexpr size_t NURSERY_SIZE = size_t(2) << 20;
+  static constexpr size_t BLOCK_SIZE = size_t(256) << 10;
+  static constexpr size_t CARD_SIZE = 512;
+  /// Objects larger than this get an old block of their own
+  static constexpr size_t LARGE_OBJECT = BLOCK_SIZE / 4;
+  /// The old generation is collected once it holds twice what survived the
+  /// last major collection, and never below this
+  static constexpr size_t MIN_MAJOR = size_t(8) << 20;
+
+  /// @brief How long a heap's objects live.
+  enum class Lifetime : uint8_t {
+    /// Until nothing refers to them
+    Collected,
+    /// As long as the heap, which never collects
+    Permanent,
+  };
+
+  /// @brief What the heap has done so far. Times are in nanoseconds; an
+  /// array's bytes include its elements, counted when it is promoted or
+  /// found alive.
+  struct Statistics {
+    uint64_t objects = 0;
+    uint64_t allocated = 0;
+    /// Copied out of the nursery by minor collections
+    uint64_t promoted = 0;
+    /// Found dead in the old generation by major collections
+    uint64_t freed = 0;
+    uint64_t minor_collections = 0;
+    uint64_t major_collections = 0;
+    uint64_t minor_pause = 0;
+    uint64_t major_pause = 0;
+    uint64_t longest_pause = 0;
+  };
+
+private:
+  /// @brief The header of an old block, which is `BLOCK_SIZE` aligned so
+  /// that any object in it finds its card. A large object's block is the
+  /// object's size rounded up, and only ever holds that object.
+  struct Block {
+    size_t size;
+    /// Whether any of `cards` is marked
+    bool dirty;
+    bool cards[BLOCK_SIZE / CARD_SIZE];
+  };
+
+  /// Where the objects of a block start
+  static constexpr size_t BLOCK_HEADER = (sizeof(Block) + 15) & ~size_t(15);
+
+  Lifetime lifetime;
+  char *nursery = nullptr;
+  char *top = nullptr;
+  char *limit = nullptr;
+  /// The arrays allocated in the nursery, whose elements are freed when
+  /// they die there, and how many bytes of elements they had
+  std::vector<Array *> young_arrays;
+  size_t young_elements = 0;
+
+  std::vector<Block *> blocks;
+  /// The free space that old objects are being bump-allocated into
+  char *cursor = nullptr;
+  char *hole_end = nullptr;
+  /// Free space the last sweep found, for when the current hole is full
+  std::vector<std::pair<char *, char *>> holes;
+  /// Bytes in the old generation, and how many trigger a major collection
+  size_t old_size = 0;
+  size_t next_major = MIN_MAJOR;
+
+  Collection wanted = Collection::None;
+  /// Objects that were reached but whose values haven't been looked at yet
+  std::vector<Object *> gray;
+  Statistics stats;
+
+  bool is_young(const Object *object) const {
+    return reinterpret_cast<uintptr_t>(object) -
+               reinterpret_cast<uintptr_t>(nursery) <
+           NURSERY_SIZE;
+  }
+
+  void *allocate(size_t size, Object::Space &space) {
+    if (size <= static_cast<size_t>(limit - top)) [[likely]] {
+      void *at = top;
+      top += size;
+      space = Object::Space::Young;
+      return at;
+    }
+    return allocate_slow(size, space);
+  }
+
+  template <typename T, typename... Args>
+  T *make(size_t size, Args &&...args) {
+    Object::Space space;
+    T *object = new (allocate(size, space)) T(std::forward<Args>(args)...);
+    object->space = space;
+    object->size = static_cast<uint32_t>(size);
+    stats.objects++;
+    stats.allocated += size;
+    return object;
+  }
+
+  void *allocate_slow(size_t size, Object::Space &space);
+  void *allocate_old(size_t size);
+  void *allocate_large(size_t size);
+  void remember(Object *holder);
+
+  void minor(std::initializer_list<std::span<Value>> roots);
+  void major(std::initializer_list<std::span<Value>> roots);
+  void evacuate(Value &value);
+  void mark(Value value);
+  void sweep();
+
+public:
+  explicit Heap(Lifetime lifetime = Lifetime::Collected);
+  ~Heap();
+
+  Heap(const Heap &) = delete;
+  Heap &operator=(const Heap &) = delete;
+
+  /// @brief An int as a value, boxed only if it doesn't fit inline.
+  Value integer(int64_t value) {
+    if (Value::fits(value))
+      return Value::small(value);
+    return Value::object(make<Integer>(sizeof(Integer), value));
+  }
+  /// @brief A new string of `first` followed by `second`.
+  String *string(std::string_view first, std::string_view second = {});
+  Array *array(std::vector<Value> elements);
+  Instance *instance(uint32_t klass, uint32_t shape, uint32_t fields);
+
+  /// @brief Must follow every store of `value` into `holder`.
+  void write(Object *holder, Value value) {
+    if (value.is_object() && is_young(value.as_object()) && !is_young(holder))
+        [[unlikely]]
+      remember(holder);
+  }
+
+  /// @brief The collection due, if any.
+  Collection pending() const { return wanted; }
+
+  /// @brief Runs `collection`. Every value that refers to an object of the
+  /// heap and isn't in an object itself has to be in `roots`, which are
+  /// updated to where the objects moved.
+  void collect(Collection collection,
+               std::initializer_list<std::span<Value>> roots);
+
+  const Statistics &statistics() const { return stats; }
+};
+
+} // namespace vm
+
+#endif
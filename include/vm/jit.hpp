@@ -0,0 +1,66 @@
+#ifndef JIT_H
+#define JIT_H
+#include "vm/bytecode.hpp"
+#include "vm/value.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+/// A baseline compiler from bytecode to x86-64, for Linux. Elsewhere
+/// `translate()` always gives up and every function stays interpreted.
+namespace vm::jit {
+
+#if defined(__x86_64__) && defined(__linux__)
+constexpr bool SUPPORTED = true;
+#else
+constexpr bool SUPPORTED = false;
+#endif
+
+/// How many times the interpreter reaches a point where it could enter a
+/// function's native code, such as a call or a loop's backward branch,
+/// before the function is translated
+constexpr uint32_t THRESHOLD = 1000;
+
+/// @brief A function translated to native code, one template per
+/// instruction, stitched together in executable memory of its own.
+///
+/// Every template reads its operands from the function's registers in
+/// memory and writes its result back there, so the code can be entered at
+/// any instruction and left after any of them without translating state.
+/// It leaves at an instruction it has no template for, such as a call, or
+/// whose operands aren't what the template expects, such as an `AddInt` of
+/// a boxed int, and says which one; the interpreter runs that instruction
+/// and goes on from there.
+///
+/// Templates never allocate, so no collection can become due while native
+/// code runs, and objects never move under it.
+class Code {
+  void *memory;
+  size_t size;
+  /// Where each instruction's template starts
+  std::vector<uint32_t> offsets;
+
+  Code(void *memory, size_t size, std::vector<uint32_t> offsets)
+      : memory(memory), size(size), offsets(std::move(offsets)) {}
+
+public:
+  ~Code();
+
+  Code(const Code &) = delete;
+  Code &operator=(const Code &) = delete;
+
+  /// @brief Translates `function`, or returns nothing if this platform has
+  /// no JIT or executable memory can't be had.
+  static std::unique_ptr<Code> translate(const Function &function);
+
+  /// @brief Runs from instruction `at` with the registers at `base`, and
+  /// returns the instruction the interpreter has to go on from.
+  uint32_t run(Value *base, const Value *constants, Value *globals,
+               uint32_t at) const;
+};
+
+} // namespace vm::jit
+
+#endif
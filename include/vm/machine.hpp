@@ -0,0 +1,179 @@
+#ifndef MACHINE_H
+#define MACHINE_H
+#include "common/diagnostic.hpp"
+#include "vm/bytecode.hpp"
+#include "vm/heap.hpp"
+#include "vm/jit.hpp"
+#include "vm/value.hpp"
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace vm {
+
+/// @brief The inline cache of one `Site`: for the last few shapes a field
+/// was looked up on, the slot it was in, or for the last few classes a
+/// method was, the function it was. A site that sees one kind of object is
+/// monomorphic and hits on the first compare; one that sees up to `WAYS`
+/// is polymorphic. Past that it is megamorphic, stops learning, and looks
+/// members up in a table that all megamorphic sites share.
+struct Cache {
+  static constexpr size_t WAYS = 4;
+
+  enum class State : uint8_t { Empty, Monomorphic, Polymorphic, Megamorphic };
+
+  State state = State::Empty;
+  uint8_t size = 0;
+  uint32_t keys[WAYS] = {};
+  uint32_t values[WAYS] = {};
+
+  /// @brief What the site learned about `key`, if anything.
+  const uint32_t *find(uint32_t key) const {
+    for (uint8_t i = 0; i < size; i++) {
+      if (keys[i] == key)
+        return &values[i];
+    }
+    return nullptr;
+  }
+
+  /// @brief Remembers `value` for `key`, or returns false if the site has
+  /// seen too many keys to.
+  bool learn(uint32_t key, uint32_t value) {
+    if (state == State::Megamorphic)
+      return false;
+    if (size == WAYS) {
+      state = State::Megamorphic;
+      size = 0;
+      return false;
+    }
+    keys[size] = key;
+    values[size] = value;
+    size++;
+    state = size == 1 ? State::Monomorphic : State::Polymorphic;
+    return true;
+  }
+};
+
+/// @brief Runs a compiled program. Every call's registers are a window onto
+/// one shared stack that starts right after the callee, so arguments are
+/// passed without copying and results come back in the callee's register.
+class Machine {
+public:
+  using Write = std::function<void(std::string_view)>;
+
+  static constexpr size_t STACK_SIZE = size_t(1) << 18;
+  static constexpr size_t MAX_DEPTH = 10000;
+  /// Output is handed to `write` in chunks of about this many bytes
+  static constexpr size_t OUTPUT_CHUNK = size_t(1) << 16;
+  /// Entries in the table megamorphic sites share
+  static constexpr size_t MEGAMORPHIC_SIZE = 1024;
+
+private:
+  struct Frame {
+    const Function *function;
+    const Instruction *pc;
+    Value *base;
+  };
+
+  /// @brief A member found by a megamorphic site. `key` is a shape, or a
+  /// class with `method` set, and `name` the constant it was looked up by.
+  struct Member {
+    const Object *name = nullptr;
+    uint32_t key = 0;
+    bool method = false;
+    uint32_t value = 0;
+  };
+
+  const Program &program;
+  Write write;
+  Heap heap;
+  std::vector<Value> stack;
+  std::vector<Value> globals;
+  /// The callers of the running function
+  std::vector<Frame> frames;
+  /// One per `Site` in the program
+  std::vector<Cache> caches;
+  std::array<Member, MEGAMORPHIC_SIZE> megamorphic;
+  /// Zero unless hot functions are translated to native code
+  uint32_t threshold = 0;
+  /// Per function: how often it could have been entered as native code so
+  /// far, and what it was translated to once that reached `threshold`
+  std::vector<uint32_t> heat;
+  std::vector<std::unique_ptr<jit::Code>> natives;
+  std::string output;
+
+  /// What went wrong, set by whatever returned false
+  std::string error;
+
+  /// @brief Runs until the top level returns or an instruction fails, in
+  /// which case `at` and `next` are left just past it.
+  bool execute(const Function *&at, const Instruction *&next);
+
+  bool fail(std::string message);
+  /// @brief Runs `function`'s native code from instruction `at`, if it has
+  /// any by now, and returns the instruction to go on interpreting from.
+  uint32_t enter(const Function *function, Value *base, uint32_t at);
+  /// @brief Runs the collection the heap wants, with every register up to
+  /// `end` and every global as roots.
+  void collect(Value *end);
+  void format(std::string &out, Value value, bool nested) const;
+  /// @brief `format()` for anything but an array.
+  void format_flat(std::string &out, Value value, bool nested) const;
+  std::string describe(Value value) const;
+  static bool truthy(Value value);
+  static bool equal(Value a, Value b);
+  /// @brief `equal()` for anything but two arrays.
+  static bool equal_flat(Value a, Value b);
+
+  bool arithmetic(Op op, Value &out, Value a, Value b);
+  bool compare(Op op, Value &out, Value a, Value b);
+  bool negate(Value &out, Value value);
+  bool invert(Value &out, Value value);
+  bool convert(Op op, Value &out, Value value);
+  bool length(Value &out, Value value);
+  bool range(Value &out, const Value *bounds, size_t count);
+  bool get_index(Value &out, Value object, Value position);
+  bool set_index(Value object, Value position, Value value);
+  Instance *instance(Value object, std::string_view wanted);
+  Value *field_of(Value object, uint32_t shape, uint32_t slot);
+  std::optional<uint32_t> resolve(Cache &cache, uint32_t key, bool method,
+                                  Value name);
+  bool get_named(Value &out, Value object, Value name, Cache &cache);
+  bool set_named(Value object, Value name, Value value, Cache &cache);
+  bool method(Value &out, Value object, Value name, Cache &cache);
+  void print(const Value *values, size_t count);
+  void flush();
+
+public:
+  Machine(const Program &program, Write write);
+
+  Machine(const Machine &) = delete;
+  Machine &operator=(const Machine &) = delete;
+
+  /// @brief Runs the top level to its end. Stops at the first runtime
+  /// error, which is reported at the code it happened in, and returns
+  /// false. Whatever was printed before it is written either way.
+  bool run(DiagnosticEngine &diagnostics);
+
+  /// @brief Has `run()` translate a function to native code once the
+  /// interpreter has called it, returned to it or branched back in it
+  /// `threshold` times. Functions stay interpreted where there is no JIT.
+  void enable_jit(uint32_t threshold = jit::THRESHOLD);
+  /// @brief How many functions the last run translated.
+  size_t translated() const;
+
+  /// @brief The objects the program has created so far.
+  const Heap &objects() const { return heap; }
+
+  /// @brief What each `Site` has learned, indexed by its `Ax`.
+  const std::vector<Cache> &sites() const { return caches; }
+};
+
+} // namespace vm
+
+#endif
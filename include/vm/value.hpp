@@ -0,0 +1,232 @@
+#ifndef VALUE_H
+#define VALUE_H
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace vm {
+
+struct Object;
+
+/// @brief Anything a register, a global or a field can hold, in one 64-bit
+/// word. A float is stored as itself. Every other kind of value hides in
+/// the negative quiet NaNs that no arithmetic produces: the top 16 bits tag
+/// it and the low 48 bits are its payload. Any NaN that would collide with
+/// a tag is stored as the one canonical NaN instead.
+///
+/// Ints that fit in 48 bits are stored inline and need no allocation;
+/// larger ones are boxed on the heap, which `Heap::integer()` decides.
+/// `is_int()` and `as_int()` cover both, and the interpreter's fast paths
+/// only look for the inline kind.
+class Value {
+  uint64_t bits;
+
+  static constexpr uint64_t TAG_MASK = 0xFFFF'0000'0000'0000;
+  static constexpr uint64_t PAYLOAD_MASK = 0x0000'FFFF'FFFF'FFFF;
+  static constexpr uint64_t NIL_TAG = 0xFFF9'0000'0000'0000;
+  static constexpr uint64_t BOOL_TAG = 0xFFFA'0000'0000'0000;
+  static constexpr uint64_t INT_TAG = 0xFFFB'0000'0000'0000;
+  static constexpr uint64_t FUNCTION_TAG = 0xFFFC'0000'0000'0000;
+  static constexpr uint64_t OBJECT_TAG = 0xFFFD'0000'0000'0000;
+  static constexpr uint64_t CANONICAL_NAN = 0x7FF8'0000'0000'0000;
+
+  constexpr explicit Value(uint64_t bits) : bits(bits) {}
+
+public:
+  enum class Kind : uint8_t { Nil, Bool, Int, Float, Function, Object };
+
+  /// The ints stored inline
+  static constexpr int64_t SMALL_MIN = -(int64_t(1) << 47);
+  static constexpr int64_t SMALL_MAX = (int64_t(1) << 47) - 1;
+
+  static constexpr bool fits(int64_t value) {
+    return value >= SMALL_MIN && value <= SMALL_MAX;
+  }
+
+  constexpr Value() : bits(NIL_TAG) {}
+
+  static constexpr Value boolean(bool value) {
+    return Value(BOOL_TAG | uint64_t(value));
+  }
+  /// @brief An inline int; `value` must `fits()`.
+  static constexpr Value small(int64_t value) {
+    return Value(INT_TAG | (static_cast<uint64_t>(value) & PAYLOAD_MASK));
+  }
+  static constexpr Value real(double value) {
+    uint64_t bits = std::bit_cast<uint64_t>(value);
+    return Value(bits >= NIL_TAG ? CANONICAL_NAN : bits);
+  }
+  /// @brief The function at `index` in the program.
+  static constexpr Value function(uint32_t index) {
+    return Value(FUNCTION_TAG | index);
+  }
+  static Value object(Object *object) {
+    return Value(OBJECT_TAG | reinterpret_cast<uintptr_t>(object));
+  }
+
+  /// @brief What the value is; a boxed int is an `Int`, not an `Object`.
+  Kind kind() const;
+  bool is_nil() const { return bits == NIL_TAG; }
+  bool is_bool() const { return (bits & TAG_MASK) == BOOL_TAG; }
+  bool is_small_int() const { return (bits & TAG_MASK) == INT_TAG; }
+  bool is_int() const;
+  bool is_float() const { return bits < NIL_TAG; }
+  bool is_number() const { return is_float() || is_int(); }
+  bool is_function() const { return (bits & TAG_MASK) == FUNCTION_TAG; }
+  /// @brief Whether the value points at the heap, boxed ints included.
+  bool is_object() const { return (bits & TAG_MASK) == OBJECT_TAG; }
+
+  bool as_bool() const { return bits & 1; }
+  /// @brief Sign-extends the payload of an inline int.
+  int64_t as_small_int() const {
+    return static_cast<int64_t>(bits << 16) >> 16;
+  }
+  int64_t as_int() const;
+  double as_float() const { return std::bit_cast<double>(bits); }
+  uint32_t as_function() const { return static_cast<uint32_t>(bits); }
+  Object *as_object() const {
+    return reinterpret_cast<Object *>(bits & PAYLOAD_MASK);
+  }
+
+  /// @brief An int or a float as a float.
+  double as_number() const {
+    return is_float() ? as_float() : static_cast<double>(as_int());
+  }
+
+  /// @brief The word itself, for code that works on values without
+  /// decoding them.
+  constexpr uint64_t raw() const { return bits; }
+};
+
+static_assert(sizeof(Value) == 8);
+static_assert(sizeof(void *) == 8, "object pointers must fit in a payload");
+
+/// @brief The header every object on a heap starts with. Objects are laid
+/// out back to back, so `size` is what gets from one to the next.
+struct Object {
+  enum class Kind : uint8_t { Integer, String, Array, Instance };
+
+  /// @brief Where an object is, which decides what a collection does with
+  /// it.
+  enum class Space : uint8_t {
+    /// In the nursery, until the next minor collection
+    Young,
+    /// In the old generation, until a major collection finds it dead
+    Old,
+    /// Alive as long as its heap, such as a program's constants
+    Permanent,
+    /// Copied out of the nursery; the copy's address follows the header
+    Forwarded,
+    /// Not an object, but unused space in an old block
+    Free,
+  };
+
+  Kind kind;
+  Space space = Space::Young;
+  /// Set on the objects a major collection has reached
+  bool marked = false;
+  /// Bytes the object takes up, header included
+  uint32_t size = 0;
+
+  explicit Object(Kind kind) : kind(kind) {}
+};
+
+/// @brief An int too large to be stored inline.
+struct Integer : Object {
+  int64_t value;
+
+  explicit Integer(int64_t value) : Object(Kind::Integer), value(value) {}
+};
+
+/// @brief Strings are immutable, so their characters are stored right
+/// after the object rather than in a buffer of their own.
+struct String : Object {
+  uint32_t length;
+
+  explicit String(uint32_t length) : Object(Kind::String), length(length) {}
+
+  char *data() { return reinterpret_cast<char *>(this) + sizeof(String); }
+  std::string_view text() const {
+    return {reinterpret_cast<const char *>(this) + sizeof(String), length};
+  }
+};
+
+/// @brief The only object that owns memory off the heap, since arrays grow.
+struct Array : Object {
+  std::vector<Value> elements;
+
+  explicit Array(std::vector<Value> elements)
+      : Object(Kind::Array), elements(std::move(elements)) {}
+};
+
+/// @brief A class's fields are fixed, so they are stored right after the
+/// object, in the slots its shape gives them.
+struct Instance : Object {
+  /// Indices into the program's classes and shapes
+  uint32_t klass;
+  uint32_t shape;
+
+  Instance(uint32_t klass, uint32_t shape, uint32_t count)
+      : Object(Kind::Instance), klass(klass), shape(shape) {
+    for (uint32_t i = 0; i < count; i++)
+      new (fields() + i) Value();
+  }
+
+  Value *fields() {
+    return reinterpret_cast<Value *>(reinterpret_cast<char *>(this) +
+                                     sizeof(Instance));
+  }
+  uint32_t count() const {
+    return static_cast<uint32_t>((size - sizeof(Instance)) / sizeof(Value));
+  }
+};
+
+static_assert(sizeof(Object) == 8 && sizeof(Integer) == 16);
+static_assert(sizeof(Instance) % alignof(Value) == 0);
+
+inline Value::Kind Value::kind() const {
+  switch (bits & TAG_MASK) {
+  case NIL_TAG:
+    return Kind::Nil;
+  case BOOL_TAG:
+    return Kind::Bool;
+  case INT_TAG:
+    return Kind::Int;
+  case FUNCTION_TAG:
+    return Kind::Function;
+  case OBJECT_TAG:
+    return as_object()->kind == Object::Kind::Integer ? Kind::Int
+                                                      : Kind::Object;
+  default:
+    return Kind::Float;
+  }
+}
+
+inline bool Value::is_int() const {
+  return is_small_int() ||
+         (is_object() && as_object()->kind == Object::Kind::Integer);
+}
+
+inline int64_t Value::as_int() const {
+  return is_small_int() ? as_small_int()
+                        : static_cast<Integer *>(as_object())->value;
+}
+
+inline bool is_string(Value value) {
+  return value.is_object() && value.as_object()->kind == Object::Kind::String;
+}
+inline bool is_array(Value value) {
+  return value.is_object() && value.as_object()->kind == Object::Kind::Array;
+}
+inline bool is_instance(Value value) {
+  return value.is_object() &&
+         value.as_object()->kind == Object::Kind::Instance;
+}
+
+} // namespace vm
+
+#endif
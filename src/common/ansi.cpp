@@ -1,4 +1,5 @@
 #include "common/ansi.hpp"
+#include <charconv>
 
 bool console::IS_COLOR_CAPABLE = false;
 
@@ -29,19 +30,39 @@ void console::initialize_console_attributes() {
 }
 #endif
 
-std::string console::colorize(const std::string &input, const char *color) {
-  using namespace console;
+console::StyledWriter::StyledWriter(std::string &out)
+    : StyledWriter(out, IS_COLOR_CAPABLE) {}
 
-  // Early return the input if the terminal isn't color capable
-  if (!IS_COLOR_CAPABLE)
-    return std::string(input);
+console::StyledWriter::StyledWriter(std::string &out, bool colored)
+    : out(out), colored(colored), current(Style::Plain) {}
 
-  // Append data to the resulting string
-  std::string result = ESC;
-  result += color;
-  result += input;
-  result += ESC;
-  result += RESET;
+void console::StyledWriter::set_style(Style style) {
+  if (!colored || style == current)
+    return;
+
+  out += get_style_sequence(style);
+  current = style;
+}
+
+void console::StyledWriter::write(std::string_view text) { out += text; }
+
+void console::StyledWriter::write(Style style, std::string_view text) {
+  set_style(style);
+  out += text;
+}
+
+void console::StyledWriter::write(char c) { out += c; }
+
+void console::StyledWriter::write_repeated(char c, size_t count) {
+  out.append(count, c);
+}
+
+void console::StyledWriter::write_number(size_t n) {
+  char buffer[24];
+  auto [end, ec] = std::to_chars(buffer, buffer + sizeof(buffer), n);
+  out.append(buffer, end);
+}
+
+void console::StyledWriter::reset() { set_style(Style::Plain); }
 
-  return result;
-}
\ No newline at end of file
+bool console::StyledWriter::is_colored() const { return colored; }
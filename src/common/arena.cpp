@@ -0,0 +1,88 @@
+#include "common/arena.hpp"
+#include "common/profile.hpp"
+#include <algorithm>
+
+Arena::Arena()
+    : blocks(), current(0), cursor(nullptr), limit(nullptr), used(0) {}
+
+Arena::Arena(Arena &&other) noexcept
+    : blocks(std::move(other.blocks)), current(other.current),
+      cursor(other.cursor), limit(other.limit), used(other.used) {
+  other.current = 0;
+  other.cursor = nullptr;
+  other.limit = nullptr;
+  other.used = 0;
+}
+
+Arena &Arena::operator=(Arena &&other) noexcept {
+  if (this == &other)
+    return *this;
+
+  blocks = std::move(other.blocks);
+  current = other.current;
+  cursor = other.cursor;
+  limit = other.limit;
+  used = other.used;
+  other.current = 0;
+  other.cursor = nullptr;
+  other.limit = nullptr;
+  other.used = 0;
+  return *this;
+}
+
+void Arena::grow(size_t minimum) {
+  // Move on to a spare block if one is big enough
+  for (size_t next = cursor == nullptr ? 0 : current + 1; next < blocks.size();
+       next++) {
+    if (blocks[next].size >= minimum) {
+      current = next;
+      cursor = blocks[next].memory.get();
+      limit = cursor + blocks[next].size;
+      return;
+    }
+  }
+
+  // Blocks double in size so that large files need few of them
+  size_t size = blocks.empty() ? DEFAULT_BLOCK_SIZE : blocks.back().size * 2;
+  size = std::max(size, minimum);
+
+  // Not `make_unique`, which would zero the whole block up front
+  blocks.push_back({std::unique_ptr<std::byte[]>(new std::byte[size]), size});
+  profile::record_allocation(size);
+  current = blocks.size() - 1;
+  cursor = blocks.back().memory.get();
+  limit = cursor + size;
+}
+
+void Arena::reset() {
+  if (blocks.empty())
+    return;
+
+  auto largest = std::max_element(
+      blocks.begin(), blocks.end(),
+      [](const Block &a, const Block &b) { return a.size < b.size; });
+  Block keep = std::move(*largest);
+  blocks.clear();
+  blocks.push_back(std::move(keep));
+
+  current = 0;
+  cursor = blocks.back().memory.get();
+  limit = cursor + blocks.back().size;
+  used = 0;
+}
+
+void Arena::rewind(const Mark &mark) {
+  used = mark.used;
+  if (mark.cursor == nullptr) {
+    current = 0;
+    cursor = nullptr;
+    limit = nullptr;
+    return;
+  }
+
+  current = mark.block;
+  cursor = mark.cursor;
+  limit = blocks[current].memory.get() + blocks[current].size;
+}
+
+size_t Arena::bytes_used() const { return used; }
@@ -1,49 +1,98 @@
 #include "common/diagnostic.hpp"
 #include "common/ansi.hpp"
+#include "common/profile.hpp"
 #include "common/span.hpp"
+#include <array>
 #include <cassert>
 #include <iostream>
-#include <sstream>
 #include <string>
 
 using namespace diagnostic;
 
+namespace {
+
+/// Backing storage for the colored labels, filled once by
+/// `initialize_label_tables()`.
+std::array<std::string, SEVERITY_COUNT> colored_severity_storage;
+
+/// The table every severity lookup indexes. Starts out as the plain labels so
+/// that lookups before initialization (and in tests) are still valid.
+std::array<std::string_view, SEVERITY_COUNT> severity_strings = {
+#define X(name, str, style) str,
+    DIAGNOSTIC_SEVERITIES
+#undef X
+};
+
+} // namespace
+
+void diagnostic::initialize_label_tables() {
+  for (size_t i = 0; i < SEVERITY_COUNT; i++) {
+    if (!console::IS_COLOR_CAPABLE) {
+      severity_strings[i] = DIAGNOSTIC_SEVERITY_LABELS[i];
+      continue;
+    }
+
+    auto &colored = colored_severity_storage[i];
+    colored = console::get_style_sequence(DIAGNOSTIC_SEVERITY_STYLES[i]);
+    colored += DIAGNOSTIC_SEVERITY_LABELS[i];
+    colored += console::get_style_sequence(console::Style::Plain);
+    severity_strings[i] = colored;
+  }
+}
+
+std::string_view
+diagnostic::get_diagnostic_severity_string(const Severity &severity) {
+  return severity_strings[static_cast<size_t>(severity)];
+}
+
 Diagnostic::Diagnostic(const Kind kind, const Span span,
                        const std::string message)
     : severity(get_diagnostic_kind_severity(kind)), kind(kind), span(span),
       message(std::move(message)) {}
 
 std::string diagnostic::Diagnostic::print() const {
+  std::string out;
+  console::StyledWriter writer(out);
+  render(writer);
+  return out;
+}
+
+void diagnostic::Diagnostic::render(console::StyledWriter &writer) const {
+  using console::Style;
   assert(span.length >= 1 && "Invalid diagnostic length");
 
   auto col = span.get_column_number();
   auto line = span.get_line_number();
-  auto line_text =
-      console::colorize(std::string(span.get_line()), console::FG_MAGENTA);
-
-  std::stringstream ss;
+  auto [label, style] = get_diagnostic_severity_label(severity);
 
   // Build header
-  ss << get_diagnostic_severity_string(severity) << " ";
-  ss << span.file.path << ":" + std::to_string(line) << ":"
-     << std::to_string(col) << " -> ";
-  ss << get_diagnostic_kind_string(kind) << "\n";
+  writer.write(style, label);
+  writer.write(Style::Plain, " ");
+  writer.write(span.file.path);
+  writer.write(':');
+  writer.write_number(static_cast<size_t>(line));
+  writer.write(':');
+  writer.write_number(static_cast<size_t>(col));
+  writer.write(" -> ");
+  writer.write(get_diagnostic_kind_string(kind));
+  writer.write('\n');
 
   // Build source code representation
-  ss << " | \n";
-  ss << " | " << line_text << "\n";
+  writer.write(" | \n");
+  writer.write(" | ");
+  writer.write(Style::Magenta, span.get_line());
+  writer.write(Style::Plain, "\n");
 
   // Build the underline highlighter
-  std::string prefix_whitespace = std::string(col == 0 ? 0 : col - 1, ' ');
-  std::string suffix_tildes = std::string(span.length - 1, '~');
-  ss << " | " + prefix_whitespace
-     << console::colorize(std::string("^") + suffix_tildes, console::FG_GREEN)
-     << "\n";
+  writer.write(" | ");
+  writer.write_repeated(' ', col == 0 ? 0 : col - 1);
+  writer.write(Style::Green, "^");
+  writer.write_repeated('~', span.length - 1);
+  writer.write(Style::Plain, "\n");
 
   // Build the help message
-  ss << console::colorize("Help: ", console::BOLD_YELLOW) + message;
-
-  return ss.str();
+  writer.write(Style::BoldYellow, "Help: ");
+  writer.write(Style::Plain, message);
 }
 
 std::ostream &diagnostic::operator<<(std::ostream &os, const Kind &kind) {
@@ -63,8 +112,42 @@ void DiagnosticEngine::emit(const Diagnostic diag) {
   diagnostics.push_back(std::move(diag));
 }
 
-void DiagnosticEngine::print_all() const {
+size_t DiagnosticEngine::size() const { return diagnostics.size(); }
+
+std::vector<Diagnostic>::const_iterator DiagnosticEngine::begin() const {
+  return diagnostics.begin();
+}
+
+std::vector<Diagnostic>::const_iterator DiagnosticEngine::end() const {
+  return diagnostics.end();
+}
+
+void DiagnosticEngine::merge(const DiagnosticEngine &other) {
+  // Diagnostics can't be assigned to, so `insert` is not an option
+  diagnostics.reserve(diagnostics.size() + other.diagnostics.size());
+  for (auto &d : other.diagnostics)
+    diagnostics.push_back(d);
+}
+
+void DiagnosticEngine::print_all(output::Sink &sink) const {
+  profile::Scope scope(profile::Phase::Render);
+  for (auto &d : diagnostics) {
+    console::StyledWriter writer(sink.buffer(d.message.size() + 256));
+    d.render(writer);
+    writer.write('\n');
+    sink.commit();
+  }
+
+  sink.flush();
+}
+
+void DiagnosticEngine::print_all() const { print_all(output::out()); }
+
+void DiagnosticEngine::render_all(std::string &out, bool colored) const {
+  profile::Scope scope(profile::Phase::Render);
+  console::StyledWriter writer(out, colored);
   for (auto &d : diagnostics) {
-    std::cout << d.print() << std::endl;
+    d.render(writer);
+    writer.write('\n');
   }
 }
@@ -0,0 +1,274 @@
+#include "common/hash.hpp"
+#include <bit>
+#include <cstddef>
+#include <cstring>
+
+namespace {
+
+constexpr uint64_t PRIME32_1 = 0x9E3779B1u;
+constexpr uint64_t PRIME32_2 = 0x85EBCA77u;
+constexpr uint64_t PRIME32_3 = 0xC2B2AE3Du;
+constexpr uint64_t PRIME64_1 = 0x9E3779B185EBCA87ull;
+constexpr uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4Full;
+constexpr uint64_t PRIME64_3 = 0x165667B19E3779F9ull;
+constexpr uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63ull;
+constexpr uint64_t PRIME64_5 = 0x27D4EB2F165667C5ull;
+constexpr uint64_t PRIME_MX1 = 0x165667919E3779F9ull;
+constexpr uint64_t PRIME_MX2 = 0x9FB21C651E98DF25ull;
+
+constexpr size_t STRIPE_LEN = 64;
+constexpr size_t SECRET_CONSUME_RATE = 8;
+constexpr size_t ACC_NB = STRIPE_LEN / sizeof(uint64_t);
+constexpr size_t SECRET_MERGEACCS_START = 11;
+constexpr size_t SECRET_LASTACC_START = 7;
+constexpr size_t SECRET_SIZE_MIN = 136;
+constexpr size_t MID_SIZE_MAX = 240;
+constexpr size_t SECRET_SIZE = 192;
+
+constexpr unsigned char DEFAULT_SECRET[SECRET_SIZE] = {
+    0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c,
+    0xf7, 0x21, 0xad, 0x1c, 0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb,
+    0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f, 0xcb, 0x79, 0xe6, 0x4e,
+    0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+    0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6,
+    0x81, 0x3a, 0x26, 0x4c, 0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb,
+    0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3, 0x71, 0x64, 0x48, 0x97,
+    0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+    0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7,
+    0xc7, 0x0b, 0x4f, 0x1d, 0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31,
+    0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64, 0xea, 0xc5, 0xac, 0x83,
+    0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+    0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26,
+    0x29, 0xd4, 0x68, 0x9e, 0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc,
+    0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce, 0x45, 0xcb, 0x3a, 0x8f,
+    0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+};
+
+/* ---------------------------------------------------------------------------*/
+/* PRIMITIVES */
+/* ---------------------------------------------------------------------------*/
+
+// The algorithm is defined over little-endian words
+uint32_t read32(const unsigned char *p) {
+  uint32_t v;
+  std::memcpy(&v, p, sizeof(v));
+  if constexpr (std::endian::native == std::endian::big)
+    v = __builtin_bswap32(v);
+  return v;
+}
+
+uint64_t read64(const unsigned char *p) {
+  uint64_t v;
+  std::memcpy(&v, p, sizeof(v));
+  if constexpr (std::endian::native == std::endian::big)
+    v = __builtin_bswap64(v);
+  return v;
+}
+
+void write64(unsigned char *p, uint64_t v) {
+  if constexpr (std::endian::native == std::endian::big)
+    v = __builtin_bswap64(v);
+  std::memcpy(p, &v, sizeof(v));
+}
+
+uint64_t mul128_fold64(uint64_t lhs, uint64_t rhs) {
+#ifdef __SIZEOF_INT128__
+  __extension__ using u128 = unsigned __int128;
+  u128 product = static_cast<u128>(lhs) * rhs;
+  return static_cast<uint64_t>(product) ^
+         static_cast<uint64_t>(product >> 64);
+#else
+  uint64_t lo_lo = (lhs & 0xFFFFFFFF) * (rhs & 0xFFFFFFFF);
+  uint64_t hi_lo = (lhs >> 32) * (rhs & 0xFFFFFFFF);
+  uint64_t lo_hi = (lhs & 0xFFFFFFFF) * (rhs >> 32);
+  uint64_t hi_hi = (lhs >> 32) * (rhs >> 32);
+  uint64_t cross = (lo_lo >> 32) + (hi_lo & 0xFFFFFFFF) + lo_hi;
+  uint64_t upper = (hi_lo >> 32) + (cross >> 32) + hi_hi;
+  uint64_t lower = (cross << 32) | (lo_lo & 0xFFFFFFFF);
+  return lower ^ upper;
+#endif
+}
+
+uint64_t xxh64_avalanche(uint64_t h) {
+  h ^= h >> 33;
+  h *= PRIME64_2;
+  h ^= h >> 29;
+  h *= PRIME64_3;
+  return h ^ (h >> 32);
+}
+
+uint64_t avalanche(uint64_t h) {
+  h ^= h >> 37;
+  h *= PRIME_MX1;
+  return h ^ (h >> 32);
+}
+
+uint64_t rrmxmx(uint64_t h, uint64_t length) {
+  h ^= std::rotl(h, 49) ^ std::rotl(h, 24);
+  h *= PRIME_MX2;
+  h ^= (h >> 35) + length;
+  h *= PRIME_MX2;
+  return h ^ (h >> 28);
+}
+
+uint64_t mix16(const unsigned char *input, const unsigned char *secret,
+               uint64_t seed) {
+  return mul128_fold64(read64(input) ^ (read64(secret) + seed),
+                       read64(input + 8) ^ (read64(secret + 8) - seed));
+}
+
+/* ---------------------------------------------------------------------------*/
+/* SHORT INPUTS */
+/* ---------------------------------------------------------------------------*/
+
+uint64_t hash_0to16(const unsigned char *input, size_t length,
+                    const unsigned char *secret, uint64_t seed) {
+  if (length > 8) {
+    uint64_t flip1 = (read64(secret + 24) ^ read64(secret + 32)) + seed;
+    uint64_t flip2 = (read64(secret + 40) ^ read64(secret + 48)) - seed;
+    uint64_t lo = read64(input) ^ flip1;
+    uint64_t hi = read64(input + length - 8) ^ flip2;
+    uint64_t acc =
+        length + __builtin_bswap64(lo) + hi + mul128_fold64(lo, hi);
+    return avalanche(acc);
+  }
+
+  if (length >= 4) {
+    seed ^= static_cast<uint64_t>(
+                __builtin_bswap32(static_cast<uint32_t>(seed)))
+            << 32;
+    uint64_t first = read32(input);
+    uint64_t last = read32(input + length - 4);
+    uint64_t flip = (read64(secret + 8) ^ read64(secret + 16)) - seed;
+    return rrmxmx((last + (first << 32)) ^ flip, length);
+  }
+
+  if (length > 0) {
+    uint32_t combined = (static_cast<uint32_t>(input[0]) << 16) |
+                        (static_cast<uint32_t>(input[length >> 1]) << 24) |
+                        static_cast<uint32_t>(input[length - 1]) |
+                        (static_cast<uint32_t>(length) << 8);
+    uint64_t flip = (read32(secret) ^ read32(secret + 4)) + seed;
+    return xxh64_avalanche(combined ^ flip);
+  }
+
+  return xxh64_avalanche(seed ^ read64(secret + 56) ^ read64(secret + 64));
+}
+
+uint64_t hash_17to128(const unsigned char *input, size_t length,
+                      const unsigned char *secret, uint64_t seed) {
+  uint64_t acc = length * PRIME64_1;
+  if (length > 32) {
+    if (length > 64) {
+      if (length > 96) {
+        acc += mix16(input + 48, secret + 96, seed);
+        acc += mix16(input + length - 64, secret + 112, seed);
+      }
+      acc += mix16(input + 32, secret + 64, seed);
+      acc += mix16(input + length - 48, secret + 80, seed);
+    }
+    acc += mix16(input + 16, secret + 32, seed);
+    acc += mix16(input + length - 32, secret + 48, seed);
+  }
+  acc += mix16(input, secret, seed);
+  acc += mix16(input + length - 16, secret + 16, seed);
+  return avalanche(acc);
+}
+
+uint64_t hash_129to240(const unsigned char *input, size_t length,
+                       const unsigned char *secret, uint64_t seed) {
+  constexpr size_t START_OFFSET = 3;
+  constexpr size_t LAST_OFFSET = 17;
+
+  uint64_t acc = length * PRIME64_1;
+  size_t rounds = length / 16;
+  for (size_t i = 0; i < 8; i++)
+    acc += mix16(input + 16 * i, secret + 16 * i, seed);
+  acc = avalanche(acc);
+
+  for (size_t i = 8; i < rounds; i++)
+    acc += mix16(input + 16 * i, secret + 16 * (i - 8) + START_OFFSET, seed);
+  acc += mix16(input + length - 16, secret + SECRET_SIZE_MIN - LAST_OFFSET,
+               seed);
+  return avalanche(acc);
+}
+
+/* ---------------------------------------------------------------------------*/
+/* LONG INPUTS */
+/* ---------------------------------------------------------------------------*/
+
+void accumulate_512(uint64_t *acc, const unsigned char *input,
+                    const unsigned char *secret) {
+  for (size_t i = 0; i < ACC_NB; i++) {
+    uint64_t value = read64(input + 8 * i);
+    uint64_t key = value ^ read64(secret + 8 * i);
+    acc[i ^ 1] += value;
+    acc[i] += (key & 0xFFFFFFFF) * (key >> 32);
+  }
+}
+
+void scramble(uint64_t *acc, const unsigned char *secret) {
+  for (size_t i = 0; i < ACC_NB; i++) {
+    uint64_t a = acc[i];
+    a ^= a >> 47;
+    a ^= read64(secret + 8 * i);
+    acc[i] = a * PRIME32_1;
+  }
+}
+
+uint64_t hash_long(const unsigned char *input, size_t length,
+                   const unsigned char *secret) {
+  uint64_t acc[ACC_NB] = {PRIME32_3, PRIME64_1, PRIME64_2, PRIME64_3,
+                          PRIME64_4, PRIME32_2, PRIME64_5, PRIME32_1};
+
+  constexpr size_t stripes_per_block =
+      (SECRET_SIZE - STRIPE_LEN) / SECRET_CONSUME_RATE;
+  constexpr size_t block_len = STRIPE_LEN * stripes_per_block;
+  size_t blocks = (length - 1) / block_len;
+
+  for (size_t b = 0; b < blocks; b++) {
+    for (size_t s = 0; s < stripes_per_block; s++)
+      accumulate_512(acc, input + b * block_len + s * STRIPE_LEN,
+                     secret + s * SECRET_CONSUME_RATE);
+    scramble(acc, secret + SECRET_SIZE - STRIPE_LEN);
+  }
+
+  size_t stripes = ((length - 1) - block_len * blocks) / STRIPE_LEN;
+  for (size_t s = 0; s < stripes; s++)
+    accumulate_512(acc, input + blocks * block_len + s * STRIPE_LEN,
+                   secret + s * SECRET_CONSUME_RATE);
+  accumulate_512(acc, input + length - STRIPE_LEN,
+                 secret + SECRET_SIZE - STRIPE_LEN - SECRET_LASTACC_START);
+
+  uint64_t result = length * PRIME64_1;
+  for (size_t i = 0; i < 4; i++) {
+    const unsigned char *key = secret + SECRET_MERGEACCS_START + 16 * i;
+    result += mul128_fold64(acc[2 * i] ^ read64(key),
+                            acc[2 * i + 1] ^ read64(key + 8));
+  }
+  return avalanche(result);
+}
+
+} // namespace
+
+uint64_t hash::xxh3_64(std::string_view bytes, uint64_t seed) {
+  auto input = reinterpret_cast<const unsigned char *>(bytes.data());
+  size_t length = bytes.size();
+
+  if (length <= 16)
+    return hash_0to16(input, length, DEFAULT_SECRET, seed);
+  if (length <= 128)
+    return hash_17to128(input, length, DEFAULT_SECRET, seed);
+  if (length <= MID_SIZE_MAX)
+    return hash_129to240(input, length, DEFAULT_SECRET, seed);
+  if (seed == 0)
+    return hash_long(input, length, DEFAULT_SECRET);
+
+  // Long inputs fold the seed into a secret of their own instead
+  unsigned char secret[SECRET_SIZE];
+  for (size_t i = 0; i < SECRET_SIZE / 16; i++) {
+    write64(secret + 16 * i, read64(DEFAULT_SECRET + 16 * i) + seed);
+    write64(secret + 16 * i + 8, read64(DEFAULT_SECRET + 16 * i + 8) - seed);
+  }
+  return hash_long(input, length, secret);
+}
@@ -0,0 +1,60 @@
+#include "common/interner.hpp"
+#include "common/hash.hpp"
+
+namespace {
+
+constexpr size_t INITIAL_SLOTS = 256;
+
+} // namespace
+
+StringInterner::StringInterner()
+    : storage(), names(), slots(INITIAL_SLOTS, {0, NO_SYMBOL}) {}
+
+Symbol StringInterner::find(std::string_view name) const {
+  auto hash = static_cast<uint32_t>(hash::xxh3_64(name));
+  size_t mask = slots.size() - 1;
+  for (size_t i = hash & mask;; i = (i + 1) & mask) {
+    const Slot &slot = slots[i];
+    if (slot.symbol == NO_SYMBOL)
+      return NO_SYMBOL;
+    if (slot.hash == hash && names[slot.symbol] == name)
+      return slot.symbol;
+  }
+}
+
+Symbol StringInterner::intern(std::string_view name) {
+  auto hash = static_cast<uint32_t>(hash::xxh3_64(name));
+  size_t mask = slots.size() - 1;
+  size_t i = hash & mask;
+  for (;; i = (i + 1) & mask) {
+    const Slot &slot = slots[i];
+    if (slot.symbol == NO_SYMBOL)
+      break;
+    if (slot.hash == hash && names[slot.symbol] == name)
+      return slot.symbol;
+  }
+
+  auto symbol = static_cast<Symbol>(names.size());
+  auto copy = storage.copy(std::span<const char>(name.data(), name.size()));
+  names.emplace_back(copy.data(), copy.size());
+  slots[i] = {hash, symbol};
+
+  if (names.size() * 2 > slots.size())
+    grow();
+  return symbol;
+}
+
+void StringInterner::grow() {
+  std::vector<Slot> old(slots.size() * 2, {0, NO_SYMBOL});
+  old.swap(slots);
+
+  size_t mask = slots.size() - 1;
+  for (const Slot &slot : old) {
+    if (slot.symbol == NO_SYMBOL)
+      continue;
+    size_t i = slot.hash & mask;
+    while (slots[i].symbol != NO_SYMBOL)
+      i = (i + 1) & mask;
+    slots[i] = slot;
+  }
+}
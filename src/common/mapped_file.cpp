@@ -0,0 +1,102 @@
+#include "common/mapped_file.hpp"
+#include <utility>
+
+#ifdef _WIN32
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile() : address(nullptr), length(0) {}
+
+MappedFile::~MappedFile() { close(); }
+
+MappedFile::MappedFile(MappedFile &&other) noexcept
+    : address(std::exchange(other.address, nullptr)),
+      length(std::exchange(other.length, 0))
+#ifdef _WIN32
+      ,
+      buffer(std::move(other.buffer))
+#endif
+{
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+  if (this != &other) {
+    close();
+    address = std::exchange(other.address, nullptr);
+    length = std::exchange(other.length, 0);
+#ifdef _WIN32
+    buffer = std::move(other.buffer);
+#endif
+  }
+  return *this;
+}
+
+#ifdef _WIN32
+
+void MappedFile::close() {
+  buffer.reset();
+  address = nullptr;
+  length = 0;
+}
+
+bool MappedFile::open(const std::string &path) {
+  close();
+  std::ifstream in(path, std::ios::binary | std::ios::ate);
+  if (!in)
+    return false;
+
+  auto size = static_cast<size_t>(in.tellg());
+  if (size == 0)
+    return false;
+  buffer = std::make_unique<std::byte[]>(size);
+  in.seekg(0);
+  if (!in.read(reinterpret_cast<char *>(buffer.get()),
+               static_cast<std::streamsize>(size))) {
+    buffer.reset();
+    return false;
+  }
+
+  address = buffer.get();
+  length = size;
+  return true;
+}
+
+#else
+
+void MappedFile::close() {
+  if (address != nullptr)
+    munmap(const_cast<std::byte *>(address), length);
+  address = nullptr;
+  length = 0;
+}
+
+bool MappedFile::open(const std::string &path) {
+  close();
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+    ::close(fd);
+    return false;
+  }
+
+  auto size = static_cast<size_t>(info.st_size);
+  void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping keeps the file alive on its own
+  ::close(fd);
+  if (mapping == MAP_FAILED)
+    return false;
+
+  address = static_cast<const std::byte *>(mapping);
+  length = size;
+  return true;
+}
+
+#endif
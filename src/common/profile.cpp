@@ -0,0 +1,223 @@
+#include "common/profile.hpp"
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using profile::Phase;
+
+bool profile::ENABLED = false;
+bool profile::TRACING = false;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+Clock::time_point epoch;
+
+uint64_t now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() -
+                                                              epoch)
+      .count();
+}
+
+struct OpenScope {
+  Phase phase;
+  bool counted;
+  uint64_t start;
+  std::string detail;
+};
+
+struct Event {
+  Phase phase;
+  uint64_t start;
+  uint64_t duration;
+  std::string detail;
+};
+
+/// @brief Everything one thread recorded. Only ever touched by its own thread
+/// until the report is written, so none of it needs a lock.
+struct ThreadLog {
+  size_t id;
+  std::vector<OpenScope> open;
+  std::vector<Event> events;
+  std::array<uint64_t, profile::PHASE_COUNT> time;
+  std::array<uint64_t, profile::PHASE_COUNT> calls;
+  std::array<uint64_t, profile::PHASE_COUNT> bytes;
+};
+
+std::mutex registry_mutex;
+std::vector<std::unique_ptr<ThreadLog>> registry;
+thread_local ThreadLog *current = nullptr;
+
+ThreadLog &thread_log() {
+  if (current == nullptr) {
+    std::lock_guard lock(registry_mutex);
+    registry.push_back(std::make_unique<ThreadLog>());
+    current = registry.back().get();
+    current->id = registry.size() - 1;
+  }
+  return *current;
+}
+
+/// @brief Formats a byte count the way the report shows it, e.g. `1.5M`.
+std::string format_bytes(uint64_t bytes) {
+  char text[32];
+  if (bytes >= 1024 * 1024)
+    std::snprintf(text, sizeof(text), "%.1fM", bytes / (1024.0 * 1024.0));
+  else if (bytes >= 1024)
+    std::snprintf(text, sizeof(text), "%.1fK", bytes / 1024.0);
+  else
+    std::snprintf(text, sizeof(text), "%lluB",
+                  static_cast<unsigned long long>(bytes));
+  return text;
+}
+
+void write_json_string(std::ostream &os, std::string_view text) {
+  os << '"';
+  for (char c : text) {
+    if (c == '"' || c == '\\') {
+      os << '\\' << c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char escape[8];
+      std::snprintf(escape, sizeof(escape), "\\u%04x", c);
+      os << escape;
+    } else {
+      os << c;
+    }
+  }
+  os << '"';
+}
+
+} // namespace
+
+void profile::enable(bool trace) {
+  epoch = Clock::now();
+  ENABLED = true;
+  TRACING = trace;
+
+  // Register the calling thread first, so that it gets the first track
+  thread_log();
+}
+
+#ifndef SYMPH_NO_PROFILE
+
+void profile::Scope::begin(Phase phase, std::string_view detail) {
+  auto &log = thread_log();
+  bool counted = true;
+  for (auto &scope : log.open)
+    counted = counted && scope.phase != phase;
+
+  log.open.push_back({phase, counted, now(),
+                      TRACING ? std::string(detail) : std::string()});
+  active = true;
+}
+
+void profile::Scope::end() {
+  auto &log = thread_log();
+  auto scope = std::move(log.open.back());
+  log.open.pop_back();
+
+  uint64_t duration = now() - scope.start;
+  auto index = static_cast<size_t>(scope.phase);
+  if (scope.counted) {
+    log.time[index] += duration;
+    log.calls[index]++;
+  }
+  if (TRACING)
+    log.events.push_back(
+        {scope.phase, scope.start, duration, std::move(scope.detail)});
+}
+
+#endif
+
+void profile::record_allocation_slow(size_t bytes) {
+  auto &log = thread_log();
+  if (!log.open.empty())
+    log.bytes[static_cast<size_t>(log.open.back().phase)] += bytes;
+}
+
+void profile::write_report(output::Sink &sink) {
+  std::array<uint64_t, PHASE_COUNT> time = {}, calls = {}, bytes = {};
+  uint64_t total_time = 0, total_bytes = 0;
+  {
+    std::lock_guard lock(registry_mutex);
+    for (auto &log : registry) {
+      for (size_t i = 0; i < PHASE_COUNT; i++) {
+        time[i] += log->time[i];
+        calls[i] += log->calls[i];
+        bytes[i] += log->bytes[i];
+        total_time += log->time[i];
+        total_bytes += log->bytes[i];
+      }
+    }
+  }
+
+  // Phases run on several threads at once, so shares are of the summed time
+  // rather than of the wall time
+  char line[128];
+  sink.write("===----------------------------------------------------===\n");
+  sink.write("                      symphc time report\n");
+  sink.write("===----------------------------------------------------===\n");
+  std::snprintf(line, sizeof(line), "  %-10s %12s %8s %10s %10s\n", "phase",
+                "time (ms)", "share", "calls", "memory");
+  sink.write(line);
+
+  for (size_t i = 0; i < PHASE_COUNT; i++) {
+    if (calls[i] == 0)
+      continue;
+    double share = total_time ? 100.0 * time[i] / total_time : 0.0;
+    std::snprintf(line, sizeof(line), "  %-10s %12.3f %7.1f%% %10llu %10s\n",
+                  PHASE_NAMES[i].data(), time[i] / 1e6, share,
+                  static_cast<unsigned long long>(calls[i]),
+                  format_bytes(bytes[i]).c_str());
+    sink.write(line);
+  }
+
+  std::snprintf(line, sizeof(line), "  %-10s %12.3f %8s %10s %10s\n", "total",
+                total_time / 1e6, "", "", format_bytes(total_bytes).c_str());
+  sink.write(line);
+  std::snprintf(line, sizeof(line), "  %-10s %12.3f\n", "wall", now() / 1e6);
+  sink.write(line);
+  sink.flush();
+}
+
+bool profile::write_trace(const std::string &path) {
+  std::ofstream os(path, std::ios::binary | std::ios::trunc);
+  if (!os)
+    return false;
+
+  std::lock_guard lock(registry_mutex);
+  os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  bool first = true;
+  char number[64];
+
+  for (auto &log : registry) {
+    os << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\","
+       << "\"pid\":1,\"tid\":" << log->id << ",\"args\":{\"name\":\""
+       << (log->id == 0 ? "main" : "thread " + std::to_string(log->id))
+       << "\"}}";
+    first = false;
+
+    for (auto &event : log->events) {
+      // Trace timestamps are in microseconds
+      std::snprintf(number, sizeof(number), "\"ts\":%.3f,\"dur\":%.3f",
+                    event.start / 1e3, event.duration / 1e3);
+      os << ",\n{\"name\":\"" << PHASE_NAMES[static_cast<size_t>(event.phase)]
+         << "\",\"cat\":\"symphc\",\"ph\":\"X\"," << number
+         << ",\"pid\":1,\"tid\":" << log->id;
+      if (!event.detail.empty()) {
+        os << ",\"args\":{\"detail\":";
+        write_json_string(os, event.detail);
+        os << "}";
+      }
+      os << "}";
+    }
+  }
+
+  os << "\n]}\n";
+  return static_cast<bool>(os);
+}
@@ -0,0 +1,264 @@
+#include "common/rope.hpp"
+#include <algorithm>
+#include <cassert>
+
+struct Rope::Node {
+  std::string text;
+  uint32_t priority;
+  size_t own_newlines;
+
+  /// Totals over the whole subtree, this node included
+  size_t bytes;
+  size_t newlines;
+
+  NodePtr left;
+  NodePtr right;
+
+  Node(std::string text, uint32_t priority)
+      : text(std::move(text)), priority(priority), own_newlines(0), bytes(0),
+        newlines(0), left(nullptr), right(nullptr) {
+    recount();
+  }
+
+  static size_t bytes_of(const NodePtr &node) {
+    return node ? node->bytes : 0;
+  }
+  static size_t newlines_of(const NodePtr &node) {
+    return node ? node->newlines : 0;
+  }
+
+  /// @brief Call after changing `text`.
+  void recount() {
+    own_newlines = std::count(text.begin(), text.end(), '\n');
+    update();
+  }
+
+  /// @brief Call after changing either child.
+  void update() {
+    bytes = bytes_of(left) + text.size() + bytes_of(right);
+    newlines = newlines_of(left) + own_newlines + newlines_of(right);
+  }
+
+  void collect(size_t offset, size_t length,
+               std::vector<std::string_view> &out) const {
+    size_t left_bytes = bytes_of(left);
+    if (left && offset < left_bytes)
+      left->collect(offset, length, out);
+
+    // The part of the range that falls into this node's own chunk
+    size_t own_end = left_bytes + text.size();
+    size_t begin = std::max(offset, left_bytes);
+    size_t end = std::min(offset + length, own_end);
+    if (begin < end)
+      out.push_back(std::string_view(text).substr(begin - left_bytes,
+                                                  end - begin));
+
+    if (right && offset + length > own_end) {
+      size_t skipped = std::max(offset, own_end) - own_end;
+      right->collect(skipped, offset + length - own_end - skipped, out);
+    }
+  }
+};
+
+Rope::Rope() : root(nullptr), seed(0x9E3779B97F4A7C15ull) {}
+
+Rope::Rope(std::string_view text) : Rope() { root = build(text); }
+
+Rope::~Rope() = default;
+
+Rope::Rope(Rope &&other) noexcept = default;
+
+Rope &Rope::operator=(Rope &&other) noexcept = default;
+
+uint32_t Rope::next_priority() {
+  // xorshift64: the tree only needs priorities that look random, and a fixed
+  // seed keeps its shape reproducible
+  seed ^= seed << 13;
+  seed ^= seed >> 7;
+  seed ^= seed << 17;
+  return static_cast<uint32_t>(seed >> 32);
+}
+
+Rope::NodePtr Rope::make_node(std::string text) {
+  return std::make_unique<Node>(std::move(text), next_priority());
+}
+
+Rope::NodePtr Rope::build(std::string_view text) {
+  NodePtr result;
+  for (size_t i = 0; i < text.size(); i += MAX_CHUNK)
+    result = merge(std::move(result),
+                   make_node(std::string(text.substr(i, MAX_CHUNK))));
+  return result;
+}
+
+Rope::NodePtr Rope::merge(NodePtr left, NodePtr right) {
+  if (!left)
+    return right;
+  if (!right)
+    return left;
+
+  if (left->priority > right->priority) {
+    left->right = merge(std::move(left->right), std::move(right));
+    left->update();
+    return left;
+  }
+  right->left = merge(std::move(left), std::move(right->left));
+  right->update();
+  return right;
+}
+
+std::pair<Rope::NodePtr, Rope::NodePtr> Rope::split(NodePtr node,
+                                                    size_t offset) {
+  if (!node)
+    return {nullptr, nullptr};
+
+  size_t left_bytes = Node::bytes_of(node->left);
+  size_t own_end = left_bytes + node->text.size();
+
+  if (offset <= left_bytes) {
+    auto [first, second] = split(std::move(node->left), offset);
+    node->left = std::move(second);
+    node->update();
+    return {std::move(first), std::move(node)};
+  }
+
+  if (offset >= own_end) {
+    auto [first, second] = split(std::move(node->right), offset - own_end);
+    node->right = std::move(first);
+    node->update();
+    return {std::move(node), std::move(second)};
+  }
+
+  // The cut falls inside this chunk, whose tail starts the second half
+  size_t cut = offset - left_bytes;
+  NodePtr tail = make_node(node->text.substr(cut));
+  node->text.resize(cut);
+  NodePtr second = merge(std::move(tail), std::move(node->right));
+  node->recount();
+  return {std::move(node), std::move(second)};
+}
+
+bool Rope::edit_in_place(Node *node, size_t offset, size_t removed,
+                         std::string_view inserted) {
+  if (node == nullptr)
+    return false;
+
+  size_t left_bytes = Node::bytes_of(node->left);
+  size_t own_end = left_bytes + node->text.size();
+  bool done;
+
+  // Ties at a chunk boundary go to the chunk before it, so that typing at the
+  // end of a chunk grows it instead of starting a new one
+  if (node->left && offset + removed <= left_bytes) {
+    done = edit_in_place(node->left.get(), offset, removed, inserted);
+  } else if (offset >= left_bytes && offset + removed <= own_end) {
+    size_t size = node->text.size() - removed + inserted.size();
+    done = size > 0 && size <= MAX_CHUNK;
+    if (done) {
+      node->text.replace(offset - left_bytes, removed, inserted);
+      node->own_newlines = std::count(node->text.begin(), node->text.end(),
+                                      '\n');
+    }
+  } else if (offset >= own_end) {
+    done = edit_in_place(node->right.get(), offset - own_end, removed,
+                         inserted);
+  } else {
+    done = false;
+  }
+
+  if (done)
+    node->update();
+  return done;
+}
+
+size_t Rope::size() const { return Node::bytes_of(root); }
+
+size_t Rope::line_count() const { return Node::newlines_of(root) + 1; }
+
+void Rope::replace(size_t offset, size_t removed, std::string_view inserted) {
+  assert(offset + removed <= size());
+  if (removed == 0 && inserted.empty())
+    return;
+  if (edit_in_place(root.get(), offset, removed, inserted))
+    return;
+
+  auto [before, rest] = split(std::move(root), offset);
+  auto [gone, after] = split(std::move(rest), removed);
+  root = merge(merge(std::move(before), build(inserted)), std::move(after));
+}
+
+size_t Rope::line_start(size_t line) const {
+  if (line == 0)
+    return 0;
+  if (line >= line_count())
+    return size();
+
+  // Find the `line`th newline; the line starts right after it
+  const Node *node = root.get();
+  size_t wanted = line;
+  size_t offset = 0;
+  while (node != nullptr) {
+    size_t left_newlines = Node::newlines_of(node->left);
+    if (wanted <= left_newlines) {
+      node = node->left.get();
+      continue;
+    }
+
+    wanted -= left_newlines;
+    offset += Node::bytes_of(node->left);
+    if (wanted <= node->own_newlines) {
+      size_t position = 0;
+      for (; wanted > 0; wanted--)
+        position = node->text.find('\n', position) + 1;
+      return offset + position;
+    }
+
+    wanted -= node->own_newlines;
+    offset += node->text.size();
+    node = node->right.get();
+  }
+  return size();
+}
+
+size_t Rope::line_of(size_t offset) const {
+  const Node *node = root.get();
+  size_t newlines = 0;
+  while (node != nullptr) {
+    size_t left_bytes = Node::bytes_of(node->left);
+    if (offset <= left_bytes) {
+      node = node->left.get();
+      continue;
+    }
+
+    newlines += Node::newlines_of(node->left);
+    offset -= left_bytes;
+    if (offset <= node->text.size()) {
+      newlines += std::count(node->text.begin(),
+                             node->text.begin() + offset, '\n');
+      break;
+    }
+
+    newlines += node->own_newlines;
+    offset -= node->text.size();
+    node = node->right.get();
+  }
+  return newlines + 1;
+}
+
+std::vector<std::string_view> Rope::chunks(size_t offset,
+                                           size_t length) const {
+  std::vector<std::string_view> out;
+  if (root && length > 0)
+    root->collect(offset, length, out);
+  return out;
+}
+
+std::string Rope::substr(size_t offset, size_t length) const {
+  std::string out;
+  out.reserve(length);
+  for (auto chunk : chunks(offset, length))
+    out += chunk;
+  return out;
+}
+
+std::string Rope::materialize() const { return substr(0, size()); }
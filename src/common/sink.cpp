@@ -0,0 +1,127 @@
+#include "common/sink.hpp"
+#include <algorithm>
+#include <cerrno>
+
+#ifdef _WIN32
+#include <io.h>
+#define STDOUT_FILENO 1
+#define STDERR_FILENO 2
+#else
+#include <climits>
+#include <sys/uio.h>
+#include <unistd.h>
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+#endif
+
+using output::Sink;
+
+Sink::Sink(int fd, size_t threshold)
+    : fd(fd), threshold(threshold), pending(0), chunks({}) {}
+
+Sink::~Sink() { flush(); }
+
+void Sink::release() {
+  // Keep the first chunk's allocation around for the next batch
+  if (chunks.size() > 1)
+    chunks.resize(1);
+  if (!chunks.empty())
+    chunks.front().clear();
+  pending = 0;
+}
+
+std::string &Sink::buffer(size_t hint) {
+  if (chunks.empty() ||
+      chunks.back().size() + hint > chunks.back().capacity()) {
+    chunks.emplace_back();
+    chunks.back().reserve(std::max(CHUNK_SIZE, hint));
+  }
+  return chunks.back();
+}
+
+void Sink::commit() {
+  pending = 0;
+  for (auto &c : chunks)
+    pending += c.size();
+
+  if (pending >= threshold)
+    flush();
+}
+
+void Sink::write(std::string_view text) {
+  buffer(text.size()) += text;
+  pending += text.size();
+
+  if (pending >= threshold)
+    flush();
+}
+
+#ifdef _WIN32
+void Sink::flush() {
+  for (auto &c : chunks) {
+    const char *data = c.data();
+    size_t left = c.size();
+    while (left > 0) {
+      int n = _write(fd, data, static_cast<unsigned int>(left));
+      if (n <= 0)
+        break;
+      data += n;
+      left -= static_cast<size_t>(n);
+    }
+  }
+  release();
+}
+#else
+void Sink::flush() {
+  std::vector<iovec> iov;
+  iov.reserve(chunks.size());
+  for (auto &c : chunks) {
+    if (!c.empty())
+      iov.push_back({c.data(), c.size()});
+  }
+
+  size_t first = 0;
+  while (first < iov.size()) {
+    int count = static_cast<int>(std::min<size_t>(iov.size() - first, IOV_MAX));
+    ssize_t n = ::writev(fd, iov.data() + first, count);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      break; // Nowhere left to report to, drop the output
+    }
+
+    // Skip over whatever the kernel accepted, which may end mid-chunk
+    auto written = static_cast<size_t>(n);
+    while (first < iov.size() && written >= iov[first].iov_len) {
+      written -= iov[first].iov_len;
+      first++;
+    }
+    if (first < iov.size()) {
+      iov[first].iov_base = static_cast<char *>(iov[first].iov_base) + written;
+      iov[first].iov_len -= written;
+    }
+  }
+
+  release();
+}
+#endif
+
+size_t Sink::pending_bytes() const { return pending; }
+
+int Sink::descriptor() const { return fd; }
+
+Sink &output::out() {
+  static Sink sink(STDOUT_FILENO);
+  return sink;
+}
+
+Sink &output::err() {
+  static Sink sink(STDERR_FILENO);
+  return sink;
+}
+
+void output::flush_all() {
+  out().flush();
+  err().flush();
+}
@@ -1,8 +1,22 @@
 #include "common/span.hpp"
+#include <algorithm>
 #include <cassert>
+#include <cstring>
 
 File::File(std::string content, std::string path)
-    : content(content), path(path), length(content.size()) {}
+    : content(std::move(content)), path(std::move(path)),
+      length(this->content.size()), line_starts({0}) {
+  const char *begin = this->content.data();
+  const char *end = begin + length;
+  for (const char *p = begin;
+       (p = static_cast<const char *>(std::memchr(p, '\n', end - p)));)
+    line_starts.push_back(static_cast<uint32_t>(++p - begin));
+}
+
+size_t File::line_of(size_t offset) const {
+  return std::upper_bound(line_starts.begin(), line_starts.end(), offset) -
+         line_starts.begin();
+}
 
 Span::Span(const File &file, size_t offset, size_t length)
     : file(file), offset(offset), length(length) {}
@@ -45,28 +59,10 @@ std::string_view Span::get_line() const {
 }
 
 int Span::get_column_number() const {
-  const std::string &content = file.content;
-
-  // Find the newline before the offset
-  auto line_start = content.rfind('\n', offset == 0 ? 0 : offset - 1);
-
-  // The newline before the file doesn't exist
-  // becase this offset is on the first line
-  if (line_start == std::string::npos)
-    return static_cast<int>(offset + 1);
-
-  return static_cast<int>(offset - line_start);
+  size_t line_start = file.line_starts[file.line_of(offset) - 1];
+  return static_cast<int>(offset - line_start + 1);
 }
 
 int Span::get_line_number() const {
-  const std::string &content = file.content;
-  int line = 1;
-
-  for (size_t i = 0; i < offset && i < file.length; i++) {
-    if (content[i] == '\n') {
-      line++;
-    }
-  }
-
-  return line;
+  return static_cast<int>(file.line_of(offset));
 }
\ No newline at end of file
@@ -0,0 +1,137 @@
+#include "common/thread_pool.hpp"
+#include <algorithm>
+
+namespace {
+
+/// The pool the calling thread works for, if any, and its index in it
+thread_local const ThreadPool *worker_pool = nullptr;
+thread_local size_t worker_index = 0;
+
+/// Tasks running on the calling thread, innermost interrupting the others
+thread_local size_t task_depth = 0;
+
+} // namespace
+
+ThreadPool::ThreadPool(size_t threads)
+    : queues(), workers(), queued(0), pending(0), next_queue(0),
+      stopping(false) {
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+
+  queues.reserve(threads);
+  for (size_t i = 0; i < threads; i++)
+    queues.push_back(std::make_unique<Queue>());
+
+  workers.reserve(threads);
+  for (size_t i = 0; i < threads; i++)
+    workers.emplace_back([this, i]() { run(i); });
+}
+
+ThreadPool::~ThreadPool() {
+  wait();
+  {
+    std::lock_guard lock(mutex);
+    stopping = true;
+  }
+  available.notify_all();
+
+  for (auto &worker : workers)
+    worker.join();
+}
+
+size_t ThreadPool::current_worker() const {
+  return worker_pool == this ? worker_index : queues.size();
+}
+
+bool ThreadPool::pop(size_t index, std::function<void()> &task) {
+  auto &queue = *queues[index];
+  std::lock_guard lock(queue.mutex);
+  if (queue.tasks.empty())
+    return false;
+
+  task = std::move(queue.tasks.back());
+  queue.tasks.pop_back();
+  queued--;
+  return true;
+}
+
+bool ThreadPool::steal(size_t thief, std::function<void()> &task) {
+  // Start right after the thief so that thieves spread over their victims
+  size_t count = queues.size();
+  for (size_t offset = 1; offset <= count; offset++) {
+    auto &queue = *queues[(thief + offset) % count];
+    std::lock_guard lock(queue.mutex);
+    if (queue.tasks.empty())
+      continue;
+
+    task = std::move(queue.tasks.front());
+    queue.tasks.pop_front();
+    queued--;
+    return true;
+  }
+  return false;
+}
+
+void ThreadPool::finish() {
+  if (pending.fetch_sub(1) == 1) {
+    std::lock_guard lock(mutex);
+    idle.notify_all();
+  }
+}
+
+bool ThreadPool::run_one() {
+  std::function<void()> task;
+  size_t self = current_worker();
+  if ((self < queues.size() && pop(self, task)) || steal(self, task)) {
+    task_depth++;
+    task();
+    task_depth--;
+    finish();
+    return true;
+  }
+  return false;
+}
+
+void ThreadPool::run(size_t index) {
+  worker_pool = this;
+  worker_index = index;
+
+  while (true) {
+    if (run_one())
+      continue;
+
+    std::unique_lock lock(mutex);
+    available.wait(lock, [this]() { return stopping || queued.load() > 0; });
+    if (stopping && queued.load() == 0)
+      return;
+  }
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+  pending++;
+
+  {
+    // Counted under the sleep lock, and before the task can be popped, so
+    // that a worker about to sleep either sees it or gets the notification
+    std::lock_guard lock(mutex);
+    queued++;
+  }
+
+  size_t self = current_worker();
+  size_t index = self < queues.size() ? self : next_queue++ % queues.size();
+  {
+    auto &queue = *queues[index];
+    std::lock_guard lock(queue.mutex);
+    queue.tasks.push_back(std::move(task));
+  }
+  available.notify_one();
+}
+
+void ThreadPool::wait() {
+  std::unique_lock lock(mutex);
+  idle.wait(lock, [this]() { return pending.load() == 0; });
+}
+
+size_t ThreadPool::size() const { return workers.size(); }
+
+size_t ThreadPool::nesting() { return task_depth; }
@@ -0,0 +1,347 @@
+#include "driver/daemon.hpp"
+#include "common/sink.hpp"
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+using namespace driver;
+
+namespace {
+
+enum class Frame : unsigned char {
+  // Client to daemon
+  Build,
+  Stop,
+  // Daemon to client
+  Out,
+  Err,
+  Exit,
+};
+
+/// Requests are small; anything larger is not from one of our clients
+constexpr uint32_t MAX_REQUEST_SIZE = 1024 * 1024;
+
+/// How long a client may take to send its request, or to take a frame of
+/// output, before the daemon gives up on it and serves the next one
+constexpr time_t CLIENT_TIMEOUT_SECONDS = 10;
+
+} // namespace
+
+std::string driver::default_socket_path() {
+  if (const char *path = std::getenv("SYMPH_SOCKET"))
+    return path;
+  // Only its owner can get into this one
+  if (const char *directory = std::getenv("XDG_RUNTIME_DIR");
+      directory && *directory)
+    return (std::filesystem::path(directory) / "symphc.sock").string();
+
+  std::error_code ec;
+  auto directory = std::filesystem::temp_directory_path(ec);
+  std::string name = "symphc";
+#ifndef _WIN32
+  name += '-';
+  name += std::to_string(getuid());
+#endif
+  return ((ec ? std::filesystem::path("/tmp") : directory) / (name + ".sock"))
+      .string();
+}
+
+#ifdef _WIN32
+
+int driver::serve(const Options &) {
+  output::err().write("symphc: the daemon needs Unix domain sockets\n");
+  return 1;
+}
+
+std::optional<int> driver::request(const std::vector<std::string> &,
+                                   const Options &) {
+  return std::nullopt;
+}
+
+#else
+
+namespace {
+
+bool write_all(int fd, const char *data, size_t size) {
+  while (size > 0) {
+    ssize_t n = ::write(fd, data, size);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    data += n;
+    size -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+bool read_all(int fd, char *data, size_t size) {
+  while (size > 0) {
+    ssize_t n = ::read(fd, data, size);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    data += n;
+    size -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+bool send_frame(int fd, Frame kind, std::string_view payload) {
+  char header[5];
+  auto size = static_cast<uint32_t>(payload.size());
+  std::memcpy(header, &size, sizeof(size));
+  header[4] = static_cast<char>(kind);
+  return write_all(fd, header, sizeof(header)) &&
+         write_all(fd, payload.data(), payload.size());
+}
+
+bool receive_frame(int fd, Frame &kind, std::string &payload,
+                   uint32_t limit = UINT32_MAX) {
+  char header[5];
+  if (!read_all(fd, header, sizeof(header)))
+    return false;
+
+  uint32_t size;
+  std::memcpy(&size, header, sizeof(size));
+  if (size > limit)
+    return false;
+  kind = static_cast<Frame>(header[4]);
+  payload.resize(size);
+  return read_all(fd, payload.data(), size);
+}
+
+bool make_address(const std::string &path, sockaddr_un &address) {
+  address = {};
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path))
+    return false;
+  std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+  return true;
+}
+
+/// @brief Whether the process at the other end of `fd` runs as this user.
+/// A socket in a shared directory can be reached by anyone, and a daemon
+/// builds with its owner's rights.
+bool same_user(int fd) {
+#ifdef SO_PEERCRED
+  ucred peer;
+  socklen_t size = sizeof(peer);
+  return getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &peer, &size) == 0 &&
+         peer.uid == getuid();
+#else
+  uid_t uid;
+  gid_t gid;
+  return getpeereid(fd, &uid, &gid) == 0 && uid == getuid();
+#endif
+}
+
+/// @brief Gives up on reads and writes on `fd` that make no progress for
+/// `seconds`.
+void set_timeout(int fd, time_t seconds) {
+  timeval timeout = {};
+  timeout.tv_sec = seconds;
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+/// @brief Connects to the daemon at `path`, returning the socket or -1. A
+/// socket some other user is listening on counts as no daemon.
+int connect_to(const std::string &path) {
+  sockaddr_un address;
+  if (!make_address(path, address))
+    return -1;
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+    return -1;
+  if (connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) !=
+          0 ||
+      !same_user(fd)) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/// @brief Splits a build request into the client's working directory and its
+/// arguments, all of which are separated by NUL bytes after a flags byte.
+void decode_request(std::string_view payload, bool &colored,
+                    std::string &directory, std::vector<std::string> &args) {
+  colored = !payload.empty() && payload[0] != 0;
+  payload.remove_prefix(payload.empty() ? 0 : 1);
+
+  bool first = true;
+  while (!payload.empty()) {
+    size_t end = payload.find('\0');
+    auto field = payload.substr(0, end);
+    if (first)
+      directory = field;
+    else
+      args.emplace_back(field);
+    first = false;
+    payload.remove_prefix(end == std::string_view::npos ? payload.size()
+                                                        : end + 1);
+  }
+}
+
+} // namespace
+
+int driver::serve(const Options &options) {
+  std::string path = options.socket.empty() ? default_socket_path()
+                                            : options.socket;
+  sockaddr_un address;
+  if (!make_address(path, address)) {
+    output::err().write("symphc: socket path is too long: " + path + "\n");
+    return 1;
+  }
+
+  // A socket nobody answers on is left over from a daemon that died
+  if (int fd = connect_to(path); fd >= 0) {
+    close(fd);
+    output::err().write("symphc: a daemon is already listening on " + path +
+                        "\n");
+    return 1;
+  }
+  unlink(path.c_str());
+
+  int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listener < 0 ||
+      bind(listener, reinterpret_cast<sockaddr *>(&address),
+           sizeof(address)) != 0 ||
+      chmod(path.c_str(), S_IRUSR | S_IWUSR) != 0 ||
+      listen(listener, 16) != 0) {
+    output::err().write("symphc: cannot listen on " + path + "\n");
+    if (listener >= 0)
+      close(listener);
+    return 1;
+  }
+
+  // A client that goes away mid-build must not take the daemon with it
+  std::signal(SIGPIPE, SIG_IGN);
+  Session session(options, true);
+
+  bool running = true;
+  while (running) {
+    int client = accept(listener, nullptr, nullptr);
+    if (client < 0) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    if (!same_user(client)) {
+      close(client);
+      continue;
+    }
+    set_timeout(client, CLIENT_TIMEOUT_SECONDS);
+
+    Frame kind;
+    std::string payload;
+    if (receive_frame(client, kind, payload, MAX_REQUEST_SIZE)) {
+      if (kind == Frame::Stop) {
+        running = false;
+        send_frame(client, Frame::Exit, std::string_view("\0\0\0\0", 4));
+      } else if (kind == Frame::Build) {
+        bool colored;
+        std::string directory;
+        std::vector<std::string> args;
+        decode_request(payload, colored, directory, args);
+
+        int status = 2;
+        auto build = parse_arguments(args);
+        if (!build) {
+          send_frame(client, Frame::Err, USAGE);
+        } else if (build->run) {
+          // A program could loop forever or crash, and take every later
+          // client down with it
+          send_frame(client, Frame::Err,
+                     "symphc: the daemon doesn't run programs\n");
+        } else {
+          // Once a client stops taking output, the build goes on without it
+          bool listening = true;
+          build->colored = colored;
+          status = session.build(*build, directory,
+                                 [&](Channel channel, std::string_view text) {
+                                   listening =
+                                       listening &&
+                                       send_frame(client,
+                                                  channel == Channel::Out
+                                                      ? Frame::Out
+                                                      : Frame::Err,
+                                                  text);
+                                 });
+        }
+
+        auto code = static_cast<uint32_t>(status);
+        send_frame(client, Frame::Exit,
+                   std::string_view(reinterpret_cast<char *>(&code),
+                                    sizeof(code)));
+      }
+    }
+    close(client);
+  }
+
+  close(listener);
+  unlink(path.c_str());
+  return 0;
+}
+
+std::optional<int> driver::request(const std::vector<std::string> &args,
+                                   const Options &options) {
+  std::string path = options.socket.empty() ? default_socket_path()
+                                            : options.socket;
+  int fd = connect_to(path);
+  if (fd < 0)
+    return std::nullopt;
+
+  std::string payload;
+  if (options.stop) {
+    send_frame(fd, Frame::Stop, payload);
+  } else {
+    std::error_code ec;
+    payload += static_cast<char>(options.colored);
+    payload += std::filesystem::current_path(ec).string();
+    for (auto &arg : args) {
+      // The daemon builds; whether to hand the build off is for us
+      if (arg == "--client")
+        continue;
+      payload += '\0';
+      payload += arg;
+    }
+    send_frame(fd, Frame::Build, payload);
+  }
+
+  // Relay everything until the exit status arrives
+  std::optional<int> status;
+  Frame kind;
+  while (receive_frame(fd, kind, payload)) {
+    if (kind == Frame::Out) {
+      output::out().write(payload);
+    } else if (kind == Frame::Err) {
+      output::err().write(payload);
+    } else if (kind == Frame::Exit && payload.size() == sizeof(uint32_t)) {
+      uint32_t code;
+      std::memcpy(&code, payload.data(), sizeof(code));
+      status = static_cast<int>(code);
+      break;
+    }
+  }
+  close(fd);
+
+  // A daemon that hung up mid-build still answered; report it as a failure
+  return status ? status : std::optional<int>(1);
+}
+
+#endif
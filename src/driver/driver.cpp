@@ -0,0 +1,468 @@
+#include "driver/driver.hpp"
+#include "common/hash.hpp"
+#include "common/profile.hpp"
+#include "lexer/lexer.hpp"
+#include "parser/parallel.hpp"
+#include "query/engine.hpp"
+#include "sema/checker.hpp"
+#include "sema/folder.hpp"
+#include "sema/resolver.hpp"
+#include "vm/compiler.hpp"
+#include "vm/machine.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <unordered_set>
+
+using namespace driver;
+namespace fs = std::filesystem;
+
+const std::string_view driver::USAGE =
+    "usage: symphc <file or directory>... [-j <jobs>] [--cache-dir <dir>]\n"
+    "              [--cache-size <MiB>] [--no-cache] [--emit-ast] [--run]\n"
+    "              [--gc-stats] [--jit] [--version] [--time-report]\n"
+    "              [--trace=<file.json>]\n"
+    "       symphc --daemon [--socket <path>] [-j <jobs>] [--cache-dir <dir>]\n"
+    "       symphc --client [--socket <path>] <file or directory>...\n"
+    "       symphc --client --stop [--socket <path>]\n"
+    "       symphc --lsp\n";
+
+std::optional<Options>
+driver::parse_arguments(std::span<const std::string> args) {
+  Options options;
+  if (const char *directory = std::getenv("SYMPH_CACHE_DIR"))
+    options.cache_directory = directory;
+  else
+    options.cache_directory = ".symph-cache";
+
+  // Whether a flag sets up the process doing the build, which for a client is
+  // a daemon that was set up when it started
+  bool process_wide = false;
+
+  for (size_t i = 0; i < args.size(); i++) {
+    std::string_view arg = args[i];
+    bool has_value = i + 1 < args.size();
+    if (arg == "-j" || arg == "--cache-dir" || arg == "--cache-size" ||
+        arg == "--time-report" || arg.starts_with("--trace="))
+      process_wide = true;
+
+    if (arg == "-j" && has_value)
+      options.jobs = std::strtoull(args[++i].c_str(), nullptr, 10);
+    else if (arg == "--cache-dir" && has_value)
+      options.cache_directory = args[++i];
+    else if (arg == "--cache-size" && has_value)
+      options.cache_capacity = std::strtoull(args[++i].c_str(), nullptr, 10)
+                               << 20;
+    else if (arg == "--no-cache")
+      options.use_cache = false;
+    else if (arg == "--emit-ast")
+      options.emit_ast = true;
+    else if (arg == "--run")
+      options.run = true;
+    else if (arg == "--gc-stats")
+      options.gc_stats = true;
+    else if (arg == "--jit")
+      options.jit = true;
+    else if (arg == "--version")
+      options.version = true;
+    else if (arg == "--time-report")
+      options.time_report = true;
+    else if (arg.starts_with("--trace=") && arg.size() > 8)
+      options.trace = arg.substr(8);
+    else if (arg == "--daemon")
+      options.daemon = true;
+    else if (arg == "--client")
+      options.client = true;
+    else if (arg == "--stop")
+      options.stop = true;
+    else if (arg == "--socket" && has_value)
+      options.socket = args[++i];
+    else if (arg == "--lsp")
+      options.lsp = true;
+    else if (!arg.starts_with("-"))
+      options.inputs.emplace_back(arg);
+    else
+      return std::nullopt;
+  }
+
+  bool builds =
+      !options.daemon && !options.stop && !options.version && !options.lsp;
+  if ((builds && options.inputs.empty()) ||
+      (options.daemon && options.client) || (options.stop && !options.client) ||
+      (options.client && process_wide) ||
+      (options.lsp && (options.daemon || options.client)))
+    return std::nullopt;
+  return options;
+}
+
+/* ---------------------------------------------------------------------------*/
+/* INPUTS */
+/* ---------------------------------------------------------------------------*/
+
+namespace {
+
+/// @brief An input as the user named it, and where it actually is.
+struct Input {
+  std::string path;
+  std::string location;
+};
+
+/// @brief Expands directories into the `.symph` files below them, sorted so
+/// that the order of diagnostics never depends on the file system. A file
+/// named more than once is only compiled for its first mention.
+std::vector<Input> collect_inputs(const std::vector<std::string> &args,
+                                  const std::string &directory) {
+  std::vector<Input> inputs;
+
+  for (auto &arg : args) {
+    std::error_code ec;
+    fs::path location = directory.empty() ? fs::path(arg)
+                                           : fs::path(directory) / arg;
+    location = fs::absolute(location, ec).lexically_normal();
+
+    if (!fs::is_directory(location, ec)) {
+      inputs.push_back({arg, location.string()});
+      continue;
+    }
+
+    size_t first = inputs.size();
+    for (auto &entry : fs::recursive_directory_iterator(location, ec)) {
+      if (!entry.is_regular_file(ec) || entry.path().extension() != ".symph")
+        continue;
+      auto relative = entry.path().lexically_relative(location);
+      inputs.push_back({(fs::path(arg) / relative).string(),
+                        entry.path().string()});
+    }
+    std::sort(inputs.begin() + first, inputs.end(),
+              [](const Input &a, const Input &b) { return a.path < b.path; });
+  }
+
+  std::unordered_set<std::string> seen;
+  std::erase_if(inputs, [&](const Input &input) {
+    return !seen.insert(input.location).second;
+  });
+  return inputs;
+}
+
+std::optional<std::string> read_file(const std::string &location) {
+  profile::Scope scope(profile::Phase::Load, location);
+  std::ifstream in(location, std::ios::binary);
+  if (!in)
+    return std::nullopt;
+  std::stringstream ss;
+  ss << in.rdbuf();
+  profile::record_allocation(ss.view().size());
+  return ss.str();
+}
+
+std::string render_ast(const ast::Tree &tree) {
+  profile::Scope scope(profile::Phase::Render, tree.file->path);
+  std::stringstream ss;
+  for (auto item : tree.items()) {
+    ast::print_node(ss, tree, item);
+    ss << "\n";
+  }
+  return ss.str();
+}
+
+/// @brief One line on what the collector did during a run of `elapsed`
+/// nanoseconds, and how much of that the program had to itself.
+std::string render_gc_statistics(std::string_view path,
+                                 const vm::Heap::Statistics &statistics,
+                                 uint64_t elapsed) {
+  uint64_t paused = statistics.minor_pause + statistics.major_pause;
+  uint64_t running = elapsed - std::min(paused, elapsed);
+  double throughput = elapsed ? 100.0 * running / elapsed : 100.0;
+  char line[256];
+  std::snprintf(
+      line, sizeof(line),
+      "%.*s: gc: %llu minor, %llu major, %.3f ms paused, %.3f ms longest; "
+      "%.1f%% of %.3f ms running the program; %.1fM allocated, "
+      "%.1fM promoted, %.1fM freed\n",
+      static_cast<int>(path.size()), path.data(),
+      static_cast<unsigned long long>(statistics.minor_collections),
+      static_cast<unsigned long long>(statistics.major_collections),
+      paused / 1e6, statistics.longest_pause / 1e6, throughput, elapsed / 1e6,
+      statistics.allocated / (1024.0 * 1024.0),
+      statistics.promoted / (1024.0 * 1024.0),
+      statistics.freed / (1024.0 * 1024.0));
+  return line;
+}
+
+} // namespace
+
+/* ---------------------------------------------------------------------------*/
+/* SESSION */
+/* ---------------------------------------------------------------------------*/
+
+/// @brief A file as it was last read. Reads are compared by path and
+/// contents only: the diagnostics of a file render with its path, so a
+/// differently spelled path counts as a change.
+struct Session::Source {
+  std::string path;
+  uint64_t hash = 0;
+  // Diagnostics point into the file, so it never moves
+  std::shared_ptr<const File> file;
+  std::string error;
+
+  bool operator==(const Source &other) const {
+    return path == other.path && hash == other.hash && error == other.error;
+  }
+};
+
+/// @brief What the lexer and the parser, or the cache, made of a file.
+struct Session::Syntax {
+  std::shared_ptr<const File> file;
+  std::optional<cache::Module> module;
+  std::optional<ast::Tree> tree;
+  DiagnosticEngine diagnostics;
+
+  const ast::Tree &ast() const { return module ? module->tree() : *tree; }
+};
+
+/// @brief What name resolution, type checking and constant folding made of
+/// a file's tree.
+struct Session::Semantics {
+  std::shared_ptr<const Syntax> syntax;
+  StringInterner names;
+  sema::Resolution resolution;
+  sema::TypeInterner types;
+  sema::Typing typing;
+  sema::Folding folding;
+  DiagnosticEngine diagnostics;
+};
+
+/// @brief A file's bytecode, which doesn't depend on any option and so is
+/// kept for as long as its semantics are.
+struct Session::Bytecode {
+  std::shared_ptr<const Semantics> semantics;
+  std::unique_ptr<vm::Program> program;
+  DiagnosticEngine diagnostics;
+};
+
+/// @brief The queries of a session, all of them keyed by location. Their
+/// results are shared pointers to new objects, which compare by identity and
+/// so always count as changed when worked out again; the cutoff happens
+/// earlier, at `sources`, where an unchanged file is no change at all.
+struct Session::Database {
+  /// When and as what a file was last read, to tell without reading it
+  /// whether it needs reading again
+  struct Stamp {
+    std::string path;
+    int64_t modified = 0;
+    uint64_t size = 0;
+
+    bool operator==(const Stamp &) const = default;
+  };
+
+  query::Engine engine;
+  query::Input<std::string, Source> sources;
+  query::Query<std::string, std::shared_ptr<const Syntax>> syntax;
+  query::Query<std::string, std::shared_ptr<const Semantics>> semantics;
+  query::Query<std::string, std::shared_ptr<const Bytecode>> bytecode;
+  std::unordered_map<std::string, Stamp> stamps;
+
+  explicit Database(Session &session)
+      : engine(), sources(engine),
+        syntax(engine,
+               [this, &session](const std::string &location) {
+                 return session.parse(sources.get(location));
+               }),
+        semantics(engine,
+                  [this, &session](const std::string &location) {
+                    return session.analyze(syntax.get(location));
+                  }),
+        bytecode(engine,
+                 [this, &session](const std::string &location) {
+                   return session.generate(semantics.get(location));
+                 }),
+        stamps() {}
+};
+
+Session::Session(const Options &options, bool warm)
+    : pool(options.jobs),
+      store(options.cache_directory, options.cache_capacity), warm(warm),
+      building(nullptr), database(std::make_unique<Database>(*this)) {}
+
+Session::~Session() = default;
+
+size_t Session::remembered() const { return database->sources.size(); }
+
+std::shared_ptr<const Session::Syntax>
+Session::parse(const Source &source) {
+  if (!source.file)
+    return nullptr;
+
+  auto syntax = std::make_shared<Syntax>();
+  syntax->file = source.file;
+  const File &file = *source.file;
+  uint64_t key = cache::key_for(file, building->fingerprint);
+
+  // A hit stands in for the lexer and the parser, diagnostics included
+  if (building->use_cache)
+    syntax->module = store.load(key, file);
+
+  if (syntax->module) {
+    syntax->module->replay(syntax->diagnostics);
+  } else {
+    // Large files are split further over the same pool
+    auto tokens = Lexer(file, syntax->diagnostics).lex();
+    syntax->tree = parser::parse_parallel(tokens, syntax->diagnostics, pool);
+    if (building->use_cache)
+      store.store(key, *syntax->tree, syntax->diagnostics);
+  }
+  return syntax;
+}
+
+std::shared_ptr<const Session::Semantics>
+Session::analyze(const std::shared_ptr<const Syntax> &syntax) {
+  // Names in a tree that failed to parse would mostly be reported as missing
+  // because of whatever the parser had to skip
+  if (!syntax || syntax->diagnostics.size() > 0)
+    return nullptr;
+
+  auto semantics = std::make_shared<Semantics>();
+  semantics->syntax = syntax;
+  const ast::Tree &tree = syntax->ast();
+  semantics->resolution =
+      sema::resolve(tree, semantics->names, semantics->diagnostics);
+  semantics->typing =
+      sema::check(tree, semantics->resolution, semantics->names,
+                  semantics->types, semantics->diagnostics, pool);
+  // Folding goes by the types, which are only sound if they all checked out
+  if (semantics->diagnostics.size() == 0)
+    semantics->folding = sema::fold(tree, semantics->resolution,
+                                    semantics->typing, semantics->diagnostics);
+  return semantics;
+}
+
+std::shared_ptr<const Session::Bytecode>
+Session::generate(const std::shared_ptr<const Semantics> &semantics) {
+  if (!semantics || semantics->diagnostics.size() > 0)
+    return nullptr;
+
+  auto bytecode = std::make_shared<Bytecode>();
+  bytecode->semantics = semantics;
+  bytecode->program = vm::compile(
+      semantics->syntax->ast(), semantics->resolution, semantics->typing,
+      semantics->folding, semantics->types, bytecode->diagnostics);
+  return bytecode;
+}
+
+int Session::build(const Options &options, const std::string &directory,
+                   const Emit &emit) {
+  using Stamp = Database::Stamp;
+  auto inputs = collect_inputs(options.inputs, directory);
+  building = &options;
+
+  // Reading decides which sources changed, so it happens before any query
+  // runs; a file whose stamp is unchanged isn't read at all
+  std::vector<Stamp> stamps(inputs.size());
+  std::vector<std::optional<Source>> sources(inputs.size());
+  pool.parallel_for(inputs.size(), [&](size_t i) {
+    const auto &[path, location] = inputs[i];
+    std::error_code ec;
+    auto modified = fs::last_write_time(location, ec);
+    stamps[i].path = path;
+    stamps[i].modified = ec ? 0 : modified.time_since_epoch().count();
+    stamps[i].size = ec ? 0 : fs::file_size(location, ec);
+
+    auto previous = database->stamps.find(location);
+    if (!ec && previous != database->stamps.end() &&
+        previous->second == stamps[i])
+      return;
+
+    Source &source = sources[i].emplace();
+    source.path = path;
+    auto content = read_file(location);
+    if (!content) {
+      source.error = "symphc: cannot read '" + path + "'\n";
+      return;
+    }
+    source.hash = hash::xxh3_64(*content);
+    // Touched but not changed, which happens a lot on branch switches
+    const Source *known = database->sources.peek(location);
+    if (known && *known == source)
+      return;
+    source.file = std::make_shared<File>(std::move(*content), path);
+  });
+
+  for (size_t i = 0; i < inputs.size(); i++) {
+    database->stamps[inputs[i].location] = stamps[i];
+    if (sources[i])
+      database->sources.set(inputs[i].location, std::move(*sources[i]));
+  }
+
+  // Each input is asked for as a task of its own, and only what depends on a
+  // source that changed is worked out again
+  std::vector<std::string> errors(inputs.size());
+  std::vector<std::string> asts(inputs.size());
+  std::vector<std::shared_ptr<const Bytecode>> programs(inputs.size());
+  std::vector<char> failed(inputs.size());
+  pool.parallel_for(inputs.size(), [&](size_t i) {
+    const std::string &location = inputs[i].location;
+    errors[i] = database->sources.get(location).error;
+    const auto &syntax = database->syntax.get(location);
+    const auto &semantics = database->semantics.get(location);
+    if (syntax)
+      syntax->diagnostics.render_all(errors[i], options.colored);
+    if (semantics)
+      semantics->diagnostics.render_all(errors[i], options.colored);
+    if (options.run && errors[i].empty()) {
+      programs[i] = database->bytecode.get(location);
+      if (programs[i])
+        programs[i]->diagnostics.render_all(errors[i], options.colored);
+    }
+    failed[i] = !errors[i].empty();
+    if (options.emit_ast && syntax)
+      asts[i] = render_ast(syntax->ast());
+  });
+
+  int status = 0;
+  for (size_t i = 0; i < inputs.size(); i++) {
+    if (!errors[i].empty())
+      emit(Channel::Err, errors[i]);
+    if (!asts[i].empty())
+      emit(Channel::Out, asts[i]);
+    if (failed[i])
+      status = 1;
+
+    // Programs run one at a time, in input order, so their output never
+    // interleaves
+    if (failed[i] || !programs[i] || !programs[i]->program)
+      continue;
+    DiagnosticEngine diagnostics;
+    vm::Machine machine(*programs[i]->program, [&](std::string_view out) {
+      emit(Channel::Out, out);
+    });
+    if (options.jit)
+      machine.enable_jit();
+    auto start = std::chrono::steady_clock::now();
+    bool finished = machine.run(diagnostics);
+    if (options.gc_stats) {
+      auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now() - start);
+      emit(Channel::Err,
+           render_gc_statistics(inputs[i].path,
+                                machine.objects().statistics(),
+                                elapsed.count()));
+    }
+    if (!finished) {
+      std::string error;
+      diagnostics.render_all(error, options.colored);
+      emit(Channel::Err, error);
+      status = 1;
+    }
+  }
+
+  building = nullptr;
+  if (!warm)
+    database = std::make_unique<Database>(*this);
+  if (options.use_cache)
+    store.evict();
+  return status;
+}
@@ -0,0 +1,220 @@
+#include "lexer/lexer.hpp"
+#include "common/profile.hpp"
+#include <string>
+#include <string_view>
+
+using TK = Token::Kind;
+
+namespace {
+
+bool is_identifier_start(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+bool is_identifier_char(char c) { return is_identifier_start(c) || is_digit(c); }
+
+} // namespace
+
+Lexer::Lexer(const File &file, DiagnosticEngine &diagnostics)
+    : file(file), diagnostics(diagnostics), tokens({}), start(0), cursor(0) {}
+
+char Lexer::peek(size_t ahead) const {
+  if (cursor + ahead >= file.length)
+    return '\0';
+  return file.content[cursor + ahead];
+}
+
+bool Lexer::match(char expected) {
+  if (peek() != expected)
+    return false;
+  cursor++;
+  return true;
+}
+
+void Lexer::push(Token::Kind kind) {
+  tokens.emplace_back(kind, Span(file, start, cursor - start));
+}
+
+void Lexer::report(diagnostic::Kind kind, size_t offset, size_t length,
+                   const std::string &message) {
+  diagnostics.emit(Diagnostic(kind, Span(file, offset, length), message));
+}
+
+std::vector<Token> Lexer::lex() {
+  profile::Scope scope(profile::Phase::Lex, file.path);
+
+  // Most tokens are a handful of characters wide, so this rarely reallocates
+  tokens.reserve(file.length / 4 + 1);
+
+  while (cursor < file.length) {
+    start = cursor;
+    char c = file.content[cursor++];
+
+    switch (c) {
+    case ' ':
+    case '\t':
+    case '\r':
+      break;
+    case '\n':
+      push(TK::Newline);
+      break;
+    case '#':
+      while (cursor < file.length && file.content[cursor] != '\n')
+        cursor++;
+      break;
+    case '"':
+      lex_string();
+      break;
+    default:
+      if (is_identifier_start(c))
+        lex_identifier();
+      else if (is_digit(c))
+        lex_number();
+      else
+        lex_symbol(c);
+      break;
+    }
+  }
+
+  start = file.length;
+  push(TK::Eof);
+  profile::record_allocation(tokens.capacity() * sizeof(Token));
+  return std::move(tokens);
+}
+
+void Lexer::lex_identifier() {
+  while (is_identifier_char(peek()))
+    cursor++;
+
+  // Tokens point into the file, so nothing here needs a copy of the name
+  std::string_view text(file.content.data() + start, cursor - start);
+  if (text == "true" || text == "false") {
+    push(TK::Boolean);
+    return;
+  }
+  push(maybe_keyword(text));
+}
+
+void Lexer::lex_number() {
+  while (is_digit(peek()))
+    cursor++;
+
+  // Only treat the dot as a decimal point when a digit follows it, so that
+  // member access on an integer literal still lexes as `Dot`
+  if (peek() == '.' && is_digit(peek(1))) {
+    cursor++;
+    while (is_digit(peek()))
+      cursor++;
+    push(TK::Float);
+    return;
+  }
+
+  push(TK::Integer);
+}
+
+void Lexer::lex_string() {
+  while (cursor < file.length) {
+    char c = file.content[cursor];
+    if (c == '"') {
+      cursor++;
+      push(TK::String);
+      return;
+    }
+    if (c == '\n')
+      break;
+
+    if (c == '\\') {
+      switch (peek(1)) {
+      case 'n':
+      case 't':
+      case 'r':
+      case '0':
+      case '\\':
+      case '"':
+        break;
+      default:
+        report(diagnostic::Kind::InvalidString, cursor, 2,
+               "Unknown escape sequence in string literal");
+        break;
+      }
+      cursor++;
+    }
+    cursor++;
+  }
+
+  // Reached the end of the line or file without a closing quote
+  if (cursor > file.length)
+    cursor = file.length;
+  report(diagnostic::Kind::UnterminatedString, start, 1,
+         "String literal is missing a closing '\"'");
+  push(TK::String);
+}
+
+void Lexer::lex_symbol(char c) {
+  switch (c) {
+  case '(':
+    return push(TK::LParen);
+  case ')':
+    return push(TK::RParen);
+  case '{':
+    return push(TK::LCurl);
+  case '}':
+    return push(TK::RCurl);
+  case '[':
+    return push(TK::LBrac);
+  case ']':
+    return push(TK::RBrac);
+  case '%':
+    return push(TK::Percent);
+  case '.':
+    return push(TK::Dot);
+  case ',':
+    return push(TK::Comma);
+  case ':':
+    return push(TK::Colon);
+  case ';':
+    return push(TK::Semicolon);
+  case '?':
+    return push(TK::Question);
+  case '~':
+    return push(TK::Bang);
+  case '+':
+    if (match('+'))
+      return push(TK::PlusPlus);
+    return push(match('=') ? TK::PlusEquals : TK::Plus);
+  case '-':
+    if (match('-'))
+      return push(TK::MinusMinus);
+    if (match('>'))
+      return push(TK::Arrow);
+    return push(match('=') ? TK::MinusEquals : TK::Minus);
+  case '*':
+    if (match('*'))
+      return push(match('=') ? TK::StarStarEquals : TK::StarStar);
+    return push(match('=') ? TK::StarEquals : TK::Star);
+  case '/':
+    if (match('/'))
+      return push(match('=') ? TK::SlashSlashEquals : TK::SlashSlash);
+    return push(match('=') ? TK::SlashEquals : TK::Slash);
+  case '!':
+    return push(match('=') ? TK::BangEquals : TK::Bang);
+  case '=':
+    if (match('='))
+      return push(TK::EqualsEquals);
+    return push(match('>') ? TK::FatArrow : TK::Equals);
+  case '<':
+    return push(match('=') ? TK::LessEquals : TK::Less);
+  case '>':
+    return push(match('=') ? TK::MoreEquals : TK::More);
+  case '&':
+    return push(match('&') ? TK::AndAnd : TK::And);
+  case '|':
+    return push(match('|') ? TK::BarBar : TK::Bar);
+  default:
+    report(diagnostic::Kind::InvalidCharacter, start, 1,
+           "This character is not valid in Symphony source code");
+    return;
+  }
+}
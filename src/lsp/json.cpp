@@ -0,0 +1,352 @@
+#include "lsp/json.hpp"
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+
+using namespace json;
+
+const std::string *Value::as_string() const {
+  return std::get_if<std::string>(&data);
+}
+
+const Array *Value::as_array() const { return std::get_if<Array>(&data); }
+
+const Object *Value::as_object() const { return std::get_if<Object>(&data); }
+
+std::optional<double> Value::as_number() const {
+  if (auto *number = std::get_if<double>(&data))
+    return *number;
+  return std::nullopt;
+}
+
+std::optional<int64_t> Value::as_integer() const {
+  // Converting anything outside [-2^63, 2^63) is undefined, and NaN and the
+  // infinities fail the comparison too
+  constexpr double LIMIT = 0x1p63;
+  auto number = as_number();
+  if (!number || !(*number >= -LIMIT && *number < LIMIT) ||
+      std::trunc(*number) != *number)
+    return std::nullopt;
+  return static_cast<int64_t>(*number);
+}
+
+const Value &Value::operator[](std::string_view key) const {
+  static const Value NONE;
+  if (auto *object = as_object()) {
+    for (auto &[name, value] : *object) {
+      if (name == key)
+        return value;
+    }
+  }
+  return NONE;
+}
+
+/* ---------------------------------------------------------------------------*/
+/* PARSING */
+/* ---------------------------------------------------------------------------*/
+
+namespace {
+
+constexpr size_t MAX_DEPTH = 128;
+
+class Reader {
+  std::string_view text;
+  size_t cursor;
+
+  void skip_whitespace() {
+    while (cursor < text.size() &&
+           (text[cursor] == ' ' || text[cursor] == '\t' ||
+            text[cursor] == '\n' || text[cursor] == '\r'))
+      cursor++;
+  }
+
+  bool consume(std::string_view literal) {
+    if (text.substr(cursor, literal.size()) != literal)
+      return false;
+    cursor += literal.size();
+    return true;
+  }
+
+  std::optional<uint32_t> hex4() {
+    if (cursor + 4 > text.size())
+      return std::nullopt;
+    uint32_t code = 0;
+    auto [end, ec] =
+        std::from_chars(text.data() + cursor, text.data() + cursor + 4, code,
+                        16);
+    if (ec != std::errc() || end != text.data() + cursor + 4)
+      return std::nullopt;
+    cursor += 4;
+    return code;
+  }
+
+  static void append_utf8(std::string &out, uint32_t code) {
+    if (code < 0x80) {
+      out += static_cast<char>(code);
+    } else if (code < 0x800) {
+      out += static_cast<char>(0xC0 | (code >> 6));
+      out += static_cast<char>(0x80 | (code & 0x3F));
+    } else if (code < 0x10000) {
+      out += static_cast<char>(0xE0 | (code >> 12));
+      out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+      out += static_cast<char>(0x80 | (code & 0x3F));
+    } else {
+      out += static_cast<char>(0xF0 | (code >> 18));
+      out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+      out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+      out += static_cast<char>(0x80 | (code & 0x3F));
+    }
+  }
+
+  std::optional<std::string> string() {
+    if (!consume("\""))
+      return std::nullopt;
+
+    std::string out;
+    while (cursor < text.size()) {
+      // Copy the run up to the next quote or escape in one go
+      size_t end = text.find_first_of("\"\\", cursor);
+      if (end == std::string_view::npos)
+        return std::nullopt;
+      out.append(text.substr(cursor, end - cursor));
+      cursor = end + 1;
+      if (text[end] == '"')
+        return out;
+
+      if (cursor >= text.size())
+        return std::nullopt;
+      char escape = text[cursor++];
+      switch (escape) {
+      case '"':
+      case '\\':
+      case '/':
+        out += escape;
+        break;
+      case 'b':
+        out += '\b';
+        break;
+      case 'f':
+        out += '\f';
+        break;
+      case 'n':
+        out += '\n';
+        break;
+      case 'r':
+        out += '\r';
+        break;
+      case 't':
+        out += '\t';
+        break;
+      case 'u': {
+        auto code = hex4();
+        if (!code)
+          return std::nullopt;
+        // A high surrogate is only meaningful with the low one after it
+        if (*code >= 0xD800 && *code < 0xDC00 && consume("\\u")) {
+          auto low = hex4();
+          if (!low || *low < 0xDC00 || *low >= 0xE000)
+            return std::nullopt;
+          *code = 0x10000 + ((*code - 0xD800) << 10) + (*low - 0xDC00);
+        }
+        append_utf8(out, *code);
+        break;
+      }
+      default:
+        return std::nullopt;
+      }
+    }
+    return std::nullopt;
+  }
+
+  std::optional<Value> number() {
+    size_t start = cursor;
+    if (cursor < text.size() && text[cursor] == '-')
+      cursor++;
+    while (cursor < text.size() &&
+           std::string_view("0123456789.eE+-").find(text[cursor]) !=
+               std::string_view::npos)
+      cursor++;
+
+    double number;
+    auto [end, ec] =
+        std::from_chars(text.data() + start, text.data() + cursor, number);
+    if (ec != std::errc() || end != text.data() + cursor)
+      return std::nullopt;
+    return Value(number);
+  }
+
+public:
+  explicit Reader(std::string_view text) : text(text), cursor(0) {}
+
+  std::optional<Value> value(size_t depth) {
+    if (depth > MAX_DEPTH)
+      return std::nullopt;
+    skip_whitespace();
+    if (cursor >= text.size())
+      return std::nullopt;
+
+    switch (text[cursor]) {
+    case '{': {
+      cursor++;
+      Object object;
+      skip_whitespace();
+      if (consume("}"))
+        return Value(std::move(object));
+      do {
+        skip_whitespace();
+        auto key = string();
+        skip_whitespace();
+        if (!key || !consume(":"))
+          return std::nullopt;
+        auto member = value(depth + 1);
+        if (!member)
+          return std::nullopt;
+        object.emplace_back(std::move(*key), std::move(*member));
+        skip_whitespace();
+      } while (consume(","));
+      if (!consume("}"))
+        return std::nullopt;
+      return Value(std::move(object));
+    }
+    case '[': {
+      cursor++;
+      Array array;
+      skip_whitespace();
+      if (consume("]"))
+        return Value(std::move(array));
+      do {
+        auto element = value(depth + 1);
+        if (!element)
+          return std::nullopt;
+        array.push_back(std::move(*element));
+        skip_whitespace();
+      } while (consume(","));
+      if (!consume("]"))
+        return std::nullopt;
+      return Value(std::move(array));
+    }
+    case '"': {
+      auto text = string();
+      if (!text)
+        return std::nullopt;
+      return Value(std::move(*text));
+    }
+    case 't':
+      return consume("true") ? std::optional<Value>(true) : std::nullopt;
+    case 'f':
+      return consume("false") ? std::optional<Value>(false) : std::nullopt;
+    case 'n':
+      return consume("null") ? std::optional<Value>(nullptr) : std::nullopt;
+    default:
+      return number();
+    }
+  }
+
+  bool at_end() {
+    skip_whitespace();
+    return cursor == text.size();
+  }
+};
+
+} // namespace
+
+std::optional<Value> json::parse(std::string_view text) {
+  Reader reader(text);
+  auto value = reader.value(0);
+  if (!value || !reader.at_end())
+    return std::nullopt;
+  return value;
+}
+
+/* ---------------------------------------------------------------------------*/
+/* PRINTING */
+/* ---------------------------------------------------------------------------*/
+
+namespace {
+
+void write_string(std::string &out, std::string_view text) {
+  out += '"';
+  for (char c : text) {
+    switch (c) {
+    case '"':
+      out += "\\\"";
+      break;
+    case '\\':
+      out += "\\\\";
+      break;
+    case '\n':
+      out += "\\n";
+      break;
+    case '\r':
+      out += "\\r";
+      break;
+    case '\t':
+      out += "\\t";
+      break;
+    default:
+      if (static_cast<unsigned char>(c) < 0x20) {
+        char escape[7];
+        std::snprintf(escape, sizeof(escape), "\\u%04x", c);
+        out += escape;
+      } else {
+        out += c;
+      }
+    }
+  }
+  out += '"';
+}
+
+} // namespace
+
+void json::write(std::string &out, const Value &value) {
+  switch (value.data.index()) {
+  case 0:
+    out += "null";
+    break;
+  case 1:
+    out += std::get<bool>(value.data) ? "true" : "false";
+    break;
+  case 2: {
+    char buffer[32];
+    double number = std::get<double>(value.data);
+    auto [end, ec] = std::to_chars(buffer, buffer + sizeof(buffer), number);
+    out.append(buffer, ec == std::errc() ? end : buffer);
+    break;
+  }
+  case 3:
+    write_string(out, std::get<std::string>(value.data));
+    break;
+  case 4: {
+    out += '[';
+    bool first = true;
+    for (auto &element : std::get<Array>(value.data)) {
+      if (!first)
+        out += ',';
+      first = false;
+      write(out, element);
+    }
+    out += ']';
+    break;
+  }
+  case 5: {
+    out += '{';
+    bool first = true;
+    for (auto &[key, member] : std::get<Object>(value.data)) {
+      if (!first)
+        out += ',';
+      first = false;
+      write_string(out, key);
+      out += ':';
+      write(out, member);
+    }
+    out += '}';
+    break;
+  }
+  }
+}
+
+std::string json::dump(const Value &value) {
+  std::string out;
+  write(out, value);
+  return out;
+}
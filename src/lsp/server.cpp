@@ -0,0 +1,418 @@
+#include "lsp/server.hpp"
+#include "common/diagnostic.hpp"
+#include "parser/parser.hpp"
+#include "sema/checker.hpp"
+#include "sema/folder.hpp"
+#include "sema/resolver.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+
+using namespace lsp;
+
+/* ---------------------------------------------------------------------------*/
+/* POSITIONS */
+/* ---------------------------------------------------------------------------*/
+
+namespace {
+
+bool is_continuation(char c) {
+  return (static_cast<unsigned char>(c) & 0xC0) == 0x80;
+}
+
+/// @brief How many UTF-16 code units the character starting with `lead`
+/// takes: two for anything outside the basic multilingual plane.
+uint32_t utf16_width(char lead) {
+  return static_cast<unsigned char>(lead) >= 0xF0 ? 2 : 1;
+}
+
+} // namespace
+
+size_t lsp::offset_of(const Rope &text, Position position) {
+  if (position.line >= text.line_count())
+    return text.size();
+
+  size_t offset = text.line_start(position.line);
+  size_t end = text.line_start(position.line + 1);
+  uint32_t units = 0;
+  for (auto chunk : text.chunks(offset, end - offset)) {
+    for (char c : chunk) {
+      if (!is_continuation(c)) {
+        if (c == '\n' || units >= position.character)
+          return offset;
+        units += utf16_width(c);
+      }
+      offset++;
+    }
+  }
+  return offset;
+}
+
+Position lsp::position_of(const File &file, size_t offset) {
+  offset = std::min(offset, file.length);
+  size_t line = file.line_of(offset) - 1;
+
+  uint32_t units = 0;
+  for (size_t i = file.line_starts[line]; i < offset; i++) {
+    if (!is_continuation(file.content[i]))
+      units += utf16_width(file.content[i]);
+  }
+  return {static_cast<uint32_t>(line), units};
+}
+
+namespace {
+
+/// LSP's `uinteger`, which positions are made of
+bool is_uinteger(std::optional<int64_t> number) {
+  return number && *number >= 0 && *number <= UINT32_MAX;
+}
+
+/// LSP's `integer`, which versions are
+bool is_integer(std::optional<int64_t> number) {
+  return number && *number >= INT32_MIN && *number <= INT32_MAX;
+}
+
+std::optional<Position> parse_position(const json::Value &value) {
+  auto line = value["line"].as_integer();
+  auto character = value["character"].as_integer();
+  if (!is_uinteger(line) || !is_uinteger(character))
+    return std::nullopt;
+  return Position{static_cast<uint32_t>(*line),
+                  static_cast<uint32_t>(*character)};
+}
+
+json::Value position_json(Position position) {
+  return json::Object{{"line", static_cast<size_t>(position.line)},
+                      {"character", static_cast<size_t>(position.character)}};
+}
+
+json::Value diagnostic_json(const Diagnostic &diagnostic) {
+  const File &file = diagnostic.span.file;
+  size_t start = diagnostic.span.offset;
+  size_t end = start + diagnostic.span.length;
+  json::Value range =
+      json::Object{{"start", position_json(position_of(file, start))},
+                   {"end", position_json(position_of(file, end))}};
+
+  // LSP numbers its severities from 1 in the same order as ours
+  int severity = static_cast<int>(diagnostic.severity) + 1;
+  return json::Object{
+      {"range", std::move(range)},
+      {"severity", severity},
+      {"code", diagnostic::get_diagnostic_kind_string(diagnostic.kind)},
+      {"source", "symphc"},
+      {"message", diagnostic.message},
+  };
+}
+
+} // namespace
+
+/* ---------------------------------------------------------------------------*/
+/* SERVER */
+/* ---------------------------------------------------------------------------*/
+
+Server::Server(Send send, std::chrono::milliseconds debounce)
+    : send(std::move(send)), send_mutex(), debounce(debounce),
+      shut_down(false), mutex(), wake(), idle(), queue(), busy(false),
+      stopping(false), pool(), documents(), worker() {
+  worker = std::thread([this]() { run(); });
+}
+
+Server::~Server() {
+  {
+    std::lock_guard lock(mutex);
+    stopping = true;
+  }
+  wake.notify_all();
+  worker.join();
+}
+
+int Server::exit_status() const { return shut_down ? 0 : 1; }
+
+void Server::reply(const json::Value &id, json::Value result) {
+  json::Value message = json::Object{
+      {"jsonrpc", "2.0"}, {"id", id}, {"result", std::move(result)}};
+  std::lock_guard lock(send_mutex);
+  send(json::dump(message));
+}
+
+void Server::reply_error(const json::Value &id, int code,
+                         std::string message) {
+  json::Value error =
+      json::Object{{"code", code}, {"message", std::move(message)}};
+  json::Value response = json::Object{
+      {"jsonrpc", "2.0"}, {"id", id}, {"error", std::move(error)}};
+  std::lock_guard lock(send_mutex);
+  send(json::dump(response));
+}
+
+void Server::notify(std::string method, json::Value params) {
+  json::Value message = json::Object{{"jsonrpc", "2.0"},
+                                     {"method", std::move(method)},
+                                     {"params", std::move(params)}};
+  std::lock_guard lock(send_mutex);
+  send(json::dump(message));
+}
+
+bool Server::handle(std::string_view text) {
+  auto message = json::parse(text);
+  if (!message || !message->as_object()) {
+    reply_error(nullptr, -32700, "Parse error");
+    return true;
+  }
+
+  const json::Value &id = (*message)["id"];
+  const json::Value &params = (*message)["params"];
+  const std::string *method = (*message)["method"].as_string();
+  // Responses to requests we never make
+  if (method == nullptr)
+    return true;
+
+  if (*method == "exit")
+    return false;
+  if (shut_down) {
+    if (!id.is_null())
+      reply_error(id, -32600, "The server is shutting down");
+    return true;
+  }
+
+  if (*method == "initialize") {
+    json::Value sync = json::Object{{"openClose", true}, {"change", 2}};
+    json::Value capabilities = json::Object{{"positionEncoding", "utf-16"},
+                                            {"textDocumentSync", sync}};
+    json::Value info =
+        json::Object{{"name", "symphc"}, {"version", SYMPH_VERSION}};
+    reply(id, json::Object{{"capabilities", std::move(capabilities)},
+                           {"serverInfo", std::move(info)}});
+  } else if (*method == "shutdown") {
+    shut_down = true;
+    reply(id, nullptr);
+  } else if (*method == "textDocument/didOpen") {
+    const json::Value &document = params["textDocument"];
+    const std::string *uri = document["uri"].as_string();
+    const std::string *content = document["text"].as_string();
+    auto version = document["version"].as_integer();
+    if (uri == nullptr || content == nullptr || !is_integer(version))
+      return true;
+
+    Pending change;
+    change.version = *version;
+    change.opened = true;
+    change.edits.push_back({std::nullopt, *content});
+    // Nothing to coalesce with yet, so a freshly opened file is checked now
+    change.due = Clock::now();
+    enqueue(*uri, std::move(change));
+  } else if (*method == "textDocument/didChange") {
+    const json::Value &document = params["textDocument"];
+    const std::string *uri = document["uri"].as_string();
+    const json::Array *changes = params["contentChanges"].as_array();
+    auto version = document["version"].as_integer();
+    if (uri == nullptr || changes == nullptr || !is_integer(version))
+      return true;
+
+    Pending change;
+    change.version = *version;
+    change.due = Clock::now() + debounce;
+    for (auto &content_change : *changes) {
+      const std::string *inserted = content_change["text"].as_string();
+      const json::Value &range = content_change["range"];
+      auto start = parse_position(range["start"]);
+      auto end = parse_position(range["end"]);
+
+      // Only a change without a range replaces the whole document. Every
+      // edit is relative to the ones before it, so one that can't be applied
+      // makes the rest meaningless too.
+      if (inserted == nullptr || (!range.is_null() && !(start && end))) {
+        notify("window/logMessage",
+               json::Object{{"type", 1},
+                            {"message", "Ignored a malformed change to " +
+                                            *uri}});
+        return true;
+      }
+
+      Edit edit{std::nullopt, *inserted};
+      if (!range.is_null())
+        edit.range = {*start, *end};
+      change.edits.push_back(std::move(edit));
+    }
+    enqueue(*uri, std::move(change));
+  } else if (*method == "textDocument/didClose") {
+    const std::string *uri = params["textDocument"]["uri"].as_string();
+    if (uri == nullptr)
+      return true;
+
+    Pending change;
+    change.closed = true;
+    change.due = Clock::now();
+    enqueue(*uri, std::move(change));
+  } else if (!id.is_null()) {
+    reply_error(id, -32601, "Unsupported method: " + *method);
+  }
+  return true;
+}
+
+void Server::enqueue(const std::string &uri, Pending change) {
+  {
+    std::lock_guard lock(mutex);
+    auto [it, inserted] = queue.try_emplace(uri);
+    Pending &pending = it->second;
+
+    if (inserted || change.opened || change.closed) {
+      pending = std::move(change);
+    } else {
+      // Keep whatever opened the document, the edits build on it
+      pending.version = change.version;
+      pending.due = change.due;
+      for (auto &edit : change.edits)
+        pending.edits.push_back(std::move(edit));
+    }
+  }
+  wake.notify_all();
+}
+
+void Server::wait_idle() {
+  std::unique_lock lock(mutex);
+  idle.wait(lock, [&]() { return queue.empty() && !busy; });
+}
+
+bool Server::superseded(const std::string &uri) {
+  std::lock_guard lock(mutex);
+  return queue.contains(uri);
+}
+
+void Server::run() {
+  std::unique_lock lock(mutex);
+  while (true) {
+    wake.wait(lock, [&]() { return stopping || !queue.empty(); });
+    if (stopping)
+      return;
+
+    // Every keystroke pushes its document's deadline back, so a burst of
+    // typing is analyzed once, after it settles
+    auto next = std::min_element(
+        queue.begin(), queue.end(), [](const auto &a, const auto &b) {
+          return a.second.due < b.second.due;
+        });
+    if (next->second.due > Clock::now()) {
+      wake.wait_until(lock, next->second.due);
+      continue;
+    }
+
+    std::string uri = next->first;
+    Pending change = std::move(next->second);
+    queue.erase(next);
+    busy = true;
+
+    lock.unlock();
+    analyze(uri, std::move(change));
+    lock.lock();
+
+    busy = false;
+    if (queue.empty())
+      idle.notify_all();
+  }
+}
+
+void Server::analyze(const std::string &uri, Pending change) {
+  if (change.closed) {
+    documents.erase(uri);
+    notify("textDocument/publishDiagnostics",
+           json::Object{{"uri", uri}, {"diagnostics", json::Array()}});
+    return;
+  }
+
+  auto &document = documents[uri];
+  for (auto &edit : change.edits) {
+    if (!edit.range) {
+      document = std::make_unique<syntax::SyntaxTree>(std::move(edit.text),
+                                                      uri);
+      continue;
+    }
+    // Changes to a document that was never opened have nothing to apply to
+    if (!document)
+      continue;
+
+    const Rope &text = document->get_text();
+    size_t start = offset_of(text, edit.range->first);
+    size_t end = std::max(start, offset_of(text, edit.range->second));
+    document->edit(start, end - start, edit.text);
+  }
+  if (!document) {
+    documents.erase(uri);
+    return;
+  }
+
+  // The edits are applied either way, but a version that is already out of
+  // date isn't worth parsing, let alone reporting
+  if (superseded(uri))
+    return;
+
+  DiagnosticEngine diagnostics;
+  diagnostics.merge(document->get_diagnostics());
+  auto tokens = document->tokens();
+  auto tree = Parser(tokens, diagnostics).parse();
+  if (diagnostics.size() == 0) {
+    StringInterner names;
+    sema::TypeInterner types;
+    auto resolution = sema::resolve(tree, names, diagnostics);
+    auto typing =
+        sema::check(tree, resolution, names, types, diagnostics, pool);
+    if (diagnostics.size() == 0)
+      sema::fold(tree, resolution, typing, diagnostics);
+  }
+  if (superseded(uri))
+    return;
+
+  json::Array published;
+  published.reserve(diagnostics.size());
+  for (auto &diagnostic : diagnostics)
+    published.push_back(diagnostic_json(diagnostic));
+  notify("textDocument/publishDiagnostics",
+         json::Object{{"uri", uri},
+                      {"version", change.version},
+                      {"diagnostics", std::move(published)}});
+}
+
+/* ---------------------------------------------------------------------------*/
+/* TRANSPORT */
+/* ---------------------------------------------------------------------------*/
+
+std::optional<std::string> lsp::read_message(std::istream &in) {
+  constexpr std::string_view CONTENT_LENGTH = "Content-Length:";
+  std::optional<size_t> length;
+
+  std::string line;
+  while (std::getline(in, line)) {
+    if (!line.empty() && line.back() == '\r')
+      line.pop_back();
+    if (line.empty()) {
+      if (length)
+        break;
+      continue;
+    }
+    if (line.starts_with(CONTENT_LENGTH))
+      length = std::strtoull(line.c_str() + CONTENT_LENGTH.size(), nullptr, 10);
+  }
+  if (!length || !in)
+    return std::nullopt;
+
+  std::string body(*length, '\0');
+  if (!in.read(body.data(), static_cast<std::streamsize>(*length)))
+    return std::nullopt;
+  return body;
+}
+
+int lsp::serve(std::istream &in, output::Sink &out) {
+  Server server([&](std::string_view body) {
+    out.write("Content-Length: " + std::to_string(body.size()) + "\r\n\r\n");
+    out.write(body);
+    out.flush();
+  });
+
+  while (auto message = read_message(in)) {
+    if (!server.handle(*message))
+      return server.exit_status();
+  }
+  // The client went away without saying goodbye
+  return 1;
+}
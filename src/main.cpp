@@ -1,19 +1,76 @@
 #include "common/ansi.hpp"
 #include "common/diagnostic.hpp"
-#include "common/span.hpp"
+#include "common/profile.hpp"
+#include "common/sink.hpp"
+#include "driver/daemon.hpp"
+#include "driver/driver.hpp"
+#include "lsp/server.hpp"
 #include <iostream>
+#include <string>
+#include <vector>
 
-int main() {
+int main(int argc, char **argv) {
   console::initialize_console_attributes();
+  diagnostic::initialize_label_tables();
 
-  std::string source = "let x = 42;\nlet y = 10;";
-  std::string path = "test.symph";
-  File file(source, path);
+  std::vector<std::string> args(argv + 1, argv + argc);
+  auto options = driver::parse_arguments(args);
+  if (!options) {
+    output::err().write(driver::USAGE);
+    output::flush_all();
+    return 2;
+  }
 
-  Span span(file, 4, 5);
-  Diagnostic diag(diagnostic::Kind::ExpectedExpression, span,
-                  "Invalid assignment");
+  if (options->version) {
+    output::out().write("symphc " SYMPH_VERSION "\n");
+    output::flush_all();
+    return 0;
+  }
 
-  std::cout << diag.print() << std::endl;
-  return 0;
-}
\ No newline at end of file
+  if (options->lsp) {
+    std::ios::sync_with_stdio(false);
+    return lsp::serve(std::cin, output::out());
+  }
+
+  options->colored = console::IS_COLOR_CAPABLE;
+  if (options->daemon) {
+    int status = driver::serve(*options);
+    output::flush_all();
+    return status;
+  }
+
+  // The daemon never runs programs, which could hang or bring it down; they
+  // run here, in a process of their own
+  if (options->client && !options->run) {
+    auto status = driver::request(args, *options);
+    if (!status && options->stop)
+      output::err().write("symphc: no daemon is listening\n");
+    if (status || options->stop) {
+      output::flush_all();
+      return status.value_or(1);
+    }
+    // Nobody is listening, so build here instead
+  }
+
+  if (options->time_report || !options->trace.empty())
+    profile::enable(!options->trace.empty());
+
+  int status = driver::Session(*options, false)
+                   .build(*options, "",
+                          [](driver::Channel channel, std::string_view text) {
+                            auto &sink = channel == driver::Channel::Out
+                                             ? output::out()
+                                             : output::err();
+                            sink.write(text);
+                          });
+
+  if (options->time_report)
+    profile::write_report(output::err());
+  if (!options->trace.empty() && !profile::write_trace(options->trace)) {
+    output::err().write("symphc: cannot write '" + options->trace + "'\n");
+    status = 1;
+  }
+
+  output::flush_all();
+  return status;
+}
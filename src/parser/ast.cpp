@@ -0,0 +1,392 @@
+#include "parser/ast.hpp"
+#include <cassert>
+
+using namespace ast;
+
+Tree::Tree(const File &file)
+    : file(&file), token_kinds({}), token_offsets({}), token_lengths({}),
+      tags({}), main_tokens({}), data({}), extra({}) {}
+
+void Tree::set_tokens(const std::vector<Token> &tokens) {
+  token_kinds.resize(tokens.size());
+  token_offsets.resize(tokens.size());
+  token_lengths.resize(tokens.size());
+
+  for (size_t i = 0; i < tokens.size(); i++) {
+    token_kinds[i] = tokens[i].kind;
+    token_offsets[i] = static_cast<uint32_t>(tokens[i].span.offset);
+    token_lengths[i] = static_cast<uint32_t>(tokens[i].span.length);
+  }
+}
+
+NodeIndex Tree::add_node(Tag tag, TokenIndex main_token, Data node_data) {
+  auto index = static_cast<NodeIndex>(tags.size());
+  tags.push_back(tag);
+  main_tokens.push_back(main_token);
+  data.push_back(node_data);
+  return index;
+}
+
+uint32_t Tree::add_extra(std::span<const uint32_t> words) {
+  auto index = static_cast<uint32_t>(extra.size());
+  extra.append(words.begin(), words.end());
+  return index;
+}
+
+void Tree::splice(const Tree &fragment, std::vector<NodeIndex> &items) {
+  // The fragment's own root is dropped, and so is the range of items it put at
+  // the very end of its extra data
+  auto node_base = static_cast<uint32_t>(tags.size()) - 1;
+  auto extra_base = static_cast<uint32_t>(extra.size());
+  Data root = fragment.data[0];
+
+  auto node = [&](uint32_t index) {
+    return index == NULL_NODE ? NULL_NODE : index + node_base;
+  };
+
+  size_t first_extra = extra.size();
+  extra.append(fragment.extra.begin(), fragment.extra.begin() + root.lhs);
+
+  auto relocate_range = [&](uint32_t start, uint32_t end) {
+    for (uint32_t i = start; i < end; i++)
+      extra[first_extra + i] = node(extra[first_extra + i]);
+  };
+
+  for (NodeIndex n = 1; n < fragment.tags.size(); n++) {
+    Tag tag = fragment.tags[n];
+    Data d = fragment.data[n];
+
+    switch (tag) {
+    case Tag::Root:
+    case Tag::Literal:
+    case Tag::Identifier:
+    case Tag::EnumVariant:
+    case Tag::Error:
+      break;
+    case Tag::Unary:
+    case Tag::Postfix:
+    case Tag::Member:
+    case Tag::Grouping:
+    case Tag::Param:
+    case Tag::Return:
+      d.lhs = node(d.lhs);
+      break;
+    case Tag::Binary:
+    case Tag::Assign:
+    case Tag::Cast:
+    case Tag::Index:
+    case Tag::Lambda:
+    case Tag::VarDecl:
+    case Tag::While:
+    case Tag::For:
+      d.lhs = node(d.lhs);
+      d.rhs = node(d.rhs);
+      break;
+    case Tag::Ternary:
+    case Tag::If:
+      relocate_range(d.rhs, d.rhs + 2);
+      d.lhs = node(d.lhs);
+      d.rhs += extra_base;
+      break;
+    case Tag::Call: {
+      relocate_range(fragment.extra[d.rhs], fragment.extra[d.rhs + 1]);
+      extra[first_extra + d.rhs] += extra_base;
+      extra[first_extra + d.rhs + 1] += extra_base;
+      d.lhs = node(d.lhs);
+      d.rhs += extra_base;
+      break;
+    }
+    case Tag::FnDecl: {
+      relocate_range(fragment.extra[d.lhs], fragment.extra[d.lhs + 1]);
+      relocate_range(d.lhs + 2, d.lhs + 3);
+      extra[first_extra + d.lhs] += extra_base;
+      extra[first_extra + d.lhs + 1] += extra_base;
+      d.lhs += extra_base;
+      d.rhs = node(d.rhs);
+      break;
+    }
+    case Tag::Tuple:
+    case Tag::Array:
+    case Tag::Block:
+    case Tag::ClassDecl:
+    case Tag::EnumDecl:
+      relocate_range(d.lhs, d.rhs);
+      d.lhs += extra_base;
+      d.rhs += extra_base;
+      break;
+    }
+
+    tags.push_back(tag);
+    main_tokens.push_back(fragment.main_tokens[n]);
+    data.push_back(d);
+  }
+
+  for (uint32_t i = root.lhs; i < root.rhs; i++)
+    items.push_back(node(fragment.extra[i]));
+}
+
+size_t Tree::byte_size() const {
+  return token_kinds.size() * sizeof(Token::Kind) +
+         (token_offsets.size() + token_lengths.size() + main_tokens.size() +
+          extra.size()) *
+             sizeof(uint32_t) +
+         tags.size() * sizeof(Tag) + data.size() * sizeof(Data);
+}
+
+std::string_view Tree::token_lexeme(TokenIndex token) const {
+  return std::string_view(file->content)
+      .substr(token_offsets[token], token_lengths[token]);
+}
+
+Span Tree::token_span(TokenIndex token) const {
+  return Span(*file, token_offsets[token], token_lengths[token]);
+}
+
+NodeList Tree::items() const { return list(0); }
+
+NodeList Tree::list(NodeIndex node) const {
+  Data d = data[node];
+  return NodeList(extra.data() + d.lhs, d.rhs - d.lhs);
+}
+
+TernaryExpr Tree::ternary(NodeIndex node) const {
+  assert(tags[node] == Tag::Ternary);
+  Data d = data[node];
+  return {d.lhs, extra[d.rhs], extra[d.rhs + 1]};
+}
+
+CallExpr Tree::call(NodeIndex node) const {
+  assert(tags[node] == Tag::Call);
+  Data d = data[node];
+  uint32_t start = extra[d.rhs], end = extra[d.rhs + 1];
+  return {d.lhs, NodeList(extra.data() + start, end - start)};
+}
+
+VarDecl Tree::var_decl(NodeIndex node) const {
+  assert(tags[node] == Tag::VarDecl);
+  return {main_tokens[node], data[node].lhs, data[node].rhs};
+}
+
+IfStmt Tree::if_stmt(NodeIndex node) const {
+  assert(tags[node] == Tag::If);
+  Data d = data[node];
+  return {d.lhs, extra[d.rhs], extra[d.rhs + 1]};
+}
+
+WhileStmt Tree::while_stmt(NodeIndex node) const {
+  assert(tags[node] == Tag::While);
+  return {data[node].lhs, data[node].rhs};
+}
+
+ForStmt Tree::for_stmt(NodeIndex node) const {
+  assert(tags[node] == Tag::For);
+  return {main_tokens[node] + 1, data[node].lhs, data[node].rhs};
+}
+
+ReturnStmt Tree::return_stmt(NodeIndex node) const {
+  assert(tags[node] == Tag::Return);
+  return {data[node].lhs};
+}
+
+FnDecl Tree::fn_decl(NodeIndex node) const {
+  assert(tags[node] == Tag::FnDecl);
+  Data d = data[node];
+  uint32_t start = extra[d.lhs], end = extra[d.lhs + 1];
+  return {main_tokens[node], NodeList(extra.data() + start, end - start),
+          extra[d.lhs + 2], d.rhs};
+}
+
+ClassDecl Tree::class_decl(NodeIndex node) const {
+  assert(tags[node] == Tag::ClassDecl);
+  return {main_tokens[node] + 1, list(node)};
+}
+
+EnumDecl Tree::enum_decl(NodeIndex node) const {
+  assert(tags[node] == Tag::EnumDecl);
+  return {main_tokens[node] + 1, list(node)};
+}
+
+namespace {
+
+void print_children(std::ostream &os, const Tree &tree, NodeList nodes) {
+  for (auto child : nodes) {
+    os << " ";
+    print_node(os, tree, child);
+  }
+}
+
+void print_optional(std::ostream &os, const Tree &tree, NodeIndex node) {
+  os << " ";
+  if (node == NULL_NODE)
+    os << "_";
+  else
+    print_node(os, tree, node);
+}
+
+} // namespace
+
+void ast::print_node(std::ostream &os, const Tree &tree, NodeIndex node) {
+  auto lexeme = tree.token_lexeme(tree.main_token(node));
+  Data d = tree.node_data(node);
+
+  switch (tree.tag(node)) {
+  case Tag::Root:
+    os << "(module";
+    print_children(os, tree, tree.items());
+    os << ")";
+    return;
+  case Tag::Literal:
+  case Tag::Identifier:
+  case Tag::EnumVariant:
+    os << lexeme;
+    return;
+  case Tag::Unary:
+    os << "(" << lexeme;
+    print_optional(os, tree, d.lhs);
+    os << ")";
+    return;
+  case Tag::Postfix:
+    os << "(post" << lexeme;
+    print_optional(os, tree, d.lhs);
+    os << ")";
+    return;
+  case Tag::Binary:
+  case Tag::Assign:
+    os << "(" << lexeme;
+    print_optional(os, tree, d.lhs);
+    print_optional(os, tree, d.rhs);
+    os << ")";
+    return;
+  case Tag::Ternary: {
+    auto e = tree.ternary(node);
+    os << "(?";
+    print_optional(os, tree, e.condition);
+    print_optional(os, tree, e.then);
+    print_optional(os, tree, e.otherwise);
+    os << ")";
+    return;
+  }
+  case Tag::Cast:
+    os << "(as";
+    print_optional(os, tree, d.lhs);
+    print_optional(os, tree, d.rhs);
+    os << ")";
+    return;
+  case Tag::Call: {
+    auto e = tree.call(node);
+    os << "(call";
+    print_optional(os, tree, e.callee);
+    print_children(os, tree, e.arguments);
+    os << ")";
+    return;
+  }
+  case Tag::Index:
+    os << "(index";
+    print_optional(os, tree, d.lhs);
+    print_optional(os, tree, d.rhs);
+    os << ")";
+    return;
+  case Tag::Member:
+    os << "(.";
+    print_optional(os, tree, d.lhs);
+    os << " " << lexeme << ")";
+    return;
+  case Tag::Grouping:
+    print_node(os, tree, d.lhs);
+    return;
+  case Tag::Tuple:
+    os << "(tuple";
+    print_children(os, tree, tree.list(node));
+    os << ")";
+    return;
+  case Tag::Array:
+    os << "(array";
+    print_children(os, tree, tree.list(node));
+    os << ")";
+    return;
+  case Tag::Lambda:
+    os << "(=>";
+    print_optional(os, tree, d.lhs);
+    print_optional(os, tree, d.rhs);
+    os << ")";
+    return;
+  case Tag::Block:
+    os << "{";
+    print_children(os, tree, tree.list(node));
+    os << " }";
+    return;
+  case Tag::VarDecl: {
+    auto s = tree.var_decl(node);
+    os << "(let " << tree.token_lexeme(s.name);
+    print_optional(os, tree, s.type);
+    print_optional(os, tree, s.value);
+    os << ")";
+    return;
+  }
+  case Tag::If: {
+    auto s = tree.if_stmt(node);
+    os << "(if";
+    print_optional(os, tree, s.condition);
+    print_optional(os, tree, s.then);
+    print_optional(os, tree, s.otherwise);
+    os << ")";
+    return;
+  }
+  case Tag::While: {
+    auto s = tree.while_stmt(node);
+    os << "(while";
+    print_optional(os, tree, s.condition);
+    print_optional(os, tree, s.body);
+    os << ")";
+    return;
+  }
+  case Tag::For: {
+    auto s = tree.for_stmt(node);
+    os << "(for " << tree.token_lexeme(s.variable);
+    print_optional(os, tree, s.iterable);
+    print_optional(os, tree, s.body);
+    os << ")";
+    return;
+  }
+  case Tag::Return:
+    os << "(return";
+    print_optional(os, tree, tree.return_stmt(node).value);
+    os << ")";
+    return;
+  case Tag::FnDecl: {
+    auto s = tree.fn_decl(node);
+    os << "(fn " << tree.token_lexeme(s.name) << " (";
+    for (size_t i = 0; i < s.params.size(); i++) {
+      if (i > 0)
+        os << " ";
+      print_node(os, tree, s.params[i]);
+    }
+    os << ")";
+    print_optional(os, tree, s.return_type);
+    print_optional(os, tree, s.body);
+    os << ")";
+    return;
+  }
+  case Tag::Param:
+    os << lexeme << ":";
+    print_node(os, tree, d.lhs);
+    return;
+  case Tag::ClassDecl: {
+    auto s = tree.class_decl(node);
+    os << "(class " << tree.token_lexeme(s.name);
+    print_children(os, tree, s.members);
+    os << ")";
+    return;
+  }
+  case Tag::EnumDecl: {
+    auto s = tree.enum_decl(node);
+    os << "(enum " << tree.token_lexeme(s.name);
+    print_children(os, tree, s.variants);
+    os << ")";
+    return;
+  }
+  case Tag::Error:
+    os << "<error>";
+    return;
+  }
+}
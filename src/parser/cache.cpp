@@ -0,0 +1,312 @@
+#include "parser/cache.hpp"
+#include "common/hash.hpp"
+#include "common/profile.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+using namespace cache;
+using ast::Data;
+using ast::Tag;
+
+namespace fs = std::filesystem;
+
+static_assert(std::is_trivially_copyable_v<Header> && sizeof(Header) % 8 == 0);
+static_assert(std::is_trivially_copyable_v<CachedDiagnostic>);
+static_assert(std::is_trivially_copyable_v<Data> && sizeof(Data) == 8);
+static_assert(sizeof(Tag) == 1);
+
+namespace {
+
+constexpr size_t ALIGNMENT = 8;
+
+size_t align_up(size_t offset) {
+  return (offset + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+}
+
+/// @brief Byte offset of every section, derived from the header's counts alone.
+struct Layout {
+  size_t token_kinds;
+  size_t token_offsets;
+  size_t token_lengths;
+  size_t tags;
+  size_t main_tokens;
+  size_t data;
+  size_t extra;
+  size_t diagnostics;
+  size_t message_offsets;
+  size_t message_bytes;
+  size_t size;
+
+  explicit Layout(const Header &h) {
+    size_t at = align_up(sizeof(Header));
+    auto section = [&](size_t bytes) {
+      size_t start = at;
+      at = align_up(at + bytes);
+      return start;
+    };
+
+    token_kinds = section(h.token_count * sizeof(Token::Kind));
+    token_offsets = section(h.token_count * sizeof(uint32_t));
+    token_lengths = section(h.token_count * sizeof(uint32_t));
+    tags = section(h.node_count * sizeof(Tag));
+    main_tokens = section(h.node_count * sizeof(ast::TokenIndex));
+    data = section(h.node_count * sizeof(Data));
+    extra = section(h.extra_count * sizeof(uint32_t));
+    diagnostics = section(h.diagnostic_count * sizeof(CachedDiagnostic));
+    message_offsets = section((h.diagnostic_count + 1) * sizeof(uint32_t));
+    message_bytes = section(h.message_bytes);
+    size = at;
+  }
+};
+
+template <typename T>
+void put(std::vector<std::byte> &out, size_t offset, std::span<const T> items) {
+  if (!items.empty())
+    std::memcpy(out.data() + offset, items.data(), items.size_bytes());
+}
+
+/// @brief Hash of everything after the header, padding included.
+uint64_t body_hash(std::span<const std::byte> file) {
+  auto body = file.subspan(align_up(sizeof(Header)));
+  return hash::xxh3_64(
+      {reinterpret_cast<const char *>(body.data()), body.size()});
+}
+
+template <typename T>
+std::span<const T> view(const MappedFile &mapping, size_t offset,
+                        size_t count) {
+  return {reinterpret_cast<const T *>(mapping.bytes().data() + offset), count};
+}
+
+/// @brief A name no other writer, in this process or another, will pick.
+std::string temporary_path(const std::string &path) {
+  static std::atomic<uint64_t> counter = 0;
+  static const uint64_t salt = std::random_device{}();
+  uint64_t unique = hash::xxh3_64(std::to_string(counter++), salt);
+
+  char suffix[24];
+  std::snprintf(suffix, sizeof(suffix), ".%016llx.tmp",
+                static_cast<unsigned long long>(unique));
+  return path + suffix;
+}
+
+} // namespace
+
+uint64_t cache::source_hash(const File &file) {
+  return hash::xxh3_64(file.content);
+}
+
+uint64_t cache::key_for(const File &file, std::string_view options) {
+  std::string identity = "symphc " SYMPH_VERSION;
+  identity += '\0';
+  identity += std::to_string(FORMAT_VERSION);
+  identity += '\0';
+  identity += options;
+  return hash::xxh3_64(file.content, hash::xxh3_64(identity));
+}
+
+bool cache::store(const ast::Tree &tree, const DiagnosticEngine &diagnostics,
+                  const std::string &path) {
+  profile::Scope scope(profile::Phase::Cache, path);
+
+  std::vector<CachedDiagnostic> cached_diagnostics;
+  std::vector<uint32_t> message_offsets = {0};
+  std::string message_bytes;
+  for (auto &d : diagnostics) {
+    cached_diagnostics.push_back({static_cast<uint32_t>(d.kind),
+                                  static_cast<uint32_t>(d.span.offset),
+                                  static_cast<uint32_t>(d.span.length)});
+    message_bytes += d.message;
+    message_offsets.push_back(static_cast<uint32_t>(message_bytes.size()));
+  }
+
+  Header header = {};
+  std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version = FORMAT_VERSION;
+  header.byte_order = BYTE_ORDER_MARK;
+  header.source_hash = source_hash(*tree.file);
+  header.source_length = tree.file->content.size();
+  header.token_count = static_cast<uint32_t>(tree.token_kinds.size());
+  header.node_count = static_cast<uint32_t>(tree.node_count());
+  header.extra_count = static_cast<uint32_t>(tree.extra.size());
+  header.diagnostic_count = static_cast<uint32_t>(cached_diagnostics.size());
+  header.message_bytes = static_cast<uint32_t>(message_bytes.size());
+
+  Layout layout(header);
+  std::vector<std::byte> out(layout.size);
+  put<Token::Kind>(out, layout.token_kinds, tree.token_kinds);
+  put<uint32_t>(out, layout.token_offsets, tree.token_offsets);
+  put<uint32_t>(out, layout.token_lengths, tree.token_lengths);
+  put<Tag>(out, layout.tags, tree.tags);
+  put<ast::TokenIndex>(out, layout.main_tokens, tree.main_tokens);
+  put<Data>(out, layout.data, tree.data);
+  put<uint32_t>(out, layout.extra, tree.extra);
+  put<CachedDiagnostic>(out, layout.diagnostics, cached_diagnostics);
+  put<uint32_t>(out, layout.message_offsets, message_offsets);
+  put<char>(out, layout.message_bytes, message_bytes);
+  header.body_hash = body_hash(out);
+  std::memcpy(out.data(), &header, sizeof(header));
+
+  std::string temporary = temporary_path(path);
+  {
+    std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+    if (!file.write(reinterpret_cast<const char *>(out.data()),
+                    static_cast<std::streamsize>(out.size()))) {
+      file.close();
+      std::remove(temporary.c_str());
+      return false;
+    }
+  }
+  if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+    std::remove(temporary.c_str());
+    return false;
+  }
+  return true;
+}
+
+/* ---------------------------------------------------------------------------*/
+/* LOADING */
+/* ---------------------------------------------------------------------------*/
+
+Module::Module(MappedFile mapping, const File &file)
+    : mapping(std::move(mapping)), ast(file), diagnostics({}),
+      message_offsets({}), message_bytes() {
+  Header header;
+  std::memcpy(&header, this->mapping.bytes().data(), sizeof(header));
+  Layout layout(header);
+  const MappedFile &m = this->mapping;
+
+  ast.token_kinds = Column<Token::Kind>::borrow(
+      view<Token::Kind>(m, layout.token_kinds, header.token_count));
+  ast.token_offsets = Column<uint32_t>::borrow(
+      view<uint32_t>(m, layout.token_offsets, header.token_count));
+  ast.token_lengths = Column<uint32_t>::borrow(
+      view<uint32_t>(m, layout.token_lengths, header.token_count));
+  ast.tags = Column<Tag>::borrow(view<Tag>(m, layout.tags, header.node_count));
+  ast.main_tokens = Column<ast::TokenIndex>::borrow(
+      view<ast::TokenIndex>(m, layout.main_tokens, header.node_count));
+  ast.data =
+      Column<Data>::borrow(view<Data>(m, layout.data, header.node_count));
+  ast.extra = Column<uint32_t>::borrow(
+      view<uint32_t>(m, layout.extra, header.extra_count));
+
+  diagnostics = view<CachedDiagnostic>(m, layout.diagnostics,
+                                       header.diagnostic_count);
+  message_offsets =
+      view<uint32_t>(m, layout.message_offsets, header.diagnostic_count + 1);
+  auto messages = view<char>(m, layout.message_bytes, header.message_bytes);
+  message_bytes = std::string_view(messages.data(), messages.size());
+}
+
+void Module::replay(DiagnosticEngine &engine) const {
+  for (size_t i = 0; i < diagnostics.size(); i++) {
+    auto &d = diagnostics[i];
+    auto message = message_bytes.substr(
+        message_offsets[i], message_offsets[i + 1] - message_offsets[i]);
+    engine.emit(Diagnostic(static_cast<diagnostic::Kind>(d.kind),
+                           Span(*ast.file, d.offset, d.length),
+                           std::string(message)));
+  }
+}
+
+std::optional<Module> cache::load(const std::string &path, const File &file) {
+  profile::Scope scope(profile::Phase::Cache, path);
+  MappedFile mapping;
+  if (!mapping.open(path) || mapping.size() < sizeof(Header))
+    return std::nullopt;
+
+  // The sections are checked as a whole rather than index by index, which is
+  // what lets them be used in place. The header and source hash alone can't
+  // stand in for that: a torn or bit-flipped body still matches both, and its
+  // child and token indices would then be followed out of range. XXH3 runs at
+  // memory bandwidth, so on a hit it costs a small part of the parse it saves
+  Header header;
+  std::memcpy(&header, mapping.bytes().data(), sizeof(header));
+  if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+      header.version != FORMAT_VERSION ||
+      header.byte_order != BYTE_ORDER_MARK ||
+      header.source_length != file.content.size() ||
+      header.node_count == 0 || Layout(header).size != mapping.size() ||
+      header.source_hash != source_hash(file) ||
+      header.body_hash != body_hash(mapping.bytes()))
+    return std::nullopt;
+
+  return Module(std::move(mapping), file);
+}
+
+/* ---------------------------------------------------------------------------*/
+/* STORE */
+/* ---------------------------------------------------------------------------*/
+
+Store::Store(std::string directory, uint64_t capacity)
+    : directory(std::move(directory)), capacity(capacity) {}
+
+std::string Store::path_for(uint64_t key) const {
+  char name[24];
+  std::snprintf(name, sizeof(name), "%016llx.ast",
+                static_cast<unsigned long long>(key));
+  return (fs::path(directory) / name).string();
+}
+
+std::optional<Module> Store::load(uint64_t key, const File &file) const {
+  auto path = path_for(key);
+  auto module = cache::load(path, file);
+  if (module) {
+    // The modification time doubles as the last use, which is what eviction
+    // goes by
+    std::error_code ec;
+    fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+  }
+  return module;
+}
+
+bool Store::store(uint64_t key, const ast::Tree &tree,
+                  const DiagnosticEngine &diagnostics) const {
+  std::error_code ec;
+  fs::create_directories(directory, ec);
+  return cache::store(tree, diagnostics, path_for(key));
+}
+
+uint64_t Store::evict() const {
+  struct Entry {
+    fs::path path;
+    fs::file_time_type used;
+    uint64_t size;
+  };
+
+  std::error_code ec;
+  std::vector<Entry> entries;
+  uint64_t total = 0;
+  for (auto &item : fs::directory_iterator(directory, ec)) {
+    if (!item.is_regular_file(ec) || item.path().extension() != ".ast")
+      continue;
+    uint64_t size = item.file_size(ec);
+    if (ec)
+      continue;
+    entries.push_back({item.path(), item.last_write_time(ec), size});
+    total += size;
+  }
+  if (total <= capacity)
+    return 0;
+
+  std::sort(entries.begin(), entries.end(),
+            [](const Entry &a, const Entry &b) { return a.used < b.used; });
+
+  uint64_t freed = 0;
+  for (auto &entry : entries) {
+    if (total - freed <= capacity)
+      break;
+    // Readers that already mapped the entry keep their view of it
+    if (fs::remove(entry.path, ec))
+      freed += entry.size;
+  }
+  return freed;
+}
@@ -0,0 +1,124 @@
+#include "parser/parallel.hpp"
+#include "parser/parser.hpp"
+#include <algorithm>
+
+using namespace parser;
+using TK = Token::Kind;
+
+namespace {
+
+/// Below this many tokens per worker, splitting costs more than it saves
+constexpr size_t MIN_TOKENS_PER_TASK = 4096;
+
+} // namespace
+
+bool parser::starts_declaration(std::span<const Token::Kind> kinds,
+                                std::span<const uint32_t> closing,
+                                size_t index) {
+  return kinds[index] == TK::Class || kinds[index] == TK::Enum ||
+         looks_like_fn_decl(kinds, closing, index);
+}
+
+std::vector<TokenRange>
+parser::split_top_level(std::span<const Token::Kind> kinds) {
+  return split_top_level(kinds, match_parens(kinds));
+}
+
+std::vector<TokenRange>
+parser::split_top_level(std::span<const Token::Kind> kinds,
+                        std::span<const uint32_t> closing) {
+  std::vector<TokenRange> ranges;
+  size_t begin = 0;
+  size_t depth = 0;
+  bool at_statement_start = true;
+
+  for (size_t i = 0; i < kinds.size(); i++) {
+    if (depth == 0 && at_statement_start && i > begin &&
+        starts_declaration(kinds, closing, i)) {
+      ranges.push_back({begin, i});
+      begin = i;
+    }
+
+    switch (kinds[i]) {
+    case TK::LCurl:
+    case TK::LParen:
+    case TK::LBrac:
+      depth++;
+      at_statement_start = false;
+      break;
+    case TK::RCurl:
+    case TK::RParen:
+    case TK::RBrac:
+      // Unbalanced input is left for the parser to report
+      depth = depth == 0 ? 0 : depth - 1;
+      at_statement_start = depth == 0 && kinds[i] == TK::RCurl;
+      break;
+    case TK::Newline:
+    case TK::Semicolon:
+      at_statement_start = true;
+      break;
+    default:
+      at_statement_start = false;
+      break;
+    }
+  }
+
+  // The end of file token belongs to no range
+  size_t end = kinds.empty() ? 0 : kinds.size() - 1;
+  if (begin < end)
+    ranges.push_back({begin, end});
+  return ranges;
+}
+
+ast::Tree parser::parse_parallel(const std::vector<Token> &tokens,
+                                 DiagnosticEngine &diagnostics,
+                                 ThreadPool &pool) {
+  if (tokens.size() < MIN_TOKENS_PER_TASK * 2 || pool.size() < 2)
+    return Parser(tokens, diagnostics).parse();
+
+  ast::Tree tree(tokens.front().span.file);
+  tree.set_tokens(tokens);
+
+  // Brackets are matched once for the whole file, and every batch looks
+  // its function declarations up in the same table
+  auto closing = match_parens(tree.token_kinds);
+  auto ranges = split_top_level(tree.token_kinds, closing);
+
+  // Merge neighbouring ranges into batches so that every task has enough
+  // work, while still leaving several tasks per worker to balance load
+  size_t target =
+      std::max(MIN_TOKENS_PER_TASK, tokens.size() / (pool.size() * 4));
+  std::vector<TokenRange> batches;
+  for (auto range : ranges) {
+    if (!batches.empty() &&
+        batches.back().end - batches.back().begin < target)
+      batches.back().end = range.end;
+    else
+      batches.push_back(range);
+  }
+
+  std::vector<ast::Tree> fragments;
+  std::vector<DiagnosticEngine> buffers(batches.size());
+  fragments.reserve(batches.size());
+  for (size_t i = 0; i < batches.size(); i++)
+    fragments.emplace_back(*tree.file);
+
+  pool.parallel_for(batches.size(), [&](size_t i) {
+    Parser parser(tree, closing, batches[i].begin, batches[i].end,
+                  buffers[i]);
+    fragments[i] = parser.parse();
+  });
+
+  // Stitch in source order so that nodes and diagnostics are deterministic
+  tree.add_node(ast::Tag::Root, 0, {0, 0});
+  std::vector<ast::NodeIndex> items;
+  for (size_t i = 0; i < batches.size(); i++) {
+    tree.splice(fragments[i], items);
+    diagnostics.merge(buffers[i]);
+  }
+
+  auto start = static_cast<uint32_t>(tree.extra.size());
+  tree.extra.append(items.begin(), items.end());
+  tree.data[0] = {start, static_cast<uint32_t>(tree.extra.size())};
+  return tree;
+}
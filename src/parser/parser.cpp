@@ -0,0 +1,848 @@
+#include "parser/parser.hpp"
+#include "common/profile.hpp"
+#include <algorithm>
+
+using namespace parser;
+using ast::NodeIndex;
+using ast::NULL_NODE;
+using ast::Tag;
+using ast::TokenIndex;
+using TK = Token::Kind;
+using diagnostic::Kind;
+
+InfixRule parser::get_infix_rule(Token::Kind kind) {
+  switch (kind) {
+  case TK::FatArrow:
+    return {Precedence::Lambda, true};
+  case TK::Equals:
+  case TK::PlusEquals:
+  case TK::MinusEquals:
+  case TK::StarEquals:
+  case TK::SlashEquals:
+  case TK::SlashSlashEquals:
+  case TK::StarStarEquals:
+    return {Precedence::Assignment, true};
+  case TK::Question:
+    return {Precedence::Ternary, true};
+  case TK::Arrow:
+    return {Precedence::Arrow, true};
+  case TK::BarBar:
+    return {Precedence::Or, false};
+  case TK::AndAnd:
+    return {Precedence::And, false};
+  case TK::Bar:
+    return {Precedence::BitOr, false};
+  case TK::And:
+    return {Precedence::BitAnd, false};
+  case TK::EqualsEquals:
+  case TK::BangEquals:
+    return {Precedence::Equality, false};
+  case TK::Less:
+  case TK::LessEquals:
+  case TK::More:
+  case TK::MoreEquals:
+    return {Precedence::Comparison, false};
+  case TK::Plus:
+  case TK::Minus:
+    return {Precedence::Term, false};
+  case TK::Star:
+  case TK::Slash:
+  case TK::SlashSlash:
+  case TK::Percent:
+    return {Precedence::Factor, false};
+  case TK::As:
+    return {Precedence::Cast, false};
+  case TK::StarStar:
+    return {Precedence::Power, true};
+  case TK::LParen:
+  case TK::LBrac:
+  case TK::Dot:
+  case TK::PlusPlus:
+  case TK::MinusMinus:
+    return {Precedence::Postfix, false};
+  default:
+    return {Precedence::None, false};
+  }
+}
+
+Parser::Parser(const std::vector<Token> &tokens, DiagnosticEngine &diagnostics)
+    : tree(tokens.front().span.file), source(&tree), diagnostics(diagnostics),
+      cursor(0), end(tokens.size()), nesting(0), depth(0), failed(false),
+      panicking(false), error_token(0), scratch({}) {
+  tree.set_tokens(tokens);
+  matches = match_parens(tree.token_kinds);
+  closing = matches;
+
+  // Roughly one node per token is typical for expression heavy code
+  tree.tags.reserve(tokens.size());
+  tree.main_tokens.reserve(tokens.size());
+  tree.data.reserve(tokens.size());
+}
+
+// Closers past `end` can't be told from unmatched ones by `is_fn_decl()`,
+// so the table of the whole file serves as well as one of the range
+Parser::Parser(const ast::Tree &source, std::span<const uint32_t> closing,
+               size_t begin, size_t end, DiagnosticEngine &diagnostics)
+    : tree(*source.file), source(&source), diagnostics(diagnostics),
+      cursor(begin), end(end), nesting(0), depth(0), failed(false),
+      panicking(false), error_token(0), closing(closing), scratch({}) {
+  tree.tags.reserve(end - begin);
+  tree.main_tokens.reserve(end - begin);
+  tree.data.reserve(end - begin);
+}
+
+/* ---------------------------------------------------------------------------*/
+/* TOKEN STREAM */
+/* ---------------------------------------------------------------------------*/
+
+Token::Kind Parser::kind_at(size_t index) const {
+  // Everything past the end of the range looks like the end of the file
+  if (index >= end)
+    return TK::Eof;
+  return source->token_kinds[index];
+}
+
+Token::Kind Parser::peek() {
+  // Inside brackets newlines carry no meaning and are skipped over
+  if (nesting > 0)
+    skip_newlines();
+  return kind_at(cursor);
+}
+
+Token::Kind Parser::peek_raw(size_t ahead) const {
+  return kind_at(cursor + ahead);
+}
+
+TokenIndex Parser::advance() {
+  peek();
+  auto index = static_cast<TokenIndex>(cursor);
+  if (kind_at(cursor) != TK::Eof)
+    cursor++;
+  return index;
+}
+
+bool Parser::check(Token::Kind kind) { return peek() == kind; }
+
+bool Parser::match(Token::Kind kind) {
+  if (!check(kind))
+    return false;
+  advance();
+  return true;
+}
+
+bool Parser::expect(Token::Kind kind, const char *message) {
+  if (match(kind))
+    return true;
+  error(Kind::UnexpectToken, static_cast<TokenIndex>(cursor), message);
+  return false;
+}
+
+void Parser::skip_newlines() {
+  while (kind_at(cursor) == TK::Newline)
+    cursor++;
+}
+
+bool Parser::at_terminator() {
+  switch (peek()) {
+  case TK::Newline:
+  case TK::Semicolon:
+  case TK::RCurl:
+  case TK::Eof:
+    return true;
+  default:
+    return false;
+  }
+}
+
+void Parser::error(diagnostic::Kind kind, TokenIndex token,
+                   const std::string &message) {
+  failed = true;
+  if (panicking)
+    return;
+  panicking = true;
+  error_token = token;
+
+  // The end of file token is empty but diagnostics need something to point at
+  Span span = source->token_span(token);
+  span.length = std::max<size_t>(span.length, 1);
+  diagnostics.emit(Diagnostic(kind, span, message));
+}
+
+bool Parser::too_deep() {
+  if (depth < MAX_DEPTH)
+    return false;
+  error(Kind::TooDeep, static_cast<TokenIndex>(cursor),
+        "This is nested too deeply");
+  return true;
+}
+
+ast::Data Parser::take_range(size_t count) {
+  auto first = scratch.end() - static_cast<std::ptrdiff_t>(count);
+  auto start = static_cast<uint32_t>(tree.extra.size());
+  tree.extra.append(first, scratch.end());
+  scratch.erase(first, scratch.end());
+  return {start, static_cast<uint32_t>(tree.extra.size())};
+}
+
+void Parser::drop_scratch(size_t count) {
+  scratch.resize(scratch.size() - count);
+}
+
+/* ---------------------------------------------------------------------------*/
+/* STATEMENTS */
+/* ---------------------------------------------------------------------------*/
+
+ast::Tree Parser::parse() {
+  profile::Scope scope(profile::Phase::Parse, tree.file->path);
+
+  // Reserve the root so that index 0 can never be anybody's child
+  tree.add_node(Tag::Root, 0, {0, 0});
+  size_t count = 0;
+
+  while (true) {
+    while (match(TK::Newline) || match(TK::Semicolon))
+      ;
+    if (check(TK::Eof))
+      break;
+
+    scratch.push_back(parse_statement_or_recover(false));
+    count++;
+  }
+
+  tree.data[0] = take_range(count);
+  profile::record_allocation(tree.byte_size());
+  return std::move(tree);
+}
+
+NodeIndex Parser::parse_statement() {
+  switch (peek()) {
+  case TK::If:
+    return parse_if();
+  case TK::While:
+    return parse_while();
+  case TK::For:
+    return parse_for();
+  case TK::Class:
+    return parse_class_decl();
+  case TK::Enum:
+    return parse_enum_decl();
+  case TK::LCurl:
+    return parse_block();
+  case TK::Identifier:
+    if (is_fn_decl())
+      return parse_fn_decl();
+    break;
+  default:
+    break;
+  }
+
+  NodeIndex stmt = parse_simple_statement();
+  if (stmt == NULL_NODE)
+    return NULL_NODE;
+
+  if (!at_terminator()) {
+    error(Kind::UnexpectToken, static_cast<TokenIndex>(cursor),
+          "Expected a newline or ';' after this statement");
+    return NULL_NODE;
+  }
+  return stmt;
+}
+
+NodeIndex Parser::parse_member() {
+  if (check(TK::Identifier) && peek_raw(1) == TK::Colon) {
+    NodeIndex field = parse_var_decl();
+    if (field != NULL_NODE && !at_terminator()) {
+      error(Kind::UnexpectToken, static_cast<TokenIndex>(cursor),
+            "Expected a newline or ';' after this field");
+      return NULL_NODE;
+    }
+    return field;
+  }
+  if (check(TK::Identifier) && is_fn_decl())
+    return parse_fn_decl();
+
+  error(Kind::UnexpectToken, static_cast<TokenIndex>(cursor),
+        "Expected a field or method declaration");
+  return NULL_NODE;
+}
+
+NodeIndex Parser::parse_simple_statement() {
+  if (check(TK::Return))
+    return parse_return();
+  if (check(TK::Identifier) && peek_raw(1) == TK::Colon)
+    return parse_var_decl();
+  return parse_expression();
+}
+
+std::vector<uint32_t> parser::match_parens(std::span<const Token::Kind> kinds) {
+  std::vector<uint32_t> closing(kinds.size(), NO_MATCH);
+  std::vector<uint32_t> open;
+
+  for (size_t i = 0; i < kinds.size(); i++) {
+    if (kinds[i] == TK::LParen) {
+      open.push_back(static_cast<uint32_t>(i));
+    } else if (kinds[i] == TK::RParen && !open.empty()) {
+      closing[open.back()] = static_cast<uint32_t>(i);
+      open.pop_back();
+    }
+  }
+  return closing;
+}
+
+bool parser::looks_like_fn_decl(std::span<const Token::Kind> kinds,
+                                std::span<const uint32_t> closing,
+                                size_t index) {
+  // name ( ... ) followed by `->` or `{`
+  if (index + 1 >= kinds.size() || kinds[index] != TK::Identifier ||
+      kinds[index + 1] != TK::LParen)
+    return false;
+
+  uint32_t close = closing[index + 1];
+  if (close == NO_MATCH || close + 1 >= kinds.size())
+    return false;
+  return kinds[close + 1] == TK::Arrow || kinds[close + 1] == TK::LCurl;
+}
+
+bool Parser::is_fn_decl() const {
+  std::span<const Token::Kind> kinds(source->token_kinds.data(), end);
+  return looks_like_fn_decl(kinds, closing, cursor);
+}
+
+/* ---------------------------------------------------------------------------*/
+/* ERROR RECOVERY */
+/* ---------------------------------------------------------------------------*/
+
+Parser::Checkpoint Parser::checkpoint() const {
+  return {cursor, nesting, tree.tags.size(), tree.extra.size()};
+}
+
+NodeIndex Parser::parse_statement_or_recover(bool member) {
+  Checkpoint start = checkpoint();
+  size_t scratch_size = scratch.size();
+
+  NodeIndex node = member ? parse_member() : parse_statement();
+  if (node != NULL_NODE)
+    return node;
+
+  scratch.resize(scratch_size);
+  return recover(start);
+}
+
+NodeIndex Parser::recover(const Checkpoint &start) {
+  // Drop the nodes of the failed statement so that later passes never see
+  // half-built subtrees; the statement becomes a single `Error` node
+  tree.tags.resize(start.nodes);
+  tree.main_tokens.resize(start.nodes);
+  tree.data.resize(start.nodes);
+  tree.extra.resize(start.extra);
+  nesting = start.nesting;
+
+  // Braces opened by the failed statement are skipped as a unit, so that the
+  // body of a broken declaration doesn't resurface as a run of statements
+  size_t braces = 0;
+  for (size_t i = start.cursor; i < cursor; i++) {
+    if (kind_at(i) == TK::LCurl)
+      braces++;
+    else if (kind_at(i) == TK::RCurl && braces > 0)
+      braces--;
+  }
+
+  // Guarantee forward progress
+  if (cursor == start.cursor && kind_at(cursor) != TK::Eof) {
+    if (kind_at(cursor) == TK::LCurl)
+      braces++;
+    cursor++;
+  }
+
+  while (kind_at(cursor) != TK::Eof) {
+    TK kind = kind_at(cursor);
+
+    if (kind == TK::LCurl) {
+      braces++;
+    } else if (kind == TK::RCurl) {
+      // An unmatched `}` closes whatever block we are in
+      if (braces == 0)
+        break;
+      braces--;
+    } else if (braces == 0) {
+      if (kind == TK::Newline || kind == TK::Semicolon) {
+        cursor++;
+        break;
+      }
+      if (kind == TK::Class || kind == TK::Enum || kind == TK::If ||
+          kind == TK::While || kind == TK::For || kind == TK::Return)
+        break;
+    }
+    cursor++;
+  }
+
+  panicking = false;
+  auto skipped_begin = static_cast<uint32_t>(start.cursor);
+  auto skipped_end = static_cast<uint32_t>(cursor);
+  return tree.add_node(Tag::Error, error_token, {skipped_begin, skipped_end});
+}
+
+NodeIndex Parser::parse_block() {
+  auto brace = advance();
+  if (kind_at(brace) != TK::LCurl) {
+    error(Kind::UnexpectToken, brace, "Expected '{' to start a block");
+    return NULL_NODE;
+  }
+  if (too_deep())
+    return NULL_NODE;
+
+  // Statements are newline separated again, even inside brackets
+  unsigned saved = nesting;
+  nesting = 0;
+  depth++;
+  size_t count = 0;
+
+  while (true) {
+    while (match(TK::Newline) || match(TK::Semicolon))
+      ;
+    if (check(TK::RCurl) || check(TK::Eof))
+      break;
+
+    scratch.push_back(parse_statement_or_recover(false));
+    count++;
+  }
+
+  nesting = saved;
+  depth--;
+  if (!expect(TK::RCurl, "Expected '}' to close this block")) {
+    drop_scratch(count);
+    return NULL_NODE;
+  }
+  return tree.add_node(Tag::Block, brace, take_range(count));
+}
+
+NodeIndex Parser::parse_type() {
+  // Types share the expression grammar but stop short of `=` and `?`
+  return parse_expression(Precedence::Arrow);
+}
+
+NodeIndex Parser::parse_var_decl() {
+  auto name = advance();
+  advance(); // :
+
+  NodeIndex type = NULL_NODE;
+  if (!check(TK::Equals)) {
+    type = parse_type();
+    if (type == NULL_NODE)
+      return NULL_NODE;
+  }
+
+  NodeIndex value = NULL_NODE;
+  if (match(TK::Equals)) {
+    skip_newlines();
+    value = parse_expression();
+    if (value == NULL_NODE)
+      return NULL_NODE;
+  }
+
+  return tree.add_node(Tag::VarDecl, name, {type, value});
+}
+
+NodeIndex Parser::parse_if() {
+  auto keyword = advance();
+  NodeIndex condition = parse_expression();
+  if (condition == NULL_NODE)
+    return NULL_NODE;
+
+  NodeIndex then = parse_block();
+  if (then == NULL_NODE)
+    return NULL_NODE;
+
+  // Allow `else` to start on the line after the closing brace
+  NodeIndex otherwise = NULL_NODE;
+  size_t before = cursor;
+  skip_newlines();
+  if (match(TK::Else)) {
+    otherwise = check(TK::If) ? parse_if() : parse_block();
+    if (otherwise == NULL_NODE)
+      return NULL_NODE;
+  } else {
+    cursor = before;
+  }
+
+  uint32_t words[] = {then, otherwise};
+  return tree.add_node(Tag::If, keyword, {condition, tree.add_extra(words)});
+}
+
+NodeIndex Parser::parse_while() {
+  auto keyword = advance();
+  NodeIndex condition = parse_expression();
+  if (condition == NULL_NODE)
+    return NULL_NODE;
+
+  NodeIndex body = parse_block();
+  if (body == NULL_NODE)
+    return NULL_NODE;
+  return tree.add_node(Tag::While, keyword, {condition, body});
+}
+
+NodeIndex Parser::parse_for() {
+  auto keyword = advance();
+  if (!expect(TK::Identifier, "Expected a loop variable after 'for'") ||
+      !expect(TK::In, "Expected 'in' after the loop variable"))
+    return NULL_NODE;
+
+  NodeIndex iterable = parse_expression();
+  if (iterable == NULL_NODE)
+    return NULL_NODE;
+
+  NodeIndex body = parse_block();
+  if (body == NULL_NODE)
+    return NULL_NODE;
+  return tree.add_node(Tag::For, keyword, {iterable, body});
+}
+
+NodeIndex Parser::parse_return() {
+  auto keyword = advance();
+
+  NodeIndex value = NULL_NODE;
+  if (!at_terminator()) {
+    value = parse_expression();
+    if (value == NULL_NODE)
+      return NULL_NODE;
+  }
+  return tree.add_node(Tag::Return, keyword, {value, 0});
+}
+
+NodeIndex Parser::parse_fn_decl() {
+  auto name = advance();
+  advance(); // (
+  nesting++;
+
+  size_t count = 0;
+  while (!check(TK::RParen)) {
+    auto param = static_cast<TokenIndex>(cursor);
+    if (!expect(TK::Identifier, "Expected a parameter name") ||
+        !expect(TK::Colon, "Expected ':' and a type after the parameter")) {
+      nesting--;
+      drop_scratch(count);
+      return NULL_NODE;
+    }
+
+    NodeIndex type = parse_type();
+    if (type == NULL_NODE) {
+      nesting--;
+      drop_scratch(count);
+      return NULL_NODE;
+    }
+    scratch.push_back(tree.add_node(Tag::Param, param, {type, 0}));
+    count++;
+
+    if (!match(TK::Comma))
+      break;
+  }
+
+  nesting--;
+  if (!expect(TK::RParen, "Expected ')' after the parameters")) {
+    drop_scratch(count);
+    return NULL_NODE;
+  }
+
+  NodeIndex return_type = NULL_NODE;
+  if (match(TK::Arrow)) {
+    return_type = parse_type();
+    if (return_type == NULL_NODE) {
+      drop_scratch(count);
+      return NULL_NODE;
+    }
+  }
+
+  ast::Data params = take_range(count);
+  NodeIndex body = parse_block();
+  if (body == NULL_NODE)
+    return NULL_NODE;
+
+  uint32_t words[] = {params.lhs, params.rhs, return_type};
+  return tree.add_node(Tag::FnDecl, name, {tree.add_extra(words), body});
+}
+
+NodeIndex Parser::parse_class_decl() {
+  auto keyword = advance();
+  if (!expect(TK::Identifier, "Expected a name after 'class'") ||
+      !expect(TK::LCurl, "Expected '{' to start the class body"))
+    return NULL_NODE;
+
+  size_t count = 0;
+  while (true) {
+    while (match(TK::Newline) || match(TK::Semicolon))
+      ;
+    if (check(TK::RCurl) || check(TK::Eof))
+      break;
+
+    scratch.push_back(parse_statement_or_recover(true));
+    count++;
+  }
+
+  if (!expect(TK::RCurl, "Expected '}' to close the class body")) {
+    drop_scratch(count);
+    return NULL_NODE;
+  }
+  return tree.add_node(Tag::ClassDecl, keyword, take_range(count));
+}
+
+NodeIndex Parser::parse_enum_decl() {
+  auto keyword = advance();
+  if (!expect(TK::Identifier, "Expected a name after 'enum'") ||
+      !expect(TK::LCurl, "Expected '{' to start the enum body"))
+    return NULL_NODE;
+
+  nesting++;
+  size_t count = 0;
+  while (!check(TK::RCurl)) {
+    auto variant = static_cast<TokenIndex>(cursor);
+    if (!expect(TK::Identifier, "Expected an enum variant name")) {
+      nesting--;
+      drop_scratch(count);
+      return NULL_NODE;
+    }
+    scratch.push_back(tree.add_node(Tag::EnumVariant, variant, {0, 0}));
+    count++;
+
+    if (!match(TK::Comma))
+      break;
+  }
+
+  nesting--;
+  if (!expect(TK::RCurl, "Expected '}' to close the enum body")) {
+    drop_scratch(count);
+    return NULL_NODE;
+  }
+  return tree.add_node(Tag::EnumDecl, keyword, take_range(count));
+}
+
+/* ---------------------------------------------------------------------------*/
+/* EXPRESSIONS */
+/* ---------------------------------------------------------------------------*/
+
+NodeIndex Parser::parse_expression(Precedence min) {
+  if (too_deep())
+    return NULL_NODE;
+  depth++;
+  NodeIndex lhs = parse_prefix();
+
+  while (lhs != NULL_NODE) {
+    InfixRule rule = get_infix_rule(peek());
+    if (rule.precedence == Precedence::None || rule.precedence < min)
+      break;
+    lhs = parse_infix(lhs, rule);
+  }
+
+  depth--;
+  return lhs;
+}
+
+NodeIndex Parser::parse_prefix() {
+  switch (peek()) {
+  case TK::Integer:
+  case TK::Float:
+  case TK::String:
+  case TK::Boolean:
+    return tree.add_node(Tag::Literal, advance(), {0, 0});
+
+  case TK::Identifier:
+    return tree.add_node(Tag::Identifier, advance(), {0, 0});
+
+  case TK::Minus:
+  case TK::Bang:
+  case TK::PlusPlus:
+  case TK::MinusMinus: {
+    auto op = advance();
+    NodeIndex operand = parse_expression(Precedence::Prefix);
+    if (operand == NULL_NODE)
+      return NULL_NODE;
+    return tree.add_node(Tag::Unary, op, {operand, 0});
+  }
+
+  case TK::LParen:
+    return parse_parenthesized(advance());
+
+  case TK::LBrac: {
+    auto bracket = advance();
+    size_t count = 0;
+    nesting++;
+    bool ok = parse_list(TK::RBrac, count);
+    nesting--;
+    if (!ok)
+      return NULL_NODE;
+    return tree.add_node(Tag::Array, bracket, take_range(count));
+  }
+
+  default:
+    error(Kind::ExpectedExpression, static_cast<TokenIndex>(cursor),
+          "Expected an expression here");
+    return NULL_NODE;
+  }
+}
+
+NodeIndex Parser::parse_parenthesized(TokenIndex paren) {
+  nesting++;
+
+  // `()` is only meaningful as the empty parameter list of a lambda
+  if (match(TK::RParen)) {
+    nesting--;
+    auto empty = static_cast<uint32_t>(tree.extra.size());
+    return tree.add_node(Tag::Tuple, paren, {empty, empty});
+  }
+
+  NodeIndex first = parse_expression();
+  if (first == NULL_NODE) {
+    nesting--;
+    return NULL_NODE;
+  }
+
+  if (!check(TK::Comma)) {
+    nesting--;
+    if (!expect(TK::RParen, "Expected ')' to close this group"))
+      return NULL_NODE;
+    return tree.add_node(Tag::Grouping, paren, {first, 0});
+  }
+
+  scratch.push_back(first);
+  size_t count = 1;
+  advance();
+  bool ok = parse_list(TK::RParen, count);
+  nesting--;
+  if (!ok)
+    return NULL_NODE;
+  return tree.add_node(Tag::Tuple, paren, take_range(count));
+}
+
+bool Parser::parse_list(Token::Kind close, size_t &count) {
+  while (!check(close)) {
+    NodeIndex item = parse_expression();
+    if (item == NULL_NODE) {
+      drop_scratch(count);
+      return false;
+    }
+    scratch.push_back(item);
+    count++;
+
+    if (!match(TK::Comma))
+      break;
+  }
+
+  if (!expect(close, close == TK::RParen ? "Expected ')' to close this list"
+                                         : "Expected ']' to close this list")) {
+    drop_scratch(count);
+    return false;
+  }
+  return true;
+}
+
+NodeIndex Parser::parse_infix(NodeIndex lhs, InfixRule rule) {
+  auto op = advance();
+  TK kind = kind_at(op);
+
+  switch (kind) {
+  case TK::LParen: {
+    size_t count = 0;
+    nesting++;
+    bool ok = parse_list(TK::RParen, count);
+    nesting--;
+    if (!ok)
+      return NULL_NODE;
+    ast::Data args = take_range(count);
+    uint32_t words[] = {args.lhs, args.rhs};
+    return tree.add_node(Tag::Call, op, {lhs, tree.add_extra(words)});
+  }
+
+  case TK::LBrac: {
+    nesting++;
+    NodeIndex index = parse_expression();
+    nesting--;
+    if (index == NULL_NODE || !expect(TK::RBrac, "Expected ']' after index"))
+      return NULL_NODE;
+    return tree.add_node(Tag::Index, op, {lhs, index});
+  }
+
+  case TK::Dot:
+    if (!check(TK::Identifier)) {
+      error(Kind::UnexpectToken, static_cast<TokenIndex>(cursor),
+            "Expected a member name after '.'");
+      return NULL_NODE;
+    }
+    return tree.add_node(Tag::Member, advance(), {lhs, 0});
+
+  case TK::PlusPlus:
+  case TK::MinusMinus:
+    return tree.add_node(Tag::Postfix, op, {lhs, 0});
+
+  default:
+    break;
+  }
+
+  // Everything else takes a right hand side, which may start on the next line
+  skip_newlines();
+
+  if (kind == TK::Question) {
+    NodeIndex then = parse_expression(Precedence::Ternary);
+    if (then == NULL_NODE)
+      return NULL_NODE;
+    skip_newlines();
+    if (!expect(TK::Colon, "Expected ':' in conditional expression"))
+      return NULL_NODE;
+    skip_newlines();
+    NodeIndex otherwise = parse_expression(Precedence::Ternary);
+    if (otherwise == NULL_NODE)
+      return NULL_NODE;
+
+    uint32_t words[] = {then, otherwise};
+    return tree.add_node(Tag::Ternary, op, {lhs, tree.add_extra(words)});
+  }
+
+  if (kind == TK::FatArrow) {
+    bool valid = tree.tags[lhs] == Tag::Identifier;
+    if (tree.tags[lhs] == Tag::Tuple) {
+      auto params = tree.list(lhs);
+      valid = std::all_of(params.begin(), params.end(), [&](NodeIndex p) {
+        return tree.tags[p] == Tag::Identifier;
+      });
+    }
+    if (!valid) {
+      error(Kind::UnexpectToken, op,
+            "Lambda parameters must be a name or a list of names");
+      return NULL_NODE;
+    }
+
+    NodeIndex body =
+        check(TK::LCurl) ? parse_block() : parse_expression(Precedence::Lambda);
+    if (body == NULL_NODE)
+      return NULL_NODE;
+    return tree.add_node(Tag::Lambda, op, {lhs, body});
+  }
+
+  // An assigned value may be a lambda, which binds looser than `=` itself
+  auto next = static_cast<Precedence>(static_cast<uint8_t>(rule.precedence) +
+                                      (rule.right_associative ? 0 : 1));
+  if (rule.precedence == Precedence::Assignment)
+    next = Precedence::Lambda;
+  NodeIndex rhs = parse_expression(next);
+  if (rhs == NULL_NODE)
+    return NULL_NODE;
+
+  switch (rule.precedence) {
+  case Precedence::Assignment: {
+    Tag target = tree.tags[lhs];
+    if (target != Tag::Identifier && target != Tag::Member &&
+        target != Tag::Index) {
+      error(Kind::InvalidAssignment, op,
+            "Only names, members and indices can be assigned to");
+      return NULL_NODE;
+    }
+    return tree.add_node(Tag::Assign, op, {lhs, rhs});
+  }
+
+  case Precedence::Cast:
+    return tree.add_node(Tag::Cast, op, {lhs, rhs});
+
+  default:
+    return tree.add_node(Tag::Binary, op, {lhs, rhs});
+  }
+}
+
+bool Parser::had_error() const { return failed; }
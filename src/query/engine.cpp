@@ -0,0 +1,117 @@
+#include "query/engine.hpp"
+#include "common/thread_pool.hpp"
+
+using namespace query;
+
+namespace {
+
+/// @brief A query running on this thread, collecting what it reads.
+struct Frame {
+  const Engine *engine;
+  /// The pool task it runs in, by nesting depth
+  size_t task;
+  std::vector<Slot *> reads;
+};
+
+/// Innermost last. A query nests another by asking for it, and a thread
+/// waiting on a pool inside a query may run a query for another key too.
+/// Such a thread may also run a task that has nothing to do with the query,
+/// so only reads at the query's own task depth belong to it.
+thread_local std::vector<Frame> frames;
+
+} // namespace
+
+void Engine::read(Slot &slot) {
+  {
+    std::unique_lock lock(mutex);
+    ensure(slot, lock);
+  }
+  if (!frames.empty() && frames.back().engine == this &&
+      frames.back().task == ThreadPool::nesting())
+    frames.back().reads.push_back(&slot);
+}
+
+void Engine::changed(Slot &slot) {
+  std::lock_guard lock(mutex);
+  revision++;
+  slot.state = Slot::State::Done;
+  slot.changed_at = revision;
+  slot.verified_at = revision;
+}
+
+void Engine::ensure(Slot &slot, std::unique_lock<std::mutex> &lock) {
+  if (slot.input)
+    return;
+
+  while (slot.state == Slot::State::Running) {
+    // Asking for a result while working it out can never finish
+    if (slot.runner == std::this_thread::get_id())
+      std::abort();
+    finished.wait(lock);
+  }
+  if (slot.state == Slot::State::Done && slot.verified_at == revision)
+    return;
+
+  slot.state = Slot::State::Running;
+  slot.runner = std::this_thread::get_id();
+  // Should working it out throw, the slot is left to be worked out again
+  // rather than Running for good, which would hang whoever waits on it. The
+  // lock is held again by the time this runs, see execute()
+  struct Claim {
+    Engine &engine;
+    Slot &slot;
+
+    ~Claim() {
+      if (slot.state != Slot::State::Running)
+        return;
+      slot.state = Slot::State::Empty;
+      engine.finished.notify_all();
+    }
+  } claim{*this, slot};
+
+  if (slot.verified_at == 0 || outdated(slot, lock)) {
+    execute(slot, lock);
+  } else {
+    stats.reused++;
+    slot.verified_at = revision;
+  }
+  slot.state = Slot::State::Done;
+  finished.notify_all();
+}
+
+bool Engine::outdated(Slot &slot, std::unique_lock<std::mutex> &lock) {
+  // In the order they were read, since an early change may well mean a later
+  // read would not even happen any more
+  for (Slot *dependency : slot.dependencies) {
+    ensure(*dependency, lock);
+    if (dependency->changed_at > slot.verified_at)
+      return true;
+  }
+  return false;
+}
+
+void Engine::execute(Slot &slot, std::unique_lock<std::mutex> &lock) {
+  stats.executed++;
+  bool differs = false;
+  std::vector<Slot *> reads;
+  {
+    frames.push_back({this, ThreadPool::nesting(), {}});
+    lock.unlock();
+    // Undone however execute() leaves, throwing included
+    struct Running {
+      std::unique_lock<std::mutex> &lock;
+
+      ~Running() {
+        frames.pop_back();
+        lock.lock();
+      }
+    } running{lock};
+    differs = slot.execute();
+    reads = std::move(frames.back().reads);
+  }
+
+  slot.dependencies = std::move(reads);
+  if (differs)
+    slot.changed_at = revision;
+  slot.verified_at = revision;
+}
@@ -0,0 +1,822 @@
+#include "sema/checker.hpp"
+#include "common/arena.hpp"
+#include "common/profile.hpp"
+#include <algorithm>
+#include <optional>
+#include <string>
+
+using namespace sema;
+using ast::NodeIndex;
+using ast::Tag;
+using diagnostic::Kind;
+using TK = Token::Kind;
+
+namespace {
+
+constexpr TypeId ERROR = type_of(Primitive::Error);
+constexpr TypeId VOID = type_of(Primitive::Void);
+constexpr TypeId INT = type_of(Primitive::Int);
+constexpr TypeId FLOAT = type_of(Primitive::Float);
+constexpr TypeId STR = type_of(Primitive::Str);
+constexpr TypeId BOOL = type_of(Primitive::Bool);
+
+/// Bodies are handed out in runs of at least this many nodes, enough to
+/// outweigh the cost of a task, and a few runs per thread otherwise so that
+/// uneven runs even out
+constexpr size_t MIN_TASK_NODES = 4096;
+constexpr size_t TASKS_PER_THREAD = 4;
+
+bool is_numeric(TypeId type) { return type == INT || type == FLOAT; }
+
+/// @brief Everything the checkers of one file share. Nothing here changes
+/// during the second phase, except that each task fills in the types of the
+/// nodes in its own function body.
+struct Shared {
+  const ast::Tree &tree;
+  const Resolution &resolution;
+  const StringInterner &names;
+  TypeInterner &types;
+  std::vector<TypeId> &node_types;
+  Symbol list;
+};
+
+class Checker {
+  const ast::Tree &tree;
+  const Shared &shared;
+  TypeInterner &types;
+  std::vector<TypeId> &node_types;
+  DiagnosticEngine &diagnostics;
+
+  /// Scratch space for argument lists and the like, rewound after each use
+  Arena &scratch;
+
+  /// What a `return` in the current function must return; `Error` where
+  /// anything goes, e.g. at the top level or in a lambda
+  TypeId result;
+
+  /// @brief Reports the concatenation of `parts` at the node's main token.
+  template <typename... Parts>
+  void report(Kind kind, NodeIndex node, const Parts &...parts) {
+    std::string message;
+    (message += ... += parts);
+    diagnostics.emit(
+        Diagnostic(kind, tree.token_span(tree.main_token(node)), message));
+  }
+
+  std::string name(TypeId type) const {
+    return types.to_string(type, shared.names);
+  }
+
+  std::string_view lexeme(NodeIndex node) const {
+    return tree.token_lexeme(tree.main_token(node));
+  }
+
+  /// @brief The element type of anything a `for` can walk over.
+  std::optional<TypeId> element_of(TypeId type) const {
+    if (type == STR)
+      return STR;
+    const Type &t = types.get(type);
+    if (t.kind == Type::Kind::Array)
+      return t.operands[0];
+    if (t.kind == Type::Kind::Generic && t.name == shared.list)
+      return t.operands.size() == 1 ? t.operands[0] : ERROR;
+    return std::nullopt;
+  }
+
+  bool is_sequence(TypeId type) const {
+    return type != STR && element_of(type).has_value();
+  }
+
+  /// @brief Whether a value of type `actual` can go where `expected` is
+  /// wanted. `[T]` and `List[T]` are two spellings of the same thing.
+  bool compatible(TypeId expected, TypeId actual) const {
+    if (expected == actual || expected == ERROR || actual == ERROR)
+      return true;
+    if (expected == FLOAT && actual == INT)
+      return true;
+    if (is_sequence(expected) && is_sequence(actual)) {
+      TypeId e = *element_of(expected), a = *element_of(actual);
+      return e == a || e == ERROR || a == ERROR;
+    }
+    return false;
+  }
+
+  /// @brief The type both of two values fit, e.g. for the two branches of a
+  /// ternary.
+  std::optional<TypeId> unify(TypeId a, TypeId b) const {
+    if (compatible(a, b))
+      return a;
+    if (compatible(b, a))
+      return b;
+    return std::nullopt;
+  }
+
+  std::span<TypeId> allocate_types(size_t count) {
+    auto *memory = static_cast<TypeId *>(
+        scratch.allocate(count * sizeof(TypeId), alignof(TypeId)));
+    return {memory, count};
+  }
+
+  /* -------------------------------------------------------------------------*/
+  /* TYPE EXPRESSIONS */
+  /* -------------------------------------------------------------------------*/
+
+  TypeId named_type(NodeIndex node) {
+    const Binding &binding = shared.resolution[node];
+    switch (binding.kind) {
+    case Binding::Kind::Unresolved:
+      // Already reported as undefined
+      return ERROR;
+    case Binding::Kind::Builtin:
+      switch (static_cast<Builtin>(binding.target)) {
+      case Builtin::Int:
+        return INT;
+      case Builtin::Float:
+        return FLOAT;
+      case Builtin::Str:
+        return STR;
+      case Builtin::Bool:
+        return BOOL;
+      case Builtin::List:
+        return types.generic(shared.list, {});
+      default:
+        break;
+      }
+      break;
+    case Binding::Kind::Class:
+    case Binding::Kind::Enum:
+      return node_types[binding.target];
+    default:
+      break;
+    }
+    report(Kind::TypeMismatch, node, "'", lexeme(node), "' is not a type");
+    return ERROR;
+  }
+
+  /// @brief The types of a parameter list, written either as one type or as
+  /// a parenthesized list of them.
+  std::span<TypeId> type_list(NodeIndex node) {
+    if (tree.tag(node) != Tag::Tuple) {
+      auto list = allocate_types(1);
+      list[0] = type_expression(node);
+      return list;
+    }
+    auto elements = tree.list(node);
+    auto list = allocate_types(elements.size());
+    for (size_t i = 0; i < elements.size(); i++)
+      list[i] = type_expression(elements[i]);
+    return list;
+  }
+
+public:
+  TypeId type_expression(NodeIndex node) {
+    if (node == ast::NULL_NODE)
+      return ERROR;
+
+    ast::Data data = tree.node_data(node);
+    switch (tree.tag(node)) {
+    case Tag::Identifier:
+      return named_type(node);
+    case Tag::Grouping:
+      return type_expression(data.lhs);
+    case Tag::Array: {
+      auto elements = tree.list(node);
+      if (elements.size() == 1)
+        return types.array(type_expression(elements[0]));
+      break;
+    }
+    case Tag::Index: {
+      // Only the builtin `List` takes type arguments
+      const Binding &binding = shared.resolution[data.lhs];
+      if (tree.tag(data.lhs) == Tag::Identifier &&
+          binding.kind == Binding::Kind::Builtin &&
+          binding.target == static_cast<uint32_t>(Builtin::List)) {
+        auto mark = scratch.mark();
+        TypeId type = types.generic(shared.list, type_list(data.rhs));
+        scratch.rewind(mark);
+        return type;
+      }
+      break;
+    }
+    case Tag::Binary:
+      if (tree.token_kind(tree.main_token(node)) == TK::Arrow) {
+        auto mark = scratch.mark();
+        auto params = type_list(data.lhs);
+        TypeId type = types.function(params, type_expression(data.rhs));
+        scratch.rewind(mark);
+        return type;
+      }
+      break;
+    case Tag::Error:
+      return ERROR;
+    default:
+      break;
+    }
+    report(Kind::TypeMismatch, node, "Expected a type here");
+    return ERROR;
+  }
+
+  /* -------------------------------------------------------------------------*/
+  /* EXPRESSIONS */
+  /* -------------------------------------------------------------------------*/
+
+private:
+  TypeId literal(NodeIndex node) {
+    switch (tree.token_kind(tree.main_token(node))) {
+    case TK::Integer:
+      return INT;
+    case TK::Float:
+      return FLOAT;
+    case TK::String:
+      return STR;
+    case TK::Boolean:
+      return BOOL;
+    default:
+      return ERROR;
+    }
+  }
+
+  TypeId identifier(NodeIndex node) {
+    const Binding &binding = shared.resolution[node];
+    switch (binding.kind) {
+    case Binding::Kind::Unresolved:
+    case Binding::Kind::Builtin:
+      // Builtins only mean something when called, see `builtin_call()`
+      return ERROR;
+    default:
+      return node_types[binding.target];
+    }
+  }
+
+  /// @brief The type of `lhs op rhs`, or nothing if `op` doesn't apply.
+  std::optional<TypeId> arithmetic(TK op, TypeId lhs, TypeId rhs) const {
+    if (lhs == ERROR || rhs == ERROR)
+      return ERROR;
+
+    switch (op) {
+    case TK::Plus:
+      if (lhs == STR && rhs == STR)
+        return STR;
+      if (is_sequence(lhs) && compatible(lhs, rhs))
+        return lhs;
+      [[fallthrough]];
+    case TK::Minus:
+    case TK::Star:
+    case TK::StarStar:
+    case TK::SlashSlash:
+    case TK::Percent:
+      if (is_numeric(lhs) && is_numeric(rhs))
+        return lhs == INT && rhs == INT ? INT : FLOAT;
+      return std::nullopt;
+    case TK::Slash:
+      if (is_numeric(lhs) && is_numeric(rhs))
+        return FLOAT;
+      return std::nullopt;
+    case TK::And:
+    case TK::Bar:
+      if ((lhs == INT && rhs == INT) || (lhs == BOOL && rhs == BOOL))
+        return lhs;
+      return std::nullopt;
+    case TK::AndAnd:
+    case TK::BarBar:
+      if (lhs == BOOL && rhs == BOOL)
+        return BOOL;
+      return std::nullopt;
+    case TK::EqualsEquals:
+    case TK::BangEquals:
+      if (unify(lhs, rhs))
+        return BOOL;
+      return std::nullopt;
+    case TK::Less:
+    case TK::LessEquals:
+    case TK::More:
+    case TK::MoreEquals:
+      if ((is_numeric(lhs) && is_numeric(rhs)) || (lhs == STR && rhs == STR))
+        return BOOL;
+      return std::nullopt;
+    default:
+      return std::nullopt;
+    }
+  }
+
+  TypeId binary(NodeIndex node) {
+    ast::Data data = tree.node_data(node);
+    TypeId lhs = check(data.lhs);
+    TypeId rhs = check(data.rhs);
+    auto op = tree.token_kind(tree.main_token(node));
+    if (auto type = arithmetic(op, lhs, rhs))
+      return *type;
+
+    report(Kind::TypeMismatch, node, "Cannot apply '", lexeme(node), "' to ",
+           name(lhs), " and ", name(rhs));
+    return ERROR;
+  }
+
+  TypeId assign(NodeIndex node) {
+    ast::Data data = tree.node_data(node);
+    TypeId target = check(data.lhs);
+    TypeId value = check(data.rhs);
+    auto op = tree.token_kind(tree.main_token(node));
+
+    if (op != TK::Equals) {
+      auto applied = arithmetic(compound_operator(op), target, value);
+      if (!applied) {
+        report(Kind::TypeMismatch, node, "Cannot apply '", lexeme(node),
+               "' to ", name(target), " and ", name(value));
+        return target;
+      }
+      value = *applied;
+    }
+    if (!compatible(target, value))
+      report(Kind::TypeMismatch, node, "Cannot assign ", name(value), " to ",
+             name(target));
+    return target;
+  }
+
+  TypeId unary(NodeIndex node) {
+    TypeId operand = check(tree.node_data(node).lhs);
+    if (operand == ERROR)
+      return ERROR;
+
+    auto op = tree.token_kind(tree.main_token(node));
+    if (op == TK::Bang ? operand == BOOL || operand == INT
+                       : is_numeric(operand))
+      return operand;
+    report(Kind::TypeMismatch, node, "Cannot apply '", lexeme(node), "' to ",
+           name(operand));
+    return ERROR;
+  }
+
+  TypeId cast(NodeIndex node) {
+    ast::Data data = tree.node_data(node);
+    TypeId value = check(data.lhs);
+    TypeId target = type_expression(data.rhs);
+
+    auto scalar = [&](TypeId type) {
+      return is_numeric(type) || type == BOOL ||
+             types.get(type).kind == Type::Kind::Enum;
+    };
+    bool allowed = unify(value, target) || target == STR ||
+                   (scalar(value) && (is_numeric(target) || target == BOOL));
+    if (!allowed)
+      report(Kind::TypeMismatch, node, "Cannot cast ", name(value), " to ",
+             name(target));
+    return target;
+  }
+
+  void expect_arguments(NodeIndex node, std::string_view callee,
+                        ast::NodeList arguments, size_t count) {
+    if (arguments.size() != count)
+      report(Kind::TypeMismatch, node, "'", callee, "' takes ",
+             std::to_string(count), " argument", (count == 1 ? "" : "s"),
+             ", not ", std::to_string(arguments.size()));
+  }
+
+  TypeId builtin_call(NodeIndex node, Builtin builtin,
+                      ast::NodeList arguments) {
+    auto mark = scratch.mark();
+    auto argument_types = allocate_types(arguments.size());
+    for (size_t i = 0; i < arguments.size(); i++)
+      argument_types[i] = check(arguments[i]);
+    scratch.rewind(mark);
+
+    std::string_view callee = BUILTIN_NAMES[static_cast<size_t>(builtin)];
+    switch (builtin) {
+    case Builtin::Int:
+    case Builtin::Float:
+    case Builtin::Str:
+    case Builtin::Bool:
+      expect_arguments(node, callee, arguments, 1);
+      return named_type(tree.call(node).callee);
+    case Builtin::Print:
+      return VOID;
+    case Builtin::Len:
+      expect_arguments(node, callee, arguments, 1);
+      if (arguments.size() == 1 && !element_of(argument_types[0]))
+        report(Kind::TypeMismatch, node, name(argument_types[0]),
+               " has no length");
+      return INT;
+    case Builtin::Range:
+      for (size_t i = 0; i < arguments.size(); i++) {
+        if (!compatible(INT, argument_types[i]))
+          report(Kind::TypeMismatch, arguments[i], "Expected int, got ",
+                 name(argument_types[i]));
+      }
+      return types.generic(shared.list, std::span(&INT, 1));
+    case Builtin::List:
+      return ERROR;
+    }
+    return ERROR;
+  }
+
+  TypeId call(NodeIndex node) {
+    auto call = tree.call(node);
+    if (tree.tag(call.callee) == Tag::Identifier) {
+      const Binding &binding = shared.resolution[call.callee];
+      if (binding.kind == Binding::Kind::Builtin)
+        return builtin_call(node, static_cast<Builtin>(binding.target),
+                            call.arguments);
+    }
+
+    TypeId callee = check(call.callee);
+    const Type &type = types.get(callee);
+    if (type.kind != Type::Kind::Function) {
+      for (NodeIndex argument : call.arguments)
+        check(argument);
+      if (callee == ERROR)
+        return ERROR;
+      // Classes are called to construct them; their fields are set later
+      if (type.kind == Type::Kind::Class) {
+        if (!call.arguments.empty())
+          report(Kind::TypeMismatch, node, "Expected 0 arguments, got ",
+                 std::to_string(call.arguments.size()));
+        return callee;
+      }
+      report(Kind::TypeMismatch, node, name(callee), " cannot be called");
+      return ERROR;
+    }
+
+    auto params = types.params(callee);
+    if (params.size() != call.arguments.size())
+      report(Kind::TypeMismatch, node, "Expected ",
+             std::to_string(params.size()), " arguments, got ",
+             std::to_string(call.arguments.size()));
+    for (size_t i = 0; i < call.arguments.size(); i++) {
+      TypeId argument = check(call.arguments[i]);
+      if (i < params.size() && !compatible(params[i], argument))
+        report(Kind::TypeMismatch, call.arguments[i], "Expected ",
+               name(params[i]), ", got ", name(argument));
+    }
+    return types.result(callee);
+  }
+
+  TypeId index(NodeIndex node) {
+    ast::Data data = tree.node_data(node);
+    TypeId object = check(data.lhs);
+    TypeId position = check(data.rhs);
+    if (!compatible(INT, position))
+      report(Kind::TypeMismatch, data.rhs, "Expected an int index, got ",
+             name(position));
+
+    if (object == ERROR)
+      return ERROR;
+    if (auto element = element_of(object))
+      return *element;
+    report(Kind::TypeMismatch, node, "Cannot index into ", name(object));
+    return ERROR;
+  }
+
+  TypeId member(NodeIndex node) {
+    TypeId object = check(tree.node_data(node).lhs);
+    std::string_view wanted = lexeme(node);
+    const Type &type = types.get(object);
+
+    switch (type.kind) {
+    case Type::Kind::Class:
+      for (NodeIndex member : tree.class_decl(type.declaration).members) {
+        if (tree.tag(member) != Tag::Error && lexeme(member) == wanted)
+          return node_types[member];
+      }
+      break;
+    case Type::Kind::Enum:
+      for (NodeIndex variant : tree.enum_decl(type.declaration).variants) {
+        if (lexeme(variant) == wanted)
+          return object;
+      }
+      break;
+    case Type::Kind::Primitive:
+      if (object == ERROR || object == STR)
+        return ERROR;
+      break;
+    case Type::Kind::Function:
+      break;
+    case Type::Kind::Array:
+    case Type::Kind::Generic:
+      // Sequences have methods that aren't declared anywhere yet
+      return ERROR;
+    }
+
+    report(Kind::UnknownMember, node, name(object), " has no member '", wanted,
+           "'");
+    return ERROR;
+  }
+
+  TypeId array_literal(NodeIndex node) {
+    TypeId element = ERROR;
+    bool first = true;
+    for (NodeIndex item : tree.list(node)) {
+      TypeId type = check(item);
+      if (first) {
+        element = type;
+        first = false;
+      } else if (auto common = unify(element, type)) {
+        element = *common;
+      } else {
+        report(Kind::TypeMismatch, item, "Expected ", name(element), ", got ",
+               name(type));
+      }
+    }
+    return types.array(element);
+  }
+
+  TypeId ternary(NodeIndex node) {
+    auto ternary = tree.ternary(node);
+    condition(ternary.condition);
+    TypeId then = check(ternary.then);
+    TypeId otherwise = check(ternary.otherwise);
+    if (auto common = unify(then, otherwise))
+      return *common;
+    report(Kind::TypeMismatch, node, "The branches have different types: ",
+           name(then), " and ", name(otherwise));
+    return ERROR;
+  }
+
+  TypeId lambda(NodeIndex node) {
+    ast::Data data = tree.node_data(node);
+    size_t count = tree.tag(data.lhs) == Tag::Tuple
+                       ? tree.list(data.lhs).size()
+                       : 1;
+
+    // Parameters have no annotations to go by
+    TypeId body;
+    if (tree.tag(data.rhs) == Tag::Block) {
+      TypeId outer = result;
+      result = ERROR;
+      check(data.rhs);
+      result = outer;
+      body = ERROR;
+    } else {
+      body = check(data.rhs);
+    }
+
+    auto mark = scratch.mark();
+    auto params = allocate_types(count);
+    std::fill(params.begin(), params.end(), ERROR);
+    TypeId type = types.function(params, body);
+    scratch.rewind(mark);
+    return type;
+  }
+
+  /* -------------------------------------------------------------------------*/
+  /* STATEMENTS */
+  /* -------------------------------------------------------------------------*/
+
+  void condition(NodeIndex node) {
+    TypeId type = check(node);
+    if (!compatible(BOOL, type))
+      report(Kind::TypeMismatch, node, "Expected a bool condition, got ",
+             name(type));
+  }
+
+  TypeId var_decl(NodeIndex node) {
+    auto decl = tree.var_decl(node);
+    TypeId declared = decl.type ? type_expression(decl.type) : ERROR;
+    if (decl.value == ast::NULL_NODE)
+      return declared;
+
+    TypeId value = check(decl.value);
+    if (decl.type == ast::NULL_NODE)
+      return value;
+    if (!compatible(declared, value))
+      report(Kind::TypeMismatch, decl.value, "Cannot assign ", name(value),
+             " to ", name(declared));
+    return declared;
+  }
+
+  TypeId for_loop(NodeIndex node) {
+    auto loop = tree.for_stmt(node);
+    TypeId iterable = check(loop.iterable);
+    auto element = element_of(iterable);
+    if (!element && iterable != ERROR)
+      report(Kind::TypeMismatch, loop.iterable, "Cannot iterate over ",
+             name(iterable));
+
+    // The loop variable's type is the `For`'s, see `identifier()`
+    node_types[node] = element.value_or(ERROR);
+    check(loop.body);
+    return node_types[node];
+  }
+
+  void return_value(NodeIndex node) {
+    NodeIndex value = tree.return_stmt(node).value;
+    TypeId type = value ? check(value) : VOID;
+    if (!compatible(result, type))
+      report(Kind::TypeMismatch, value ? value : node, "Expected to return ",
+             name(result), ", got ", name(type));
+  }
+
+public:
+  Checker(const Shared &shared, DiagnosticEngine &diagnostics, Arena &scratch)
+      : tree(shared.tree), shared(shared), types(shared.types),
+        node_types(shared.node_types), diagnostics(diagnostics),
+        scratch(scratch), result(ERROR) {}
+
+  /// @brief Checks a node and records its type.
+  TypeId check(NodeIndex node) {
+    if (node == ast::NULL_NODE)
+      return ERROR;
+
+    TypeId type = ERROR;
+    switch (tree.tag(node)) {
+    case Tag::Root:
+    case Tag::EnumVariant:
+    case Tag::Error:
+    case Tag::Param:
+    // Declarations were typed by the first phase
+    case Tag::EnumDecl:
+      return node_types[node];
+    case Tag::Literal:
+      type = literal(node);
+      break;
+    case Tag::Identifier:
+      type = identifier(node);
+      break;
+    case Tag::Unary:
+    case Tag::Postfix:
+      type = unary(node);
+      break;
+    case Tag::Binary:
+      type = binary(node);
+      break;
+    case Tag::Assign:
+      type = assign(node);
+      break;
+    case Tag::Ternary:
+      type = ternary(node);
+      break;
+    case Tag::Cast:
+      type = cast(node);
+      break;
+    case Tag::Call:
+      type = call(node);
+      break;
+    case Tag::Index:
+      type = index(node);
+      break;
+    case Tag::Member:
+      type = member(node);
+      break;
+    case Tag::Grouping:
+      type = check(tree.node_data(node).lhs);
+      break;
+    case Tag::Tuple:
+      // There are no tuple types yet
+      for (NodeIndex element : tree.list(node))
+        check(element);
+      break;
+    case Tag::Array:
+      type = array_literal(node);
+      break;
+    case Tag::Lambda:
+      type = lambda(node);
+      break;
+    case Tag::Block:
+      for (NodeIndex statement : tree.list(node))
+        check(statement);
+      return ERROR;
+    case Tag::VarDecl:
+      type = var_decl(node);
+      break;
+    case Tag::If: {
+      auto branch = tree.if_stmt(node);
+      condition(branch.condition);
+      check(branch.then);
+      check(branch.otherwise);
+      return ERROR;
+    }
+    case Tag::While:
+      condition(tree.while_stmt(node).condition);
+      check(tree.while_stmt(node).body);
+      return ERROR;
+    case Tag::For:
+      return for_loop(node);
+    case Tag::Return:
+      return_value(node);
+      return ERROR;
+    case Tag::FnDecl:
+      // Nested functions are checked where they appear
+      body(node);
+      return node_types[node];
+    case Tag::ClassDecl:
+      fields(node);
+      for (NodeIndex member : tree.class_decl(node).members) {
+        if (tree.tag(member) == Tag::FnDecl)
+          body(member);
+      }
+      return node_types[node];
+    }
+
+    node_types[node] = type;
+    return type;
+  }
+
+  /// @brief Checks the body of a function against its signature.
+  void body(NodeIndex node) {
+    TypeId outer = result;
+    result = types.result(node_types[node]);
+    check(tree.fn_decl(node).body);
+    result = outer;
+  }
+
+  /// @brief Types the fields of a class, in order.
+  void fields(NodeIndex node) {
+    for (NodeIndex member : tree.class_decl(node).members) {
+      if (tree.tag(member) == Tag::VarDecl)
+        check(member);
+    }
+  }
+
+  /// @brief Works out a function's type from its signature.
+  void signature(NodeIndex node) {
+    auto fn = tree.fn_decl(node);
+    auto mark = scratch.mark();
+    auto params = allocate_types(fn.params.size());
+    for (size_t i = 0; i < fn.params.size(); i++) {
+      NodeIndex type = tree.node_data(fn.params[i]).lhs;
+      params[i] = type ? type_expression(type) : ERROR;
+      node_types[fn.params[i]] = params[i];
+    }
+    TypeId returned = fn.return_type ? type_expression(fn.return_type) : VOID;
+    node_types[node] = types.function(params, returned);
+    scratch.rewind(mark);
+  }
+};
+
+} // namespace
+
+Typing sema::check(const ast::Tree &tree, const Resolution &resolution,
+                   StringInterner &names, TypeInterner &types,
+                   DiagnosticEngine &diagnostics, ThreadPool &pool) {
+  profile::Scope scope(profile::Phase::Sema, tree.file->path);
+  Typing typing;
+  typing.types.assign(tree.node_count(), ERROR);
+  Shared shared{tree, resolution, names, types, typing.types,
+                names.intern(BUILTIN_NAMES[static_cast<size_t>(
+                    Builtin::List)])};
+
+  // Phase one: every declaration, in the order the nodes were built
+  Arena scratch;
+  Checker declarations(shared, diagnostics, scratch);
+  for (NodeIndex node = 1; node < tree.node_count(); node++) {
+    Tag tag = tree.tag(node);
+    if (tag != Tag::ClassDecl && tag != Tag::EnumDecl)
+      continue;
+
+    if (tag == Tag::ClassDecl) {
+      auto name = tree.token_lexeme(tree.class_decl(node).name);
+      typing.types[node] = types.class_type(names.intern(name), node);
+    } else {
+      auto name = tree.token_lexeme(tree.enum_decl(node).name);
+      typing.types[node] = types.enum_type(names.intern(name), node);
+    }
+  }
+  for (NodeIndex node = 1; node < tree.node_count(); node++) {
+    if (tree.tag(node) == Tag::FnDecl)
+      declarations.signature(node);
+  }
+
+  // The top level runs before any function can be called, so globals are
+  // typed before the bodies that use them
+  std::vector<NodeIndex> bodies;
+  for (NodeIndex item : tree.items()) {
+    if (tree.tag(item) == Tag::FnDecl) {
+      bodies.push_back(item);
+    } else if (tree.tag(item) == Tag::ClassDecl) {
+      declarations.fields(item);
+      for (NodeIndex member : tree.class_decl(item).members) {
+        if (tree.tag(member) == Tag::FnDecl)
+          bodies.push_back(member);
+      }
+    } else {
+      declarations.check(item);
+    }
+  }
+
+  // Phase two: runs of consecutive bodies, each run a task with its own
+  // scratch space and diagnostics. Nodes are numbered in source order, so
+  // the gap between two bodies' nodes is roughly the size of the second.
+  size_t total = bodies.empty() ? 0 : bodies.back() - bodies.front();
+  size_t per_task =
+      std::max(MIN_TASK_NODES, total / (pool.size() * TASKS_PER_THREAD));
+  std::vector<size_t> starts;
+  for (size_t i = 0, weight = per_task; i < bodies.size(); i++) {
+    if (weight >= per_task) {
+      starts.push_back(i);
+      weight = 0;
+    }
+    weight += bodies[i] - (i == 0 ? 0 : bodies[i - 1]);
+  }
+  starts.push_back(bodies.size());
+
+  std::vector<DiagnosticEngine> found(starts.size() - 1);
+  pool.parallel_for(found.size(), [&](size_t task) {
+    profile::Scope scope(profile::Phase::Sema, tree.file->path);
+    Arena task_scratch;
+    Checker checker(shared, found[task], task_scratch);
+    for (size_t i = starts[task]; i < starts[task + 1]; i++)
+      checker.body(bodies[i]);
+  });
+  for (auto &engine : found)
+    diagnostics.merge(engine);
+  return typing;
+}
@@ -0,0 +1,552 @@
+#include "sema/folder.hpp"
+#include "common/arith.hpp"
+#include "common/profile.hpp"
+#include <charconv>
+#include <cmath>
+#include <limits>
+#include <optional>
+#include <string>
+
+using namespace sema;
+using arith::floor_divide;
+using arith::floor_modulo;
+using arith::power;
+using ast::NodeIndex;
+using ast::Tag;
+using diagnostic::Kind;
+using CK = Constant::Kind;
+using TK = Token::Kind;
+
+namespace {
+
+constexpr TypeId INT = type_of(Primitive::Int);
+constexpr TypeId FLOAT = type_of(Primitive::Float);
+constexpr TypeId BOOL = type_of(Primitive::Bool);
+
+constexpr int64_t LOWEST = std::numeric_limits<int64_t>::min();
+
+double as_float(const Constant &constant) {
+  return constant.kind == CK::Int ? static_cast<double>(constant.integer)
+                                  : constant.real;
+}
+
+bool is_zero(const Constant &constant) {
+  return (constant.kind == CK::Int && constant.integer == 0) ||
+         (constant.kind == CK::Float && constant.real == 0.0);
+}
+
+class Folder {
+  const ast::Tree &tree;
+  const Resolution &resolution;
+  const Typing &typing;
+  DiagnosticEngine &diagnostics;
+  std::vector<Constant> &constants;
+
+  /// Indexed by `VarDecl`: whether anything assigns to the variable after
+  /// its declaration. Fields count as assigned, since any object can be.
+  std::vector<bool> assigned;
+
+  /// Above zero while folding code that a constant condition rules out,
+  /// which is folded all the same but never reported on
+  uint32_t dead;
+
+  /// The function or lambda whose body is being folded, or `NULL_NODE` at
+  /// the top level, and for every `VarDecl` folded so far, the one it was
+  /// declared in
+  NodeIndex function;
+  std::vector<NodeIndex> declared_in;
+
+  /// @brief Reports the concatenation of `parts` at the node's main token.
+  template <typename... Parts>
+  void report(Kind kind, NodeIndex node, const Parts &...parts) {
+    if (dead > 0)
+      return;
+    std::string message;
+    (message += ... += parts);
+    diagnostics.emit(
+        Diagnostic(kind, tree.token_span(tree.main_token(node)), message));
+  }
+
+  std::string_view lexeme(NodeIndex node) const {
+    return tree.token_lexeme(tree.main_token(node));
+  }
+
+  Constant overflow(NodeIndex node) {
+    report(Kind::IntegerOverflow, node, "'", lexeme(node),
+           "' overflows a 64-bit int here");
+    return {};
+  }
+
+  /// The result of `int ** int` is an int, which a negative power isn't
+  Constant negative_power(NodeIndex node) {
+    report(Kind::TypeMismatch, node, "'", lexeme(node),
+           "' raises an int to a negative power, which isn't an int");
+    return {};
+  }
+
+  /// @brief Folds `node` with `dead` raised if `live` is false.
+  Constant fold_if(bool live, NodeIndex node) {
+    if (live)
+      return fold(node);
+    dead++;
+    Constant constant = fold(node);
+    dead--;
+    return constant;
+  }
+
+  void find_assignments() {
+    for (NodeIndex node = 1; node < tree.node_count(); node++) {
+      NodeIndex target = ast::NULL_NODE;
+      switch (tree.tag(node)) {
+      case Tag::Assign:
+        target = tree.node_data(node).lhs;
+        break;
+      case Tag::Unary:
+      case Tag::Postfix: {
+        auto op = tree.token_kind(tree.main_token(node));
+        if (op == TK::PlusPlus || op == TK::MinusMinus)
+          target = tree.node_data(node).lhs;
+        break;
+      }
+      case Tag::ClassDecl:
+        for (NodeIndex member : tree.class_decl(node).members)
+          assigned[member] = true;
+        break;
+      default:
+        break;
+      }
+
+      if (target != ast::NULL_NODE && tree.tag(target) == Tag::Identifier &&
+          resolution[target].kind == Binding::Kind::Variable)
+        assigned[resolution[target].target] = true;
+    }
+  }
+
+  /* -------------------------------------------------------------------------*/
+  /* EXPRESSIONS */
+  /* -------------------------------------------------------------------------*/
+
+  Constant literal(NodeIndex node) {
+    std::string_view text = lexeme(node);
+    switch (tree.token_kind(tree.main_token(node))) {
+    case TK::Integer: {
+      int64_t value = 0;
+      auto ec = std::from_chars(text.data(), text.end(), value).ec;
+      if (ec == std::errc::result_out_of_range) {
+        report(Kind::IntegerOverflow, node, "'", text,
+               "' doesn't fit in a 64-bit int");
+        return {};
+      }
+      return ec == std::errc() ? Constant::of_int(value) : Constant();
+    }
+    case TK::Float: {
+      double value = 0;
+      auto ec = std::from_chars(text.data(), text.end(), value).ec;
+      return ec == std::errc() ? Constant::of_float(value) : Constant();
+    }
+    case TK::Boolean:
+      return Constant::of_bool(text == "true");
+    default:
+      return {};
+    }
+  }
+
+  Constant identifier(NodeIndex node) {
+    const Binding &binding = resolution[node];
+    if (binding.kind != Binding::Kind::Variable ||
+        tree.tag(binding.target) != Tag::VarDecl || assigned[binding.target])
+      return {};
+    // Code in the same body runs after the declaration, as it is folded
+    // after it. Any other body may be called before the variable is set,
+    // and then sees nil, however constant its value is.
+    if (declared_in[binding.target] != function)
+      return {};
+    return constants[binding.target];
+  }
+
+  Constant unary(NodeIndex node) {
+    Constant operand = fold(tree.node_data(node).lhs);
+    switch (tree.token_kind(tree.main_token(node))) {
+    case TK::Minus:
+      if (operand.kind == CK::Int)
+        return operand.integer == LOWEST
+                   ? overflow(node)
+                   : Constant::of_int(-operand.integer);
+      if (operand.kind == CK::Float)
+        return Constant::of_float(-operand.real);
+      return {};
+    case TK::Bang:
+      if (operand.kind == CK::Bool)
+        return Constant::of_bool(!operand.boolean);
+      if (operand.kind == CK::Int)
+        return Constant::of_int(~operand.integer);
+      return {};
+    default:
+      return {};
+    }
+  }
+
+  template <typename T>
+  static std::optional<bool> compare(TK op, T a, T b) {
+    switch (op) {
+    case TK::EqualsEquals:
+      return a == b;
+    case TK::BangEquals:
+      return a != b;
+    case TK::Less:
+      return a < b;
+    case TK::LessEquals:
+      return a <= b;
+    case TK::More:
+      return a > b;
+    case TK::MoreEquals:
+      return a >= b;
+    default:
+      return std::nullopt;
+    }
+  }
+
+  static Constant logic(TK op, bool a, bool b) {
+    switch (op) {
+    case TK::EqualsEquals:
+      return Constant::of_bool(a == b);
+    case TK::BangEquals:
+      return Constant::of_bool(a != b);
+    case TK::And:
+      return Constant::of_bool(a && b);
+    case TK::Bar:
+      return Constant::of_bool(a || b);
+    default:
+      return {};
+    }
+  }
+
+  Constant integers(NodeIndex node, TK op, int64_t a, int64_t b) {
+    int64_t result = 0;
+    switch (op) {
+    case TK::Plus:
+      if (__builtin_add_overflow(a, b, &result))
+        return overflow(node);
+      return Constant::of_int(result);
+    case TK::Minus:
+      if (__builtin_sub_overflow(a, b, &result))
+        return overflow(node);
+      return Constant::of_int(result);
+    case TK::Star:
+      if (__builtin_mul_overflow(a, b, &result))
+        return overflow(node);
+      return Constant::of_int(result);
+    case TK::Slash:
+      return Constant::of_float(static_cast<double>(a) /
+                                static_cast<double>(b));
+    case TK::SlashSlash:
+      if (a == LOWEST && b == -1)
+        return overflow(node);
+      return Constant::of_int(floor_divide(a, b));
+    case TK::Percent:
+      return Constant::of_int(floor_modulo(a, b));
+    case TK::StarStar: {
+      if (b < 0)
+        return negative_power(node);
+      auto raised = power(a, b);
+      return raised ? Constant::of_int(*raised) : overflow(node);
+    }
+    case TK::And:
+      return Constant::of_int(a & b);
+    case TK::Bar:
+      return Constant::of_int(a | b);
+    default:
+      if (auto result = compare(op, a, b))
+        return Constant::of_bool(*result);
+      return {};
+    }
+  }
+
+  static Constant floats(TK op, double a, double b) {
+    switch (op) {
+    case TK::Plus:
+      return Constant::of_float(a + b);
+    case TK::Minus:
+      return Constant::of_float(a - b);
+    case TK::Star:
+      return Constant::of_float(a * b);
+    case TK::Slash:
+      return Constant::of_float(a / b);
+    case TK::SlashSlash:
+      return Constant::of_float(std::floor(a / b));
+    case TK::Percent:
+      return Constant::of_float(floor_modulo(a, b));
+    case TK::StarStar:
+      return Constant::of_float(std::pow(a, b));
+    default:
+      if (auto result = compare(op, a, b))
+        return Constant::of_bool(*result);
+      return {};
+    }
+  }
+
+  static bool divides(TK op) {
+    return op == TK::Slash || op == TK::SlashSlash || op == TK::Percent ||
+           op == TK::SlashEquals || op == TK::SlashSlashEquals;
+  }
+
+  Constant binary(NodeIndex node) {
+    ast::Data data = tree.node_data(node);
+    auto op = tree.token_kind(tree.main_token(node));
+    Constant lhs = fold(data.lhs);
+
+    // The right side of a short circuit that is taken never runs
+    if (op == TK::AndAnd || op == TK::BarBar) {
+      bool decisive = op == TK::BarBar;
+      bool taken = lhs.kind == CK::Bool && lhs.boolean == decisive;
+      Constant rhs = fold_if(!taken, data.rhs);
+      if (taken)
+        return lhs;
+      return lhs.kind == CK::Bool && rhs.kind == CK::Bool ? rhs : Constant();
+    }
+
+    Constant rhs = fold(data.rhs);
+    if (divides(op) && is_zero(rhs)) {
+      report(Kind::DivisionByZero, node, "The right side of '", lexeme(node),
+             "' is always zero");
+      return {};
+    }
+
+    if (lhs.kind == CK::Bool && rhs.kind == CK::Bool)
+      return logic(op, lhs.boolean, rhs.boolean);
+    if (lhs.kind == CK::Int && rhs.kind == CK::Int)
+      return integers(node, op, lhs.integer, rhs.integer);
+    bool numbers = (lhs.kind == CK::Int || lhs.kind == CK::Float) &&
+                   (rhs.kind == CK::Int || rhs.kind == CK::Float);
+    if (numbers)
+      return floats(op, as_float(lhs), as_float(rhs));
+    return {};
+  }
+
+  /// @brief `value` as a value of type `type`, if it can be one.
+  static Constant convert(const Constant &value, TypeId type) {
+    if (!value.known())
+      return {};
+    if (type == INT) {
+      if (value.kind == CK::Bool)
+        return Constant::of_int(value.boolean);
+      // Out of range or not a number, which is the runtime's to deal with
+      constexpr double LIMIT = 0x1p63;
+      if (value.kind == CK::Float &&
+          !(value.real >= -LIMIT && value.real < LIMIT))
+        return {};
+      return value.kind == CK::Float
+                 ? Constant::of_int(static_cast<int64_t>(value.real))
+                 : value;
+    }
+    if (type == FLOAT)
+      return value.kind == CK::Bool ? Constant::of_float(value.boolean)
+                                    : Constant::of_float(as_float(value));
+    if (type == BOOL) {
+      if (value.kind == CK::Int)
+        return Constant::of_bool(value.integer != 0);
+      if (value.kind == CK::Float)
+        return Constant::of_bool(value.real != 0.0);
+      return value;
+    }
+    return {};
+  }
+
+  Constant ternary(NodeIndex node) {
+    auto ternary = tree.ternary(node);
+    Constant condition = fold(ternary.condition);
+    bool known = condition.kind == CK::Bool;
+    Constant then = fold_if(!known || condition.boolean, ternary.then);
+    Constant otherwise =
+        fold_if(!known || !condition.boolean, ternary.otherwise);
+    if (!known)
+      return {};
+    return convert(condition.boolean ? then : otherwise, typing[node]);
+  }
+
+  Constant assign(NodeIndex node) {
+    ast::Data data = tree.node_data(node);
+    fold(data.lhs);
+    Constant value = fold(data.rhs);
+    auto op = tree.token_kind(tree.main_token(node));
+    if (divides(op) && is_zero(value))
+      report(Kind::DivisionByZero, node, "The right side of '", lexeme(node),
+             "' is always zero");
+    if (op == TK::StarStarEquals && typing[data.lhs] == INT &&
+        value.kind == CK::Int && value.integer < 0)
+      negative_power(node);
+    return {};
+  }
+
+  /* -------------------------------------------------------------------------*/
+  /* STATEMENTS */
+  /* -------------------------------------------------------------------------*/
+
+  /// @brief Folds a block in the order the resolver visits it: functions
+  /// and classes last, so that every variable their bodies can see has
+  /// already been folded.
+  void statements(ast::NodeList statements) {
+    for (NodeIndex statement : statements)
+      fold(statement);
+
+    for (NodeIndex statement : statements) {
+      if (tree.tag(statement) == Tag::FnDecl) {
+        body(statement, tree.fn_decl(statement).body);
+      } else if (tree.tag(statement) == Tag::ClassDecl) {
+        auto members = tree.class_decl(statement).members;
+        for (NodeIndex member : members) {
+          if (tree.tag(member) == Tag::VarDecl)
+            fold(member);
+        }
+        for (NodeIndex member : members) {
+          if (tree.tag(member) == Tag::FnDecl)
+            body(member, tree.fn_decl(member).body);
+        }
+      }
+    }
+  }
+
+  /// @brief Folds the body of the function or lambda `owner`.
+  void body(NodeIndex owner, NodeIndex node) {
+    NodeIndex outer = function;
+    function = owner;
+    fold(node);
+    function = outer;
+  }
+
+  void branch(NodeIndex node) {
+    auto branch = tree.if_stmt(node);
+    Constant condition = fold(branch.condition);
+    bool known = condition.kind == CK::Bool;
+    fold_if(!known || condition.boolean, branch.then);
+    fold_if(!known || !condition.boolean, branch.otherwise);
+  }
+
+  void loop(NodeIndex node) {
+    auto loop = tree.while_stmt(node);
+    Constant condition = fold(loop.condition);
+    fold_if(condition.kind != CK::Bool || condition.boolean, loop.body);
+  }
+
+public:
+  Folder(const ast::Tree &tree, const Resolution &resolution,
+         const Typing &typing, DiagnosticEngine &diagnostics,
+         std::vector<Constant> &constants)
+      : tree(tree), resolution(resolution), typing(typing),
+        diagnostics(diagnostics), constants(constants),
+        assigned(tree.node_count(), false), dead(0),
+        function(ast::NULL_NODE),
+        declared_in(tree.node_count(), ast::NULL_NODE) {}
+
+  /// @brief Folds a node and records its value.
+  Constant fold(NodeIndex node) {
+    if (node == ast::NULL_NODE)
+      return {};
+
+    Constant constant;
+    ast::Data data = tree.node_data(node);
+    switch (tree.tag(node)) {
+    case Tag::Root:
+    case Tag::EnumVariant:
+    case Tag::EnumDecl:
+    case Tag::Error:
+    case Tag::Param:
+    // Bodies are folded once their block is, see `statements()`
+    case Tag::FnDecl:
+    case Tag::ClassDecl:
+      return {};
+    case Tag::Literal:
+      constant = literal(node);
+      break;
+    case Tag::Identifier:
+      constant = identifier(node);
+      break;
+    case Tag::Unary:
+      constant = unary(node);
+      break;
+    case Tag::Postfix:
+    case Tag::Member:
+      fold(data.lhs);
+      break;
+    case Tag::Binary:
+      constant = binary(node);
+      break;
+    case Tag::Assign:
+      constant = assign(node);
+      break;
+    case Tag::Ternary:
+      constant = ternary(node);
+      break;
+    case Tag::Cast:
+      // The right side is a type
+      constant = convert(fold(data.lhs), typing[node]);
+      break;
+    case Tag::Call: {
+      auto call = tree.call(node);
+      fold(call.callee);
+      for (NodeIndex argument : call.arguments)
+        fold(argument);
+      break;
+    }
+    case Tag::Index:
+      fold(data.lhs);
+      fold(data.rhs);
+      break;
+    case Tag::Grouping:
+      constant = fold(data.lhs);
+      break;
+    case Tag::Tuple:
+    case Tag::Array:
+      for (NodeIndex element : tree.list(node))
+        fold(element);
+      break;
+    case Tag::Lambda:
+      body(node, data.rhs);
+      break;
+    case Tag::Block:
+      statements(tree.list(node));
+      break;
+    case Tag::VarDecl: {
+      // A declared type may widen the value, as in `x: float = 1`
+      auto decl = tree.var_decl(node);
+      constant = convert(fold(decl.value), typing[node]);
+      declared_in[node] = function;
+      break;
+    }
+    case Tag::If:
+      branch(node);
+      break;
+    case Tag::While:
+      loop(node);
+      break;
+    case Tag::For: {
+      auto loop = tree.for_stmt(node);
+      fold(loop.iterable);
+      fold(loop.body);
+      break;
+    }
+    case Tag::Return:
+      fold(tree.return_stmt(node).value);
+      break;
+    }
+
+    constants[node] = constant;
+    return constant;
+  }
+
+  void run() {
+    find_assignments();
+    statements(tree.items());
+  }
+};
+
+} // namespace
+
+Folding sema::fold(const ast::Tree &tree, const Resolution &resolution,
+                   const Typing &typing, DiagnosticEngine &diagnostics) {
+  profile::Scope scope(profile::Phase::Sema, tree.file->path);
+  Folding folding;
+  folding.constants.resize(tree.node_count());
+  Folder(tree, resolution, typing, diagnostics, folding.constants).run();
+  return folding;
+}
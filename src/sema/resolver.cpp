@@ -0,0 +1,243 @@
+#include "sema/resolver.hpp"
+#include "common/profile.hpp"
+#include "sema/scope.hpp"
+#include <iterator>
+#include <string>
+
+using namespace sema;
+using ast::NodeIndex;
+using ast::Tag;
+using Kind = Binding::Kind;
+
+namespace {
+
+class Resolver {
+  const ast::Tree &tree;
+  StringInterner &names;
+  DiagnosticEngine &diagnostics;
+  Resolution &resolution;
+  ScopeStack<Binding> scopes;
+
+  Symbol symbol_of(ast::TokenIndex token) {
+    return names.intern(tree.token_lexeme(token));
+  }
+
+  void declare(ast::TokenIndex name, Kind kind, NodeIndex target) {
+    scopes.declare(symbol_of(name), {kind, target});
+  }
+
+  /// @brief Declares the functions, classes and enums of a block up front.
+  void hoist(ast::NodeList statements) {
+    for (NodeIndex statement : statements) {
+      switch (tree.tag(statement)) {
+      case Tag::FnDecl:
+        declare(tree.main_token(statement), Kind::Function, statement);
+        break;
+      case Tag::ClassDecl:
+        declare(tree.class_decl(statement).name, Kind::Class, statement);
+        break;
+      case Tag::EnumDecl:
+        declare(tree.enum_decl(statement).name, Kind::Enum, statement);
+        break;
+      default:
+        break;
+      }
+    }
+  }
+
+  void resolve_statements(ast::NodeList statements) {
+    hoist(statements);
+    for (NodeIndex statement : statements)
+      resolve_node(statement);
+
+    // Bodies go last so that they see everything the block declares
+    for (NodeIndex statement : statements) {
+      if (tree.tag(statement) == Tag::FnDecl)
+        resolve_function(statement);
+      else if (tree.tag(statement) == Tag::ClassDecl)
+        resolve_class(statement);
+    }
+  }
+
+  void resolve_function(NodeIndex node) {
+    auto fn = tree.fn_decl(node);
+    scopes.push();
+    for (NodeIndex param : fn.params)
+      declare(tree.main_token(param), Kind::Parameter, param);
+    resolve_node(fn.body);
+    scopes.pop();
+  }
+
+  void resolve_class(NodeIndex node) {
+    auto members = tree.class_decl(node).members;
+    scopes.push();
+    for (NodeIndex member : members) {
+      if (tree.tag(member) == Tag::VarDecl)
+        declare(tree.main_token(member), Kind::Variable, member);
+      else if (tree.tag(member) == Tag::FnDecl)
+        declare(tree.main_token(member), Kind::Function, member);
+    }
+    for (NodeIndex member : members)
+      resolve_node(member);
+    for (NodeIndex member : members) {
+      if (tree.tag(member) == Tag::FnDecl)
+        resolve_function(member);
+    }
+    scopes.pop();
+  }
+
+  void resolve_identifier(NodeIndex node) {
+    ast::TokenIndex token = tree.main_token(node);
+    const Binding *binding = scopes.lookup(symbol_of(token));
+    if (binding != nullptr) {
+      resolution.bindings[node] = *binding;
+      return;
+    }
+
+    diagnostics.emit(Diagnostic(diagnostic::Kind::UndefinedName,
+                                tree.token_span(token),
+                                "Nothing named '" +
+                                    std::string(tree.token_lexeme(token)) +
+                                    "' is in scope here"));
+  }
+
+  void resolve_list(ast::NodeList nodes) {
+    for (NodeIndex node : nodes)
+      resolve_node(node);
+  }
+
+  void resolve_node(NodeIndex node) {
+    if (node == ast::NULL_NODE)
+      return;
+
+    ast::Data data = tree.node_data(node);
+    switch (tree.tag(node)) {
+    case Tag::Root:
+    case Tag::Literal:
+    case Tag::EnumVariant:
+    case Tag::EnumDecl:
+    case Tag::Error:
+      break;
+    case Tag::Identifier:
+      resolve_identifier(node);
+      break;
+    case Tag::Unary:
+    case Tag::Postfix:
+    case Tag::Grouping:
+    case Tag::Return:
+    // Members are looked up on the object's type, which takes a type checker
+    case Tag::Member:
+      resolve_node(data.lhs);
+      break;
+    case Tag::Binary:
+    case Tag::Assign:
+    case Tag::Cast:
+    case Tag::Index:
+    case Tag::While:
+      resolve_node(data.lhs);
+      resolve_node(data.rhs);
+      break;
+    case Tag::Ternary: {
+      auto ternary = tree.ternary(node);
+      resolve_node(ternary.condition);
+      resolve_node(ternary.then);
+      resolve_node(ternary.otherwise);
+      break;
+    }
+    case Tag::If: {
+      auto branch = tree.if_stmt(node);
+      resolve_node(branch.condition);
+      resolve_node(branch.then);
+      resolve_node(branch.otherwise);
+      break;
+    }
+    case Tag::Call: {
+      auto call = tree.call(node);
+      resolve_node(call.callee);
+      resolve_list(call.arguments);
+      break;
+    }
+    case Tag::Tuple:
+    case Tag::Array:
+      resolve_list(tree.list(node));
+      break;
+    case Tag::Block:
+      scopes.push();
+      resolve_statements(tree.list(node));
+      scopes.pop();
+      break;
+    case Tag::Lambda:
+      scopes.push();
+      if (tree.tag(data.lhs) == Tag::Identifier) {
+        declare(tree.main_token(data.lhs), Kind::Parameter, data.lhs);
+        resolution.bindings[data.lhs] = {Kind::Parameter, data.lhs};
+      } else if (tree.tag(data.lhs) == Tag::Tuple) {
+        for (NodeIndex param : tree.list(data.lhs)) {
+          declare(tree.main_token(param), Kind::Parameter, param);
+          resolution.bindings[param] = {Kind::Parameter, param};
+        }
+      }
+      resolve_node(data.rhs);
+      scopes.pop();
+      break;
+    case Tag::VarDecl: {
+      // The value can't see the variable it initializes, only an outer one
+      auto decl = tree.var_decl(node);
+      resolve_node(decl.type);
+      resolve_node(decl.value);
+      declare(decl.name, Kind::Variable, node);
+      break;
+    }
+    case Tag::For: {
+      auto loop = tree.for_stmt(node);
+      resolve_node(loop.iterable);
+      scopes.push();
+      declare(loop.variable, Kind::Variable, node);
+      resolve_node(loop.body);
+      scopes.pop();
+      break;
+    }
+    case Tag::FnDecl: {
+      // Only the signature, the body comes once the block is done
+      auto fn = tree.fn_decl(node);
+      resolve_list(fn.params);
+      resolve_node(fn.return_type);
+      break;
+    }
+    case Tag::Param:
+      resolve_node(data.lhs);
+      break;
+    case Tag::ClassDecl:
+      break;
+    }
+  }
+
+public:
+  Resolver(const ast::Tree &tree, StringInterner &names,
+           DiagnosticEngine &diagnostics, Resolution &resolution)
+      : tree(tree), names(names), diagnostics(diagnostics),
+        resolution(resolution), scopes() {}
+
+  void run() {
+    scopes.push();
+    for (size_t i = 0; i < std::size(BUILTIN_NAMES); i++)
+      scopes.declare(names.intern(BUILTIN_NAMES[i]),
+                     {Kind::Builtin, static_cast<uint32_t>(i)});
+
+    scopes.push();
+    resolve_statements(tree.items());
+    scopes.pop();
+    scopes.pop();
+  }
+};
+
+} // namespace
+
+Resolution sema::resolve(const ast::Tree &tree, StringInterner &names,
+                         DiagnosticEngine &diagnostics) {
+  profile::Scope scope(profile::Phase::Sema, tree.file->path);
+  Resolution resolution;
+  resolution.bindings.resize(tree.node_count());
+  Resolver(tree, names, diagnostics, resolution).run();
+  return resolution;
+}
@@ -0,0 +1,219 @@
+#include "sema/types.hpp"
+#include "common/hash.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <mutex>
+
+using namespace sema;
+using Kind = Type::Kind;
+
+namespace {
+
+constexpr size_t INITIAL_SLOTS = 64;
+
+constexpr std::array<Type, PRIMITIVE_COUNT> PRIMITIVES = [] {
+  std::array<Type, PRIMITIVE_COUNT> types = {};
+  for (TypeId i = 0; i < PRIMITIVE_COUNT; i++)
+    types[i] = {Kind::Primitive, StringInterner::NO_SYMBOL, i, {}};
+  return types;
+}();
+
+uint64_t hash_of(const Type &key) {
+  uint32_t header[] = {static_cast<uint32_t>(key.kind), key.name,
+                       key.declaration};
+  uint64_t seed = hash::xxh3_64(std::string_view(
+      reinterpret_cast<const char *>(header), sizeof(header)));
+  return hash::xxh3_64(
+      std::string_view(reinterpret_cast<const char *>(key.operands.data()),
+                       key.operands.size_bytes()),
+      seed);
+}
+
+bool matches(const Type &type, const Type &key) {
+  return type.kind == key.kind && type.name == key.name &&
+         type.declaration == key.declaration &&
+         std::ranges::equal(type.operands, key.operands);
+}
+
+} // namespace
+
+TypeInterner::Shard::Shard()
+    : mutex(), slots(INITIAL_SLOTS, {0, EMPTY}), chunks(), count(0),
+      operands() {}
+
+void TypeInterner::Shard::grow() {
+  std::vector<Slot> old(slots.size() * 2, {0, EMPTY});
+  old.swap(slots);
+
+  size_t mask = slots.size() - 1;
+  for (const Slot &slot : old) {
+    if (slot.index == EMPTY)
+      continue;
+    size_t i = slot.hash & mask;
+    while (slots[i].index != EMPTY)
+      i = (i + 1) & mask;
+    slots[i] = slot;
+  }
+}
+
+std::optional<uint32_t> TypeInterner::probe(const Shard &shard, uint32_t hash,
+                                            const Type &key) {
+  size_t mask = shard.slots.size() - 1;
+  for (size_t i = hash & mask;; i = (i + 1) & mask) {
+    const Slot &slot = shard.slots[i];
+    if (slot.index == EMPTY)
+      return std::nullopt;
+    if (slot.hash == hash && matches(shard.at(slot.index), key))
+      return slot.index;
+  }
+}
+
+TypeId TypeInterner::intern(const Type &key) {
+  uint64_t full_hash = hash_of(key);
+  size_t shard_index = full_hash & (SHARD_COUNT - 1);
+  auto hash = static_cast<uint32_t>(full_hash >> 32);
+  Shard &shard = shards[shard_index];
+
+  auto id = [&](uint32_t index) {
+    return PRIMITIVE_COUNT +
+           static_cast<TypeId>(index << SHARD_BITS | shard_index);
+  };
+
+  // Nearly every type a checker asks for already exists
+  {
+    std::shared_lock lock(shard.mutex);
+    if (auto index = probe(shard, hash, key))
+      return id(*index);
+  }
+
+  std::unique_lock lock(shard.mutex);
+  if (auto index = probe(shard, hash, key))
+    return id(*index);
+
+  uint32_t index = shard.count;
+  auto [chunk_index, offset] = Shard::locate(index);
+  if (chunk_index == MAX_CHUNKS)
+    std::abort();
+  auto &chunk = shard.chunks[chunk_index];
+  if (!chunk)
+    chunk = std::make_unique<Type[]>(FIRST_CHUNK << chunk_index);
+
+  // Only now is anything copied: the key's operands belong to the caller
+  Type &type = chunk[offset];
+  type = key;
+  type.operands = shard.operands.copy(key.operands);
+  shard.count++;
+
+  size_t mask = shard.slots.size() - 1;
+  size_t i = hash & mask;
+  while (shard.slots[i].index != EMPTY)
+    i = (i + 1) & mask;
+  shard.slots[i] = {hash, index};
+  if (shard.count * 2 > shard.slots.size())
+    shard.grow();
+  return id(index);
+}
+
+const Type &TypeInterner::get(TypeId type) const {
+  if (type < PRIMITIVE_COUNT)
+    return PRIMITIVES[type];
+  type -= PRIMITIVE_COUNT;
+  return shards[type & (SHARD_COUNT - 1)].at(type >> SHARD_BITS);
+}
+
+TypeId TypeInterner::class_type(Symbol name, uint32_t declaration) {
+  return intern({Kind::Class, name, declaration, {}});
+}
+
+TypeId TypeInterner::enum_type(Symbol name, uint32_t declaration) {
+  return intern({Kind::Enum, name, declaration, {}});
+}
+
+TypeId TypeInterner::function(std::span<const TypeId> params, TypeId result) {
+  // Small enough for the stack in every realistic signature
+  constexpr size_t INLINE = 16;
+  std::array<TypeId, INLINE> buffer;
+  std::vector<TypeId> spilled;
+  std::span<TypeId> operands;
+  if (params.size() < INLINE) {
+    operands = std::span(buffer).first(params.size() + 1);
+  } else {
+    spilled.resize(params.size() + 1);
+    operands = spilled;
+  }
+
+  std::ranges::copy(params, operands.begin());
+  operands.back() = result;
+  return intern({Kind::Function, StringInterner::NO_SYMBOL, 0, operands});
+}
+
+TypeId TypeInterner::array(TypeId element) {
+  return intern(
+      {Kind::Array, StringInterner::NO_SYMBOL, 0, std::span(&element, 1)});
+}
+
+TypeId TypeInterner::generic(Symbol name, std::span<const TypeId> arguments) {
+  return intern({Kind::Generic, name, 0, arguments});
+}
+
+size_t TypeInterner::size() const {
+  size_t total = 0;
+  for (const Shard &shard : shards) {
+    std::shared_lock lock(shard.mutex);
+    total += shard.count;
+  }
+  return total;
+}
+
+void TypeInterner::append(std::string &out, TypeId id,
+                          const StringInterner &names) const {
+  const Type &type = get(id);
+  switch (type.kind) {
+  case Kind::Primitive:
+    out += PRIMITIVE_NAMES[id];
+    break;
+  case Kind::Class:
+  case Kind::Enum:
+    out += names.name(type.name);
+    break;
+  case Kind::Array:
+    out += '[';
+    append(out, type.operands[0], names);
+    out += ']';
+    break;
+  case Kind::Generic:
+    out += names.name(type.name);
+    out += '[';
+    for (size_t i = 0; i < type.operands.size(); i++) {
+      if (i > 0)
+        out += ", ";
+      append(out, type.operands[i], names);
+    }
+    out += ']';
+    break;
+  case Kind::Function: {
+    // `->` is right associative, so only a function parameter needs parens
+    auto params = type.operands.first(type.operands.size() - 1);
+    bool bare = params.size() == 1 && get(params[0]).kind != Kind::Function;
+    if (!bare)
+      out += '(';
+    for (size_t i = 0; i < params.size(); i++) {
+      if (i > 0)
+        out += ", ";
+      append(out, params[i], names);
+    }
+    if (!bare)
+      out += ')';
+    out += " -> ";
+    append(out, type.operands.back(), names);
+    break;
+  }
+  }
+}
+
+std::string TypeInterner::to_string(TypeId type,
+                                    const StringInterner &names) const {
+  std::string out;
+  append(out, type, names);
+  return out;
+}
@@ -0,0 +1,536 @@
+#include "syntax/syntax_tree.hpp"
+#include "common/diagnostic.hpp"
+#include "lexer/lexer.hpp"
+#include "parser/parallel.hpp"
+#include "parser/parser.hpp"
+#include <functional>
+
+using namespace syntax;
+using TK = Token::Kind;
+
+namespace {
+
+size_t combine(size_t seed, size_t value) {
+  return seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2));
+}
+
+bool is_opener(TK kind) {
+  return kind == TK::LCurl || kind == TK::LParen || kind == TK::LBrac;
+}
+
+bool is_closer(TK kind) {
+  return kind == TK::RCurl || kind == TK::RParen || kind == TK::RBrac;
+}
+
+/// Green tokens for everything but the end of file, plus the text left over
+/// after the last token (which becomes the trivia of whatever follows).
+struct Leaves {
+  std::vector<const GreenNode *> tokens;
+  std::vector<TK> kinds;
+  std::string_view trailing;
+};
+
+Leaves make_leaves(GreenInterner &interner, std::string_view text,
+                   const std::vector<Token> &tokens) {
+  Leaves leaves;
+  leaves.tokens.reserve(tokens.size());
+  leaves.kinds.reserve(tokens.size());
+
+  size_t previous_end = 0;
+  for (auto &token : tokens) {
+    if (token.kind == TK::Eof)
+      break;
+
+    size_t end = token.span.offset + token.span.length;
+    auto trivia = static_cast<uint32_t>(token.span.offset - previous_end);
+    leaves.tokens.push_back(interner.token(
+        token.kind, text.substr(previous_end, end - previous_end), trivia));
+    leaves.kinds.push_back(token.kind);
+    previous_end = end;
+  }
+
+  leaves.trailing = text.substr(previous_end);
+  return leaves;
+}
+
+/// Nests a run of tokens into groups at every bracket pair. `balanced` is
+/// cleared if a closer has no opener or an opener is never closed.
+std::vector<const GreenNode *>
+group_leaves(GreenInterner &interner, std::span<const GreenNode *const> leaves,
+             bool &balanced) {
+  std::vector<std::vector<const GreenNode *>> stack(1);
+  balanced = true;
+
+  for (auto *leaf : leaves) {
+    if (is_opener(leaf->token)) {
+      stack.emplace_back();
+      stack.back().push_back(leaf);
+    } else if (is_closer(leaf->token) && stack.size() > 1) {
+      stack.back().push_back(leaf);
+      auto *group = interner.node(GreenKind::Group, std::move(stack.back()));
+      stack.pop_back();
+      stack.back().push_back(group);
+    } else {
+      balanced &= !is_closer(leaf->token);
+      stack.back().push_back(leaf);
+    }
+  }
+
+  // Unclosed groups still become groups, they just have no closer
+  while (stack.size() > 1) {
+    balanced = false;
+    auto *group = interner.node(GreenKind::Group, std::move(stack.back()));
+    stack.pop_back();
+    stack.back().push_back(group);
+  }
+  return std::move(stack.front());
+}
+
+} // namespace
+
+/* ---------------------------------------------------------------------------*/
+/* GREEN NODES */
+/* ---------------------------------------------------------------------------*/
+
+GreenNode::GreenNode(GreenKind kind, Token::Kind token, uint32_t width,
+                     uint32_t trivia, std::string text,
+                     std::vector<const GreenNode *> children)
+    : kind(kind), token(token), width(width), trivia(trivia),
+      text(std::move(text)), children(std::move(children)),
+      hash([&]() {
+        size_t h = combine(static_cast<size_t>(kind),
+                           static_cast<size_t>(token));
+        h = combine(h, std::hash<std::string>()(this->text));
+        for (auto *child : this->children)
+          h = combine(h, std::hash<const GreenNode *>()(child));
+        return h;
+      }()) {}
+
+bool GreenInterner::Equal::operator()(const GreenNode *a,
+                                      const GreenNode *b) const {
+  return a->kind == b->kind && a->token == b->token && a->text == b->text &&
+         a->children == b->children;
+}
+
+GreenInterner::GreenInterner() : nodes() {}
+
+GreenInterner::~GreenInterner() {
+  for (auto *node : nodes)
+    delete node;
+}
+
+const GreenNode *GreenInterner::intern(GreenNode *candidate) {
+  auto [it, inserted] = nodes.insert(candidate);
+  if (!inserted)
+    delete candidate;
+  return *it;
+}
+
+const GreenNode *GreenInterner::token(Token::Kind kind, std::string_view text,
+                                      uint32_t trivia) {
+  return intern(new GreenNode(GreenKind::Token, kind,
+                              static_cast<uint32_t>(text.size()), trivia,
+                              std::string(text), {}));
+}
+
+const GreenNode *GreenInterner::node(GreenKind kind,
+                                     std::vector<const GreenNode *> children) {
+  uint32_t width = 0;
+  for (auto *child : children)
+    width += child->width;
+  uint32_t trivia = children.empty() ? 0 : children.front()->trivia;
+
+  return intern(
+      new GreenNode(kind, TK::Eof, width, trivia, "", std::move(children)));
+}
+
+void GreenInterner::sweep(const GreenNode *root) {
+  std::unordered_set<const GreenNode *> live;
+  std::vector<const GreenNode *> pending = {root};
+  while (!pending.empty()) {
+    auto *node = pending.back();
+    pending.pop_back();
+    if (!live.insert(node).second)
+      continue;
+    pending.insert(pending.end(), node->children.begin(), node->children.end());
+  }
+
+  for (auto it = nodes.begin(); it != nodes.end();) {
+    if (live.count(*it)) {
+      ++it;
+      continue;
+    }
+    delete *it;
+    it = nodes.erase(it);
+  }
+}
+
+void GreenInterner::release(const GreenNode *node) {
+  auto it = nodes.find(const_cast<GreenNode *>(node));
+  if (it == nodes.end() || *it != node)
+    return;
+  delete *it;
+  nodes.erase(it);
+}
+
+size_t GreenInterner::size() const { return nodes.size(); }
+
+/* ---------------------------------------------------------------------------*/
+/* RED CURSORS */
+/* ---------------------------------------------------------------------------*/
+
+SyntaxNode::SyntaxNode(const GreenNode *green, uint32_t offset)
+    : green(green), offset(offset) {}
+
+const GreenNode *SyntaxNode::get_green() const { return green; }
+
+GreenKind SyntaxNode::kind() const { return green->kind; }
+
+Token::Kind SyntaxNode::token_kind() const { return green->token; }
+
+uint32_t SyntaxNode::get_offset() const { return offset; }
+
+Span SyntaxNode::get_span(const File &file) const {
+  return Span(file, offset + green->trivia, green->width - green->trivia);
+}
+
+std::vector<SyntaxNode> SyntaxNode::children() const {
+  std::vector<SyntaxNode> result;
+  result.reserve(green->children.size());
+
+  uint32_t position = offset;
+  for (auto *child : green->children) {
+    result.emplace_back(child, position);
+    position += child->width;
+  }
+  return result;
+}
+
+std::optional<SyntaxNode> SyntaxNode::token_at(uint32_t position) const {
+  if (position < offset || position > offset + green->width)
+    return std::nullopt;
+
+  const GreenNode *node = green;
+  uint32_t start = offset;
+  while (!node->is_token()) {
+    if (node->children.empty())
+      return std::nullopt;
+
+    // Fall back to the last child when the position is the very end
+    const GreenNode *next = node->children.back();
+    uint32_t next_start = start + node->width - next->width;
+    uint32_t child_start = start;
+    for (auto *child : node->children) {
+      if (position < child_start + child->width) {
+        next = child;
+        next_start = child_start;
+        break;
+      }
+      child_start += child->width;
+    }
+    node = next;
+    start = next_start;
+  }
+  return SyntaxNode(node, start);
+}
+
+/* ---------------------------------------------------------------------------*/
+/* SYNTAX TREE */
+/* ---------------------------------------------------------------------------*/
+
+SyntaxTree::SyntaxTree(std::string content, std::string path)
+    : interner(), text(content), file(std::move(content), std::move(path)),
+      stale(false), root(nullptr), lexical(), live_after_sweep(0) {
+  rebuild();
+  live_after_sweep = interner.size();
+}
+
+const File &SyntaxTree::get_file() const {
+  if (stale) {
+    file = File(text.materialize(), std::move(file.path));
+    stale = false;
+  }
+  return file;
+}
+
+const Rope &SyntaxTree::get_text() const { return text; }
+
+SyntaxNode SyntaxTree::get_root() const { return SyntaxNode(root, 0); }
+
+const GreenNode *SyntaxTree::get_green_root() const { return root; }
+
+const DiagnosticEngine &SyntaxTree::get_diagnostics() const {
+  // Their spans read the file
+  get_file();
+  return lexical;
+}
+
+void SyntaxTree::rebuild() {
+  lexical = DiagnosticEngine();
+  get_file();
+  auto tokens = Lexer(file, lexical).lex();
+  auto leaves = make_leaves(interner, file.content, tokens);
+
+  leaves.kinds.push_back(TK::Eof);
+  auto ranges = parser::split_top_level(leaves.kinds);
+
+  std::vector<const GreenNode *> items;
+  items.reserve(ranges.size() + 1);
+  for (auto range : ranges) {
+    bool balanced;
+    std::span<const GreenNode *const> run(leaves.tokens.data() + range.begin,
+                                          range.end - range.begin);
+    items.push_back(
+        interner.node(GreenKind::Item, group_leaves(interner, run, balanced)));
+  }
+
+  auto trivia = static_cast<uint32_t>(leaves.trailing.size());
+  items.push_back(interner.token(TK::Eof, leaves.trailing, trivia));
+  root = interner.node(GreenKind::Root, std::move(items));
+}
+
+bool SyntaxTree::try_incremental(size_t offset, size_t removed,
+                                 std::string_view inserted) {
+  size_t edit_end = offset + removed;
+
+  // Walk down to the innermost group whose interior holds the whole edit,
+  // remembering the path so that the spine can be rebuilt afterwards
+  std::vector<std::pair<const GreenNode *, size_t>> path;
+  size_t target_depth = 0;
+  const GreenNode *node = root;
+  size_t node_offset = 0;
+  size_t target_offset = 0;
+  std::optional<size_t> item;
+  size_t item_offset = 0;
+
+  while (!node->is_token()) {
+    bool descended = false;
+    size_t child_offset = node_offset;
+
+    for (size_t i = 0; i < node->children.size(); i++) {
+      const GreenNode *child = node->children[i];
+      size_t child_end = child_offset + child->width;
+
+      if (child->kind == GreenKind::Item && offset >= child_offset &&
+          edit_end < child_end) {
+        item = i;
+        item_offset = child_offset;
+        path.push_back({node, i});
+        node = child;
+        node_offset = child_offset;
+        descended = true;
+        break;
+      }
+
+      if (child->kind == GreenKind::Group) {
+        const GreenNode *closer = child->children.back();
+        size_t interior_start = child_offset + child->children.front()->width;
+        size_t closer_text = child_end - (closer->width - closer->trivia);
+
+        if (closer->is_token() && is_closer(closer->token) &&
+            child->children.size() >= 2 && offset >= interior_start &&
+            edit_end <= closer_text) {
+          path.push_back({node, i});
+          node = child;
+          node_offset = child_offset;
+          target_depth = path.size();
+          target_offset = child_offset;
+          descended = true;
+          break;
+        }
+      }
+      child_offset = child_end;
+    }
+
+    if (!descended)
+      break;
+  }
+
+  // Outside any group, the statements around the edit are relexed instead
+  if (target_depth == 0)
+    return item && relex_item(*item, item_offset, offset, removed, inserted);
+  path.resize(target_depth);
+  const GreenNode *group = path.back().first->children[path.back().second];
+
+  // Relex only the group's interior, which runs up to the closer's text
+  const GreenNode *opener = group->children.front();
+  const GreenNode *closer = group->children.back();
+  size_t interior_start = target_offset + opener->width;
+  size_t interior_end = target_offset + group->width - closer->width +
+                        closer->trivia;
+
+  std::string region =
+      text.substr(interior_start, interior_end - interior_start);
+  region.replace(offset - interior_start, removed, inserted);
+
+  File region_file(region, file.path);
+  DiagnosticEngine diagnostics;
+  auto tokens = Lexer(region_file, diagnostics).lex();
+  if (diagnostics.size() > 0)
+    return false;
+
+  auto leaves = make_leaves(interner, region_file.content, tokens);
+
+  // A comment running into the closer would swallow it when lexing the file
+  auto comment = leaves.trailing.rfind('#');
+  if (comment != std::string_view::npos &&
+      leaves.trailing.find('\n', comment) == std::string_view::npos)
+    return false;
+
+  bool balanced;
+  auto interior = group_leaves(interner, leaves.tokens, balanced);
+  if (!balanced)
+    return false;
+
+  std::string closer_text(leaves.trailing);
+  closer_text += closer->text.substr(closer->trivia);
+  std::vector<const GreenNode *> children;
+  children.reserve(interior.size() + 2);
+  children.push_back(opener);
+  children.insert(children.end(), interior.begin(), interior.end());
+  children.push_back(interner.token(
+      closer->token, closer_text,
+      static_cast<uint32_t>(leaves.trailing.size())));
+
+  // Rebuild only the spine, every sibling along the way is reused as is
+  const GreenNode *replacement = interner.node(GreenKind::Group, children);
+  for (auto it = path.rbegin(); it != path.rend(); ++it) {
+    auto siblings = it->first->children;
+    siblings[it->second] = replacement;
+    replacement = interner.node(it->first->kind, std::move(siblings));
+  }
+
+  root = replacement;
+  text.replace(offset, removed, inserted);
+  stale = true;
+  shift_diagnostics(interior_start, interior_end, inserted.size() - removed);
+  return true;
+}
+
+bool SyntaxTree::relex_item(size_t index, size_t item_offset, size_t offset,
+                            size_t removed, std::string_view inserted) {
+  const GreenNode *item = root->children[index];
+  size_t item_end = item_offset + item->width;
+
+  std::string region = text.substr(item_offset, item->width);
+  region.replace(offset - item_offset, removed, inserted);
+
+  File region_file(region, file.path);
+  DiagnosticEngine diagnostics;
+  auto tokens = Lexer(region_file, diagnostics).lex();
+  if (diagnostics.size() > 0)
+    return false;
+
+  // Whatever follows has to start a statement exactly as it did before, with
+  // no text left over to join its trivia
+  auto leaves = make_leaves(interner, region_file.content, tokens);
+  if (leaves.kinds.empty() || !leaves.trailing.empty())
+    return false;
+  TK last = leaves.kinds.back();
+  bool before_eof = root->children[index + 1]->is_token();
+  if (!before_eof && last != TK::Newline && last != TK::Semicolon &&
+      last != TK::RCurl)
+    return false;
+
+  // And the region itself has to start a declaration, or a full split would
+  // fold it into the item before
+  leaves.kinds.push_back(TK::Eof);
+  auto closing = parser::match_parens(leaves.kinds);
+  if (index > 0 && !parser::starts_declaration(leaves.kinds, closing, 0))
+    return false;
+
+  auto ranges = parser::split_top_level(leaves.kinds);
+  std::vector<const GreenNode *> items;
+  items.reserve(ranges.size());
+  for (auto range : ranges) {
+    bool balanced;
+    std::span<const GreenNode *const> run(leaves.tokens.data() + range.begin,
+                                          range.end - range.begin);
+    items.push_back(
+        interner.node(GreenKind::Item, group_leaves(interner, run, balanced)));
+    if (!balanced)
+      return false;
+  }
+
+  std::vector<const GreenNode *> children;
+  children.reserve(root->children.size() + items.size());
+  children.insert(children.end(), root->children.begin(),
+                  root->children.begin() + index);
+  children.insert(children.end(), items.begin(), items.end());
+  children.insert(children.end(), root->children.begin() + index + 1,
+                  root->children.end());
+
+  root = interner.node(GreenKind::Root, std::move(children));
+  text.replace(offset, removed, inserted);
+  stale = true;
+  shift_diagnostics(item_offset, item_end, inserted.size() - removed);
+  return true;
+}
+
+void SyntaxTree::shift_diagnostics(size_t start, size_t end, size_t delta) {
+  DiagnosticEngine kept;
+  for (auto &diagnostic : lexical) {
+    size_t offset = diagnostic.span.offset;
+    if (offset >= start && offset < end)
+      continue;
+    if (offset >= end)
+      offset += delta;
+    kept.emit(Diagnostic(diagnostic.kind,
+                         Span(file, offset, diagnostic.span.length),
+                         diagnostic.message));
+  }
+  lexical = std::move(kept);
+}
+
+bool SyntaxTree::edit(size_t offset, size_t removed,
+                      std::string_view inserted) {
+  const GreenNode *previous = root;
+  bool incremental = try_incremental(offset, removed, inserted);
+  if (!incremental) {
+    text.replace(offset, removed, inserted);
+    stale = true;
+    rebuild();
+  }
+
+  // A root is never shared, and holding every item it is by far the largest
+  // node, so the old one goes right away
+  if (root != previous)
+    interner.release(previous);
+
+  // Old versions of other edited nodes pile up in the interner, so drop them
+  // once they clearly outnumber the live tree
+  if (interner.size() > live_after_sweep * 2 + 1024) {
+    interner.sweep(root);
+    live_after_sweep = interner.size();
+  }
+  return incremental;
+}
+
+std::vector<Token> SyntaxTree::tokens() const {
+  const File &current = get_file();
+  std::vector<Token> result;
+  result.reserve(current.length / 4);
+
+  // Walks the green nodes themselves; red nodes would allocate a vector of
+  // children for every node on the way
+  std::vector<std::pair<const GreenNode *, uint32_t>> pending = {{root, 0}};
+  while (!pending.empty()) {
+    auto [node, offset] = pending.back();
+    pending.pop_back();
+
+    if (node->is_token()) {
+      result.emplace_back(node->token,
+                          Span(current, offset + node->trivia,
+                               node->width - node->trivia));
+      continue;
+    }
+
+    uint32_t end = offset + node->width;
+    for (auto it = node->children.rbegin(); it != node->children.rend();
+         ++it) {
+      end -= (*it)->width;
+      pending.emplace_back(*it, end);
+    }
+  }
+  return result;
+}
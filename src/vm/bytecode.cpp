@@ -0,0 +1,44 @@
+#include "vm/bytecode.hpp"
+#include <cstdio>
+
+using namespace vm;
+
+std::string vm::disassemble(const Program &program) {
+  std::string out;
+  char line[64];
+  for (const Function &function : program.functions) {
+    out += function.name;
+    out += ":\n";
+    for (size_t pc = 0; pc < function.code.size(); pc++) {
+      Instruction instruction = function.code[pc];
+      Op op = op_of(instruction);
+      size_t index = static_cast<size_t>(op);
+      int a = a_of(instruction);
+      switch (OP_FORMATS[index]) {
+      case Format::ABC:
+        std::snprintf(line, sizeof(line), "  %04zu  %-14s %d %d %d\n", pc,
+                      OP_NAMES[index].data(), a, b_of(instruction),
+                      c_of(instruction));
+        break;
+      case Format::ABx:
+        std::snprintf(line, sizeof(line), "  %04zu  %-14s %d %d\n", pc,
+                      OP_NAMES[index].data(), a, bx_of(instruction));
+        break;
+      case Format::AsBx:
+        std::snprintf(line, sizeof(line), "  %04zu  %-14s %d %d\n", pc,
+                      OP_NAMES[index].data(), a, sbx_of(instruction));
+        break;
+      case Format::sAx:
+        std::snprintf(line, sizeof(line), "  %04zu  %-14s %d\n", pc,
+                      OP_NAMES[index].data(), sax_of(instruction));
+        break;
+      case Format::Ax:
+        std::snprintf(line, sizeof(line), "  %04zu  %-14s %u\n", pc,
+                      OP_NAMES[index].data(), ax_of(instruction));
+        break;
+      }
+      out += line;
+    }
+  }
+  return out;
+}
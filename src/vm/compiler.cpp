@@ -0,0 +1,1393 @@
+#include "vm/compiler.hpp"
+#include "common/profile.hpp"
+#include <algorithm>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+using namespace vm;
+using ast::NodeIndex;
+using ast::Tag;
+using diagnostic::Kind;
+using sema::Binding;
+using sema::Builtin;
+using sema::Constant;
+using sema::TypeId;
+using CK = Constant::Kind;
+using TK = Token::Kind;
+
+namespace {
+
+constexpr TypeId ERROR = sema::type_of(sema::Primitive::Error);
+constexpr TypeId INT = sema::type_of(sema::Primitive::Int);
+constexpr TypeId FLOAT = sema::type_of(sema::Primitive::Float);
+constexpr TypeId STR = sema::type_of(sema::Primitive::Str);
+constexpr TypeId BOOL = sema::type_of(sema::Primitive::Bool);
+
+constexpr uint32_t NONE = UINT32_MAX;
+
+/// Leaves room for the four registers a `for` over a range takes at once
+constexpr uint32_t MAX_REGISTERS = 250;
+
+bool is_numeric(TypeId type) { return type == INT || type == FLOAT; }
+
+/// @brief The text of a string literal, without its quotes and with its
+/// escapes replaced. The lexer has already rejected any invalid escape.
+std::string unescape(std::string_view literal) {
+  literal = literal.substr(1, literal.size() - 2);
+  std::string text;
+  text.reserve(literal.size());
+  for (size_t i = 0; i < literal.size(); i++) {
+    if (literal[i] != '\\' || i + 1 == literal.size()) {
+      text += literal[i];
+      continue;
+    }
+    switch (literal[++i]) {
+    case 'n':
+      text += '\n';
+      break;
+    case 't':
+      text += '\t';
+      break;
+    case 'r':
+      text += '\r';
+      break;
+    case '0':
+      text += '\0';
+      break;
+    default:
+      text += literal[i];
+      break;
+    }
+  }
+  return text;
+}
+
+/// @brief The instruction for `lhs op rhs`: a typed one when both sides are
+/// statically ints or floats, the generic one otherwise.
+Op binary_op(TK op, TypeId lhs, TypeId rhs) {
+  bool ints = lhs == INT && rhs == INT;
+  bool floats = is_numeric(lhs) && is_numeric(rhs) && !ints;
+  switch (op) {
+  case TK::Plus:
+    return ints ? Op::AddInt : floats ? Op::AddFloat : Op::Add;
+  case TK::Minus:
+    return ints ? Op::SubInt : floats ? Op::SubFloat : Op::Sub;
+  case TK::Star:
+    return ints ? Op::MulInt : floats ? Op::MulFloat : Op::Mul;
+  case TK::Slash:
+    return ints || floats ? Op::DivFloat : Op::Div;
+  case TK::SlashSlash:
+    return ints ? Op::FloorDivInt : Op::FloorDiv;
+  case TK::Percent:
+    return ints ? Op::ModInt : Op::Mod;
+  case TK::StarStar:
+    return Op::Pow;
+  case TK::And:
+    return Op::BitAnd;
+  case TK::Bar:
+    return Op::BitOr;
+  case TK::Less:
+    return ints ? Op::LtInt : floats ? Op::LtFloat : Op::Lt;
+  case TK::LessEquals:
+    return ints ? Op::LeInt : floats ? Op::LeFloat : Op::Le;
+  case TK::EqualsEquals:
+    return ints ? Op::EqInt : Op::Eq;
+  case TK::BangEquals:
+    return ints ? Op::NeInt : Op::Ne;
+  default:
+    std::abort();
+  }
+}
+
+/// @brief Where an assignment stores its value.
+struct Place {
+  enum class Kind : uint8_t { Register, Global, Field, Named, Element };
+
+  Kind kind;
+  /// The register itself, or the object a field or element belongs to
+  uint8_t object = 0;
+  /// The register holding an element's position
+  uint8_t key = 0;
+  /// The global, the field or the constant naming it
+  uint32_t index = 0;
+  /// The shape a field's slot is for
+  uint32_t shape = 0;
+};
+
+class Compiler {
+  const ast::Tree &tree;
+  const sema::Resolution &resolution;
+  const sema::Typing &typing;
+  const sema::Folding &folding;
+  const sema::TypeInterner &types;
+  DiagnosticEngine &diagnostics;
+  Program &program;
+  bool failed;
+
+  // Indexed by node, filled in before anything is compiled
+  /// The function an `FnDecl` or `Lambda` compiles to, or the initializer of
+  /// a `ClassDecl`
+  std::vector<uint32_t> functions;
+  /// The class a `ClassDecl` compiles to
+  std::vector<uint32_t> classes;
+  /// The global a top-level `VarDecl` declares
+  std::vector<uint32_t> globals;
+  /// The field a member `VarDecl` declares
+  std::vector<uint32_t> fields;
+  /// The `ClassDecl` a field or method belongs to
+  std::vector<NodeIndex> owners;
+  /// The register a local variable lives in and the function it belongs
+  /// to, filled in as declarations are compiled
+  std::vector<uint32_t> registers;
+  std::vector<uint32_t> homes;
+
+  /// The node each function is compiled from: `Root` for the top level
+  std::vector<NodeIndex> sources;
+
+  // The function being compiled
+  uint32_t current;
+  Function *function;
+  /// The `ClassDecl` whose instance `R[0]` is, in methods and initializers
+  NodeIndex receiver;
+  /// What the function's `return`s are converted to
+  TypeId result;
+  /// The first free register
+  uint32_t top;
+  /// Where each scalar is in the pool, by its bits, and each boxed int by
+  /// its value
+  std::unordered_map<uint64_t, uint16_t> numbers;
+  std::unordered_map<int64_t, uint16_t> boxed;
+  std::unordered_map<std::string, uint16_t> strings;
+
+  /* -------------------------------------------------------------------------*/
+  /* HELPERS */
+  /* -------------------------------------------------------------------------*/
+
+  /// @brief Reports the concatenation of `parts` at the node's main token.
+  template <typename... Parts>
+  void report(NodeIndex node, const Parts &...parts) {
+    std::string message;
+    (message += ... += parts);
+    diagnostics.emit(Diagnostic(Kind::Unsupported,
+                                tree.token_span(tree.main_token(node)),
+                                message));
+    failed = true;
+  }
+
+  std::string_view lexeme(NodeIndex node) const {
+    return tree.token_lexeme(tree.main_token(node));
+  }
+
+  bool is_builtin(NodeIndex node, Builtin builtin) const {
+    const Binding &binding = resolution[node];
+    return tree.tag(node) == Tag::Identifier &&
+           binding.kind == Binding::Kind::Builtin &&
+           binding.target == static_cast<uint32_t>(builtin);
+  }
+
+  /// @brief The member of a class called `name`, if it has one.
+  std::optional<NodeIndex> member_of(NodeIndex klass,
+                                     std::string_view name) const {
+    for (NodeIndex member : tree.class_decl(klass).members) {
+      if (tree.tag(member) != Tag::Error && lexeme(member) == name)
+        return member;
+    }
+    return std::nullopt;
+  }
+
+  uint32_t add_function(NodeIndex source, std::string name) {
+    sources.push_back(source);
+    program.functions.emplace_back();
+    program.functions.back().name = std::move(name);
+    return program.functions.size() - 1;
+  }
+
+  size_t emit(Instruction instruction, NodeIndex node) {
+    Span span = tree.token_span(tree.main_token(node));
+    function->code.push_back(instruction);
+    function->offsets.push_back(span.offset);
+    function->lengths.push_back(span.length);
+    return function->code.size() - 1;
+  }
+
+  /// @brief Emits an instruction that finds a member by name, and the
+  /// `Site` after it that gives it an inline cache of its own.
+  void emit_cached(Instruction instruction, NodeIndex node) {
+    emit(instruction, node);
+    if (program.sites == MAX_SITES) {
+      if (!failed)
+        report(node, "This program accesses members by name in more than ",
+               std::to_string(MAX_SITES), " places");
+      return;
+    }
+    emit(encode_ax(Op::Site, program.sites++), node);
+  }
+
+  /// @brief The shape with exactly these fields, made if no class before
+  /// had them.
+  uint32_t shape_of(std::vector<std::string> fields) {
+    for (size_t i = 0; i < program.shapes.size(); i++) {
+      if (program.shapes[i].fields == fields)
+        return static_cast<uint32_t>(i);
+    }
+    program.shapes.push_back(Shape{std::move(fields)});
+    return static_cast<uint32_t>(program.shapes.size() - 1);
+  }
+
+  uint32_t shape_of_class(NodeIndex declaration) const {
+    return program.classes[classes[declaration]].shape;
+  }
+
+  void move(uint8_t target, uint8_t source, NodeIndex node) {
+    if (target != source)
+      emit(encode(Op::Move, target, source, 0), node);
+  }
+
+  uint8_t allocate(NodeIndex node) {
+    if (top >= MAX_REGISTERS) {
+      if (!failed)
+        report(node, "This function needs more than ",
+               std::to_string(MAX_REGISTERS), " registers");
+      return 0;
+    }
+    uint8_t r = top++;
+    function->registers = std::max<uint32_t>(function->registers, top);
+    return r;
+  }
+
+  uint16_t add_constant(Value value, NodeIndex node) {
+    if (function->constants.size() > UINT16_MAX) {
+      if (!failed)
+        report(node, "This function has more than ",
+               std::to_string(UINT16_MAX + 1), " constants");
+      return 0;
+    }
+    function->constants.push_back(value);
+    return function->constants.size() - 1;
+  }
+
+  /// @brief The pool index of a value that isn't on the heap, shared by
+  /// every use of the same value in the function.
+  uint16_t constant(Value value, NodeIndex node) {
+    auto [it, inserted] = numbers.try_emplace(value.raw(), 0);
+    if (inserted)
+      it->second = add_constant(value, node);
+    return it->second;
+  }
+
+  uint16_t int_constant(int64_t value, NodeIndex node) {
+    if (Value::fits(value))
+      return constant(Value::small(value), node);
+    // Boxed ints are shared by value, so that each is only boxed once
+    auto [it, inserted] = boxed.try_emplace(value, 0);
+    if (inserted)
+      it->second = add_constant(program.heap.integer(value), node);
+    return it->second;
+  }
+
+  uint16_t string_constant(std::string text, NodeIndex node) {
+    auto it = strings.find(text);
+    if (it != strings.end())
+      return it->second;
+    Value value = Value::object(program.heap.string(text));
+    uint16_t index = add_constant(value, node);
+    strings.emplace(std::move(text), index);
+    return index;
+  }
+
+  void load_constant(const Constant &constant, uint8_t target,
+                     NodeIndex node) {
+    switch (constant.kind) {
+    case CK::Int:
+      if (constant.integer >= -SBX_BIAS && constant.integer <= SBX_BIAS)
+        emit(encode_sbx(Op::LoadInt, target, constant.integer), node);
+      else
+        emit(encode_bx(Op::LoadK, target, int_constant(constant.integer, node)),
+             node);
+      break;
+    case CK::Float:
+      emit(encode_bx(Op::LoadK, target,
+                     this->constant(Value::real(constant.real), node)),
+           node);
+      break;
+    case CK::Bool:
+      emit(encode(constant.boolean ? Op::LoadTrue : Op::LoadFalse, target, 0,
+                  0),
+           node);
+      break;
+    case CK::Unknown:
+      std::abort();
+    }
+  }
+
+  void load_function(uint32_t index, uint8_t target, NodeIndex node) {
+    emit(encode_bx(Op::LoadK, target, constant(Value::function(index), node)),
+         node);
+  }
+
+  static bool has_default(TypeId type) {
+    return type == INT || type == FLOAT || type == BOOL || type == STR;
+  }
+
+  /// @brief The value a variable of type `type` starts out with when its
+  /// declaration has none: nil unless `has_default()`.
+  void load_default(TypeId type, uint8_t target, NodeIndex node) {
+    if (type == INT)
+      load_constant(Constant::of_int(0), target, node);
+    else if (type == FLOAT)
+      load_constant(Constant::of_float(0.0), target, node);
+    else if (type == BOOL)
+      load_constant(Constant::of_bool(false), target, node);
+    else if (type == STR)
+      emit(encode_bx(Op::LoadK, target, string_constant("", node)), node);
+    else
+      emit(encode(Op::LoadNil, target, 0, 0), node);
+  }
+
+  /// @brief Converts an int in `r` to a float where one is expected, since
+  /// the checker lets ints go wherever floats do.
+  void coerce(uint8_t r, TypeId expected, TypeId actual, NodeIndex node) {
+    if (expected == FLOAT && actual == INT)
+      emit(encode(Op::ToFloat, r, r, 0), node);
+  }
+
+  /// @brief Emits a jump to be aimed later with `patch()` or `land()`.
+  size_t jump(Op op, uint8_t a, NodeIndex node) {
+    if (OP_FORMATS[static_cast<size_t>(op)] == Format::sAx)
+      return emit(encode_sax(op, 0), node);
+    return emit(encode_sbx(op, a, 0), node);
+  }
+
+  /// @brief Aims the jump at `at` at the instruction `target`.
+  void land(size_t at, size_t target, NodeIndex node) {
+    int64_t offset = int64_t(target) - int64_t(at + 1);
+    Instruction &instruction = function->code[at];
+    Op op = op_of(instruction);
+    bool wide = OP_FORMATS[static_cast<size_t>(op)] == Format::sAx;
+    int64_t bias = wide ? SAX_BIAS : SBX_BIAS;
+    int64_t span = wide ? 0xFFFFFF : 0xFFFF;
+    if (offset < -bias || offset > span - bias) {
+      report(node, "This jumps too far");
+      return;
+    }
+    instruction = wide ? encode_sax(op, offset)
+                       : encode_sbx(op, a_of(instruction), offset);
+  }
+
+  /// @brief Aims the jump at `at` at the next instruction emitted.
+  void patch(size_t at, NodeIndex node) {
+    land(at, function->code.size(), node);
+  }
+
+  /* -------------------------------------------------------------------------*/
+  /* VARIABLES */
+  /* -------------------------------------------------------------------------*/
+
+  void declare(NodeIndex variable, uint8_t r) {
+    registers[variable] = r;
+    homes[variable] = current;
+  }
+
+  /// @brief The register `node` lives in if it names a local variable of
+  /// the function being compiled, so reading it needs no instruction.
+  std::optional<uint8_t> local(NodeIndex node) const {
+    if (tree.tag(node) == Tag::Grouping)
+      return local(tree.node_data(node).lhs);
+    if (tree.tag(node) != Tag::Identifier)
+      return std::nullopt;
+    const Binding &binding = resolution[node];
+    if (binding.kind != Binding::Kind::Variable &&
+        binding.kind != Binding::Kind::Parameter)
+      return std::nullopt;
+    if (registers[binding.target] == NONE || homes[binding.target] != current)
+      return std::nullopt;
+    return registers[binding.target];
+  }
+
+  /// @brief Where the variable, field or element `node` is stored. Works
+  /// out the object and position of fields and elements into registers.
+  std::optional<Place> place(NodeIndex node) {
+    switch (tree.tag(node)) {
+    case Tag::Grouping:
+      return place(tree.node_data(node).lhs);
+    case Tag::Identifier: {
+      const Binding &binding = resolution[node];
+      NodeIndex target = binding.target;
+      if (binding.kind != Binding::Kind::Variable &&
+          binding.kind != Binding::Kind::Parameter)
+        break;
+      if (globals[target] != NONE)
+        return Place{Place::Kind::Global, 0, 0, globals[target]};
+      if (fields[target] != NONE && owners[target] == receiver)
+        return Place{Place::Kind::Field, 0, 0, fields[target],
+                     shape_of_class(receiver)};
+      if (auto r = local(node))
+        return Place{Place::Kind::Register, *r, 0, 0};
+      report(node, "Functions can't use the variables of the functions "
+                   "around them yet");
+      return std::nullopt;
+    }
+    case Tag::Member: {
+      NodeIndex object = tree.node_data(node).lhs;
+      const sema::Type &type = types.get(typing[object]);
+      if (type.kind == sema::Type::Kind::Class) {
+        auto member = member_of(type.declaration, lexeme(node));
+        if (!member || tree.tag(*member) != Tag::VarDecl)
+          break;
+        return Place{Place::Kind::Field, operand(object), 0, fields[*member],
+                     shape_of_class(owners[*member])};
+      }
+      if (typing[object] != ERROR)
+        break;
+      uint16_t name = string_constant(std::string(lexeme(node)), node);
+      if (name > UINT8_MAX) {
+        report(node, "This function names too many fields");
+        return std::nullopt;
+      }
+      return Place{Place::Kind::Named, operand(object), 0, name};
+    }
+    case Tag::Index: {
+      ast::Data data = tree.node_data(node);
+      uint8_t object = operand(data.lhs);
+      uint8_t key = operand(data.rhs);
+      return Place{Place::Kind::Element, object, key, 0};
+    }
+    default:
+      break;
+    }
+    report(node, "This can't be assigned to yet");
+    return std::nullopt;
+  }
+
+  void load(const Place &place, uint8_t target, NodeIndex node) {
+    switch (place.kind) {
+    case Place::Kind::Register:
+      move(target, place.object, node);
+      break;
+    case Place::Kind::Global:
+      emit(encode_bx(Op::GetGlobal, target, place.index), node);
+      break;
+    case Place::Kind::Field:
+      emit(encode(Op::GetField, target, place.object, place.index), node);
+      emit(encode_ax(Op::Shape, place.shape), node);
+      break;
+    case Place::Kind::Named:
+      emit_cached(encode(Op::GetFieldNamed, target, place.object, place.index),
+                  node);
+      break;
+    case Place::Kind::Element:
+      emit(encode(Op::GetIndex, target, place.object, place.key), node);
+      break;
+    }
+  }
+
+  void store(const Place &place, uint8_t value, NodeIndex node) {
+    switch (place.kind) {
+    case Place::Kind::Register:
+      move(place.object, value, node);
+      break;
+    case Place::Kind::Global:
+      emit(encode_bx(Op::SetGlobal, value, place.index), node);
+      break;
+    case Place::Kind::Field:
+      emit(encode(Op::SetField, place.object, place.index, value), node);
+      emit(encode_ax(Op::Shape, place.shape), node);
+      break;
+    case Place::Kind::Named:
+      emit_cached(encode(Op::SetFieldNamed, place.object, place.index, value),
+                  node);
+      break;
+    case Place::Kind::Element:
+      emit(encode(Op::SetIndex, place.object, place.key, value), node);
+      break;
+    }
+  }
+
+  /* -------------------------------------------------------------------------*/
+  /* EXPRESSIONS */
+  /* -------------------------------------------------------------------------*/
+
+  /// @brief A register holding the value of `node`: the variable itself for
+  /// a local, otherwise a new one. Free it by restoring `top`.
+  uint8_t operand(NodeIndex node) {
+    if (!folding[node].known()) {
+      if (auto r = local(node))
+        return *r;
+    }
+    uint8_t r = allocate(node);
+    expression(node, r);
+    return r;
+  }
+
+  /// @brief Whether compiling `node` into a register writes the register
+  /// before it is done reading the operands, which would clobber a
+  /// variable the register belongs to.
+  bool writes_early(NodeIndex node) const {
+    if (folding[node].known())
+      return false;
+    switch (tree.tag(node)) {
+    case Tag::Grouping:
+    case Tag::Cast:
+      return writes_early(tree.node_data(node).lhs);
+    case Tag::Ternary:
+      return true;
+    case Tag::Binary: {
+      auto op = tree.token_kind(tree.main_token(node));
+      return op == TK::AndAnd || op == TK::BarBar;
+    }
+    case Tag::Array:
+      return tree.list(node).size() > UINT8_MAX;
+    default:
+      return false;
+    }
+  }
+
+  /// @brief Compiles `node` so that its value ends up in `target`.
+  void expression(NodeIndex node, uint8_t target) {
+    const Constant &constant = folding[node];
+    if (constant.known()) {
+      load_constant(constant, target, node);
+      return;
+    }
+
+    switch (tree.tag(node)) {
+    case Tag::Literal:
+      literal(node, target);
+      break;
+    case Tag::Identifier:
+      identifier(node, target);
+      break;
+    case Tag::Grouping:
+      expression(tree.node_data(node).lhs, target);
+      break;
+    case Tag::Unary:
+      unary(node, target);
+      break;
+    case Tag::Postfix:
+      increment(tree.node_data(node).lhs,
+                tree.token_kind(tree.main_token(node)), target, false, node);
+      break;
+    case Tag::Binary:
+      binary(node, target);
+      break;
+    case Tag::Assign:
+      assign(node, target);
+      break;
+    case Tag::Ternary:
+      ternary(node, target);
+      break;
+    case Tag::Cast:
+      cast(node, target);
+      break;
+    case Tag::Call:
+      call(node, target);
+      break;
+    case Tag::Index: {
+      uint32_t saved = top;
+      ast::Data data = tree.node_data(node);
+      uint8_t object = operand(data.lhs);
+      uint8_t key = operand(data.rhs);
+      emit(encode(Op::GetIndex, target, object, key), node);
+      top = saved;
+      break;
+    }
+    case Tag::Member:
+      member(node, target);
+      break;
+    case Tag::Array:
+      array(node, target);
+      break;
+    case Tag::Lambda:
+      load_function(functions[node], target, node);
+      break;
+    default:
+      report(node, "This can't be run yet");
+      break;
+    }
+  }
+
+  void literal(NodeIndex node, uint8_t target) {
+    // Numbers and booleans are always folded
+    if (tree.token_kind(tree.main_token(node)) != TK::String) {
+      report(node, "This literal can't be run yet");
+      return;
+    }
+    uint16_t index = string_constant(unescape(lexeme(node)), node);
+    emit(encode_bx(Op::LoadK, target, index), node);
+  }
+
+  void identifier(NodeIndex node, uint8_t target) {
+    const Binding &binding = resolution[node];
+    switch (binding.kind) {
+    case Binding::Kind::Variable:
+    case Binding::Kind::Parameter:
+      if (auto p = place(node))
+        load(*p, target, node);
+      break;
+    case Binding::Kind::Function:
+      if (owners[binding.target] != ast::NULL_NODE) {
+        report(node, "Methods can't be used as values yet");
+        break;
+      }
+      load_function(functions[binding.target], target, node);
+      break;
+    default:
+      report(node, "'", lexeme(node), "' can't be used as a value yet");
+      break;
+    }
+  }
+
+  void unary(NodeIndex node, uint8_t target) {
+    auto op = tree.token_kind(tree.main_token(node));
+    NodeIndex operand_node = tree.node_data(node).lhs;
+    if (op == TK::PlusPlus || op == TK::MinusMinus) {
+      increment(operand_node, op, target, true, node);
+      return;
+    }
+    uint32_t saved = top;
+    uint8_t r = operand(operand_node);
+    emit(encode(op == TK::Minus ? Op::Neg : Op::Not, target, r, 0), node);
+    top = saved;
+  }
+
+  /// @brief `++` and `--`, leaving the new value in `target` if `prefix`
+  /// and the old one otherwise.
+  void increment(NodeIndex operand_node, TK op, std::optional<uint8_t> target,
+                 bool prefix, NodeIndex node) {
+    uint32_t saved = top;
+    auto p = place(operand_node);
+    if (!p) {
+      top = saved;
+      return;
+    }
+    bool in_register = p->kind == Place::Kind::Register;
+    uint8_t value = in_register ? p->object : allocate(node);
+    if (!in_register)
+      load(*p, value, node);
+    if (target && !prefix)
+      move(*target, value, node);
+
+    int8_t delta = op == TK::PlusPlus ? 1 : -1;
+    TypeId type = typing[operand_node];
+    if (type == INT) {
+      emit(encode(Op::AddIntImm, value, value, static_cast<uint8_t>(delta)),
+           node);
+    } else {
+      uint8_t one = allocate(node);
+      load_constant(Constant::of_int(delta), one, node);
+      emit(encode(type == FLOAT ? Op::AddFloat : Op::Add, value, value, one),
+           node);
+    }
+
+    if (!in_register)
+      store(*p, value, node);
+    if (target && prefix)
+      move(*target, value, node);
+    top = saved;
+  }
+
+  /// @brief `R[target] = R[lhs] op rhs`, compiling `rhs` as needed. Adding
+  /// or subtracting a small constant to an int takes no register for it.
+  void arithmetic(TK op, TypeId lhs_type, NodeIndex rhs, uint8_t target,
+                  uint8_t lhs, NodeIndex node) {
+    TypeId rhs_type = typing[rhs];
+    const Constant &constant = folding[rhs];
+    if ((op == TK::Plus || op == TK::Minus) && lhs_type == INT &&
+        rhs_type == INT && constant.kind == CK::Int) {
+      int64_t immediate = op == TK::Plus ? constant.integer : -constant.integer;
+      if (immediate >= INT8_MIN && immediate <= INT8_MAX) {
+        emit(encode(Op::AddIntImm, target, lhs,
+                    static_cast<uint8_t>(static_cast<int8_t>(immediate))),
+             node);
+        return;
+      }
+    }
+    uint32_t saved = top;
+    uint8_t r = operand(rhs);
+    emit(encode(binary_op(op, lhs_type, rhs_type), target, lhs, r), node);
+    top = saved;
+  }
+
+  void binary(NodeIndex node, uint8_t target) {
+    ast::Data data = tree.node_data(node);
+    auto op = tree.token_kind(tree.main_token(node));
+
+    if (op == TK::AndAnd || op == TK::BarBar) {
+      expression(data.lhs, target);
+      size_t skip =
+          jump(op == TK::AndAnd ? Op::JumpIfFalse : Op::JumpIfTrue, target,
+               node);
+      expression(data.rhs, target);
+      patch(skip, node);
+      return;
+    }
+
+    uint32_t saved = top;
+    uint8_t lhs = operand(data.lhs);
+    if (op != TK::More && op != TK::MoreEquals) {
+      arithmetic(op, typing[data.lhs], data.rhs, target, lhs, node);
+      top = saved;
+      return;
+    }
+    // `a > b` is `b < a`
+    uint8_t rhs = operand(data.rhs);
+    TK flipped = op == TK::More ? TK::Less : TK::LessEquals;
+    emit(encode(binary_op(flipped, typing[data.rhs], typing[data.lhs]),
+                target, rhs, lhs),
+         node);
+    top = saved;
+  }
+
+  void assign(NodeIndex node, std::optional<uint8_t> target) {
+    ast::Data data = tree.node_data(node);
+    auto op = tree.token_kind(tree.main_token(node));
+    uint32_t saved = top;
+    auto p = place(data.lhs);
+    if (!p) {
+      top = saved;
+      return;
+    }
+
+    bool in_register = p->kind == Place::Kind::Register;
+    uint8_t value;
+    if (op == TK::Equals) {
+      value = in_register && !writes_early(data.rhs) ? p->object
+                                                     : allocate(node);
+      expression(data.rhs, value);
+      coerce(value, typing[data.lhs], typing[data.rhs], node);
+    } else {
+      value = in_register ? p->object : allocate(node);
+      if (!in_register)
+        load(*p, value, node);
+      arithmetic(compound_operator(op), typing[data.lhs], data.rhs, value,
+                 value, node);
+    }
+
+    store(*p, value, node);
+    if (target)
+      move(*target, value, node);
+    top = saved;
+  }
+
+  void ternary(NodeIndex node, uint8_t target) {
+    auto ternary = tree.ternary(node);
+    uint32_t saved = top;
+    uint8_t condition = operand(ternary.condition);
+    size_t skip = jump(Op::JumpIfFalse, condition, node);
+    top = saved;
+
+    expression(ternary.then, target);
+    coerce(target, typing[node], typing[ternary.then], node);
+    size_t done = jump(Op::Jump, 0, node);
+    patch(skip, node);
+    expression(ternary.otherwise, target);
+    coerce(target, typing[node], typing[ternary.otherwise], node);
+    patch(done, node);
+  }
+
+  void cast(NodeIndex node, uint8_t target) {
+    NodeIndex value = tree.node_data(node).lhs;
+    TypeId to = typing[node];
+    Op op;
+    if (to == typing[value])
+      op = Op::Move;
+    else if (to == INT)
+      op = Op::ToInt;
+    else if (to == FLOAT)
+      op = Op::ToFloat;
+    else if (to == STR)
+      op = Op::ToStr;
+    else if (to == BOOL)
+      op = Op::ToBool;
+    else
+      op = Op::Move;
+
+    if (op == Op::Move) {
+      expression(value, target);
+      return;
+    }
+    uint32_t saved = top;
+    uint8_t r = operand(value);
+    emit(encode(op, target, r, 0), node);
+    top = saved;
+  }
+
+  void member(NodeIndex node, uint8_t target) {
+    NodeIndex object = tree.node_data(node).lhs;
+    const sema::Type &type = types.get(typing[object]);
+
+    if (type.kind == sema::Type::Kind::Enum) {
+      auto variants = tree.enum_decl(type.declaration).variants;
+      auto it = std::find_if(variants.begin(), variants.end(),
+                             [&](NodeIndex variant) {
+                               return lexeme(variant) == lexeme(node);
+                             });
+      load_constant(Constant::of_int(it - variants.begin()), target, node);
+      return;
+    }
+    if (type.kind == sema::Type::Kind::Class) {
+      auto member = member_of(type.declaration, lexeme(node));
+      if (member && tree.tag(*member) == Tag::FnDecl) {
+        report(node, "Methods can't be used as values yet");
+        return;
+      }
+    } else if (typing[object] != ERROR) {
+      report(node, "This member can't be run yet");
+      return;
+    }
+
+    uint32_t saved = top;
+    if (auto p = place(node))
+      load(*p, target, node);
+    top = saved;
+  }
+
+  void array(NodeIndex node, uint8_t target) {
+    auto elements = tree.list(node);
+    TypeId element_type = ERROR;
+    const sema::Type &type = types.get(typing[node]);
+    if (type.kind == sema::Type::Kind::Array)
+      element_type = type.operands[0];
+
+    if (elements.empty()) {
+      emit(encode(Op::NewArray, target, 0, 0), node);
+      return;
+    }
+    for (size_t start = 0; start < elements.size(); start += UINT8_MAX) {
+      size_t count = std::min<size_t>(UINT8_MAX, elements.size() - start);
+      uint32_t saved = top;
+      uint8_t base = top;
+      for (size_t i = start; i < start + count; i++) {
+        uint8_t r = allocate(elements[i]);
+        expression(elements[i], r);
+        coerce(r, element_type, typing[elements[i]], elements[i]);
+      }
+      emit(encode(start == 0 ? Op::NewArray : Op::Push, target, base, count),
+           node);
+      top = saved;
+    }
+  }
+
+  /// @brief Compiles `arguments` into the registers from `top` up,
+  /// converting each to the type of its parameter.
+  void arguments(ast::NodeList arguments, TypeId callee) {
+    std::span<const TypeId> params;
+    if (types.get(callee).kind == sema::Type::Kind::Function)
+      params = types.params(callee);
+    for (size_t i = 0; i < arguments.size(); i++) {
+      uint8_t r = allocate(arguments[i]);
+      expression(arguments[i], r);
+      if (i < params.size())
+        coerce(r, params[i], typing[arguments[i]], arguments[i]);
+    }
+  }
+
+  /// @brief Emits the call of the function in `base`, whose arguments
+  /// follow it, and moves the result into `target`.
+  void invoke(uint8_t base, uint32_t count, uint8_t target, NodeIndex node) {
+    if (count > UINT8_MAX) {
+      report(node, "This passes too many arguments");
+      return;
+    }
+    emit(encode(Op::Call, base, count, 0), node);
+    move(target, base, node);
+  }
+
+  void call(NodeIndex node, uint8_t target) {
+    auto call = tree.call(node);
+    NodeIndex callee = call.callee;
+    uint32_t saved = top;
+
+    if (tree.tag(callee) == Tag::Identifier) {
+      const Binding &binding = resolution[callee];
+      if (binding.kind == Binding::Kind::Builtin) {
+        builtin(node, static_cast<Builtin>(binding.target), call.arguments,
+                target);
+        top = saved;
+        return;
+      }
+      if (binding.kind == Binding::Kind::Class) {
+        construct(node, binding.target, call.arguments, target);
+        top = saved;
+        return;
+      }
+      if (binding.kind == Binding::Kind::Function &&
+          owners[binding.target] != ast::NULL_NODE) {
+        // A method calling another method of its own class by name
+        if (owners[binding.target] != receiver) {
+          report(callee, "Methods can only be called on an object");
+          return;
+        }
+        uint8_t base = allocate(node);
+        load_function(functions[binding.target], base, callee);
+        move(allocate(node), 0, callee);
+        arguments(call.arguments, typing[callee]);
+        invoke(base, call.arguments.size() + 1, target, node);
+        top = saved;
+        return;
+      }
+    }
+
+    if (tree.tag(callee) == Tag::Member) {
+      NodeIndex object = tree.node_data(callee).lhs;
+      TypeId object_type = typing[object];
+      const sema::Type &type = types.get(object_type);
+      std::optional<NodeIndex> method;
+      if (type.kind == sema::Type::Kind::Class) {
+        method = member_of(type.declaration, lexeme(callee));
+        if (method && tree.tag(*method) != Tag::FnDecl)
+          method.reset();
+      }
+
+      if (method || object_type == ERROR) {
+        uint8_t base = allocate(node);
+        uint8_t self = allocate(node);
+        expression(object, self);
+        if (method) {
+          load_function(functions[*method], base, callee);
+        } else {
+          uint16_t name = string_constant(std::string(lexeme(callee)), node);
+          if (name > UINT8_MAX) {
+            report(callee, "This function names too many methods");
+            return;
+          }
+          emit_cached(encode(Op::SelfMethod, base, self, name), callee);
+        }
+        arguments(call.arguments, typing[callee]);
+        invoke(base, call.arguments.size() + 1, target, node);
+        top = saved;
+        return;
+      }
+    }
+
+    uint8_t base = allocate(node);
+    expression(callee, base);
+    arguments(call.arguments, typing[callee]);
+    invoke(base, call.arguments.size(), target, node);
+    top = saved;
+  }
+
+  void builtin(NodeIndex node, Builtin builtin, ast::NodeList arguments,
+               uint8_t target) {
+    uint8_t base = top;
+    for (NodeIndex argument : arguments)
+      expression(argument, allocate(argument));
+
+    switch (builtin) {
+    case Builtin::Print:
+      emit(encode(Op::Print, base, arguments.size(), 0), node);
+      emit(encode(Op::LoadNil, target, 0, 0), node);
+      return;
+    case Builtin::Range:
+      emit(encode(Op::Range, target, base, arguments.size()), node);
+      return;
+    case Builtin::Len:
+      emit(encode(Op::Len, target, base, 0), node);
+      return;
+    case Builtin::Int:
+      emit(encode(Op::ToInt, target, base, 0), node);
+      return;
+    case Builtin::Float:
+      emit(encode(Op::ToFloat, target, base, 0), node);
+      return;
+    case Builtin::Str:
+      emit(encode(Op::ToStr, target, base, 0), node);
+      return;
+    case Builtin::Bool:
+      emit(encode(Op::ToBool, target, base, 0), node);
+      return;
+    case Builtin::List:
+      break;
+    }
+    report(node, "'", sema::BUILTIN_NAMES[static_cast<size_t>(builtin)],
+           "' can't be called yet");
+  }
+
+  /// @brief Creates an instance and sets the fields that have initializers.
+  /// Nothing takes arguments yet, but they still run.
+  void construct(NodeIndex node, NodeIndex klass, ast::NodeList arguments,
+                 uint8_t target) {
+    uint8_t object = allocate(node);
+    emit(encode_bx(Op::New, object, classes[klass]), node);
+    for (NodeIndex argument : arguments) {
+      uint32_t saved = top;
+      expression(argument, allocate(argument));
+      top = saved;
+    }
+    if (auto initializer = program.classes[classes[klass]].initializer) {
+      uint8_t base = allocate(node);
+      load_function(*initializer, base, node);
+      move(allocate(node), object, node);
+      emit(encode(Op::Call, base, 1, 0), node);
+    }
+    move(target, object, node);
+  }
+
+  /* -------------------------------------------------------------------------*/
+  /* STATEMENTS */
+  /* -------------------------------------------------------------------------*/
+
+  void statement(NodeIndex node) {
+    if (node == ast::NULL_NODE)
+      return;
+
+    uint32_t saved = top;
+    switch (tree.tag(node)) {
+    case Tag::Block:
+      for (NodeIndex child : tree.list(node))
+        statement(child);
+      // Variables declared in the block end with it
+      top = saved;
+      break;
+    case Tag::VarDecl:
+      declaration(node);
+      break;
+    case Tag::If:
+      branch(node);
+      break;
+    case Tag::While:
+      loop(node);
+      break;
+    case Tag::For:
+      for_loop(node);
+      break;
+    case Tag::Return:
+      return_value(node);
+      break;
+    case Tag::FnDecl:
+    case Tag::ClassDecl:
+    case Tag::EnumDecl:
+      break;
+    case Tag::Assign:
+      assign(node, std::nullopt);
+      break;
+    case Tag::Unary:
+    case Tag::Postfix: {
+      auto op = tree.token_kind(tree.main_token(node));
+      if (op == TK::PlusPlus || op == TK::MinusMinus) {
+        increment(tree.node_data(node).lhs, op, std::nullopt, false, node);
+        break;
+      }
+      [[fallthrough]];
+    }
+    default:
+      expression(node, allocate(node));
+      top = saved;
+      break;
+    }
+  }
+
+  void declaration(NodeIndex node) {
+    auto decl = tree.var_decl(node);
+    bool global = globals[node] != NONE;
+    uint32_t saved = top;
+    uint8_t r = allocate(node);
+
+    if (folding[node].known()) {
+      load_constant(folding[node], r, node);
+    } else if (decl.value != ast::NULL_NODE) {
+      expression(decl.value, r);
+      coerce(r, typing[node], typing[decl.value], node);
+    } else {
+      load_default(typing[node], r, node);
+    }
+
+    if (global) {
+      emit(encode_bx(Op::SetGlobal, r, globals[node]), node);
+      top = saved;
+    } else {
+      declare(node, r);
+    }
+  }
+
+  void branch(NodeIndex node) {
+    auto branch = tree.if_stmt(node);
+    // A constant condition leaves only one of the branches to compile
+    const Constant &constant = folding[branch.condition];
+    if (constant.kind == CK::Bool) {
+      statement(constant.boolean ? branch.then : branch.otherwise);
+      return;
+    }
+
+    uint32_t saved = top;
+    uint8_t condition = operand(branch.condition);
+    size_t skip = jump(Op::JumpIfFalse, condition, node);
+    top = saved;
+    statement(branch.then);
+    if (branch.otherwise == ast::NULL_NODE) {
+      patch(skip, node);
+      return;
+    }
+    size_t done = jump(Op::Jump, 0, node);
+    patch(skip, node);
+    statement(branch.otherwise);
+    patch(done, node);
+  }
+
+  /// The condition goes after the body, so that each iteration takes one
+  /// jump rather than two
+  void loop(NodeIndex node) {
+    auto loop = tree.while_stmt(node);
+    const Constant &constant = folding[loop.condition];
+    bool forever = constant.kind == CK::Bool && constant.boolean;
+    if (constant.kind == CK::Bool && !constant.boolean)
+      return;
+
+    size_t enter = forever ? 0 : jump(Op::Jump, 0, node);
+    size_t body = function->code.size();
+    statement(loop.body);
+    if (forever) {
+      land(jump(Op::Jump, 0, node), body, node);
+      return;
+    }
+    patch(enter, node);
+    uint32_t saved = top;
+    uint8_t condition = operand(loop.condition);
+    land(jump(Op::JumpIfTrue, condition, node), body, node);
+    top = saved;
+  }
+
+  void for_loop(NodeIndex node) {
+    auto loop = tree.for_stmt(node);
+    uint32_t saved = top;
+
+    NodeIndex iterable = loop.iterable;
+    while (tree.tag(iterable) == Tag::Grouping)
+      iterable = tree.node_data(iterable).lhs;
+    auto range = tree.tag(iterable) == Tag::Call
+                     ? std::optional(tree.call(iterable))
+                     : std::nullopt;
+    if (range && is_builtin(range->callee, Builtin::Range) &&
+        !range->arguments.empty() && range->arguments.size() <= 3) {
+      // Counts in registers rather than building the range
+      auto bounds = range->arguments;
+      uint8_t base = allocate(node);
+      allocate(node);
+      allocate(node);
+      declare(node, allocate(node));
+      if (bounds.size() == 1)
+        load_constant(Constant::of_int(0), base, node);
+      for (size_t i = 0; i < bounds.size(); i++)
+        expression(bounds[i], base + i + (bounds.size() == 1));
+      if (bounds.size() < 3)
+        load_constant(Constant::of_int(1), base + 2, node);
+
+      size_t prepare = jump(Op::ForPrep, base, node);
+      size_t body = function->code.size();
+      statement(loop.body);
+      land(jump(Op::ForLoop, base, node), body, node);
+      patch(prepare, node);
+      top = saved;
+      return;
+    }
+
+    uint8_t sequence = allocate(node);
+    uint8_t position = allocate(node);
+    declare(node, allocate(node));
+    expression(loop.iterable, sequence);
+    load_constant(Constant::of_int(0), position, node);
+    size_t next = jump(Op::IterNext, sequence, node);
+    statement(loop.body);
+    land(jump(Op::Jump, 0, node), next, node);
+    patch(next, node);
+    top = saved;
+  }
+
+  void return_value(NodeIndex node) {
+    NodeIndex value = tree.return_stmt(node).value;
+    if (value == ast::NULL_NODE) {
+      emit(encode(Op::ReturnNil, 0, 0, 0), node);
+      return;
+    }
+    uint32_t saved = top;
+    uint8_t r;
+    if (result == FLOAT && typing[value] == INT) {
+      // The conversion mustn't change the variable being returned
+      r = allocate(node);
+      expression(value, r);
+      coerce(r, result, INT, node);
+    } else {
+      r = operand(value);
+    }
+    emit(encode(Op::Return, r, 0, 0), node);
+    top = saved;
+  }
+
+  /* -------------------------------------------------------------------------*/
+  /* FUNCTIONS */
+  /* -------------------------------------------------------------------------*/
+
+  /// @brief Numbers every function, class and global before any code is
+  /// compiled, so that code can refer to ones declared after it.
+  void declare_all() {
+    add_function(ast::NULL_NODE, "<main>");
+    for (NodeIndex node = 1; node < tree.node_count(); node++) {
+      switch (tree.tag(node)) {
+      case Tag::FnDecl:
+        functions[node] = add_function(node, std::string(lexeme(node)));
+        break;
+      case Tag::Lambda:
+        functions[node] = add_function(node, "<lambda>");
+        break;
+      case Tag::ClassDecl: {
+        // Members come before their class, so its methods are numbered
+        auto decl = tree.class_decl(node);
+        Class klass;
+        klass.name = tree.token_lexeme(decl.name);
+        std::vector<std::string> names;
+        bool initialized = false;
+        for (NodeIndex member : decl.members) {
+          if (tree.tag(member) == Tag::VarDecl) {
+            fields[member] = names.size();
+            names.emplace_back(lexeme(member));
+            initialized |= tree.var_decl(member).value != ast::NULL_NODE ||
+                           has_default(typing[member]);
+          } else if (tree.tag(member) == Tag::FnDecl) {
+            uint32_t method = functions[member];
+            program.functions[method].name = klass.name + "." +
+                                             program.functions[method].name;
+            klass.methods.emplace_back(lexeme(member), method);
+          } else {
+            continue;
+          }
+          owners[member] = node;
+        }
+        klass.shape = shape_of(std::move(names));
+        if (initialized) {
+          klass.initializer = add_function(node, "<init " + klass.name + ">");
+          functions[node] = *klass.initializer;
+        }
+        classes[node] = program.classes.size();
+        program.classes.push_back(std::move(klass));
+        break;
+      }
+      default:
+        break;
+      }
+    }
+    for (NodeIndex item : tree.items()) {
+      if (tree.tag(item) == Tag::VarDecl)
+        globals[item] = program.globals++;
+    }
+  }
+
+  void parameter(NodeIndex param) { declare(param, allocate(param)); }
+
+  void compile_function(uint32_t index) {
+    NodeIndex node = sources[index];
+    current = index;
+    function = &program.functions[index];
+    receiver = ast::NULL_NODE;
+    result = ERROR;
+    top = 0;
+    numbers.clear();
+    boxed.clear();
+    strings.clear();
+
+    switch (tree.tag(node)) {
+    case Tag::Root:
+      for (NodeIndex item : tree.items())
+        statement(item);
+      break;
+    case Tag::FnDecl: {
+      auto decl = tree.fn_decl(node);
+      receiver = owners[node];
+      if (receiver != ast::NULL_NODE)
+        allocate(node);
+      for (NodeIndex param : decl.params)
+        parameter(param);
+      function->arity = top;
+      result = types.result(typing[node]);
+      statement(decl.body);
+      break;
+    }
+    case Tag::Lambda: {
+      ast::Data data = tree.node_data(node);
+      if (tree.tag(data.lhs) == Tag::Tuple) {
+        for (NodeIndex param : tree.list(data.lhs))
+          parameter(param);
+      } else {
+        parameter(data.lhs);
+      }
+      function->arity = top;
+      if (tree.tag(data.rhs) == Tag::Block) {
+        statement(data.rhs);
+        break;
+      }
+      uint8_t r = operand(data.rhs);
+      emit(encode(Op::Return, r, 0, 0), data.rhs);
+      return;
+    }
+    case Tag::ClassDecl:
+      // The initializer: sets the fields in the order they are declared
+      receiver = node;
+      allocate(node);
+      function->arity = 1;
+      for (NodeIndex member : tree.class_decl(node).members) {
+        if (tree.tag(member) != Tag::VarDecl)
+          continue;
+        NodeIndex value = tree.var_decl(member).value;
+        if (value == ast::NULL_NODE && !has_default(typing[member]))
+          continue;
+        uint32_t saved = top;
+        uint8_t r = allocate(member);
+        if (folding[member].known()) {
+          load_constant(folding[member], r, member);
+        } else if (value != ast::NULL_NODE) {
+          expression(value, r);
+          coerce(r, typing[member], typing[value], member);
+        } else {
+          load_default(typing[member], r, member);
+        }
+        emit(encode(Op::SetField, 0, fields[member], r), member);
+        emit(encode_ax(Op::Shape, shape_of_class(node)), member);
+        top = saved;
+      }
+      break;
+    default:
+      std::abort();
+    }
+    emit(encode(Op::ReturnNil, 0, 0, 0), node);
+  }
+
+public:
+  Compiler(const ast::Tree &tree, const sema::Resolution &resolution,
+           const sema::Typing &typing, const sema::Folding &folding,
+           const sema::TypeInterner &types, DiagnosticEngine &diagnostics,
+           Program &program)
+      : tree(tree), resolution(resolution), typing(typing), folding(folding),
+        types(types), diagnostics(diagnostics), program(program),
+        failed(false), functions(tree.node_count(), NONE),
+        classes(tree.node_count(), NONE), globals(tree.node_count(), NONE),
+        fields(tree.node_count(), NONE),
+        owners(tree.node_count(), ast::NULL_NODE),
+        registers(tree.node_count(), NONE), homes(tree.node_count(), NONE),
+        current(0), function(nullptr), receiver(ast::NULL_NODE),
+        result(ERROR), top(0) {}
+
+  bool run() {
+    declare_all();
+    for (uint32_t i = 0; i < program.functions.size(); i++)
+      compile_function(i);
+    return !failed;
+  }
+};
+
+} // namespace
+
+std::unique_ptr<Program> vm::compile(const ast::Tree &tree,
+                                     const sema::Resolution &resolution,
+                                     const sema::Typing &typing,
+                                     const sema::Folding &folding,
+                                     const sema::TypeInterner &types,
+                                     DiagnosticEngine &diagnostics) {
+  profile::Scope scope(profile::Phase::Codegen, tree.file->path);
+  auto program = std::make_unique<Program>();
+  program->file = tree.file;
+  Compiler compiler(tree, resolution, typing, folding, types, diagnostics,
+                    *program);
+  if (!compiler.run())
+    return nullptr;
+  return program;
+}
@@ -0,0 +1,351 @@
+#include "vm/heap.hpp"
+#include "common/profile.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <new>
+#include <tuple>
+
+using namespace vm;
+
+namespace {
+
+/// Free space smaller than this is left for the sweep that frees its block
+constexpr size_t MIN_HOLE = 64;
+
+size_t round_up(size_t size, size_t to) { return (size + to - 1) / to * to; }
+
+/// @brief Marks the bytes from `from` to `to` as free, so that walking a
+/// block steps over them.
+void fill(char *from, char *to) {
+  auto *filler = new (from) Object(Object::Kind::Integer);
+  filler->space = Object::Space::Free;
+  filler->size = static_cast<uint32_t>(to - from);
+}
+
+/// @brief Calls `visit` on every value an object holds.
+template <typename Visit> void each_child(Object *object, Visit visit) {
+  if (object->kind == Object::Kind::Array) {
+    for (Value &element : static_cast<Array *>(object)->elements)
+      visit(element);
+  } else if (object->kind == Object::Kind::Instance) {
+    auto *instance = static_cast<Instance *>(object);
+    for (uint32_t i = 0, count = instance->count(); i < count; i++)
+      visit(instance->fields()[i]);
+  }
+}
+
+bool has_children(const Object *object) {
+  return object->kind == Object::Kind::Array ||
+         object->kind == Object::Kind::Instance;
+}
+
+/// @brief The bytes an object accounts for, elements included.
+size_t footprint(const Object *object) {
+  size_t size = object->size;
+  if (object->kind == Object::Kind::Array)
+    size += static_cast<const Array *>(object)->elements.capacity() *
+            sizeof(Value);
+  return size;
+}
+
+} // namespace
+
+Heap::Heap(Lifetime lifetime) : lifetime(lifetime) {
+  if (lifetime == Lifetime::Collected) {
+    nursery = static_cast<char *>(::operator new(NURSERY_SIZE));
+    top = nursery;
+    limit = nursery + NURSERY_SIZE;
+  }
+}
+
+Heap::~Heap() {
+  for (Array *array : young_arrays)
+    array->~Array();
+  for (Block *block : blocks) {
+    char *at = reinterpret_cast<char *>(block) + BLOCK_HEADER;
+    char *end = reinterpret_cast<char *>(block) + block->size;
+    while (at < end) {
+      auto *object = reinterpret_cast<Object *>(at);
+      at += object->size;
+      if (object->kind == Object::Kind::Array &&
+          object->space != Object::Space::Free)
+        static_cast<Array *>(object)->~Array();
+    }
+    ::operator delete(block, std::align_val_t(BLOCK_SIZE));
+  }
+  ::operator delete(nursery);
+}
+
+/* ---------------------------------------------------------------------------*/
+/* ALLOCATION */
+/* ---------------------------------------------------------------------------*/
+
+String *Heap::string(std::string_view first, std::string_view second) {
+  size_t length = first.size() + second.size();
+  auto *string = make<String>(round_up(sizeof(String) + length, 8),
+                              static_cast<uint32_t>(length));
+  first.copy(string->data(), first.size());
+  second.copy(string->data() + first.size(), second.size());
+  return string;
+}
+
+Array *Heap::array(std::vector<Value> elements) {
+  auto *array = make<Array>(sizeof(Array), std::move(elements));
+  // An old array may start out holding young values
+  if (array->space != Object::Space::Young) {
+    remember(array);
+    return array;
+  }
+  young_arrays.push_back(array);
+  // Elements are off the heap, but fill it up all the same
+  young_elements += array->elements.capacity() * sizeof(Value);
+  if (young_elements > NURSERY_SIZE && wanted == Collection::None)
+    wanted = Collection::Minor;
+  return array;
+}
+
+Instance *Heap::instance(uint32_t klass, uint32_t shape, uint32_t fields) {
+  return make<Instance>(sizeof(Instance) + fields * sizeof(Value), klass,
+                        shape, fields);
+}
+
+void *Heap::allocate_slow(size_t size, Object::Space &space) {
+  if (lifetime == Lifetime::Permanent) {
+    space = Object::Space::Permanent;
+    return allocate_old(size);
+  }
+
+  // The nursery is full until the next collection empties it
+  space = Object::Space::Old;
+  old_size += size;
+  if (wanted == Collection::None)
+    wanted = Collection::Minor;
+  if (old_size > next_major)
+    wanted = Collection::Major;
+  return allocate_old(size);
+}
+
+void *Heap::allocate_old(size_t size) {
+  if (size > LARGE_OBJECT)
+    return allocate_large(size);
+
+  // The rest of a hole that is given up on is already marked free
+  while (static_cast<size_t>(hole_end - cursor) < size) {
+    if (!holes.empty()) {
+      std::tie(cursor, hole_end) = holes.back();
+      holes.pop_back();
+      continue;
+    }
+    void *memory = ::operator new(BLOCK_SIZE, std::align_val_t(BLOCK_SIZE));
+    blocks.push_back(new (memory) Block{BLOCK_SIZE, false, {}});
+    cursor = static_cast<char *>(memory) + BLOCK_HEADER;
+    hole_end = static_cast<char *>(memory) + BLOCK_SIZE;
+    fill(cursor, hole_end);
+  }
+
+  char *at = cursor;
+  cursor += size;
+  if (cursor != hole_end)
+    fill(cursor, hole_end);
+  return at;
+}
+
+void *Heap::allocate_large(size_t size) {
+  size_t bytes = round_up(BLOCK_HEADER + size, BLOCK_SIZE);
+  void *memory = ::operator new(bytes, std::align_val_t(BLOCK_SIZE));
+  blocks.push_back(new (memory) Block{bytes, false, {}});
+  char *at = static_cast<char *>(memory) + BLOCK_HEADER;
+  if (BLOCK_HEADER + size != bytes)
+    fill(at + size, static_cast<char *>(memory) + bytes);
+  return at;
+}
+
+void Heap::remember(Object *holder) {
+  auto address = reinterpret_cast<uintptr_t>(holder);
+  auto *block = reinterpret_cast<Block *>(address & ~(BLOCK_SIZE - 1));
+  block->cards[(address & (BLOCK_SIZE - 1)) / CARD_SIZE] = true;
+  block->dirty = true;
+}
+
+/* ---------------------------------------------------------------------------*/
+/* COLLECTION */
+/* ---------------------------------------------------------------------------*/
+
+void Heap::collect(Collection collection,
+                   std::initializer_list<std::span<Value>> roots) {
+  if (collection == Collection::None || lifetime == Lifetime::Permanent)
+    return;
+  profile::Scope scope(profile::Phase::Collect);
+  auto start = std::chrono::steady_clock::now();
+
+  // A major collection only has to look at the old generation once the
+  // nursery is empty
+  minor(roots);
+  if (collection == Collection::Major)
+    major(roots);
+
+  uint64_t pause = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  if (collection == Collection::Major) {
+    stats.major_collections++;
+    stats.major_pause += pause;
+  } else {
+    stats.minor_collections++;
+    stats.minor_pause += pause;
+  }
+  stats.longest_pause = std::max(stats.longest_pause, pause);
+  wanted = old_size > next_major ? Collection::Major : Collection::None;
+}
+
+void Heap::minor(std::initializer_list<std::span<Value>> roots) {
+  // The old objects on marked cards may hold the only references to young
+  // ones. They are found before anything is promoted into their blocks
+  for (Block *block : blocks) {
+    if (!block->dirty)
+      continue;
+    char *begin = reinterpret_cast<char *>(block);
+    char *at = begin + BLOCK_HEADER, *end = begin + block->size;
+    while (at < end) {
+      auto *object = reinterpret_cast<Object *>(at);
+      if (object->space == Object::Space::Old &&
+          block->cards[(at - begin) / CARD_SIZE])
+        gray.push_back(object);
+      at += object->size;
+    }
+    std::fill(std::begin(block->cards), std::end(block->cards), false);
+    block->dirty = false;
+  }
+
+  for (std::span<Value> values : roots) {
+    for (Value &value : values)
+      evacuate(value);
+  }
+  while (!gray.empty()) {
+    Object *object = gray.back();
+    gray.pop_back();
+    each_child(object, [this](Value &value) { evacuate(value); });
+  }
+
+  for (Array *array : young_arrays) {
+    if (array->space != Object::Space::Forwarded)
+      array->~Array();
+  }
+  young_arrays.clear();
+  young_elements = 0;
+  top = nursery;
+}
+
+/// @brief Moves a young object to the old generation, unless it has been
+/// already, and points `value` at where it went.
+void Heap::evacuate(Value &value) {
+  if (!value.is_object() || !is_young(value.as_object()))
+    return;
+  Object *object = value.as_object();
+  char *address = reinterpret_cast<char *>(object) + sizeof(Object);
+  Object *copy;
+
+  if (object->space == Object::Space::Forwarded) {
+    std::memcpy(&copy, address, sizeof(copy));
+  } else {
+    copy = static_cast<Object *>(allocate_old(object->size));
+    if (object->kind == Object::Kind::Array)
+      new (copy) Array(std::move(*static_cast<Array *>(object)));
+    else
+      std::memcpy(static_cast<void *>(copy), object, object->size);
+    copy->space = Object::Space::Old;
+    old_size += footprint(copy);
+    stats.promoted += footprint(copy);
+    if (has_children(copy))
+      gray.push_back(copy);
+
+    // What is left of the object only has to say where it went
+    object->space = Object::Space::Forwarded;
+    std::memcpy(address, &copy, sizeof(copy));
+  }
+  value = Value::object(copy);
+}
+
+void Heap::major(std::initializer_list<std::span<Value>> roots) {
+  size_t before = old_size;
+  old_size = 0;
+  for (std::span<Value> values : roots) {
+    for (Value value : values)
+      mark(value);
+  }
+  while (!gray.empty()) {
+    Object *object = gray.back();
+    gray.pop_back();
+    each_child(object, [this](Value value) { mark(value); });
+  }
+
+  sweep();
+  stats.freed += before > old_size ? before - old_size : 0;
+  next_major = std::max(MIN_MAJOR, 2 * old_size);
+}
+
+void Heap::mark(Value value) {
+  if (!value.is_object())
+    return;
+  Object *object = value.as_object();
+  // Permanent objects belong to some other heap
+  if (object->space != Object::Space::Old || object->marked)
+    return;
+  object->marked = true;
+  old_size += footprint(object);
+  if (has_children(object))
+    gray.push_back(object);
+}
+
+/// @brief Frees every old object that wasn't marked. Runs of them become
+/// holes to allocate into, and blocks left with nothing alive are released.
+void Heap::sweep() {
+  holes.clear();
+  cursor = hole_end = nullptr;
+
+  size_t kept = 0;
+  for (Block *block : blocks) {
+    char *begin = reinterpret_cast<char *>(block);
+    char *at = begin + BLOCK_HEADER, *end = begin + block->size;
+    size_t first_hole = holes.size();
+    bool alive = false;
+    char *run = nullptr;
+    auto close = [&](char *until) {
+      if (run == nullptr)
+        return;
+      fill(run, until);
+      // A large object's block past the first card table isn't reused
+      if (block->size == BLOCK_SIZE &&
+          static_cast<size_t>(until - run) >= MIN_HOLE)
+        holes.emplace_back(run, until);
+      run = nullptr;
+    };
+
+    while (at < end) {
+      auto *object = reinterpret_cast<Object *>(at);
+      char *next = at + object->size;
+      if (object->marked) {
+        object->marked = false;
+        alive = true;
+        close(at);
+      } else {
+        if (object->kind == Object::Kind::Array &&
+            object->space == Object::Space::Old)
+          static_cast<Array *>(object)->~Array();
+        if (run == nullptr)
+          run = at;
+      }
+      at = next;
+    }
+    close(end);
+
+    if (alive) {
+      blocks[kept++] = block;
+    } else {
+      holes.resize(first_hole);
+      ::operator delete(block, std::align_val_t(BLOCK_SIZE));
+    }
+  }
+  blocks.resize(kept);
+}
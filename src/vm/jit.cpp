@@ -0,0 +1,675 @@
+#include "vm/jit.hpp"
+
+#if defined(__x86_64__) && defined(__linux__)
+#include <bit>
+#include <cstddef>
+#include <cstring>
+#include <optional>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace vm;
+using namespace vm::jit;
+
+#if defined(__x86_64__) && defined(__linux__)
+
+namespace {
+
+/* ---------------------------------------------------------------------------*/
+/* ASSEMBLER */
+/* ---------------------------------------------------------------------------*/
+
+/// The registers the templates use, numbered as instructions encode them
+enum Reg : uint8_t {
+  RAX = 0,
+  RCX = 1,
+  RDX = 2,
+  RBX = 3,
+  RSP = 4,
+  RSI = 6,
+  RDI = 7,
+  R8 = 8,
+  R9 = 9,
+  R12 = 12,
+  R13 = 13
+};
+
+enum Xmm : uint8_t { XMM0, XMM1 };
+
+/// Condition codes, as the low nibble of `Jcc`, `SETcc` and `CMOVcc`
+enum Cond : uint8_t {
+  O = 0x0,
+  AE = 0x3,
+  E = 0x4,
+  NE = 0x5,
+  A = 0x7,
+  NS = 0x9,
+  L = 0xC,
+  GE = 0xD,
+  LE = 0xE
+};
+
+/// `op r/m64, r64` opcodes
+enum Alu : uint8_t {
+  ADD = 0x01,
+  OR = 0x09,
+  SUB = 0x29,
+  XOR = 0x31,
+  CMP = 0x39,
+  TEST = 0x85,
+  MOV = 0x89
+};
+
+/// `/n` extensions of the shift and immediate groups
+enum Ext : uint8_t {
+  EXT_ADD = 0,
+  EXT_SHL = 4,
+  EXT_SHR = 5,
+  EXT_SAR = 7,
+  EXT_CMP = 7
+};
+
+/// `op xmm, xmm/m64` opcodes after F2 0F
+enum Sse : uint8_t { ADDSD = 0x58, MULSD = 0x59, SUBSD = 0x5C, DIVSD = 0x5E };
+
+/// @brief Encodes the few x86-64 instructions the templates are made of.
+/// Memory operands are always a register plus a 32-bit displacement.
+class Assembler {
+  std::vector<uint8_t> code;
+
+  void rex(bool wide, uint8_t reg, uint8_t rm) {
+    uint8_t prefix = 0x40 | wide << 3 | (reg >> 3) << 2 | rm >> 3;
+    if (prefix != 0x40)
+      byte(prefix);
+  }
+  void direct(uint8_t reg, uint8_t rm) {
+    byte(0xC0 | (reg & 7) << 3 | (rm & 7));
+  }
+  void indirect(uint8_t reg, Reg base, int32_t displacement) {
+    byte(0x80 | (reg & 7) << 3 | (base & 7));
+    // RSP and R12 as a base need a SIB byte
+    if ((base & 7) == RSP)
+      byte(0x24);
+    dword(static_cast<uint32_t>(displacement));
+  }
+
+public:
+  size_t here() const { return code.size(); }
+  const std::vector<uint8_t> &bytes() const { return code; }
+
+  void byte(uint8_t value) { code.push_back(value); }
+  void dword(uint32_t value) {
+    for (int i = 0; i < 4; i++)
+      byte(static_cast<uint8_t>(value >> 8 * i));
+  }
+  void qword(uint64_t value) {
+    dword(static_cast<uint32_t>(value));
+    dword(static_cast<uint32_t>(value >> 32));
+  }
+
+  /// `mov dst, [base + displacement]`
+  void load(Reg dst, Reg base, int32_t displacement) {
+    rex(true, dst, base);
+    byte(0x8B);
+    indirect(dst, base, displacement);
+  }
+  /// `mov [base + displacement], src`
+  void store(Reg base, int32_t displacement, Reg src) {
+    rex(true, src, base);
+    byte(0x89);
+    indirect(src, base, displacement);
+  }
+  /// `cmp dword [base + displacement], value`
+  void compare_dword(Reg base, int32_t displacement, uint32_t value) {
+    rex(false, 0, base);
+    byte(0x81);
+    indirect(7, base, displacement);
+    dword(value);
+  }
+  /// `movzx dst, byte [base + displacement]`
+  void load_byte(Reg dst, Reg base, int32_t displacement) {
+    rex(false, dst, base);
+    byte(0x0F);
+    byte(0xB6);
+    indirect(dst, base, displacement);
+  }
+  void move(Reg dst, Reg src) { alu(MOV, dst, src); }
+  /// `mov dst, imm64`, or the shorter `mov dst32, imm32` when it zero
+  /// extends to the same
+  void immediate(Reg dst, uint64_t value) {
+    if (value <= UINT32_MAX) {
+      rex(false, 0, dst);
+      byte(0xB8 + (dst & 7));
+      dword(static_cast<uint32_t>(value));
+      return;
+    }
+    rex(true, 0, dst);
+    byte(0xB8 + (dst & 7));
+    qword(value);
+  }
+  /// `op dst, src`
+  void alu(Alu op, Reg dst, Reg src) {
+    rex(true, src, dst);
+    byte(op);
+    direct(src, dst);
+  }
+  /// `add` or `cmp` of `dst` and a sign-extended 32-bit immediate
+  void alu(Ext ext, Reg dst, int32_t value) {
+    rex(true, 0, dst);
+    byte(0x81);
+    direct(ext, dst);
+    dword(static_cast<uint32_t>(value));
+  }
+  void shift(Ext ext, Reg dst, uint8_t count) {
+    rex(true, 0, dst);
+    byte(0xC1);
+    direct(ext, dst);
+    byte(count);
+  }
+  /// `imul dst, src`
+  void multiply(Reg dst, Reg src) {
+    rex(true, dst, src);
+    byte(0x0F);
+    byte(0xAF);
+    direct(dst, src);
+  }
+  /// `cqo; idiv divisor`: RDX:RAX by `divisor`, the quotient in RAX and the
+  /// remainder in RDX
+  void divide(Reg divisor) {
+    byte(0x48);
+    byte(0x99);
+    rex(true, 0, divisor);
+    byte(0xF7);
+    direct(7, divisor);
+  }
+  /// `test al, mask`
+  void test_low(uint8_t mask) {
+    byte(0xA8);
+    byte(mask);
+  }
+  /// `setcc dst8; movzx dst, dst8`, for RAX to RBX only
+  void set(Cond cond, Reg dst) {
+    byte(0x0F);
+    byte(0x90 | cond);
+    direct(0, dst);
+    byte(0x0F);
+    byte(0xB6);
+    direct(dst, dst);
+  }
+  /// `cmovcc dst, src`
+  void move_if(Cond cond, Reg dst, Reg src) {
+    rex(true, dst, src);
+    byte(0x0F);
+    byte(0x40 | cond);
+    direct(dst, src);
+  }
+  /// `movq dst, src`
+  void to_xmm(Xmm dst, Reg src) {
+    byte(0x66);
+    rex(true, dst, src);
+    byte(0x0F);
+    byte(0x6E);
+    direct(dst, src);
+  }
+  void from_xmm(Reg dst, Xmm src) {
+    byte(0x66);
+    rex(true, src, dst);
+    byte(0x0F);
+    byte(0x7E);
+    direct(src, dst);
+  }
+  void sse(Sse op, Xmm dst, Xmm src) {
+    byte(0xF2);
+    byte(0x0F);
+    byte(op);
+    direct(dst, src);
+  }
+  void ucomisd(Xmm a, Xmm b) {
+    byte(0x66);
+    byte(0x0F);
+    byte(0x2E);
+    direct(a, b);
+  }
+  void push(Reg reg) {
+    rex(false, 0, reg);
+    byte(0x50 + (reg & 7));
+  }
+  void pop(Reg reg) {
+    rex(false, 0, reg);
+    byte(0x58 + (reg & 7));
+  }
+  /// `jmp reg`
+  void jump_to(Reg reg) {
+    rex(false, 0, reg);
+    byte(0xFF);
+    direct(4, reg);
+  }
+  void ret() { byte(0xC3); }
+
+  /// @brief A `jcc rel32` to be pointed somewhere with `patch()`; returns
+  /// where its displacement is.
+  size_t jump(Cond cond) {
+    byte(0x0F);
+    byte(0x80 | cond);
+    dword(0);
+    return here() - 4;
+  }
+  /// @brief The same for a `jmp rel32`.
+  size_t jump() {
+    byte(0xE9);
+    dword(0);
+    return here() - 4;
+  }
+  void patch(size_t at, size_t target) {
+    auto displacement = static_cast<uint32_t>(static_cast<int32_t>(
+        static_cast<int64_t>(target) - static_cast<int64_t>(at + 4)));
+    std::memcpy(&code[at], &displacement, sizeof(displacement));
+  }
+};
+
+/* ---------------------------------------------------------------------------*/
+/* TEMPLATES */
+/* ---------------------------------------------------------------------------*/
+
+/// Hold the same thing in every template: the running function's registers,
+/// its constants and the globals
+constexpr Reg BASE = RBX, CONSTANTS = R12, GLOBALS = R13;
+/// Scratch for checking tags and building values
+constexpr Reg TAG = R8, MASK = R9;
+
+constexpr uint64_t NIL = Value().raw();
+constexpr uint64_t FALSE = Value::boolean(false).raw();
+constexpr uint64_t TRUE = Value::boolean(true).raw();
+constexpr uint64_t INT_TAG = Value::small(0).raw();
+constexpr uint64_t CANONICAL_NAN =
+    Value::real(std::bit_cast<double>(~uint64_t(0))).raw();
+/// Below this, a value is a float
+constexpr uint64_t FIRST_TAG = NIL;
+
+/// @brief Where an instance keeps its shape. `offsetof` only promises to
+/// work on standard-layout types, which an `Instance` isn't.
+int32_t shape_offset() {
+  Instance probe(0, 0, 0);
+  return static_cast<int32_t>(reinterpret_cast<char *>(&probe.shape) -
+                              reinterpret_cast<char *>(&probe));
+}
+
+int32_t slot(uint32_t index) {
+  return static_cast<int32_t>(index * sizeof(Value));
+}
+
+/// @brief Lays out one template per instruction of a function, then the
+/// exits they share.
+class Translator {
+  const Function &function;
+  Assembler out;
+  std::vector<uint32_t> offsets;
+  /// Jumps to instructions, and exits to the interpreter, with the
+  /// instruction each goes to; patched once everything has been laid out
+  std::vector<std::pair<size_t, uint32_t>> jumps;
+  std::vector<std::pair<size_t, uint32_t>> exits;
+  uint32_t index = 0;
+
+  /// @brief Leaves for the interpreter at the current instruction.
+  void leave() { exits.emplace_back(out.jump(), index); }
+  void leave_if(Cond cond) { exits.emplace_back(out.jump(cond), index); }
+  void go_to(uint32_t target) { jumps.emplace_back(out.jump(), target); }
+  void go_to_if(Cond cond, uint32_t target) {
+    jumps.emplace_back(out.jump(cond), target);
+  }
+  uint32_t target(int32_t offset) const {
+    return static_cast<uint32_t>(static_cast<int32_t>(index) + 1 + offset);
+  }
+
+  /// @brief Loads register `from` into `reg` and leaves unless its top 16
+  /// bits are `tag`'s.
+  void load_tagged(Reg reg, uint8_t from, uint64_t tag) {
+    out.load(reg, BASE, slot(from));
+    out.move(TAG, reg);
+    out.shift(EXT_SHR, TAG, 48);
+    out.alu(EXT_CMP, TAG, static_cast<int32_t>(tag >> 48));
+    leave_if(NE);
+  }
+  /// @brief Loads an inline int and sign-extends it.
+  void load_int(Reg reg, uint8_t from) {
+    load_tagged(reg, from, INT_TAG);
+    out.shift(EXT_SHL, reg, 16);
+    out.shift(EXT_SAR, reg, 16);
+  }
+  void load_float(Xmm xmm, Reg reg, uint8_t from) {
+    out.load(reg, BASE, slot(from));
+    out.immediate(MASK, FIRST_TAG);
+    out.alu(CMP, reg, MASK);
+    leave_if(AE);
+    out.to_xmm(xmm, reg);
+  }
+
+  /// @brief Stores `reg` as an inline int, leaving if it doesn't fit; the
+  /// interpreter boxes it.
+  void store_int(uint8_t to, Reg reg) {
+    out.move(TAG, reg);
+    out.shift(EXT_SHL, TAG, 16);
+    out.shift(EXT_SAR, TAG, 16);
+    out.alu(CMP, TAG, reg);
+    leave_if(NE);
+    out.shift(EXT_SHL, reg, 16);
+    out.shift(EXT_SHR, reg, 16);
+    out.immediate(TAG, INT_TAG);
+    out.alu(OR, reg, TAG);
+    out.store(BASE, slot(to), reg);
+  }
+  /// @brief Stores XMM0, with any NaN that would look like a tag made the
+  /// canonical one.
+  void store_float(uint8_t to) {
+    out.from_xmm(RAX, XMM0);
+    out.immediate(MASK, FIRST_TAG);
+    out.immediate(TAG, CANONICAL_NAN);
+    out.alu(CMP, RAX, MASK);
+    out.move_if(AE, RAX, TAG);
+    out.store(BASE, slot(to), RAX);
+  }
+  void store_bool(uint8_t to, Cond cond) {
+    out.set(cond, RAX);
+    out.immediate(TAG, FALSE);
+    out.alu(OR, RAX, TAG);
+    out.store(BASE, slot(to), RAX);
+  }
+  void store_constant(uint8_t to, uint64_t value) {
+    out.immediate(RAX, value);
+    out.store(BASE, slot(to), RAX);
+  }
+
+  void int_op(Instruction instruction, Op op);
+  void float_op(Instruction instruction, Sse op);
+  void compare_ints(Instruction instruction, Cond cond);
+  void compare_floats(Instruction instruction, Cond cond);
+  void branch(Instruction instruction, bool when);
+  void for_loop(Instruction instruction);
+  void get_field(Instruction instruction);
+  void translate(Instruction instruction);
+
+public:
+  explicit Translator(const Function &function) : function(function) {}
+
+  /// @brief The code, and where each instruction's template is in it.
+  std::pair<std::vector<uint8_t>, std::vector<uint32_t>> run();
+};
+
+void Translator::int_op(Instruction instruction, Op op) {
+  if (op == Op::FloorDivInt || op == Op::ModInt) {
+    load_int(RAX, b_of(instruction));
+    load_int(RCX, c_of(instruction));
+    // Division by zero is the interpreter's to report
+    out.alu(TEST, RCX, RCX);
+    leave_if(E);
+    // Neither operand is more than 48 bits wide, so `idiv` can't overflow
+    out.divide(RCX);
+    // Round towards negative infinity: a remainder whose sign differs from
+    // the divisor's takes one off the quotient and the divisor off itself
+    out.alu(TEST, RDX, RDX);
+    size_t exact = out.jump(E);
+    out.move(RSI, RDX);
+    out.alu(XOR, RSI, RCX);
+    size_t same_sign = out.jump(NS);
+    if (op == Op::FloorDivInt)
+      out.alu(EXT_ADD, RAX, -1);
+    else
+      out.alu(ADD, RDX, RCX);
+    out.patch(exact, out.here());
+    out.patch(same_sign, out.here());
+    store_int(a_of(instruction), op == Op::FloorDivInt ? RAX : RDX);
+    return;
+  }
+
+  load_int(RAX, b_of(instruction));
+  if (op == Op::AddIntImm) {
+    out.alu(EXT_ADD, RAX, static_cast<int8_t>(c_of(instruction)));
+  } else {
+    load_int(RDX, c_of(instruction));
+    if (op == Op::AddInt) {
+      out.alu(ADD, RAX, RDX);
+    } else if (op == Op::SubInt) {
+      out.alu(SUB, RAX, RDX);
+    } else {
+      out.multiply(RAX, RDX);
+      leave_if(O);
+    }
+  }
+  store_int(a_of(instruction), RAX);
+}
+
+void Translator::float_op(Instruction instruction, Sse op) {
+  load_float(XMM0, RAX, b_of(instruction));
+  load_float(XMM1, RDX, c_of(instruction));
+  if (op == DIVSD) {
+    // Zero of either sign is all zeros but the sign bit
+    out.shift(EXT_SHL, RDX, 1);
+    leave_if(E);
+  }
+  out.sse(op, XMM0, XMM1);
+  store_float(a_of(instruction));
+}
+
+void Translator::compare_ints(Instruction instruction, Cond cond) {
+  // Moving the payloads to the top keeps them in order
+  load_tagged(RCX, b_of(instruction), INT_TAG);
+  load_tagged(RDX, c_of(instruction), INT_TAG);
+  out.shift(EXT_SHL, RCX, 16);
+  out.shift(EXT_SHL, RDX, 16);
+  out.alu(CMP, RCX, RDX);
+  store_bool(a_of(instruction), cond);
+}
+
+void Translator::compare_floats(Instruction instruction, Cond cond) {
+  // Swapped, so that `above` reads as the operator and NaNs compare false
+  load_float(XMM0, RAX, b_of(instruction));
+  load_float(XMM1, RDX, c_of(instruction));
+  out.ucomisd(XMM1, XMM0);
+  store_bool(a_of(instruction), cond);
+}
+
+void Translator::branch(Instruction instruction, bool when) {
+  // Anything but a bool is the interpreter's to judge
+  load_tagged(RAX, a_of(instruction), FALSE);
+  out.test_low(1);
+  go_to_if(when ? NE : E, target(sbx_of(instruction)));
+}
+
+void Translator::for_loop(Instruction instruction) {
+  uint8_t a = a_of(instruction);
+  load_int(RAX, a);
+  load_int(RDX, a + 1);
+  load_int(RSI, a + 2);
+  out.alu(ADD, RAX, RSI);
+  out.alu(TEST, RSI, RSI);
+  size_t down = out.jump(LE);
+  out.alu(CMP, RAX, RDX);
+  size_t up_done = out.jump(GE);
+  size_t taken = out.jump();
+  out.patch(down, out.here());
+  out.alu(CMP, RAX, RDX);
+  size_t down_done = out.jump(LE);
+
+  out.patch(taken, out.here());
+  store_int(a, RAX);
+  out.store(BASE, slot(a + 3), RAX);
+  go_to(target(sbx_of(instruction)));
+  out.patch(up_done, out.here());
+  out.patch(down_done, out.here());
+}
+
+void Translator::get_field(Instruction instruction) {
+  load_tagged(RAX, b_of(instruction), Value::object(nullptr).raw());
+  out.shift(EXT_SHL, RAX, 16);
+  out.shift(EXT_SHR, RAX, 16);
+  out.load_byte(RCX, RAX, offsetof(Object, kind));
+  out.alu(EXT_CMP, RCX, static_cast<int32_t>(Object::Kind::Instance));
+  leave_if(NE);
+  // The slot is only right for instances of the shape that follows
+  out.compare_dword(RAX, shape_offset(), ax_of(function.code[index + 1]));
+  leave_if(NE);
+  out.load(RAX, RAX,
+           static_cast<int32_t>(sizeof(Instance)) + slot(c_of(instruction)));
+  out.store(BASE, slot(a_of(instruction)), RAX);
+}
+
+void Translator::translate(Instruction instruction) {
+  uint8_t a = a_of(instruction);
+  switch (op_of(instruction)) {
+  case Op::Move:
+    out.load(RAX, BASE, slot(b_of(instruction)));
+    out.store(BASE, slot(a), RAX);
+    return;
+  case Op::LoadK:
+    out.load(RAX, CONSTANTS, slot(bx_of(instruction)));
+    out.store(BASE, slot(a), RAX);
+    return;
+  case Op::LoadInt:
+    return store_constant(a, Value::small(sbx_of(instruction)).raw());
+  case Op::LoadNil:
+    return store_constant(a, NIL);
+  case Op::LoadTrue:
+    return store_constant(a, TRUE);
+  case Op::LoadFalse:
+    return store_constant(a, FALSE);
+  case Op::GetGlobal:
+    out.load(RAX, GLOBALS, slot(bx_of(instruction)));
+    out.store(BASE, slot(a), RAX);
+    return;
+  case Op::SetGlobal:
+    // Globals are roots, so storing to them needs no barrier
+    out.load(RAX, BASE, slot(a));
+    out.store(GLOBALS, slot(bx_of(instruction)), RAX);
+    return;
+
+  case Op::AddInt:
+  case Op::SubInt:
+  case Op::MulInt:
+  case Op::FloorDivInt:
+  case Op::ModInt:
+  case Op::AddIntImm:
+    return int_op(instruction, op_of(instruction));
+  case Op::AddFloat:
+    return float_op(instruction, ADDSD);
+  case Op::SubFloat:
+    return float_op(instruction, SUBSD);
+  case Op::MulFloat:
+    return float_op(instruction, MULSD);
+  case Op::DivFloat:
+    return float_op(instruction, DIVSD);
+  case Op::LtInt:
+    return compare_ints(instruction, L);
+  case Op::LeInt:
+    return compare_ints(instruction, LE);
+  case Op::EqInt:
+    return compare_ints(instruction, E);
+  case Op::NeInt:
+    return compare_ints(instruction, NE);
+  case Op::LtFloat:
+    return compare_floats(instruction, A);
+  case Op::LeFloat:
+    return compare_floats(instruction, AE);
+
+  case Op::Jump:
+    return go_to(target(sax_of(instruction)));
+  case Op::JumpIfFalse:
+    return branch(instruction, false);
+  case Op::JumpIfTrue:
+    return branch(instruction, true);
+  case Op::ForLoop:
+    return for_loop(instruction);
+  case Op::GetField:
+    return get_field(instruction);
+  case Op::Site:
+  case Op::Shape:
+    // Only ever stepped over, by the templates that read them or on the
+    // way out of the ones that leave
+    return;
+
+  default:
+    // Calls, anything that allocates or stores into an object, and the
+    // generic instructions
+    return leave();
+  }
+}
+
+std::pair<std::vector<uint8_t>, std::vector<uint32_t>> Translator::run() {
+  // Entered as `uint32_t (Value *base, const Value *constants,
+  // Value *globals, const void *at)`, and jumps straight to `at`
+  out.push(BASE);
+  out.push(CONSTANTS);
+  out.push(GLOBALS);
+  out.move(BASE, RDI);
+  out.move(CONSTANTS, RSI);
+  out.move(GLOBALS, RDX);
+  out.jump_to(RCX);
+
+  for (index = 0; index < function.code.size(); index++) {
+    offsets.push_back(static_cast<uint32_t>(out.here()));
+    translate(function.code[index]);
+  }
+
+  // Every exit from one instruction shares a stub that says which it is
+  size_t leaving = out.here();
+  out.pop(GLOBALS);
+  out.pop(CONSTANTS);
+  out.pop(BASE);
+  out.ret();
+  std::optional<uint32_t> last;
+  size_t stub = 0;
+  for (auto [at, instruction] : exits) {
+    if (instruction != last) {
+      stub = out.here();
+      out.immediate(RAX, instruction);
+      out.patch(out.jump(), leaving);
+      last = instruction;
+    }
+    out.patch(at, stub);
+  }
+  for (auto [at, instruction] : jumps)
+    out.patch(at, offsets[instruction]);
+  return {out.bytes(), std::move(offsets)};
+}
+
+} // namespace
+
+Code::~Code() { munmap(memory, size); }
+
+std::unique_ptr<Code> Code::translate(const Function &function) {
+  auto [bytes, offsets] = Translator(function).run();
+  auto page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  size_t size = (bytes.size() + page - 1) / page * page;
+  // Written while it can't be run, then run while it can't be written
+  void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (memory == MAP_FAILED)
+    return nullptr;
+  std::memcpy(memory, bytes.data(), bytes.size());
+  if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+    munmap(memory, size);
+    return nullptr;
+  }
+  return std::unique_ptr<Code>(new Code(memory, size, std::move(offsets)));
+}
+
+uint32_t Code::run(Value *base, const Value *constants, Value *globals,
+                   uint32_t at) const {
+  using Entry = uint32_t (*)(Value *, const Value *, Value *, const void *);
+  Entry entry;
+  std::memcpy(&entry, &memory, sizeof(entry));
+  return entry(base, constants, globals,
+               static_cast<const char *>(memory) + offsets[at]);
+}
+
+#else
+
+Code::~Code() {}
+
+std::unique_ptr<Code> Code::translate(const Function &) { return nullptr; }
+
+uint32_t Code::run(Value *, const Value *, Value *, uint32_t at) const {
+  return at;
+}
+
+#endif
@@ -0,0 +1,1210 @@
+#include "vm/machine.hpp"
+#include "common/arith.hpp"
+#include "common/profile.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <limits>
+#include <optional>
+#include <set>
+#include <unordered_set>
+
+using namespace vm;
+using arith::floor_divide;
+using arith::floor_modulo;
+using arith::power;
+
+// Jumping straight from one instruction's handler to the next gives every
+// handler a branch of its own for the predictor to learn, which a single
+// `switch` can't. Labels as values are a GNU extension, so other compilers
+// get the `switch`, as does a build with `SYMPH_NO_COMPUTED_GOTO` defined.
+#if defined(__GNUC__) && !defined(SYMPH_NO_COMPUTED_GOTO)
+#define COMPUTED_GOTO 1
+#else
+#define COMPUTED_GOTO 0
+#endif
+
+namespace {
+
+constexpr int64_t LOWEST = std::numeric_limits<int64_t>::min();
+
+/// Longest array `range()` builds, to fail cleanly rather than run out of
+/// memory
+constexpr uint64_t MAX_RANGE = uint64_t(1) << 28;
+
+std::string_view text_of(Value value) {
+  return static_cast<String *>(value.as_object())->text();
+}
+
+std::vector<Value> &elements_of(Value value) {
+  return static_cast<Array *>(value.as_object())->elements;
+}
+
+/// @brief Python's rules for positions: negative ones count from the end.
+std::optional<size_t> position_in(Value position, size_t size) {
+  if (!position.is_int())
+    return std::nullopt;
+  int64_t i = position.as_int();
+  if (i < 0)
+    i += static_cast<int64_t>(size);
+  if (i < 0 || static_cast<uint64_t>(i) >= size)
+    return std::nullopt;
+  return static_cast<size_t>(i);
+}
+
+} // namespace
+
+Machine::Machine(const Program &program, Write write)
+    : program(program), write(std::move(write)) {}
+
+/* ---------------------------------------------------------------------------*/
+/* SLOW PATHS */
+/* ---------------------------------------------------------------------------*/
+
+bool Machine::fail(std::string message) {
+  error = std::move(message);
+  return false;
+}
+
+uint32_t Machine::enter(const Function *function, Value *base, uint32_t at) {
+  size_t index = function - program.functions.data();
+  if (!natives[index]) {
+    if (++heat[index] != threshold)
+      return at;
+    profile::Scope scope(profile::Phase::Jit, function->name);
+    natives[index] = jit::Code::translate(*function);
+    if (!natives[index])
+      return at;
+  }
+  return natives[index]->run(base, function->constants.data(),
+                             globals.data(), at);
+}
+
+void Machine::collect(Value *end) {
+  heap.collect(heap.pending(), {std::span<Value>(stack.data(), end),
+                                std::span<Value>(globals)});
+}
+
+void Machine::format(std::string &out, Value value, bool nested) const {
+  // Arrays are walked with a stack of their own, so that deep nesting can't
+  // run out of the machine's, and an array met again inside itself prints as
+  // `[...]` instead of going around forever
+  struct Level {
+    const Object *array;
+    const std::vector<Value> *elements;
+    size_t next;
+  };
+  std::vector<Level> levels;
+  std::unordered_set<const Object *> open;
+
+  while (true) {
+    if (!is_array(value)) {
+      format_flat(out, value, nested || !levels.empty());
+    } else if (!open.insert(value.as_object()).second) {
+      out += "[...]";
+    } else {
+      out += '[';
+      levels.push_back({value.as_object(), &elements_of(value), 0});
+    }
+
+    // On to the next element, closing every array that has none left
+    while (!levels.empty() &&
+           levels.back().next == levels.back().elements->size()) {
+      out += ']';
+      open.erase(levels.back().array);
+      levels.pop_back();
+    }
+    if (levels.empty())
+      return;
+    Level &level = levels.back();
+    if (level.next > 0)
+      out += ", ";
+    value = (*level.elements)[level.next++];
+  }
+}
+
+void Machine::format_flat(std::string &out, Value value, bool nested) const {
+  switch (value.kind()) {
+  case Value::Kind::Nil:
+    out += "nil";
+    return;
+  case Value::Kind::Bool:
+    out += value.as_bool() ? "true" : "false";
+    return;
+  case Value::Kind::Int:
+    out += std::to_string(value.as_int());
+    return;
+  case Value::Kind::Float: {
+    char buffer[32];
+    auto [end, ec] = std::to_chars(buffer, buffer + sizeof(buffer),
+                                   value.as_float());
+    std::string_view digits(buffer, end - buffer);
+    out += digits;
+    // Floats always look like floats, so `1.0` doesn't print as `1`
+    if (std::isfinite(value.as_float()) &&
+        digits.find_first_of(".e") == std::string_view::npos)
+      out += ".0";
+    return;
+  }
+  case Value::Kind::Function:
+    out += "<fn ";
+    out += program.functions[value.as_function()].name;
+    out += '>';
+    return;
+  case Value::Kind::Object:
+    break;
+  }
+
+  Object *object = value.as_object();
+  switch (object->kind) {
+  case Object::Kind::Integer:
+  case Object::Kind::Array:
+    // Reported as an int by `kind()`, and left to `format()`
+    std::abort();
+  case Object::Kind::String:
+    if (nested)
+      out += '"';
+    out += static_cast<String *>(object)->text();
+    if (nested)
+      out += '"';
+    return;
+
+  case Object::Kind::Instance:
+    out += '<';
+    out += program.classes[static_cast<Instance *>(object)->klass].name;
+    out += '>';
+    return;
+  }
+}
+
+/// @brief A value as an error message shows it.
+std::string Machine::describe(Value value) const {
+  std::string out;
+  format(out, value, true);
+  if (out.size() > 40)
+    out = out.substr(0, 37) + "...";
+  return out;
+}
+
+bool Machine::truthy(Value value) {
+  switch (value.kind()) {
+  case Value::Kind::Nil:
+    return false;
+  case Value::Kind::Bool:
+    return value.as_bool();
+  case Value::Kind::Int:
+    return value.as_int() != 0;
+  case Value::Kind::Float:
+    return value.as_float() != 0.0;
+  case Value::Kind::Function:
+    return true;
+  case Value::Kind::Object:
+    break;
+  }
+  if (is_string(value))
+    return !text_of(value).empty();
+  if (is_array(value))
+    return !elements_of(value).empty();
+  return true;
+}
+
+bool Machine::equal(Value a, Value b) {
+  if (!is_array(a) || !is_array(b))
+    return equal_flat(a, b);
+
+  // Compared with a stack of their own, like `format()`. A pair of arrays
+  // met again while comparing it is taken as equal so far, which is what
+  // lets two arrays that contain themselves compare at all
+  std::vector<std::pair<Value, Value>> pending = {{a, b}};
+  std::set<std::pair<const Object *, const Object *>> seen;
+  while (!pending.empty()) {
+    auto [x, y] = pending.back();
+    pending.pop_back();
+    if (!is_array(x) || !is_array(y)) {
+      if (!equal_flat(x, y))
+        return false;
+      continue;
+    }
+    if (!seen.insert({x.as_object(), y.as_object()}).second)
+      continue;
+
+    const auto &p = elements_of(x), &q = elements_of(y);
+    if (p.size() != q.size())
+      return false;
+    // Backwards, so that elements are compared front to back
+    for (size_t i = p.size(); i-- > 0;)
+      pending.push_back({p[i], q[i]});
+  }
+  return true;
+}
+
+bool Machine::equal_flat(Value a, Value b) {
+  if (a.is_int() && b.is_int())
+    return a.as_int() == b.as_int();
+  if (a.is_number() && b.is_number())
+    return a.as_number() == b.as_number();
+  if (a.kind() != b.kind())
+    return false;
+  switch (a.kind()) {
+  case Value::Kind::Nil:
+    return true;
+  case Value::Kind::Bool:
+    return a.as_bool() == b.as_bool();
+  case Value::Kind::Function:
+    return a.as_function() == b.as_function();
+  default:
+    break;
+  }
+  if (is_string(a) && is_string(b))
+    return text_of(a) == text_of(b);
+  return a.as_object() == b.as_object();
+}
+
+/// @brief The generic arithmetic instructions, which every typed one falls
+/// back to.
+bool Machine::arithmetic(Op op, Value &out, Value a, Value b) {
+  if (a.is_int() && b.is_int()) {
+    int64_t x = a.as_int(), y = b.as_int(), result = 0;
+    bool overflow = false;
+    switch (op) {
+    case Op::Add:
+      overflow = __builtin_add_overflow(x, y, &result);
+      break;
+    case Op::Sub:
+      overflow = __builtin_sub_overflow(x, y, &result);
+      break;
+    case Op::Mul:
+      overflow = __builtin_mul_overflow(x, y, &result);
+      break;
+    case Op::Div:
+      if (y == 0)
+        return fail("Division by zero");
+      out = Value::real(double(x) / double(y));
+      return true;
+    case Op::FloorDiv:
+      if (y == 0)
+        return fail("Division by zero");
+      overflow = x == LOWEST && y == -1;
+      result = overflow ? 0 : floor_divide(x, y);
+      break;
+    case Op::Mod:
+      if (y == 0)
+        return fail("Division by zero");
+      result = floor_modulo(x, y);
+      break;
+    case Op::Pow: {
+      // Typed as an int, like every other operation on two ints
+      if (y < 0)
+        return fail("This raises an int to a negative power");
+      auto raised = power(x, y);
+      overflow = !raised;
+      result = raised.value_or(0);
+      break;
+    }
+    case Op::BitAnd:
+      result = x & y;
+      break;
+    case Op::BitOr:
+      result = x | y;
+      break;
+    default:
+      std::abort();
+    }
+    if (overflow)
+      return fail("This overflows a 64-bit int");
+    out = heap.integer(result);
+    return true;
+  }
+
+  if (a.is_number() && b.is_number() && op != Op::BitAnd &&
+      op != Op::BitOr) {
+    double x = a.as_number(), y = b.as_number();
+    switch (op) {
+    case Op::Add:
+      out = Value::real(x + y);
+      return true;
+    case Op::Sub:
+      out = Value::real(x - y);
+      return true;
+    case Op::Mul:
+      out = Value::real(x * y);
+      return true;
+    case Op::Pow:
+      out = Value::real(std::pow(x, y));
+      return true;
+    default:
+      break;
+    }
+    if (y == 0)
+      return fail("Division by zero");
+    if (op == Op::Div)
+      out = Value::real(x / y);
+    else if (op == Op::FloorDiv)
+      out = Value::real(std::floor(x / y));
+    else
+      out = Value::real(floor_modulo(x, y));
+    return true;
+  }
+
+  if (a.is_bool() && b.is_bool() && (op == Op::BitAnd || op == Op::BitOr)) {
+    out = Value::boolean(op == Op::BitAnd ? a.as_bool() && b.as_bool()
+                                          : a.as_bool() || b.as_bool());
+    return true;
+  }
+  if (op == Op::Add && is_string(a) && is_string(b)) {
+    out = Value::object(heap.string(text_of(a), text_of(b)));
+    return true;
+  }
+  if (op == Op::Add && is_array(a) && is_array(b)) {
+    std::vector<Value> elements = elements_of(a);
+    const auto &more = elements_of(b);
+    elements.insert(elements.end(), more.begin(), more.end());
+    out = Value::object(heap.array(std::move(elements)));
+    return true;
+  }
+
+  std::string_view name = OP_NAMES[static_cast<size_t>(op)];
+  return fail("Cannot " + std::string(name) + " " + describe(a) + " and " +
+              describe(b));
+}
+
+bool Machine::compare(Op op, Value &out, Value a, Value b) {
+  if (op == Op::Eq || op == Op::Ne) {
+    out = Value::boolean(equal(a, b) == (op == Op::Eq));
+    return true;
+  }
+
+  bool strict = op == Op::Lt;
+  if (a.is_int() && b.is_int()) {
+    int64_t x = a.as_int(), y = b.as_int();
+    out = Value::boolean(strict ? x < y : x <= y);
+  } else if (a.is_number() && b.is_number()) {
+    double x = a.as_number(), y = b.as_number();
+    out = Value::boolean(strict ? x < y : x <= y);
+  } else if (is_string(a) && is_string(b)) {
+    std::string_view x = text_of(a), y = text_of(b);
+    out = Value::boolean(strict ? x < y : x <= y);
+  } else {
+    return fail("Cannot compare " + describe(a) + " and " + describe(b));
+  }
+  return true;
+}
+
+bool Machine::negate(Value &out, Value value) {
+  if (value.is_int() && value.as_int() != LOWEST)
+    out = heap.integer(-value.as_int());
+  else if (value.is_int())
+    return fail("This overflows a 64-bit int");
+  else if (value.is_float())
+    out = Value::real(-value.as_float());
+  else
+    return fail("Cannot negate " + describe(value));
+  return true;
+}
+
+bool Machine::invert(Value &out, Value value) {
+  if (value.is_bool())
+    out = Value::boolean(!value.as_bool());
+  else if (value.is_int())
+    out = heap.integer(~value.as_int());
+  else
+    return fail("Cannot apply '~' to " + describe(value));
+  return true;
+}
+
+bool Machine::convert(Op op, Value &out, Value value) {
+  switch (op) {
+  case Op::ToBool:
+    out = Value::boolean(truthy(value));
+    return true;
+  case Op::ToStr: {
+    if (is_string(value)) {
+      out = value;
+      return true;
+    }
+    std::string text;
+    format(text, value, false);
+    out = Value::object(heap.string(std::move(text)));
+    return true;
+  }
+  case Op::ToInt:
+    if (value.is_int()) {
+      out = value;
+    } else if (value.is_bool()) {
+      out = heap.integer(value.as_bool());
+    } else if (value.is_float()) {
+      double real = std::trunc(value.as_float());
+      // 2^63 itself doesn't fit, but every double below it does
+      if (!(real >= -0x1p63 && real < 0x1p63))
+        return fail("Cannot convert " + describe(value) + " to int");
+      out = heap.integer(static_cast<int64_t>(real));
+    } else if (is_string(value)) {
+      std::string_view text = text_of(value);
+      int64_t parsed = 0;
+      auto [end, ec] =
+          std::from_chars(text.data(), text.data() + text.size(), parsed);
+      if (ec != std::errc() || end != text.data() + text.size())
+        return fail("Cannot convert " + describe(value) + " to int");
+      out = heap.integer(parsed);
+    } else {
+      return fail("Cannot convert " + describe(value) + " to int");
+    }
+    return true;
+  case Op::ToFloat:
+    if (value.is_number()) {
+      out = Value::real(value.as_number());
+    } else if (value.is_bool()) {
+      out = Value::real(value.as_bool());
+    } else if (is_string(value)) {
+      std::string_view text = text_of(value);
+      double parsed = 0;
+      auto [end, ec] =
+          std::from_chars(text.data(), text.data() + text.size(), parsed);
+      if (ec != std::errc() || end != text.data() + text.size())
+        return fail("Cannot convert " + describe(value) + " to float");
+      out = Value::real(parsed);
+    } else {
+      return fail("Cannot convert " + describe(value) + " to float");
+    }
+    return true;
+  default:
+    std::abort();
+  }
+}
+
+bool Machine::length(Value &out, Value value) {
+  if (is_string(value))
+    out = heap.integer(text_of(value).size());
+  else if (is_array(value))
+    out = heap.integer(elements_of(value).size());
+  else
+    return fail(describe(value) + " has no length");
+  return true;
+}
+
+bool Machine::range(Value &out, const Value *bounds, size_t count) {
+  int64_t start = 0, end = 0, step = 1;
+  for (size_t i = 0; i < count; i++) {
+    if (!bounds[i].is_int())
+      return fail("range() takes ints, not " + describe(bounds[i]));
+  }
+  if (count == 1) {
+    end = bounds[0].as_int();
+  } else if (count >= 2) {
+    start = bounds[0].as_int();
+    end = bounds[1].as_int();
+  }
+  if (count == 3)
+    step = bounds[2].as_int();
+  if (step == 0)
+    return fail("range() step can't be zero");
+
+  // In unsigned arithmetic, where the distance between any two ints fits
+  bool empty = step > 0 ? start >= end : start <= end;
+  uint64_t distance = step > 0 ? uint64_t(end) - uint64_t(start)
+                               : uint64_t(start) - uint64_t(end);
+  uint64_t stride = step > 0 ? uint64_t(step) : 0 - uint64_t(step);
+  uint64_t size = empty ? 0 : (distance - 1) / stride + 1;
+  if (size > MAX_RANGE)
+    return fail("range() is too long to build");
+
+  std::vector<Value> elements;
+  elements.reserve(size);
+  int64_t value = start;
+  for (uint64_t i = 0; i < size; i++) {
+    elements.push_back(heap.integer(value));
+    // Stepping past the last element could overflow
+    if (i + 1 < size)
+      value += step;
+  }
+  out = Value::object(heap.array(std::move(elements)));
+  return true;
+}
+
+bool Machine::get_index(Value &out, Value object, Value position) {
+  if (is_array(object)) {
+    const auto &elements = elements_of(object);
+    if (auto i = position_in(position, elements.size())) {
+      out = elements[*i];
+      return true;
+    }
+  } else if (is_string(object)) {
+    std::string_view text = text_of(object);
+    if (auto i = position_in(position, text.size())) {
+      out = Value::object(heap.string(text.substr(*i, 1)));
+      return true;
+    }
+  } else {
+    return fail("Cannot index into " + describe(object));
+  }
+  return fail("Index " + describe(position) + " is out of range");
+}
+
+bool Machine::set_index(Value object, Value position, Value value) {
+  if (!is_array(object))
+    return fail("Cannot assign to an element of " + describe(object));
+  auto &elements = elements_of(object);
+  auto i = position_in(position, elements.size());
+  if (!i)
+    return fail("Index " + describe(position) + " is out of range");
+  elements[*i] = value;
+  heap.write(object.as_object(), value);
+  return true;
+}
+
+/// @brief `object` as an instance, failing with a message about `wanted`
+/// if it isn't one.
+Instance *Machine::instance(Value object, std::string_view wanted) {
+  if (is_instance(object))
+    return static_cast<Instance *>(object.as_object());
+  fail(describe(object) + " has no member '" + std::string(wanted) + "'");
+  return nullptr;
+}
+
+/// @brief Where the field or method `name` of a shape or class is, which
+/// a cache hit would have given. Found by looking through the shape or
+/// class, unless a megamorphic site has found it before, and remembered.
+std::optional<uint32_t> Machine::resolve(Cache &cache, uint32_t key,
+                                         bool method, Value name) {
+  const Object *text = name.as_object();
+  size_t hash = (reinterpret_cast<uintptr_t>(text) >> 3) ^ key * 0x9E3779B1u;
+  Member &entry = megamorphic[(hash ^ method) % MEGAMORPHIC_SIZE];
+  if (cache.state == Cache::State::Megamorphic && entry.name == text &&
+      entry.key == key && entry.method == method)
+    return entry.value;
+
+  std::optional<uint32_t> found;
+  std::string_view wanted = text_of(name);
+  if (!method) {
+    found = program.shapes[key].slot(wanted);
+  } else {
+    for (const auto &[member, function] : program.classes[key].methods) {
+      if (member == wanted) {
+        found = function;
+        break;
+      }
+    }
+  }
+  if (found && !cache.learn(key, *found))
+    entry = {text, key, method, *found};
+  return found;
+}
+
+/// @brief The field of `object` that has the name of slot `slot` of
+/// `shape`, or null if it has no such field.
+Value *Machine::field_of(Value object, uint32_t shape, uint32_t slot) {
+  const std::string &wanted = program.shapes[shape].fields[slot];
+  Instance *self = instance(object, wanted);
+  if (!self)
+    return nullptr;
+  auto found = program.shapes[self->shape].slot(wanted);
+  if (!found) {
+    fail(describe(object) + " has no field '" + wanted + "'");
+    return nullptr;
+  }
+  return self->fields() + *found;
+}
+
+bool Machine::get_named(Value &out, Value object, Value name, Cache &cache) {
+  std::string_view wanted = text_of(name);
+  Instance *self = instance(object, wanted);
+  if (!self)
+    return false;
+  auto slot = resolve(cache, self->shape, false, name);
+  if (!slot)
+    return fail(describe(object) + " has no field '" + std::string(wanted) +
+                "'");
+  out = self->fields()[*slot];
+  return true;
+}
+
+bool Machine::set_named(Value object, Value name, Value value, Cache &cache) {
+  std::string_view wanted = text_of(name);
+  Instance *self = instance(object, wanted);
+  if (!self)
+    return false;
+  auto slot = resolve(cache, self->shape, false, name);
+  if (!slot)
+    return fail(describe(object) + " has no field '" + std::string(wanted) +
+                "'");
+  self->fields()[*slot] = value;
+  heap.write(self, value);
+  return true;
+}
+
+bool Machine::method(Value &out, Value object, Value name, Cache &cache) {
+  std::string_view wanted = text_of(name);
+  Instance *self = instance(object, wanted);
+  if (!self)
+    return false;
+  auto function = resolve(cache, self->klass, true, name);
+  if (!function)
+    return fail(describe(object) + " has no method '" + std::string(wanted) +
+                "'");
+  out = Value::function(*function);
+  return true;
+}
+
+void Machine::print(const Value *values, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    if (i > 0)
+      output += ' ';
+    format(output, values[i], false);
+  }
+  output += '\n';
+  if (output.size() >= OUTPUT_CHUNK)
+    flush();
+}
+
+void Machine::flush() {
+  if (!output.empty())
+    write(output);
+  output.clear();
+}
+
+/* ---------------------------------------------------------------------------*/
+/* INTERPRETER */
+/* ---------------------------------------------------------------------------*/
+
+#if COMPUTED_GOTO
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
+bool Machine::execute(const Function *&at, const Instruction *&next) {
+  // Kept in locals so that they can live in registers, and only written
+  // back on the way out
+  const Function *function = at;
+  const Instruction *pc = next;
+  Value *base = stack.data() + 1;
+  const Value *constants = function->constants.data();
+  Instruction instruction;
+
+#define RA base[a_of(instruction)]
+#define RB base[b_of(instruction)]
+#define RC base[c_of(instruction)]
+#define KBX constants[bx_of(instruction)]
+#define CHECK(condition)                                                       \
+  if (!(condition)) [[unlikely]]                                               \
+    goto failed;
+// Objects only move here, at calls and backward branches, where every live
+// value is in a register or a global rather than a local of some handler
+#define SAFEPOINT()                                                            \
+  if (heap.pending() != Collection::None) [[unlikely]]                         \
+    collect(base + function->registers)
+// The same points are where a hot function's native code takes over, until
+// it reaches an instruction it leaves to the interpreter
+#define NATIVE()                                                               \
+  if (threshold != 0) [[unlikely]]                                             \
+    pc = function->code.data() +                                               \
+         enter(function, base,                                                 \
+               static_cast<uint32_t>(pc - function->code.data()))
+
+#if COMPUTED_GOTO
+  static const void *const HANDLERS[] = {
+#define X(name, format) &&op_##name,
+      OPCODES
+#undef X
+  };
+#define CASE(name) op_##name:
+#define DISPATCH()                                                             \
+  do {                                                                         \
+    instruction = *pc++;                                                       \
+    goto *HANDLERS[instruction & 0xFF];                                        \
+  } while (0)
+  DISPATCH();
+#else
+#define CASE(name) case Op::name:
+#define DISPATCH() continue
+  for (;;) {
+    instruction = *pc++;
+    switch (op_of(instruction)) {
+#endif
+
+  CASE(Move) {
+    RA = RB;
+    DISPATCH();
+  }
+  CASE(LoadK) {
+    RA = KBX;
+    DISPATCH();
+  }
+  CASE(LoadInt) {
+    RA = Value::small(sbx_of(instruction));
+    DISPATCH();
+  }
+  CASE(LoadNil) {
+    RA = Value();
+    DISPATCH();
+  }
+  CASE(LoadTrue) {
+    RA = Value::boolean(true);
+    DISPATCH();
+  }
+  CASE(LoadFalse) {
+    RA = Value::boolean(false);
+    DISPATCH();
+  }
+  CASE(GetGlobal) {
+    RA = globals[bx_of(instruction)];
+    DISPATCH();
+  }
+  CASE(SetGlobal) {
+    globals[bx_of(instruction)] = RA;
+    DISPATCH();
+  }
+
+  // Typed instructions: a check of both tags, then the generic instruction
+  // if it fails, which also deals with overflow, division by zero and ints
+  // that have to be boxed. Two inline ints can't overflow 64 bits when
+  // added or subtracted, so only their result needs checking
+#define INT_OP(name, generic, expression)                                      \
+  CASE(name) {                                                                 \
+    Value b = RB, c = RC;                                                      \
+    int64_t result;                                                            \
+    if (b.is_small_int() && c.is_small_int() && (expression) &&                \
+        Value::fits(result)) [[likely]] {                                      \
+      RA = Value::small(result);                                               \
+      DISPATCH();                                                              \
+    }                                                                          \
+    CHECK(arithmetic(Op::generic, RA, b, c));                                  \
+    DISPATCH();                                                                \
+  }
+  INT_OP(AddInt, Add, (result = b.as_small_int() + c.as_small_int(), true))
+  INT_OP(SubInt, Sub, (result = b.as_small_int() - c.as_small_int(), true))
+  INT_OP(MulInt, Mul,
+         !__builtin_mul_overflow(b.as_small_int(), c.as_small_int(), &result))
+  INT_OP(FloorDivInt, FloorDiv,
+         c.as_small_int() != 0 &&
+             (result = floor_divide(b.as_small_int(), c.as_small_int()), true))
+  INT_OP(ModInt, Mod,
+         c.as_small_int() != 0 &&
+             (result = floor_modulo(b.as_small_int(), c.as_small_int()), true))
+#undef INT_OP
+
+#define FLOAT_OP(name, generic, operator)                                      \
+  CASE(name) {                                                                 \
+    Value b = RB, c = RC;                                                      \
+    if (b.is_float() && c.is_float()) [[likely]] {                             \
+      RA = Value::real(b.as_float() operator c.as_float());                    \
+      DISPATCH();                                                              \
+    }                                                                          \
+    CHECK(arithmetic(Op::generic, RA, b, c));                                  \
+    DISPATCH();                                                                \
+  }
+  FLOAT_OP(AddFloat, Add, +)
+  FLOAT_OP(SubFloat, Sub, -)
+  FLOAT_OP(MulFloat, Mul, *)
+#undef FLOAT_OP
+
+  CASE(DivFloat) {
+    Value b = RB, c = RC;
+    if (b.is_number() && c.is_number() && c.as_number() != 0) [[likely]] {
+      RA = Value::real(b.as_number() / c.as_number());
+      DISPATCH();
+    }
+    CHECK(arithmetic(Op::Div, RA, b, c));
+    DISPATCH();
+  }
+
+#define GENERIC_OP(name)                                                       \
+  CASE(name) {                                                                 \
+    CHECK(arithmetic(Op::name, RA, RB, RC));                                   \
+    DISPATCH();                                                                \
+  }
+  GENERIC_OP(Add)
+  GENERIC_OP(Sub)
+  GENERIC_OP(Mul)
+  GENERIC_OP(Div)
+  GENERIC_OP(FloorDiv)
+  GENERIC_OP(Mod)
+  GENERIC_OP(Pow)
+  GENERIC_OP(BitAnd)
+  GENERIC_OP(BitOr)
+#undef GENERIC_OP
+
+#define COMPARE_OP(name, generic, check, get, operator)                        \
+  CASE(name) {                                                                 \
+    Value b = RB, c = RC;                                                      \
+    if (b.check() && c.check()) [[likely]] {                                   \
+      RA = Value::boolean(b.get() operator c.get());                           \
+      DISPATCH();                                                              \
+    }                                                                          \
+    CHECK(compare(Op::generic, RA, b, c));                                     \
+    DISPATCH();                                                                \
+  }
+  COMPARE_OP(LtInt, Lt, is_small_int, as_small_int, <)
+  COMPARE_OP(LeInt, Le, is_small_int, as_small_int, <=)
+  COMPARE_OP(EqInt, Eq, is_small_int, as_small_int, ==)
+  COMPARE_OP(NeInt, Ne, is_small_int, as_small_int, !=)
+  COMPARE_OP(LtFloat, Lt, is_number, as_number, <)
+  COMPARE_OP(LeFloat, Le, is_number, as_number, <=)
+#undef COMPARE_OP
+
+#define GENERIC_COMPARE(name)                                                  \
+  CASE(name) {                                                                 \
+    CHECK(compare(Op::name, RA, RB, RC));                                      \
+    DISPATCH();                                                                \
+  }
+  GENERIC_COMPARE(Lt)
+  GENERIC_COMPARE(Le)
+  GENERIC_COMPARE(Eq)
+  GENERIC_COMPARE(Ne)
+#undef GENERIC_COMPARE
+
+  CASE(AddIntImm) {
+    Value b = RB;
+    int64_t immediate = static_cast<int8_t>(c_of(instruction));
+    if (b.is_small_int() && Value::fits(b.as_small_int() + immediate))
+        [[likely]] {
+      RA = Value::small(b.as_small_int() + immediate);
+      DISPATCH();
+    }
+    CHECK(arithmetic(Op::Add, RA, b, Value::small(immediate)));
+    DISPATCH();
+  }
+  CASE(Neg) {
+    CHECK(negate(RA, RB));
+    DISPATCH();
+  }
+  CASE(Not) {
+    CHECK(invert(RA, RB));
+    DISPATCH();
+  }
+  CASE(ToInt) {
+    CHECK(convert(Op::ToInt, RA, RB));
+    DISPATCH();
+  }
+  CASE(ToFloat) {
+    CHECK(convert(Op::ToFloat, RA, RB));
+    DISPATCH();
+  }
+  CASE(ToStr) {
+    CHECK(convert(Op::ToStr, RA, RB));
+    DISPATCH();
+  }
+  CASE(ToBool) {
+    CHECK(convert(Op::ToBool, RA, RB));
+    DISPATCH();
+  }
+  CASE(Len) {
+    CHECK(length(RA, RB));
+    DISPATCH();
+  }
+
+  CASE(Jump) {
+    int32_t offset = sax_of(instruction);
+    pc += offset;
+    if (offset < 0) {
+      SAFEPOINT();
+      NATIVE();
+    }
+    DISPATCH();
+  }
+  CASE(JumpIfFalse) {
+    Value a = RA;
+    if (a.is_bool() ? !a.as_bool() : !truthy(a)) {
+      pc += sbx_of(instruction);
+      if (sbx_of(instruction) < 0) {
+        SAFEPOINT();
+        NATIVE();
+      }
+    }
+    DISPATCH();
+  }
+  CASE(JumpIfTrue) {
+    Value a = RA;
+    if (a.is_bool() ? a.as_bool() : truthy(a)) {
+      pc += sbx_of(instruction);
+      if (sbx_of(instruction) < 0) {
+        SAFEPOINT();
+        NATIVE();
+      }
+    }
+    DISPATCH();
+  }
+  CASE(ForPrep) {
+    Value *loop = &RA;
+    for (int i = 0; i < 3; i++)
+      CHECK(loop[i].is_int() ||
+            fail("range() takes ints, not " + describe(loop[i])));
+    int64_t start = loop[0].as_int(), end = loop[1].as_int();
+    int64_t step = loop[2].as_int();
+    CHECK(step != 0 || fail("range() step can't be zero"));
+    if (step > 0 ? start >= end : start <= end)
+      pc += sbx_of(instruction);
+    else
+      loop[3] = loop[0];
+    DISPATCH();
+  }
+  CASE(ForLoop) {
+    Value *loop = &RA;
+    int64_t step = loop[2].as_int(), next;
+    if (!__builtin_add_overflow(loop[0].as_int(), step, &next) &&
+        (step > 0 ? next < loop[1].as_int() : next > loop[1].as_int())) {
+      loop[0] = loop[3] = heap.integer(next);
+      SAFEPOINT();
+      pc += sbx_of(instruction);
+      NATIVE();
+    }
+    DISPATCH();
+  }
+  CASE(IterNext) {
+    Value *loop = &RA;
+    int64_t position = loop[1].as_int();
+    if (is_array(loop[0])) {
+      const auto &elements = elements_of(loop[0]);
+      if (static_cast<uint64_t>(position) >= elements.size()) {
+        pc += sbx_of(instruction);
+        DISPATCH();
+      }
+      loop[2] = elements[position];
+    } else if (is_string(loop[0])) {
+      std::string_view text = text_of(loop[0]);
+      if (static_cast<uint64_t>(position) >= text.size()) {
+        pc += sbx_of(instruction);
+        DISPATCH();
+      }
+      loop[2] = Value::object(heap.string(text.substr(position, 1)));
+    } else {
+      CHECK(fail("Cannot iterate over " + describe(loop[0])));
+    }
+    loop[1] = Value::small(position + 1);
+    DISPATCH();
+  }
+
+  CASE(Call) {
+    SAFEPOINT();
+    Value *callee = &RA;
+    CHECK(callee->is_function() ||
+          fail(describe(*callee) + " cannot be called"));
+    const Function *target = &program.functions[callee->as_function()];
+    size_t count = b_of(instruction);
+    CHECK(target->arity == count ||
+          fail("'" + target->name + "' takes " +
+               std::to_string(target->arity) + " arguments, not " +
+               std::to_string(count)));
+    Value *next = callee + 1;
+    CHECK((frames.size() < MAX_DEPTH &&
+           next + target->registers <= stack.data() + stack.size()) ||
+          fail("Stack overflow"));
+    // Registers past the arguments never hold anything stale
+    std::fill(next + count, next + target->registers, Value());
+    frames.push_back({function, pc, base});
+    function = target;
+    constants = function->constants.data();
+    pc = function->code.data();
+    base = next;
+    NATIVE();
+    DISPATCH();
+  }
+  CASE(Return) {
+    Value result = RA;
+    if (frames.empty())
+      return true;
+    base[-1] = result;
+    Frame caller = frames.back();
+    frames.pop_back();
+    function = caller.function;
+    constants = function->constants.data();
+    pc = caller.pc;
+    base = caller.base;
+    NATIVE();
+    DISPATCH();
+  }
+  CASE(ReturnNil) {
+    if (frames.empty())
+      return true;
+    base[-1] = Value();
+    Frame caller = frames.back();
+    frames.pop_back();
+    function = caller.function;
+    constants = function->constants.data();
+    pc = caller.pc;
+    base = caller.base;
+    NATIVE();
+    DISPATCH();
+  }
+
+  CASE(NewArray) {
+    Value *first = &RB;
+    std::vector<Value> elements(first, first + c_of(instruction));
+    RA = Value::object(heap.array(std::move(elements)));
+    DISPATCH();
+  }
+  CASE(Push) {
+    Value *first = &RB, *last = first + c_of(instruction);
+    auto &elements = elements_of(RA);
+    elements.insert(elements.end(), first, last);
+    for (Value *value = first; value != last; value++)
+      heap.write(RA.as_object(), *value);
+    DISPATCH();
+  }
+  CASE(Range) {
+    CHECK(range(RA, &RB, c_of(instruction)));
+    DISPATCH();
+  }
+  CASE(GetIndex) {
+    CHECK(get_index(RA, RB, RC));
+    DISPATCH();
+  }
+  CASE(SetIndex) {
+    CHECK(set_index(RA, RB, RC));
+    DISPATCH();
+  }
+  CASE(New) {
+    const Class &klass = program.classes[bx_of(instruction)];
+    RA = Value::object(heap.instance(
+        bx_of(instruction), klass.shape,
+        static_cast<uint32_t>(program.shapes[klass.shape].fields.size())));
+    DISPATCH();
+  }
+  // The slot is only right for the shape the compiler picked it for. Any
+  // other instance, which an untyped value can be, has the field found by
+  // name, and anything else, such as nil, fails
+  CASE(GetField) {
+    Value object = RB;
+    uint32_t shape = ax_of(*pc++);
+    if (is_instance(object) &&
+        static_cast<Instance *>(object.as_object())->shape == shape)
+        [[likely]] {
+      RA = static_cast<Instance *>(object.as_object())
+               ->fields()[c_of(instruction)];
+      DISPATCH();
+    }
+    Value *field = field_of(object, shape, c_of(instruction));
+    CHECK(field);
+    RA = *field;
+    DISPATCH();
+  }
+  CASE(SetField) {
+    Value object = RA, value = RC;
+    uint32_t shape = ax_of(*pc++);
+    Value *field;
+    if (is_instance(object) &&
+        static_cast<Instance *>(object.as_object())->shape == shape)
+        [[likely]]
+      field = static_cast<Instance *>(object.as_object())->fields() +
+              b_of(instruction);
+    else
+      field = field_of(object, shape, b_of(instruction));
+    CHECK(field);
+    *field = value;
+    heap.write(object.as_object(), value);
+    DISPATCH();
+  }
+
+  // A cache hit is a compare of the instance's shape, or class, and a load
+  // of what the site learned about it
+  CASE(GetFieldNamed) {
+    Value object = RB;
+    Cache &cache = caches[ax_of(*pc++)];
+    if (is_instance(object)) [[likely]] {
+      auto *self = static_cast<Instance *>(object.as_object());
+      if (const uint32_t *slot = cache.find(self->shape)) [[likely]] {
+        RA = self->fields()[*slot];
+        DISPATCH();
+      }
+    }
+    CHECK(get_named(RA, object, constants[c_of(instruction)], cache));
+    DISPATCH();
+  }
+  CASE(SetFieldNamed) {
+    Value object = RA, value = RC;
+    Cache &cache = caches[ax_of(*pc++)];
+    if (is_instance(object)) [[likely]] {
+      auto *self = static_cast<Instance *>(object.as_object());
+      if (const uint32_t *slot = cache.find(self->shape)) [[likely]] {
+        self->fields()[*slot] = value;
+        heap.write(self, value);
+        DISPATCH();
+      }
+    }
+    CHECK(set_named(object, constants[b_of(instruction)], value, cache));
+    DISPATCH();
+  }
+  CASE(SelfMethod) {
+    Value object = RB;
+    Cache &cache = caches[ax_of(*pc++)];
+    const uint32_t *function = nullptr;
+    if (is_instance(object)) [[likely]]
+      function =
+          cache.find(static_cast<Instance *>(object.as_object())->klass);
+    if (function) [[likely]]
+      RA = Value::function(*function);
+    else
+      CHECK(method(RA, object, constants[c_of(instruction)], cache));
+    base[a_of(instruction) + 1] = object;
+    DISPATCH();
+  }
+  CASE(Site) {
+    // Always skipped by the instruction it belongs to
+    DISPATCH();
+  }
+  CASE(Shape) {
+    // The same
+    DISPATCH();
+  }
+  CASE(Print) {
+    print(&RA, b_of(instruction));
+    DISPATCH();
+  }
+
+#if !COMPUTED_GOTO
+    }
+  }
+#endif
+
+failed:
+  at = function;
+  next = pc;
+  return false;
+
+#undef RA
+#undef RB
+#undef RC
+#undef KBX
+#undef CHECK
+#undef SAFEPOINT
+#undef NATIVE
+#undef CASE
+#undef DISPATCH
+}
+
+#if COMPUTED_GOTO
+#pragma GCC diagnostic pop
+#endif
+
+bool Machine::run(DiagnosticEngine &diagnostics) {
+  profile::Scope scope(profile::Phase::Run, program.file->path);
+  stack.assign(STACK_SIZE, Value());
+  globals.assign(program.globals, Value());
+  frames.clear();
+  caches.assign(program.sites, Cache());
+  megamorphic.fill(Member());
+  heat.assign(program.functions.size(), 0);
+  natives.clear();
+  natives.resize(program.functions.size());
+
+  const Function *function = &program.functions[0];
+  const Instruction *pc = function->code.data();
+  bool finished = execute(function, pc);
+  flush();
+  if (finished)
+    return true;
+
+  // `pc` is already past the instruction that failed
+  size_t at = pc - function->code.data() - 1;
+  Span span(*program.file, function->offsets[at], function->lengths[at]);
+  diagnostics.emit(Diagnostic(diagnostic::Kind::RuntimeError, span, error));
+  return false;
+}
+
+void Machine::enable_jit(uint32_t threshold) {
+  this->threshold = std::max<uint32_t>(threshold, 1);
+}
+
+size_t Machine::translated() const {
+  return std::count_if(natives.begin(), natives.end(),
+                       [](const auto &native) { return native != nullptr; });
+}
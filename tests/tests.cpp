@@ -1,12 +1,48 @@
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include "doctest.h"
 
+#include "common/ansi.hpp"
 #include "common/diagnostic.hpp"
+#include "common/hash.hpp"
+#include "common/interner.hpp"
+#include "common/profile.hpp"
+#include "common/rope.hpp"
+#include "common/sink.hpp"
 #include "common/span.hpp"
+#include "driver/driver.hpp"
+#include "lexer/lexer.hpp"
 #include "lexer/token.hpp"
+#include "lsp/json.hpp"
+#include "lsp/server.hpp"
+#include "parser/ast.hpp"
+#include "parser/cache.hpp"
+#include "parser/parallel.hpp"
+#include "parser/parser.hpp"
+#include "query/engine.hpp"
+#include "sema/checker.hpp"
+#include "sema/folder.hpp"
+#include "sema/resolver.hpp"
+#include "sema/scope.hpp"
+#include "sema/types.hpp"
+#include "syntax/syntax_tree.hpp"
+#include "vm/compiler.hpp"
+#include "vm/heap.hpp"
+#include "vm/machine.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
 #include <sstream>
+#include <stdexcept>
 #include <string>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
 
 TEST_CASE("Testing code spans") {
   std::string source = "balls, world!";
@@ -101,4 +137,1705 @@ TEST_CASE("Token representation is accurate") {
   std::string output = ss.str();
   CHECK(output.find("+=") != std::string::npos);
   CHECK(output.find("test.symph") != std::string::npos);
-}
\ No newline at end of file
+}
+TEST_CASE("Styled writer skips redundant style transitions") {
+  std::string out;
+  console::StyledWriter writer(out, true);
+
+  writer.write(console::Style::Green, "a");
+  writer.write(console::Style::Green, "b");
+  writer.write(console::Style::Red, "c");
+  writer.reset();
+  writer.reset();
+
+  std::string expected = "\033[0;32mab\033[0;31mc\033[0m";
+  CHECK(out == expected);
+}
+
+TEST_CASE("Uncolored styled writer emits no escape sequences") {
+  std::string out;
+  console::StyledWriter writer(out, false);
+
+  writer.write(console::Style::BoldRed, "Error:");
+  writer.write(' ');
+  writer.write_number(42);
+  writer.write_repeated('~', 3);
+  writer.reset();
+
+  CHECK(out == "Error: 42~~~");
+}
+
+TEST_CASE("Diagnostic label tables") {
+  using namespace diagnostic;
+
+  CHECK(get_diagnostic_kind_string(Kind::UnexpectToken) == "Unexpected Token");
+  CHECK(get_diagnostic_kind_string(Kind::InternalError) == "Internal Error");
+  CHECK(get_diagnostic_severity_string(Severity::Warning) == "Warning:");
+
+  std::stringstream ss;
+  ss << Severity::Error << " " << Kind::InvalidString;
+  CHECK(ss.str() == "Error: Invalid String");
+}
+
+TEST_CASE("Output sink batches writes until flushed") {
+  int fds[2];
+  REQUIRE(pipe(fds) == 0);
+
+  {
+    output::Sink sink(fds[1]);
+    sink.write("hello ");
+    sink.buffer() += "world";
+    sink.commit();
+    CHECK(sink.pending_bytes() == 11);
+
+    sink.flush();
+    CHECK(sink.pending_bytes() == 0);
+  }
+  close(fds[1]);
+
+  char buffer[32] = {};
+  auto n = read(fds[0], buffer, sizeof(buffer));
+  close(fds[0]);
+  CHECK(std::string(buffer, n) == "hello world");
+}
+
+TEST_CASE("Output sink flushes once the threshold is reached") {
+  int fds[2];
+  REQUIRE(pipe(fds) == 0);
+
+  output::Sink sink(fds[1], 4);
+  sink.write("abc");
+  CHECK(sink.pending_bytes() == 3);
+  sink.write("de");
+  CHECK(sink.pending_bytes() == 0);
+
+  char buffer[8] = {};
+  auto n = read(fds[0], buffer, sizeof(buffer));
+  close(fds[0]);
+  close(fds[1]);
+  CHECK(std::string(buffer, n) == "abcde");
+}
+
+#ifndef SYMPH_NO_PROFILE
+TEST_CASE("Profiler counts nested scopes of a phase once") {
+  profile::enable(true);
+  {
+    profile::Scope outer(profile::Phase::Sema, "outer \"quoted\"");
+    profile::Scope inner(profile::Phase::Sema);
+    profile::record_allocation(4096);
+  }
+
+  int fds[2];
+  REQUIRE(pipe(fds) == 0);
+  {
+    output::Sink sink(fds[1]);
+    profile::write_report(sink);
+  }
+  close(fds[1]);
+
+  std::string report;
+  char buffer[256];
+  ssize_t n;
+  while ((n = read(fds[0], buffer, sizeof(buffer))) > 0)
+    report.append(buffer, n);
+  close(fds[0]);
+
+  auto row = report.substr(report.find("sema"));
+  row = row.substr(0, row.find('\n'));
+  CHECK(row.find(" 1 ") != std::string::npos);
+  CHECK(row.find("4.0K") != std::string::npos);
+
+  auto path =
+      (std::filesystem::temp_directory_path() / "symph_trace.json").string();
+  REQUIRE(profile::write_trace(path));
+  std::ifstream in(path);
+  std::string trace((std::istreambuf_iterator<char>(in)),
+                    std::istreambuf_iterator<char>());
+  CHECK(trace.find("\"name\":\"sema\"") != std::string::npos);
+  CHECK(trace.find("outer \\\"quoted\\\"") != std::string::npos);
+  std::remove(path.c_str());
+}
+#endif
+
+TEST_CASE("Lexer produces operators, keywords and literals") {
+  File file("x **= 2 // y -> z\nif \"s\" 1.5 true", "test.symph");
+  DiagnosticEngine engine;
+  auto tokens = Lexer(file, engine).lex();
+
+  using TK = Token::Kind;
+  std::vector<TK> expected = {
+      TK::Identifier, TK::StarStarEquals, TK::Integer, TK::SlashSlash,
+      TK::Identifier, TK::Arrow,          TK::Identifier, TK::Newline,
+      TK::If,         TK::String,         TK::Float,      TK::Boolean,
+      TK::Eof};
+
+  REQUIRE(tokens.size() == expected.size());
+  for (size_t i = 0; i < expected.size(); i++)
+    CHECK(tokens[i].kind == expected[i]);
+  CHECK(tokens[9].span.get_lexeme() == "\"s\"");
+  CHECK(engine.size() == 0);
+}
+
+TEST_CASE("Lexer reports unterminated strings and invalid characters") {
+  File file("\"abc\n$", "test.symph");
+  DiagnosticEngine engine;
+  auto tokens = Lexer(file, engine).lex();
+
+  CHECK(engine.size() == 2);
+  CHECK(tokens.back().kind == Token::Kind::Eof);
+}
+
+namespace {
+
+std::string parse_to_string(const std::string &source) {
+  File file(source, "test.symph");
+  DiagnosticEngine engine;
+  auto tokens = Lexer(file, engine).lex();
+
+  Parser parser(tokens, engine);
+  auto tree = parser.parse();
+  if (parser.had_error())
+    return "<error>";
+
+  std::stringstream ss;
+  auto items = tree.items();
+  for (size_t i = 0; i < items.size(); i++) {
+    if (i > 0)
+      ss << "; ";
+    ast::print_node(ss, tree, items[i]);
+  }
+  return ss.str();
+}
+
+} // namespace
+
+TEST_CASE("Pratt parser respects precedence and associativity") {
+  CHECK(parse_to_string("1 + 2 * 3") == "(+ 1 (* 2 3))");
+  CHECK(parse_to_string("1 - 2 - 3") == "(- (- 1 2) 3)");
+  CHECK(parse_to_string("2 ** 3 ** 2") == "(** 2 (** 3 2))");
+  CHECK(parse_to_string("-2 ** 2") == "(- (** 2 2))");
+  CHECK(parse_to_string("a // b % c") == "(% (// a b) c)");
+  CHECK(parse_to_string("a || b && c == d") == "(|| a (&& b (== c d)))");
+  CHECK(parse_to_string("a < b == c >= d") == "(== (< a b) (>= c d))");
+  CHECK(parse_to_string("x = y += 1") == "(= x (+= y 1))");
+  CHECK(parse_to_string("c ? a : b ? d : e") == "(? c a (? b d e))");
+  CHECK(parse_to_string("x as int + 1") == "(+ (as x int) 1)");
+  CHECK(parse_to_string("int -> int -> bool") == "(-> int (-> int bool))");
+}
+
+TEST_CASE("Pratt parser handles postfix, groups and lambdas") {
+  CHECK(parse_to_string("f(1, g(2))[0].name") ==
+        "(. (index (call f 1 (call g 2)) 0) name)");
+  CHECK(parse_to_string("(1 + 2) * 3") == "(* (+ 1 2) 3)");
+  CHECK(parse_to_string("i++; --j") == "(post++ i); (-- j)");
+  CHECK(parse_to_string("(a, b) => a + b") == "(=> (tuple a b) (+ a b))");
+  CHECK(parse_to_string("x => y => x") == "(=> x (=> y x))");
+  CHECK(parse_to_string("f = x => x + 1") == "(= f (=> x (+ x 1)))");
+  CHECK(parse_to_string("f += (a, b) => a") == "(+= f (=> (tuple a b) a))");
+  CHECK(parse_to_string("[1,\n 2,\n 3]") == "(array 1 2 3)");
+  CHECK(parse_to_string("a +\n b\nc") == "(+ a b); c");
+}
+
+TEST_CASE("Pratt parser reports malformed expressions") {
+  CHECK(parse_to_string("1 +") == "<error>");
+  CHECK(parse_to_string("(1, 2") == "<error>");
+  CHECK(parse_to_string("1 = 2") == "<error>");
+  CHECK(parse_to_string("1 + 2 3") == "<error>");
+}
+
+namespace {
+
+/// Prints the tree even when parsing failed, with the number of diagnostics
+std::string recover_to_string(const std::string &source) {
+  File file(source, "test.symph");
+  DiagnosticEngine engine;
+  auto tokens = Lexer(file, engine).lex();
+  auto tree = Parser(tokens, engine).parse();
+
+  std::stringstream ss;
+  ss << engine.size() << ":";
+  for (auto item : tree.items()) {
+    ss << " ";
+    ast::print_node(ss, tree, item);
+  }
+  return ss.str();
+}
+
+} // namespace
+
+TEST_CASE("Parser recovers at the next statement") {
+  CHECK(recover_to_string("x := 1 * * 2\ny := 2") == "1: <error> (let y _ 2)");
+  CHECK(recover_to_string("a b c d; e") == "1: <error> e");
+  CHECK(recover_to_string("f(a: int) { a + }\ng") ==
+        "1: (fn f (a:int) _ { <error> }) g");
+  CHECK(recover_to_string("if { x }\ny") == "1: <error> y");
+  CHECK(recover_to_string("}\nx") == "1: <error> x");
+  CHECK(recover_to_string("class P {\n 1\n x: int\n}") ==
+        "1: (class P <error> (let x int _))");
+  CHECK(recover_to_string("1 + ) ) )\n2 = 3\nz") == "2: <error> <error> z");
+}
+
+TEST_CASE("Parser recovery terminates on unbalanced input") {
+  std::string garbage;
+  for (int i = 0; i < 2000; i++)
+    garbage += "} ) ( { ] [ + = ;\n";
+
+  File file(garbage, "garbage.symph");
+  DiagnosticEngine engine;
+  auto tokens = Lexer(file, engine).lex();
+  auto tree = Parser(tokens, engine).parse();
+
+  CHECK(engine.size() > 0);
+  CHECK(engine.size() <= tokens.size());
+  CHECK(tree.tag(0) == ast::Tag::Root);
+}
+
+TEST_CASE("Parser reports nesting too deep and recovers") {
+  auto nested = [](const std::string &open, const std::string &close) {
+    std::string text;
+    for (int i = 0; i < 100000; i++)
+      text += open;
+    text += "1";
+    for (int i = 0; i < 100000; i++)
+      text += close;
+    return text;
+  };
+  CHECK(recover_to_string(nested("(", ")") + "\ny") == "1: <error> y");
+  CHECK(recover_to_string(nested("- ", "") + "\ny") == "1: <error> y");
+  // A block recovers at the statement that went too deep, like any error
+  auto blocks = recover_to_string(nested("{", "}") + "\ny");
+  CHECK(blocks.starts_with("1: { { "));
+  CHECK(blocks.find("<error>") != std::string::npos);
+  CHECK(blocks.ends_with("} y"));
+  CHECK(recover_to_string(nested("[", "]") + "\n" + nested("(", ")")) ==
+        "2: <error> <error>");
+
+  // Deep but within the limit
+  std::string deep = std::string(parser::MAX_DEPTH - 1, '(') + "1" +
+                     std::string(parser::MAX_DEPTH - 1, ')');
+  CHECK(recover_to_string(deep).starts_with("0: "));
+}
+
+TEST_CASE("Parser builds statements and declarations") {
+  CHECK(parse_to_string("x := 1; y: int = x * 2; z: float") ==
+        "(let x _ 1); (let y int (* x 2)); (let z float _)");
+  CHECK(parse_to_string("if a { b } else if c { d }\nelse { e }") ==
+        "(if a { b } (if c { d } { e }))");
+  CHECK(parse_to_string("while i < 10 {\n  i += 1\n}") ==
+        "(while (< i 10) { (+= i 1) })");
+  CHECK(parse_to_string("for x in xs { print(x) }") ==
+        "(for x xs { (call print x) })");
+  CHECK(parse_to_string("add(a: int, b: int) -> int { return a + b }") ==
+        "(fn add (a:int b:int) int { (return (+ a b)) })");
+  CHECK(parse_to_string("class P {\n x: int\n get() -> int { return x }\n}") ==
+        "(class P (let x int _) (fn get () int { (return x) }))");
+  CHECK(parse_to_string("enum Color { Red,\n Green, Blue }") ==
+        "(enum Color Red Green Blue)");
+  CHECK(parse_to_string("f(x => { return x })") ==
+        "(call f (=> x { (return x) }))");
+}
+
+TEST_CASE("Flat tree exposes typed accessors") {
+  File file("while go { if x { return } }", "test.symph");
+  DiagnosticEngine engine;
+  auto tokens = Lexer(file, engine).lex();
+  auto tree = Parser(tokens, engine).parse();
+
+  REQUIRE(tree.items().size() == 1);
+  auto loop = tree.while_stmt(tree.items()[0]);
+  CHECK(tree.token_lexeme(tree.main_token(loop.condition)) == "go");
+
+  auto body = tree.list(loop.body);
+  REQUIRE(body.size() == 1);
+  auto branch = tree.if_stmt(body[0]);
+  CHECK(branch.otherwise == ast::NULL_NODE);
+
+  auto inner = tree.list(branch.then);
+  REQUIRE(inner.size() == 1);
+  CHECK(tree.tag(inner[0]) == ast::Tag::Return);
+  CHECK(tree.return_stmt(inner[0]).value == ast::NULL_NODE);
+
+  // Children always come before their parents
+  CHECK(loop.condition < tree.items()[0]);
+  CHECK(loop.body < tree.items()[0]);
+  CHECK(branch.then < body[0]);
+}
+
+namespace {
+
+std::string generate_module(size_t items) {
+  std::string source;
+  for (size_t i = 0; i < items; i++) {
+    auto n = std::to_string(i);
+    source += "class C" + n + " {\n  x: int = " + n + "\n";
+    source += "  get(k: int) -> int { return x * k + (k ** 2) // 3 }\n}\n";
+    source += "enum E" + n + " { A, B, C }\n";
+    source += "f" + n + "(a: int) -> int {\n  for i in xs { a += i }\n";
+    source += "  return a > 0 ? a : -a\n}\n";
+    source += "total := f" + n + "(" + n + ")\n";
+  }
+  return source;
+}
+
+} // namespace
+
+TEST_CASE("Thread pool nests parallel loops without deadlocking") {
+  ThreadPool pool(2);
+  std::atomic<size_t> sum = 0;
+
+  pool.parallel_for(8, [&](size_t) {
+    pool.parallel_for(100, [&](size_t j) { sum += j; });
+  });
+  CHECK(sum == 8 * 4950);
+
+  // Loose tasks are all done once `wait()` returns
+  for (size_t i = 0; i < 1000; i++)
+    pool.submit([&]() { sum++; });
+  pool.wait();
+  CHECK(sum == 8 * 4950 + 1000);
+}
+
+TEST_CASE("Top-level split starts a range at every declaration") {
+  File file("x := 1\nclass A { }\nf() { g() }\nf()\nenum E { A }", "t");
+  DiagnosticEngine engine;
+  auto tokens = Lexer(file, engine).lex();
+  std::vector<Token::Kind> kinds;
+  for (auto &t : tokens)
+    kinds.push_back(t.kind);
+
+  auto ranges = parser::split_top_level(kinds);
+  REQUIRE(ranges.size() == 4);
+  CHECK(tokens[ranges[1].begin].kind == Token::Kind::Class);
+  CHECK(tokens[ranges[2].begin].span.get_lexeme() == "f");
+  CHECK(tokens[ranges[3].begin].kind == Token::Kind::Enum);
+  CHECK(ranges[3].end == tokens.size() - 1);
+}
+
+TEST_CASE("Parallel parsing matches sequential parsing") {
+  File file(generate_module(400), "big.symph");
+  DiagnosticEngine engine;
+  auto tokens = Lexer(file, engine).lex();
+
+  DiagnosticEngine sequential_diags;
+  auto sequential = Parser(tokens, sequential_diags).parse();
+
+  ThreadPool pool(4);
+  DiagnosticEngine parallel_diags;
+  auto parallel = parser::parse_parallel(tokens, parallel_diags, pool);
+
+  CHECK(parallel_diags.size() == 0);
+  CHECK(parallel.items().size() == sequential.items().size());
+  CHECK(parallel.tags == sequential.tags);
+  CHECK(parallel.main_tokens == sequential.main_tokens);
+  CHECK(parallel.extra == sequential.extra);
+  REQUIRE(parallel.node_count() == sequential.node_count());
+  bool same_data = true;
+  for (size_t i = 0; i < parallel.node_count(); i++) {
+    same_data &= parallel.data[i].lhs == sequential.data[i].lhs;
+    same_data &= parallel.data[i].rhs == sequential.data[i].rhs;
+  }
+  CHECK(same_data);
+}
+
+TEST_CASE("Parallel parsing recovers the same way as sequential parsing") {
+  auto source = generate_module(200) + "broken(a: int) { a + }\n" +
+                generate_module(200) + "x := )\n" + generate_module(200);
+  File file(source, "big.symph");
+  DiagnosticEngine engine;
+  auto tokens = Lexer(file, engine).lex();
+
+  DiagnosticEngine sequential_diags;
+  auto sequential = Parser(tokens, sequential_diags).parse();
+
+  ThreadPool pool(4);
+  DiagnosticEngine parallel_diags;
+  auto parallel = parser::parse_parallel(tokens, parallel_diags, pool);
+
+  CHECK(sequential_diags.size() == 2);
+  CHECK(parallel_diags.size() == 2);
+  CHECK(parallel.items().size() == sequential.items().size());
+  CHECK(parallel.tags == sequential.tags);
+}
+
+TEST_CASE("XXH3 matches the reference implementation") {
+  CHECK(hash::xxh3_64("") == 0x2D06800538D394C2ull);
+  CHECK(hash::xxh3_64("a") == 0xE6C632B61E964E1Full);
+  CHECK(hash::xxh3_64("abc") == 0x78AF5F94892F3950ull);
+  CHECK(hash::xxh3_64("hello, world") == 0x302CD5FBA73D006Cull);
+  CHECK(hash::xxh3_64(std::string(100, 'x')) == 0xC90984FFDF50CE42ull);
+  CHECK(hash::xxh3_64(std::string(200, 'x')) == 0x50EF124FB1E4DE53ull);
+  CHECK(hash::xxh3_64(std::string(1000, 'x')) == 0xC0A4877B962CBA82ull);
+  CHECK(hash::xxh3_64(std::string(1000, 'x'), 42) == 0xCB10F5998C4773FFull);
+}
+
+namespace {
+
+std::string temporary_cache_directory(const std::string &name) {
+  auto path = std::filesystem::temp_directory_path() / name;
+  std::filesystem::remove_all(path);
+  return path.string();
+}
+
+} // namespace
+
+TEST_CASE("AST cache round-trips a module without copying it") {
+  File file(generate_module(50) + "broken := )\n", "cached.symph");
+  DiagnosticEngine engine;
+  auto tokens = Lexer(file, engine).lex();
+  auto tree = Parser(tokens, engine).parse();
+  REQUIRE(engine.size() == 1);
+
+  cache::Store store(temporary_cache_directory("symph_roundtrip"));
+  uint64_t key = cache::key_for(file, "");
+  REQUIRE(store.store(key, tree, engine));
+
+  auto module = store.load(key, file);
+  REQUIRE(module.has_value());
+  const auto &cached = module->tree();
+  CHECK(cached.tags.is_borrowed());
+  CHECK(cached.tags == tree.tags);
+  CHECK(cached.data.size() == tree.data.size());
+  CHECK(cached.extra == tree.extra);
+  CHECK(cached.token_kinds == tree.token_kinds);
+
+  std::stringstream a, b;
+  ast::print_node(a, tree, tree.items()[0]);
+  ast::print_node(b, cached, cached.items()[0]);
+  CHECK(a.str() == b.str());
+
+  auto name = cached.class_decl(cached.items()[0]).name;
+  CHECK(cached.token_lexeme(name) == "C0");
+
+  DiagnosticEngine replayed;
+  module->replay(replayed);
+  REQUIRE(replayed.size() == 1);
+  CHECK(replayed.begin()->print() == engine.begin()->print());
+  std::filesystem::remove_all(std::filesystem::temp_directory_path() /
+                              "symph_roundtrip");
+}
+
+TEST_CASE("AST cache keys follow the contents and the options") {
+  File file("x := 1\n", "a.symph");
+  File renamed("x := 1\n", "b.symph");
+  File edited("x := 2\n", "a.symph");
+
+  CHECK(cache::key_for(file, "") == cache::key_for(renamed, ""));
+  CHECK(cache::key_for(file, "") != cache::key_for(edited, ""));
+  CHECK(cache::key_for(file, "") != cache::key_for(file, "-O2"));
+
+  // A colliding key still can't return the wrong module
+  DiagnosticEngine engine;
+  auto tokens = Lexer(file, engine).lex();
+  auto tree = Parser(tokens, engine).parse();
+  cache::Store store(temporary_cache_directory("symph_stale"));
+  REQUIRE(store.store(1, tree, engine));
+  CHECK(store.load(1, file).has_value());
+  CHECK_FALSE(store.load(1, edited).has_value());
+  CHECK_FALSE(store.load(2, file).has_value());
+  std::filesystem::remove_all(std::filesystem::temp_directory_path() /
+                              "symph_stale");
+}
+
+TEST_CASE("AST cache ignores an entry whose body was damaged") {
+  File file(generate_module(5), "damaged.symph");
+  DiagnosticEngine engine;
+  auto tokens = Lexer(file, engine).lex();
+  auto tree = Parser(tokens, engine).parse();
+
+  cache::Store store(temporary_cache_directory("symph_damaged"));
+  REQUIRE(store.store(0, tree, engine));
+  REQUIRE(store.load(0, file).has_value());
+
+  // Flip every bit of one byte in the middle of the sections
+  auto path = store.path_for(0);
+  auto size = std::filesystem::file_size(path);
+  {
+    std::fstream entry(path, std::ios::in | std::ios::out | std::ios::binary);
+    auto at = static_cast<std::streamoff>(size / 2);
+    entry.seekg(at);
+    char byte = static_cast<char>(entry.get());
+    entry.seekp(at);
+    entry.put(static_cast<char>(~byte));
+  }
+  CHECK(std::filesystem::file_size(path) == size);
+  CHECK_FALSE(store.load(0, file).has_value());
+  std::filesystem::remove_all(std::filesystem::temp_directory_path() /
+                              "symph_damaged");
+}
+
+TEST_CASE("AST cache evicts the least recently used entries") {
+  namespace fs = std::filesystem;
+  std::vector<File> files;
+  for (char c : std::string("abc"))
+    files.emplace_back(std::string(1, c) + " := 1\n", "lru.symph");
+
+  auto directory = temporary_cache_directory("symph_lru");
+  cache::Store unbounded(directory);
+  std::vector<ast::Tree> trees;
+  for (auto &file : files) {
+    DiagnosticEngine engine;
+    auto tokens = Lexer(file, engine).lex();
+    trees.push_back(Parser(tokens, engine).parse());
+  }
+
+  DiagnosticEngine none;
+  REQUIRE(unbounded.store(0, trees[0], none));
+  REQUIRE(unbounded.store(1, trees[1], none));
+  auto entry_size = fs::file_size(unbounded.path_for(0));
+
+  // Make the first entry the oldest, then use it again
+  auto now = fs::file_time_type::clock::now();
+  fs::last_write_time(unbounded.path_for(0), now - std::chrono::hours(2));
+  fs::last_write_time(unbounded.path_for(1), now - std::chrono::hours(1));
+  CHECK(unbounded.load(0, files[0]).has_value());
+
+  cache::Store bounded(directory, entry_size * 2);
+  REQUIRE(bounded.store(2, trees[2], none));
+  CHECK(bounded.evict() == entry_size);
+  CHECK(fs::exists(bounded.path_for(0)));
+  CHECK_FALSE(fs::exists(bounded.path_for(1)));
+  CHECK(fs::exists(bounded.path_for(2)));
+  fs::remove_all(directory);
+}
+
+namespace {
+
+std::string green_text(const syntax::GreenNode *node) {
+  if (node->is_token())
+    return node->text;
+  std::string text;
+  for (auto *child : node->children)
+    text += green_text(child);
+  return text;
+}
+
+bool same_tokens_as_full_lex(const syntax::SyntaxTree &tree) {
+  DiagnosticEngine engine;
+  auto expected = Lexer(tree.get_file(), engine).lex();
+  auto actual = tree.tokens();
+  if (expected.size() != actual.size())
+    return false;
+
+  for (size_t i = 0; i < expected.size(); i++) {
+    if (expected[i].kind != actual[i].kind ||
+        expected[i].span.offset != actual[i].span.offset ||
+        expected[i].span.length != actual[i].span.length)
+      return false;
+  }
+  return true;
+}
+
+} // namespace
+
+TEST_CASE("Syntax tree is lossless and hash-consed") {
+  std::string source = "# header\nclass A { x: int }\nclass A { x: int }\n"
+                       "f(a: int) {\n  return a  # done\n}\n";
+  syntax::SyntaxTree tree(source, "test.symph");
+
+  CHECK(green_text(tree.get_green_root()) == source);
+  CHECK(same_tokens_as_full_lex(tree));
+
+  // The comment's newline, both classes, the function and the end of file.
+  // Both classes are textually identical and therefore the same node
+  auto items = tree.get_green_root()->children;
+  REQUIRE(items.size() == 5);
+  CHECK(items[1] == items[2]);
+
+  auto position = static_cast<uint32_t>(source.find("return"));
+  auto token = tree.get_root().token_at(position);
+  REQUIRE(token.has_value());
+  CHECK(token->token_kind() == Token::Kind::Return);
+  CHECK(token->get_span(tree.get_file()).get_lexeme() == "return");
+}
+
+TEST_CASE("Syntax tree edits inside a group only rebuild the spine") {
+  std::string source = "class A {\n  x: int\n}\n"
+                       "f(a: int) -> int {\n  return a + 1\n}\n"
+                       "enum E { One, Two }\n";
+  syntax::SyntaxTree tree(source, "test.symph");
+  auto before = tree.get_green_root()->children;
+
+  auto position = source.find("a + 1") + 4;
+  CHECK(tree.edit(position, 1, "22"));
+  source.replace(position, 1, "22");
+
+  auto after = tree.get_green_root()->children;
+  REQUIRE(after.size() == before.size());
+  CHECK(after[0] == before[0]);
+  CHECK(after[1] != before[1]);
+  CHECK(after[2] == before[2]);
+  CHECK(green_text(tree.get_green_root()) == source);
+  CHECK(tree.get_file().content == source);
+  CHECK(same_tokens_as_full_lex(tree));
+}
+
+TEST_CASE("Syntax tree falls back to a full relex when structure changes") {
+  std::string source = "f() {\n  g()\n}\nh() { }\n";
+  syntax::SyntaxTree tree(source, "test.symph");
+  auto before = tree.get_green_root()->children;
+
+  // Unbalances the braces of the first function
+  auto position = source.find("g()");
+  CHECK_FALSE(tree.edit(position, 0, "{"));
+  source.insert(position, 1, '{');
+  CHECK(green_text(tree.get_green_root()) == source);
+  CHECK(same_tokens_as_full_lex(tree));
+
+  // Starting a string that would run into the closer can't be done locally
+  syntax::SyntaxTree strings("f() { x }", "test.symph");
+  CHECK_FALSE(strings.edit(6, 0, "\""));
+  CHECK(same_tokens_as_full_lex(strings));
+
+  // Edits outside any group relex only their item
+  syntax::SyntaxTree top("a := 1\nf() { g() }\n", "test.symph");
+  auto kept = top.get_green_root()->children[1];
+  CHECK(top.edit(0, 1, "b"));
+  CHECK(top.get_green_root()->children[1] == kept);
+  CHECK(same_tokens_as_full_lex(top));
+
+  // An item that stops being a declaration merges into the one before it
+  syntax::SyntaxTree merged("a := 1\nclass A { }\n", "test.symph");
+  CHECK_FALSE(merged.edit(7, 5, "klass"));
+  CHECK(merged.get_green_root()->children.size() == 2);
+  CHECK(same_tokens_as_full_lex(merged));
+}
+
+TEST_CASE("Files index their line starts") {
+  File file("ab\ncd\n\nef", "lines.symph");
+  CHECK(file.line_starts == std::vector<uint32_t>{0, 3, 6, 7});
+  CHECK(file.line_of(0) == 1);
+  CHECK(file.line_of(2) == 1);
+  CHECK(file.line_of(3) == 2);
+  CHECK(file.line_of(6) == 3);
+  CHECK(file.line_of(8) == 4);
+
+  Span span(file, 8, 1);
+  CHECK(span.get_line_number() == 4);
+  CHECK(span.get_column_number() == 2);
+}
+
+TEST_CASE("Warm sessions reuse unchanged files across builds") {
+  namespace fs = std::filesystem;
+  auto directory = temporary_cache_directory("symph_session");
+  fs::create_directories(directory);
+  auto path = (fs::path(directory) / "warm.symph").string();
+  std::ofstream(path) << "x := 1 * * 2\n";
+
+  driver::Options options;
+  options.inputs = {"warm.symph"};
+  options.use_cache = false;
+  options.jobs = 2;
+  driver::Session session(options, true);
+
+  std::string err;
+  auto emit = [&](driver::Channel channel, std::string_view text) {
+    if (channel == driver::Channel::Err)
+      err += text;
+  };
+
+  CHECK(session.build(options, directory, emit) == 1);
+  CHECK(session.remembered() == 1);
+  auto first = err;
+  CHECK(first.find("warm.symph:1:10") != std::string::npos);
+
+  err.clear();
+  CHECK(session.build(options, directory, emit) == 1);
+  CHECK(session.remembered() == 1);
+  CHECK(err == first);
+
+  // Same size and, at this resolution, maybe the same time: only the
+  // contents can tell this edit apart
+  std::ofstream(path) << "x := 1 + 2 *\n";
+  err.clear();
+  CHECK(session.build(options, directory, emit) == 1);
+  CHECK(err != first);
+
+  std::ofstream(path) << "x := 1 + 2\n";
+  err.clear();
+  CHECK(session.build(options, directory, emit) == 0);
+  CHECK(err.empty());
+  fs::remove_all(directory);
+}
+
+TEST_CASE("Queries only run again once what they read has changed") {
+  query::Engine engine;
+  query::Input<std::string, int> numbers(engine);
+  std::unordered_map<std::string, int> parity_runs;
+  std::unordered_map<std::string, int> label_runs;
+
+  query::Query<std::string, int> parity(engine, [&](const std::string &key) {
+    parity_runs[key]++;
+    return numbers.get(key) % 2;
+  });
+  query::Query<std::string, std::string> label(
+      engine, [&](const std::string &key) {
+        label_runs[key]++;
+        return std::string(parity.get(key) == 0 ? "even" : "odd");
+      });
+
+  numbers.set("a", 1);
+  numbers.set("b", 2);
+  CHECK(label.get("a") == "odd");
+  CHECK(label.get("b") == "even");
+  CHECK(label.get("a") == "odd");
+  CHECK(parity_runs["a"] == 1);
+  CHECK(label_runs["a"] == 1);
+
+  // An equal value is no change at all
+  auto revision = engine.current();
+  numbers.set("a", 1);
+  CHECK(engine.current() == revision);
+
+  // Only what reads `a` runs again; `b` is found green
+  numbers.set("a", 4);
+  CHECK(label.get("a") == "even");
+  CHECK(label.get("b") == "even");
+  CHECK(parity_runs["a"] == 2);
+  CHECK(label_runs["a"] == 2);
+  CHECK(parity_runs["b"] == 1);
+  CHECK(label_runs["b"] == 1);
+  CHECK(engine.statistics().reused == 2);
+
+  // The parity comes out the same, so the label that reads it stays green
+  numbers.set("a", 6);
+  CHECK(label.get("a") == "even");
+  CHECK(parity_runs["a"] == 3);
+  CHECK(label_runs["a"] == 2);
+}
+
+TEST_CASE("A query asked for by many threads at once runs once") {
+  query::Engine engine;
+  query::Input<int, int> numbers(engine);
+  std::atomic<int> runs = 0;
+  query::Query<int, int> square(engine, [&](const int &key) {
+    runs++;
+    int n = numbers.get(key);
+    return n * n;
+  });
+  for (int i = 0; i < 8; i++)
+    numbers.set(i, i);
+
+  ThreadPool pool(4);
+  std::atomic<int> total = 0;
+  pool.parallel_for(256, [&](size_t i) { total += square.get(i % 8); });
+  CHECK(runs == 8);
+  CHECK(total == 32 * 140);
+
+  numbers.set(3, 4);
+  total = 0;
+  pool.parallel_for(256, [&](size_t i) { total += square.get(i % 8); });
+  CHECK(runs == 9);
+  CHECK(total == 32 * 147);
+}
+
+TEST_CASE("A query doesn't depend on pool tasks it runs while waiting") {
+  query::Engine engine;
+  query::Input<std::string, int> numbers(engine);
+  numbers.set("mine", 1);
+  numbers.set("theirs", 2);
+
+  // Keep the only worker busy, so the query's thread is the one to pick up
+  // the other task
+  ThreadPool pool(1);
+  std::atomic<bool> started = false, release = false;
+  pool.submit([&]() {
+    started = true;
+    while (!release)
+      std::this_thread::yield();
+  });
+  while (!started)
+    std::this_thread::yield();
+
+  int runs = 0;
+  query::Query<std::string, int> waiting(engine, [&](const std::string &) {
+    // Only the first run is sure the worker is still busy
+    if (runs++ == 0) {
+      pool.submit([&]() { numbers.get("theirs"); });
+      CHECK(pool.run_one());
+    }
+    return numbers.get("mine");
+  });
+  CHECK(waiting.get("") == 1);
+  release = true;
+  pool.wait();
+
+  numbers.set("theirs", 3);
+  CHECK(waiting.get("") == 1);
+  CHECK(runs == 1);
+  numbers.set("mine", 4);
+  CHECK(waiting.get("") == 4);
+  CHECK(runs == 2);
+}
+
+TEST_CASE("A query that throws is worked out again on the next ask") {
+  query::Engine engine;
+  query::Input<std::string, int> numbers(engine);
+  numbers.set("a", 1);
+
+  int runs = 0;
+  query::Query<std::string, int> flaky(engine, [&](const std::string &key) {
+    if (runs++ == 0)
+      throw std::runtime_error("flaky");
+    return numbers.get(key) + 1;
+  });
+  query::Query<std::string, int> reader(
+      engine, [&](const std::string &key) { return flaky.get(key) * 10; });
+
+  // Every query on the way out is left to run again, not Running for good
+  CHECK_THROWS_AS(reader.get("a"), std::runtime_error);
+  CHECK(reader.get("a") == 20);
+  CHECK(runs == 2);
+
+  // Another thread asking for it doesn't wait forever either
+  runs = 0;
+  numbers.set("a", 2);
+  CHECK_THROWS_AS(reader.get("a"), std::runtime_error);
+  int seen = 0;
+  std::thread other([&]() { seen = reader.get("a"); });
+  other.join();
+  CHECK(seen == 30);
+  CHECK(runs == 2);
+}
+
+TEST_CASE("JSON parses and prints what LSP sends") {
+  auto value = json::parse(R"({"id": 3, "params": {
+    "text": "a\n\"\u00e9\ud83d\ude00", "ok": [true, null, -1.5e2]}})");
+  REQUIRE(value.has_value());
+  CHECK((*value)["id"].as_integer() == 3);
+  CHECK(*(*value)["params"]["text"].as_string() ==
+        "a\n\"\xC3\xA9\xF0\x9F\x98\x80");
+  CHECK((*value)["params"]["ok"].as_array()->size() == 3);
+  CHECK((*value)["missing"]["deeper"].is_null());
+  CHECK_FALSE(json::Value(2.5).as_integer());
+  CHECK(json::Value(-0x1p63).as_integer() == INT64_MIN);
+  CHECK_FALSE(json::Value(0x1p63).as_integer());
+  CHECK_FALSE(json::Value(1e300).as_integer());
+  CHECK(json::dump(*value) ==
+        R"({"id":3,"params":{"text":"a\n\")"
+        "\xC3\xA9\xF0\x9F\x98\x80"
+        R"(","ok":[true,null,-150]}})");
+
+  CHECK_FALSE(json::parse("{\"a\": }").has_value());
+  CHECK_FALSE(json::parse("[1, 2] 3").has_value());
+  CHECK_FALSE(json::parse(std::string(1000, '[')).has_value());
+}
+
+TEST_CASE("Language server positions count UTF-16 code units") {
+  std::string text = "a\xC3\xA9" "b\n\xF0\x9F\x98\x80x\n";
+  Rope rope(text);
+  CHECK(lsp::offset_of(rope, {0, 2}) == 3);
+  CHECK(lsp::offset_of(rope, {0, 99}) == 4);
+  CHECK(lsp::offset_of(rope, {1, 2}) == 9);
+  CHECK(lsp::offset_of(rope, {7, 0}) == text.size());
+
+  File file(text, "test.symph");
+  auto position = lsp::position_of(file, 9);
+  CHECK(position.line == 1);
+  CHECK(position.character == 2);
+}
+
+TEST_CASE("Language server publishes diagnostics as documents change") {
+  std::mutex mutex;
+  std::vector<json::Value> sent;
+  lsp::Server server(
+      [&](std::string_view text) {
+        std::lock_guard lock(mutex);
+        sent.push_back(*json::parse(text));
+      },
+      std::chrono::milliseconds(0));
+
+  auto last_diagnostics = [&]() {
+    std::lock_guard lock(mutex);
+    REQUIRE(!sent.empty());
+    CHECK(*sent.back()["method"].as_string() ==
+          "textDocument/publishDiagnostics");
+    return sent.back()["params"];
+  };
+
+  CHECK(server.handle(R"({"jsonrpc":"2.0","id":1,"method":"initialize"})"));
+  server.wait_idle();
+  CHECK(sent.at(0)["result"]["capabilities"]["textDocumentSync"]["change"]
+            .as_integer() == 2);
+
+  CHECK(server.handle(R"({"jsonrpc":"2.0","method":"textDocument/didOpen",
+    "params":{"textDocument":{"uri":"file:///a.symph","version":1,
+    "text":"class A {\n  x: int\n}\ny := 1 * * 2\n"}}})"));
+  server.wait_idle();
+  auto params = last_diagnostics();
+  CHECK(params["version"].as_integer() == 1);
+  REQUIRE(params["diagnostics"].as_array()->size() == 1);
+  auto &range = params["diagnostics"].as_array()->at(0)["range"];
+  CHECK(range["start"]["line"].as_integer() == 3);
+  CHECK(range["start"]["character"].as_integer() == 9);
+
+  // Deleting the stray `*` fixes the file
+  CHECK(server.handle(R"({"jsonrpc":"2.0","method":"textDocument/didChange",
+    "params":{"textDocument":{"uri":"file:///a.symph","version":2},
+    "contentChanges":[{"range":{"start":{"line":3,"character":9},
+    "end":{"line":3,"character":11}},"text":""}]}})"));
+  server.wait_idle();
+  params = last_diagnostics();
+  CHECK(params["version"].as_integer() == 2);
+  CHECK(params["diagnostics"].as_array()->empty());
+
+  // A version LSP can't send is no change at all
+  size_t published = sent.size();
+  CHECK(server.handle(R"({"jsonrpc":"2.0","method":"textDocument/didChange",
+    "params":{"textDocument":{"uri":"file:///a.symph","version":1e300},
+    "contentChanges":[{"text":"y := 1 * * 2\n"}]}})"));
+  server.wait_idle();
+  {
+    std::lock_guard lock(mutex);
+    CHECK(sent.size() == published);
+  }
+
+  // Nor is a range without an end, rather than a new document
+  CHECK(server.handle(R"({"jsonrpc":"2.0","method":"textDocument/didChange",
+    "params":{"textDocument":{"uri":"file:///a.symph","version":3},
+    "contentChanges":[{"range":{"start":{"line":0,"character":0}},
+    "text":"!"}]}})"));
+  server.wait_idle();
+  {
+    std::lock_guard lock(mutex);
+    REQUIRE(sent.size() == published + 1);
+    CHECK(*sent.back()["method"].as_string() == "window/logMessage");
+  }
+
+  // The document is still the one before it
+  CHECK(server.handle(R"({"jsonrpc":"2.0","method":"textDocument/didChange",
+    "params":{"textDocument":{"uri":"file:///a.symph","version":4},
+    "contentChanges":[{"range":{"start":{"line":3,"character":9},
+    "end":{"line":3,"character":9}},"text":"* "}]}})"));
+  server.wait_idle();
+  params = last_diagnostics();
+  REQUIRE(params["diagnostics"].as_array()->size() == 1);
+  CHECK(params["diagnostics"].as_array()->at(0)["range"]["start"]["line"]
+            .as_integer() == 3);
+
+  CHECK(server.handle(R"({"jsonrpc":"2.0","id":2,"method":"hover"})"));
+  CHECK(server.handle(R"({"jsonrpc":"2.0","id":3,"method":"shutdown"})"));
+  CHECK_FALSE(server.handle(R"({"jsonrpc":"2.0","method":"exit"})"));
+  CHECK(server.exit_status() == 0);
+  std::lock_guard lock(mutex);
+  CHECK(sent.at(sent.size() - 2)["error"]["code"].as_integer() == -32601);
+}
+
+TEST_CASE("Rope edits match the same edits on a string") {
+  std::string expected;
+  for (int i = 0; i < 300; i++)
+    expected += "line " + std::to_string(i) + "\n";
+  Rope rope(expected);
+
+  // A deterministic mix of typing, deleting and pasting across chunks
+  uint32_t state = 1;
+  auto next = [&](uint32_t bound) {
+    state = state * 1103515245 + 12345;
+    return (state >> 8) % bound;
+  };
+  for (int step = 0; step < 500; step++) {
+    size_t offset = next(static_cast<uint32_t>(expected.size() + 1));
+    size_t removed = std::min<size_t>(next(step % 50 == 0 ? 3000 : 4),
+                                      expected.size() - offset);
+    std::string inserted(next(step % 40 == 0 ? 2500 : 3), 'x');
+    if (!inserted.empty() && step % 3 == 0)
+      inserted.back() = '\n';
+
+    expected.replace(offset, removed, inserted);
+    rope.replace(offset, removed, inserted);
+  }
+
+  REQUIRE(rope.materialize() == expected);
+  for (auto chunk : rope.chunks(0, rope.size()))
+    CHECK(chunk.size() <= Rope::MAX_CHUNK);
+
+  File file(expected, "rope.symph");
+  REQUIRE(rope.line_count() == file.line_starts.size());
+  for (size_t line = 0; line < file.line_starts.size(); line += 7)
+    CHECK(rope.line_start(line) == file.line_starts[line]);
+  CHECK(rope.line_start(file.line_starts.size()) == expected.size());
+  for (size_t offset = 0; offset <= expected.size(); offset += 13)
+    CHECK(rope.line_of(offset) == file.line_of(offset));
+  CHECK(rope.substr(100, 2000) == expected.substr(100, 2000));
+}
+
+TEST_CASE("Arena rewinds to a mark and reuses the blocks it gave up") {
+  Arena arena;
+  arena.allocate(16, 8);
+  auto mark = arena.mark();
+  void *first = arena.allocate(Arena::DEFAULT_BLOCK_SIZE, 8);
+  arena.allocate(64, 8);
+  arena.rewind(mark);
+  CHECK(arena.bytes_used() == mark.used);
+
+  // The block added after the mark is handed out again rather than freed
+  CHECK(arena.allocate(Arena::DEFAULT_BLOCK_SIZE, 8) == first);
+}
+
+TEST_CASE("String interner hands out dense, stable symbols") {
+  StringInterner names;
+  Symbol a = names.intern("alpha");
+  Symbol b = names.intern("beta");
+  CHECK(a == 0);
+  CHECK(b == 1);
+  CHECK(names.intern("alpha") == a);
+  CHECK(names.find("gamma") == StringInterner::NO_SYMBOL);
+
+  // Growing the table keeps every symbol and name
+  for (int i = 0; i < 1000; i++)
+    names.intern("name" + std::to_string(i));
+  CHECK(names.size() == 1002);
+  CHECK(names.find("name999") == 1001);
+  CHECK(names.name(a) == "alpha");
+  CHECK(names.name(b) == "beta");
+}
+
+TEST_CASE("Scope stack shadows, grows and pops whole scopes") {
+  sema::ScopeStack<int> scopes;
+  scopes.push();
+  scopes.declare(1, 10);
+  scopes.declare(2, 20);
+
+  scopes.push();
+  scopes.declare(1, 11);
+  CHECK(*scopes.lookup(1) == 11);
+  CHECK(*scopes.lookup(2) == 20);
+  CHECK(scopes.lookup_local(2) == nullptr);
+
+  // Past the inline entries the scope moves into a hash table
+  for (Symbol symbol = 100; symbol < 200; symbol++)
+    scopes.declare(symbol, static_cast<int>(symbol));
+  scopes.declare(150, -1);
+  CHECK(*scopes.lookup(1) == 11);
+  CHECK(*scopes.lookup(150) == -1);
+  CHECK(*scopes.lookup(199) == 199);
+  CHECK(scopes.depth() == 2);
+
+  scopes.pop();
+  CHECK(scopes.depth() == 1);
+  CHECK(*scopes.lookup(1) == 10);
+  CHECK(scopes.lookup(150) == nullptr);
+}
+
+namespace {
+
+/// The names `resolve()` reports as undefined, in order
+std::string undefined_names(const std::string &source) {
+  File file(source, "test.symph");
+  DiagnosticEngine engine;
+  auto tokens = Lexer(file, engine).lex();
+  auto tree = Parser(tokens, engine).parse();
+  REQUIRE(engine.size() == 0);
+
+  StringInterner names;
+  sema::resolve(tree, names, engine);
+  std::string out;
+  for (auto &diagnostic : engine) {
+    CHECK(diagnostic.kind == diagnostic::Kind::UndefinedName);
+    if (!out.empty())
+      out += " ";
+    out += file.content.substr(diagnostic.span.offset, diagnostic.span.length);
+  }
+  return out;
+}
+
+} // namespace
+
+TEST_CASE("Resolver reports names that nothing declares") {
+  CHECK(undefined_names("x := 1\nprint(x + y)") == "y");
+  CHECK(undefined_names("print(x)\nx := 1") == "x");
+  CHECK(undefined_names("x := x") == "x");
+  CHECK(undefined_names("{ a := 1 }\na") == "a");
+  CHECK(undefined_names("for i in range(3) { print(i) }\ni") == "i");
+  CHECK(undefined_names("f := (a, b) => a + b + c") == "c");
+  CHECK(undefined_names("v: List[int] = [1]; w: Missing") == "Missing");
+  CHECK(undefined_names("p := P(); p.anything") == "P");
+}
+
+TEST_CASE("Resolver lets declarations be used before they appear") {
+  CHECK(undefined_names("main() { helper(limit) }\n"
+                        "helper(n: int) -> int { return n }\n"
+                        "limit := 3")
+            .empty());
+  CHECK(undefined_names("class P {\n get() -> int { return x + y() }\n"
+                        " x: int\n y() -> int { return 1 }\n}\n"
+                        "enum E { A }\nq: P = P(E)")
+            .empty());
+  CHECK(undefined_names("class P {\n x: int\n}\nx") == "x");
+
+  File file("n := 1\nf(n: int) { n }\nn", "test.symph");
+  DiagnosticEngine engine;
+  auto tokens = Lexer(file, engine).lex();
+  auto tree = Parser(tokens, engine).parse();
+  StringInterner names;
+  auto resolution = sema::resolve(tree, names, engine);
+  CHECK(engine.size() == 0);
+
+  auto items = tree.items();
+  auto fn = tree.fn_decl(items[1]);
+  auto use = tree.list(fn.body)[0];
+  CHECK(resolution[use].kind == sema::Binding::Kind::Parameter);
+  CHECK(resolution[use].target == fn.params[0]);
+  CHECK(resolution[items[2]].kind == sema::Binding::Kind::Variable);
+  CHECK(resolution[items[2]].target == items[0]);
+}
+
+TEST_CASE("Type interner gives structurally equal types one ID") {
+  using sema::Primitive, sema::type_of;
+  StringInterner names;
+  sema::TypeInterner types;
+  sema::TypeId i = type_of(Primitive::Int);
+  sema::TypeId s = type_of(Primitive::Str);
+
+  sema::TypeId ints = types.array(i);
+  CHECK(types.array(i) == ints);
+  CHECK(types.array(s) != ints);
+
+  sema::TypeId params[] = {i, ints};
+  sema::TypeId fn = types.function(params, s);
+  sema::TypeId same[] = {i, types.array(i)};
+  CHECK(types.function(same, s) == fn);
+  CHECK(types.function(params, i) != fn);
+  CHECK(types.params(fn).size() == 2);
+  CHECK(types.result(fn) == s);
+
+  // Classes are nominal: the same name declared twice is two types
+  Symbol point = names.intern("Point");
+  CHECK(types.class_type(point, 7) == types.class_type(point, 7));
+  CHECK(types.class_type(point, 7) != types.class_type(point, 9));
+  CHECK(types.class_type(point, 7) != types.enum_type(point, 7));
+
+  sema::TypeId list = types.generic(names.intern("List"), params);
+  CHECK(types.to_string(list, names) == "List[int, [int]]");
+  CHECK(types.to_string(fn, names) == "(int, [int]) -> str");
+  sema::TypeId callback = types.function(std::span(&fn, 1), i);
+  CHECK(types.to_string(callback, names) == "((int, [int]) -> str) -> int");
+  CHECK(types.to_string(types.function(std::span(&i, 1), i), names) ==
+        "int -> int");
+}
+
+TEST_CASE("Type interner agrees with itself across threads") {
+  sema::TypeInterner types;
+  ThreadPool pool(4);
+  constexpr size_t DEPTH = 200;
+  std::vector<std::vector<sema::TypeId>> seen(8);
+
+  // Every task builds the same nest of types, racing the others to add them
+  pool.parallel_for(seen.size(), [&](size_t task) {
+    sema::TypeId type = sema::type_of(sema::Primitive::Float);
+    for (size_t i = 0; i < DEPTH; i++) {
+      type = i % 2 ? types.array(type)
+                   : types.function(std::span(&type, 1), type);
+      seen[task].push_back(type);
+    }
+  });
+
+  for (auto &ids : seen)
+    CHECK(ids == seen[0]);
+  CHECK(types.size() == DEPTH);
+}
+
+namespace {
+
+/// Every diagnostic checking `source` reports, one message per line
+std::string type_errors(const std::string &source, size_t threads = 2) {
+  File file(source, "test.symph");
+  DiagnosticEngine engine;
+  auto tokens = Lexer(file, engine).lex();
+  auto tree = Parser(tokens, engine).parse();
+  REQUIRE(engine.size() == 0);
+
+  StringInterner names;
+  sema::TypeInterner types;
+  ThreadPool pool(threads);
+  auto resolution = sema::resolve(tree, names, engine);
+  sema::check(tree, resolution, names, types, engine, pool);
+
+  std::string out;
+  for (auto &diagnostic : engine) {
+    out += diagnostic.message;
+    out += "\n";
+  }
+  return out;
+}
+
+
+/// @brief What every top-level variable folds to, one `name = value` per
+/// line with `?` for unknown, followed by the diagnostics of folding.
+std::string folded(const std::string &source) {
+  File file(source, "test.symph");
+  DiagnosticEngine engine;
+  auto tokens = Lexer(file, engine).lex();
+  auto tree = Parser(tokens, engine).parse();
+  StringInterner names;
+  sema::TypeInterner types;
+  ThreadPool pool(2);
+  auto resolution = sema::resolve(tree, names, engine);
+  auto typing = sema::check(tree, resolution, names, types, engine, pool);
+  REQUIRE(engine.size() == 0);
+  auto folding = sema::fold(tree, resolution, typing, engine);
+
+  std::ostringstream out;
+  for (ast::NodeIndex item : tree.items()) {
+    if (tree.tag(item) != ast::Tag::VarDecl)
+      continue;
+    out << tree.token_lexeme(tree.main_token(item)) << " = ";
+    const sema::Constant &constant = folding[item];
+    switch (constant.kind) {
+    case sema::Constant::Kind::Unknown:
+      out << "?";
+      break;
+    case sema::Constant::Kind::Int:
+      out << constant.integer;
+      break;
+    case sema::Constant::Kind::Float:
+      out << constant.real;
+      break;
+    case sema::Constant::Kind::Bool:
+      out << (constant.boolean ? "true" : "false");
+      break;
+    }
+    out << "\n";
+  }
+  for (auto &diagnostic : engine)
+    out << diagnostic.message << "\n";
+  return out.str();
+}
+
+} // namespace
+
+TEST_CASE("Checker accepts well-typed code") {
+  CHECK(type_errors("x := 1 + 2.5\ny: float = 3\nz := x / 2 > y || ~true\n"
+                    "s := \"a\" + \"b\"\nn := len(s) + int(x) as int") ==
+        "");
+  CHECK(type_errors("class P {\n x: int = 1\n"
+                    " get(k: int) -> int { return x * k }\n}\n"
+                    "enum E { A, B }\n"
+                    "use(p: P, e: E) -> [int] {\n"
+                    "  for i in range(p.get(2)) { p.x += i }\n"
+                    "  f := (a, b) => a\n"
+                    "  return [p.x, f(1, 2)]\n}\n"
+                    "e := E.A\nxs: List[int] = use(P(), e)") == "");
+}
+
+TEST_CASE("Checker reports mismatched types") {
+  CHECK(type_errors("x := 1 + \"a\"") ==
+        "Cannot apply '+' to int and str\n");
+  CHECK(type_errors("x: int = 1.5") == "Cannot assign float to int\n");
+  CHECK(type_errors("if 1 { }") == "Expected a bool condition, got int\n");
+  CHECK(type_errors("f(a: int) -> str { return a }\nf(\"x\")") ==
+        "Expected int, got str\nExpected to return str, got int\n");
+  CHECK(type_errors("f(a: int) { }\nf()") == "Expected 1 arguments, got 0\n");
+  CHECK(type_errors("class P { x: int }\np := P(1, 2)\np.x") ==
+        "Expected 0 arguments, got 2\n");
+  CHECK(type_errors("class P { }\np := P()\np.y") ==
+        "P has no member 'y'\n");
+  CHECK(type_errors("enum E { A }\nE.B") == "E has no member 'B'\n");
+  CHECK(type_errors("for c in 3 { }") == "Cannot iterate over int\n");
+  CHECK(type_errors("g := print\nx: print") == "'print' is not a type\n");
+  CHECK(type_errors("h: (int, str) -> [bool] = 1") ==
+        "Cannot assign int to (int, str) -> [bool]\n");
+}
+
+TEST_CASE("Checker reports the same diagnostics however bodies are run") {
+  std::string source;
+  // Enough bodies to be split over several tasks
+  for (int i = 0; i < 600; i++) {
+    auto n = std::to_string(i);
+    source += "f" + n + "(a: int) -> int {\n  b: str = a\n  return b\n}\n";
+    source += "class C" + n + " {\n  m() -> bool { return 1 }\n}\n";
+  }
+
+  auto sequential = type_errors(source, 1);
+  CHECK(std::count(sequential.begin(), sequential.end(), '\n') == 1800);
+  CHECK(sequential.starts_with("Cannot assign int to str\n"
+                               "Expected to return int, got str\n"
+                               "Expected to return bool, got int\n"));
+  for (int run = 0; run < 5; run++)
+    CHECK(type_errors(source, 4) == sequential);
+}
+
+TEST_CASE("Folding follows the language's arithmetic") {
+  CHECK(folded("a := 7 // 2\nb := -7 // 2\nc := -7 % 3\nd := 7 % -3\n"
+               "e := 7 / 2\nf := 2 ** 10\ng := 1 + 2 * 3 - 4\n"
+               "h := 7.5 // 2\ni := -7.5 % 2\nj := 3 > 2 && 1.5 <= 1\n"
+               "k := ~false || 1 < 2\nl := 6 & 3 | 8\nm := 2 ** 0.5 > 1.4") ==
+        "a = 3\nb = -4\nc = 2\nd = -2\ne = 3.5\nf = 1024\ng = 3\nh = 3\n"
+        "i = 0.5\nj = false\nk = true\nl = 10\nm = true\n");
+}
+
+TEST_CASE("Folding propagates variables nothing assigns to") {
+  CHECK(folded("n := 4\nm := n * n\nv := 1\nv = 2\nw := v + 1\n"
+               "r: float = 1\ns := (n as float) / 8\n"
+               "t := n > 3 ? 10 : 20\nu := n / n > 0.5 ? n : 2.5\n"
+               "f(x: int) -> int { return x + n }\nc := f(1)") ==
+        "n = 4\nm = 16\nv = 1\nw = ?\nr = 1\ns = 0.5\nt = 10\nu = 4\n"
+        "c = ?\n");
+}
+
+TEST_CASE("Folding reports division by zero and overflow") {
+  CHECK(folded("a := 1 / 0") ==
+        "a = ?\nThe right side of '/' is always zero\n");
+  CHECK(folded("z := 0.0\nb := 5 % z") ==
+        "z = 0\nb = ?\nThe right side of '%' is always zero\n");
+  CHECK(folded("x := 5\nx //= 0") ==
+        "x = 5\nThe right side of '//=' is always zero\n");
+  CHECK(folded("c := 9223372036854775807 + 1") ==
+        "c = ?\n'+' overflows a 64-bit int here\n");
+  CHECK(folded("d := 3 ** 40") == "d = ?\n'**' overflows a 64-bit int here\n");
+  CHECK(folded("n := 2 ** -1\nm := 2\nm **= -1") ==
+        "n = ?\nm = 2\n'**' raises an int to a negative power, which isn't "
+        "an int\n'**=' raises an int to a negative power, which isn't an "
+        "int\n");
+  CHECK(folded("e := -9223372036854775807 - 1\nf := e // -1") ==
+        "e = -9223372036854775808\nf = ?\n"
+        "'//' overflows a 64-bit int here\n");
+  CHECK(folded("g := 99999999999999999999") ==
+        "g = ?\n'99999999999999999999' doesn't fit in a 64-bit int\n");
+
+  // Ruled out by a constant condition, so never run
+  CHECK(folded("z := 0\nh := z != 0 ? 10 / z : 0\ni := false && 1 // z > 0\n"
+               "if z > 0 { print(1 / z) }\nwhile false { z / 0 }") ==
+        "z = 0\nh = 0\ni = false\n");
+}
+
+namespace {
+
+/// @brief Checks, folds and compiles `source`, which must be free of errors
+/// up to compilation, and returns the program or the compiler's messages.
+std::unique_ptr<vm::Program> compiled(const File &file, std::string &messages) {
+  DiagnosticEngine engine;
+  auto tokens = Lexer(file, engine).lex();
+  auto tree = Parser(tokens, engine).parse();
+  StringInterner names;
+  sema::TypeInterner types;
+  ThreadPool pool(2);
+  auto resolution = sema::resolve(tree, names, engine);
+  auto typing = sema::check(tree, resolution, names, types, engine, pool);
+  auto folding = sema::fold(tree, resolution, typing, engine);
+  REQUIRE(engine.size() == 0);
+  auto program = vm::compile(tree, resolution, typing, folding, types, engine);
+  for (auto &diagnostic : engine)
+    messages += diagnostic.message + "\n";
+  return program;
+}
+
+/// @brief What running `source` prints, followed by the message of the
+/// runtime error it stopped at, if any. With `jit` set, functions are
+/// translated to native code the first time they could be entered.
+std::string ran(const std::string &source, bool jit = false) {
+  File file(source, "test.symph");
+  std::string out;
+  auto program = compiled(file, out);
+  if (!program)
+    return out;
+  DiagnosticEngine engine;
+  vm::Machine machine(*program, [&](std::string_view text) { out += text; });
+  if (jit)
+    machine.enable_jit(1);
+  machine.run(engine);
+  for (auto &diagnostic : engine)
+    out += "error: " + diagnostic.message + "\n";
+  return out;
+}
+
+std::string disassembled(const std::string &source) {
+  File file(source, "test.symph");
+  std::string messages;
+  auto program = compiled(file, messages);
+  REQUIRE(program);
+  return vm::disassemble(*program);
+}
+
+} // namespace
+
+TEST_CASE("Machine runs arithmetic, loops and calls") {
+  CHECK(ran("print(1 + 2 * 3, 7 // -2, -7 % 3, 7 / 2, 2 ** 10, 2.0 ** -1)") ==
+        "7 -4 2 3.5 1024 0.5\n");
+  // A function can run before a global it reads is set, whether or not the
+  // global's value is a constant
+  CHECK(ran("f() { print(y) }\nf()\ny := 3\nf()") == "nil\n3\n");
+  CHECK(ran("g() -> int { return 3 }\nf() { print(y) }\nf()\ny := g()\n"
+            "f()") == "nil\n3\n");
+  CHECK(ran("f() { print(y) }\ny := 3\nh := () => y + 1\nf()\nprint(h())") ==
+        "3\n4\n");
+  CHECK(ran("fib(n: int) -> int {\n"
+            "  if n < 2 { return n }\n"
+            "  return fib(n - 1) + fib(n - 2)\n}\n"
+            "total := 0\nfor i in range(10) { total += i }\n"
+            "n := 0\nwhile n < 5 { n++ }\n"
+            "print(fib(20), total, n)") == "6765 45 5\n");
+  CHECK(ran("half(x: float) -> float { return x / 2 }\n"
+            "y: float = 3\nprint(half(3), y, y > 2 && ~false)") ==
+        "1.5 3.0 true\n");
+  CHECK(ran("for i in range(10, 0, -3) { print(i) }\n"
+            "for i in range(3, 3) { print(i) }") == "10\n7\n4\n1\n");
+  CHECK(ran("add := (a, b) => a + b\nprint(add(1, 2), add(\"x\", \"y\"))") ==
+        "3 xy\n");
+}
+
+TEST_CASE("Machine runs classes, arrays and strings") {
+  CHECK(ran("class Counter {\n  count: int = 10\n  step: int\n"
+            "  bump(by: int) -> int { count += by; return next() }\n"
+            "  next() -> int { return count + 1 }\n}\n"
+            "c := Counter()\nc.step = 2\n"
+            "print(c.bump(c.step), c.count, c)") == "13 12 <Counter>\n");
+  CHECK(ran("xs := [3, 1, 2]\nxs[0] = 10\nxs[-1] += 5\n"
+            "for x in xs + [4] { print(x) }\n"
+            "print(xs, len(xs), [\"a\"], range(3))") ==
+        "10\n1\n7\n4\n[10, 1, 7] 3 [\"a\"] [0, 1, 2]\n");
+  CHECK(ran("s := \"h\\ti\"\nfor c in s { print(c) }\n"
+            "print(s + \"!\", len(s), s[-1], \"ab\" < \"b\")\n"
+            "print(str(2.0), int(\"42\") + 1, float(1), bool(\"\"))") ==
+        "h\n\t\ni\nh\ti! 3 i true\n2.0 43 1.0 false\n");
+  // Lambda parameters have no types, so their members are found by name
+  CHECK(ran("show := p => print(p.x, p.twice())\n"
+            "class P {\n  x: int = 4\n  twice() -> int { return x * 2 }\n}\n"
+            "show(P())") == "4 8\n");
+  // Typed access to an instance of another class with the field elsewhere
+  CHECK(ran("class A {\n  x: int = 1\n  z: int = 2\n}\n"
+            "class C {\n  z: int = 5\n}\n"
+            "put(p: A) { p.z = 77 }\nget(p: A) -> int { return p.z }\n"
+            "c := C()\n(q => put(q))(c)\n"
+            "print(c.z, (q => get(q))(c), get(A()))") == "77 77 2\n");
+}
+
+TEST_CASE("Machine prints and compares arrays that contain themselves") {
+  std::string cyclic = "id := x => x\na := [id(1)]\na[0] = a\n"
+                       "b := [id(1)]\nb[0] = b\n";
+  CHECK(ran(cyclic + "print(a)") == "[[...]]\n");
+  CHECK(ran(cyclic + "c := [id(1), id(2)]\nc[0] = [c, c]\nprint(c)") ==
+        "[[[...], [...]], 2]\n");
+  CHECK(ran(cyclic + "print(a == b, [id(a), id(2)] == [id(b), id(3)])") ==
+        "true false\n");
+
+  // Deeper than the machine's own stack would go
+  std::string deep = "id := x => x\nd := [id(1)]\ne := [id(1)]\n"
+                     "for i in range(200000) { d = [d]\ne = [e] }\n";
+  CHECK(ran(deep + "print(d == e)") == "true\n");
+  CHECK(ran(deep + "print(d)") ==
+        std::string(200001, '[') + "1" + std::string(200001, ']') + "\n");
+}
+
+TEST_CASE("Machine boxes ints that don't fit in a value") {
+  // 2^47 is the first int past the inline ones, in both directions
+  CHECK(ran("big(x: int) -> int { return x * 2 }\n"
+            "x := big(70368744177664)\ny := -x - 1\n"
+            "print(x, x - 1, y, y + 1, x == 140737488355328, x > x - 1)") ==
+        "140737488355328 140737488355327 -140737488355329 "
+        "-140737488355328 true true\n");
+  CHECK(ran("n := 1\nfor i in range(62) { n *= 2 }\n"
+            "print(n, n // 2 ** 40, [n, -n])\nprint(n * 2)") ==
+        "4611686018427387904 4194304 [4611686018427387904, "
+        "-4611686018427387904]\nerror: This overflows a 64-bit int\n");
+
+  vm::Heap heap;
+  CHECK(heap.integer(vm::Value::SMALL_MAX).is_small_int());
+  CHECK(heap.statistics().objects == 0);
+  vm::Value boxed = heap.integer(vm::Value::SMALL_MIN - 1);
+  CHECK((boxed.is_int() && !boxed.is_small_int() &&
+         heap.statistics().objects == 1));
+  CHECK(boxed.as_int() == vm::Value::SMALL_MIN - 1);
+  // A NaN with the bits of a tag would otherwise read back as something else
+  vm::Value nan = vm::Value::real(std::bit_cast<double>(~uint64_t(0)));
+  CHECK((nan.is_float() && std::isnan(nan.as_float())));
+}
+
+TEST_CASE("Heap promotes survivors and sweeps the old generation") {
+  using vm::Collection, vm::Object, vm::Value;
+  auto text = [](Value value) {
+    return static_cast<vm::String *>(value.as_object())->text();
+  };
+
+  vm::Heap heap;
+  Value roots[] = {Value::object(heap.string("kept")),
+                   Value::object(heap.array({}))};
+  heap.string("garbage");
+  heap.collect(Collection::Minor, {roots});
+  CHECK(text(roots[0]) == "kept");
+  CHECK(roots[0].as_object()->space == Object::Space::Old);
+  CHECK(heap.statistics().promoted < heap.statistics().allocated);
+
+  // The only reference to the young string is from an old array, which the
+  // write barrier remembers
+  auto *array = static_cast<vm::Array *>(roots[1].as_object());
+  Value young = Value::object(heap.string("young"));
+  array->elements.push_back(young);
+  heap.write(array, young);
+  heap.string("garbage");
+  heap.collect(Collection::Minor, {roots});
+  CHECK(text(array->elements[0]) == "young");
+  CHECK(array->elements[0].as_object()->space == Object::Space::Old);
+
+  uint64_t freed = heap.statistics().freed;
+  roots[0] = Value();
+  heap.collect(Collection::Major, {roots});
+  CHECK(heap.statistics().freed > freed);
+  CHECK(text(array->elements[0]) == "young");
+  CHECK(heap.statistics().minor_collections == 2);
+  CHECK(heap.statistics().major_collections == 1);
+  CHECK(heap.pending() == Collection::None);
+
+  // A full nursery sends objects to the old generation until a collection
+  for (size_t i = 0; i <= vm::Heap::NURSERY_SIZE / sizeof(vm::Integer); i++)
+    heap.integer(Value::SMALL_MAX + 1);
+  CHECK(heap.pending() == Collection::Minor);
+  heap.collect(heap.pending(), {roots});
+  CHECK(heap.pending() == Collection::None);
+}
+
+TEST_CASE("Machine collects garbage while the program runs") {
+  File file("class Box {\n  item: str = \"\"\n}\n"
+            "boxes := [Box(), Box(), Box()]\ntotal := 0\n"
+            "for i in range(200000) {\n"
+            "  s := \"item \" + str(i)\n"
+            "  boxes[i % 3].item = s\n  total += len(s)\n}\n"
+            "print(boxes[0].item, boxes[1].item, boxes[2].item, total)",
+            "test.symph");
+  std::string out;
+  auto program = compiled(file, out);
+  REQUIRE(program);
+  DiagnosticEngine engine;
+  vm::Machine machine(*program, [&](std::string_view text) { out += text; });
+  CHECK(machine.run(engine));
+  CHECK(out == "item 199998 item 199999 item 199997 2088890\n");
+
+  // Almost everything died in the nursery
+  const auto &statistics = machine.objects().statistics();
+  CHECK(statistics.minor_collections > 0);
+  CHECK(statistics.promoted * 100 < statistics.allocated);
+}
+
+TEST_CASE("Member access by name is cached per site") {
+  // A and B share a shape, so `same` only ever sees one; `read` sees five
+  File file("class A {\n  x: int = 1\n  get() -> int { return x }\n}\n"
+            "class B {\n  x: int = 2\n  get() -> int { return x * 10 }\n}\n"
+            "class C {\n  y: int = 0\n  x: int = 3\n}\n"
+            "class D {\n  z: int = 0\n  x: int = 4\n}\n"
+            "class E {\n  w: int = 0\n  v: int = 0\n  x: int = 5\n}\n"
+            "class F {\n  u: int = 0\n  w: int = 0\n  v: int = 0\n"
+            "  x: int = 6\n}\n"
+            "read := p => p.x\ncall := p => p.get()\nsame := p => p.x\n"
+            "total := 0\nfor i in range(3) {\n"
+            "  total += read(A()) + read(B()) + read(C()) + read(D())\n"
+            "  total += read(E()) + read(F()) + call(A()) + call(B())\n"
+            "  total += same(A()) + same(B())\n}\nprint(total)",
+            "test.symph");
+  std::string out;
+  auto program = compiled(file, out);
+  REQUIRE(program);
+  CHECK(program->classes.size() == 6);
+  CHECK(program->shapes.size() == 5);
+  CHECK(program->sites == 3);
+
+  DiagnosticEngine engine;
+  vm::Machine machine(*program, [&](std::string_view text) { out += text; });
+  CHECK(machine.run(engine));
+  CHECK(out == "135\n");
+
+  std::vector<vm::Cache::State> states;
+  for (const vm::Cache &cache : machine.sites())
+    states.push_back(cache.state);
+  std::sort(states.begin(), states.end());
+  CHECK(states == std::vector{vm::Cache::State::Monomorphic,
+                              vm::Cache::State::Polymorphic,
+                              vm::Cache::State::Megamorphic});
+}
+
+TEST_CASE("JIT agrees with the interpreter, leaving it what it can't do") {
+  const char *programs[] = {
+      // Typed arithmetic, comparisons and loops, which all translate
+      "total := 0\nfor i in range(-50, 50, 3) {\n"
+      "  total += i * 3 - i // 4 + i % 7 - (i + 1) // -2 + i % -3\n"
+      "  if i <= 10 && i != 4 || i == 20 { total += 1 }\n}\nprint(total)",
+      "f(n: int) -> float {\n  x := 0.5\n  acc := 0.0\n"
+      "  for i in range(n) {\n    x = x * 1.5 - 0.25\n"
+      "    if x > 10.0 { x = x / 3 }\n    if x <= 1.0 { acc += 1 }\n"
+      "    acc = acc + x\n  }\n  return acc\n}\nprint(f(100), f(0))",
+      "n := 10\nwhile n > 0 { n = n - 3 }\ncount: int = 0\n"
+      "class P {\n  x: int = 4\n}\np := P()\n"
+      "for i in range(5) { count += p.x }\nprint(n, count, p.x)",
+      "x := 0.0\nlt := 0\nle := 0\nfor i in range(4) {\n"
+      "  if x < 1.0 { lt += 1 }\n  if x <= 1.0 { le += 1 }\n"
+      "  x = x + 0.5\n}\nprint(lt, le)",
+      // Infinities, and a NaN that compares false
+      "big := 1.0\nfor i in range(1100) { big = big * 2.0 }\n"
+      "nan := big - big\nprint(big, -big, nan < 1.0, nan <= nan)",
+      // Ints that grow past inline ones, then past 64 bits
+      "n := 1\nfor i in range(62) { n *= 2 }\nprint(n, n // 3, n % 5)\n"
+      "print(n * 2)",
+      "zero(x: int) -> int { return x - x }\n"
+      "for i in range(3) { print(i % (zero(i) + 2 - i)) }",
+      // Fields of instances of another shape than the typed one
+      "class A {\n  x: int = 1\n  z: int = 2\n}\n"
+      "class C {\n  z: int = 5\n}\nget(p: A) -> int { return p.z }\n"
+      "total := 0\nfor i in range(10) {\n"
+      "  total += get(A()) + (q => get(q))(C())\n}\nprint(total)",
+      // Calls and allocation are left to the interpreter
+      "fib(n: int) -> int {\n  if n < 2 { return n }\n"
+      "  return fib(n - 1) + fib(n - 2)\n}\n"
+      "xs := [1]\nfor i in range(3) { xs = xs + [fib(i + 10)] }\n"
+      "print(xs, len(str(fib(20))))",
+  };
+  for (const char *program : programs) {
+    INFO(program);
+    CHECK(ran(program, true) == ran(program));
+  }
+
+  File file("sum(n: int) -> int {\n  total := 0\n"
+            "  for i in range(n) { total += i % 7 }\n  return total\n}\n"
+            "unused() {}\nprint(sum(1000), sum(10))",
+            "test.symph");
+  std::string out;
+  auto program = compiled(file, out);
+  REQUIRE(program);
+  DiagnosticEngine engine;
+  vm::Machine machine(*program, [&](std::string_view text) { out += text; });
+  machine.enable_jit(2);
+  CHECK(machine.run(engine));
+  CHECK(out == "2997 24\n");
+  // `sum` is called twice and the top level returned to twice, while
+  // `unused` never runs
+  CHECK(machine.translated() == (vm::jit::SUPPORTED ? 2 : 0));
+}
+
+TEST_CASE("Machine reports runtime errors where they happen") {
+  CHECK(ran("xs := [1]\nprint(\"before\")\nprint(xs[3])") ==
+        "before\nerror: Index 3 is out of range\n");
+  CHECK(ran("zero(x: int) -> int { return x - x }\nprint(1 // zero(1))") ==
+        "error: Division by zero\n");
+  CHECK(ran("big := 9223372036854775807\nf(x: int) -> int { return x + 1 }\n"
+            "print(f(big))") == "error: This overflows a 64-bit int\n");
+  CHECK(ran("f(x: int) -> int { return 2 ** x }\nprint(f(-1))") ==
+        "error: This raises an int to a negative power\n");
+  CHECK(ran("f(n: int) -> int { return f(n + 1) }\nf(0)") ==
+        "error: Stack overflow\n");
+  // An untyped value gets past the checker, but not past the shape check
+  CHECK(ran("class A {\n  z: int = 2\n}\nclass B {\n  y: int = 3\n}\n"
+            "get(p: A) -> int { return p.z }\n"
+            "xs := [1, 2, 3]\nprint((q => get(q))(B()))\nprint(xs)") ==
+        "error: <B> has no field 'z'\n");
+  CHECK(ran("class A {\n  z: int = 2\n}\nclass B {\n  y: int = 3\n}\n"
+            "put(p: A) { p.z = 77 }\n(q => put(q))(B())") ==
+        "error: <B> has no field 'z'\n");
+  CHECK(ran("outer(n: int) -> int {\n"
+            "  inner() -> int { return n }\n  return inner()\n}") ==
+        "Functions can't use the variables of the functions around them "
+        "yet\n");
+}
+
+TEST_CASE("Compiler picks typed instructions and counts ranges in place") {
+  auto code = disassembled("f(n: int) -> int {\n  total := 0\n"
+                           "  for i in range(n) { total = total + i - 1 }\n"
+                           "  return total\n}");
+  CHECK(code.find("ForPrep") != std::string::npos);
+  CHECK(code.find("ForLoop") != std::string::npos);
+  CHECK(code.find("AddInt ") != std::string::npos);
+  CHECK(code.find("AddIntImm") != std::string::npos);
+  CHECK(code.find("Range") == std::string::npos);
+  CHECK(code.find("Add ") == std::string::npos);
+
+  // Folded away entirely
+  CHECK(disassembled("x := 2 * 3 + 1\nif x < 0 { print(x) }") ==
+        "<main>:\n  0000  LoadInt        0 7\n"
+        "  0001  SetGlobal      0 0\n  0002  ReturnNil      0 0 0\n");
+}